@@ -91,18 +91,32 @@ static int jack_process_callback(jack_nframes_t nframes, void *arg)
         struct state_jack_capture *s = (struct state_jack_capture *) arg;
         int i;
         int channel_size = nframes * sizeof(int32_t);
+        int len = channel_size * s->frame.ch_count;
+        void *ptr1, *ptr2;
+        int size1, size2;
+        char *dst = s->tmp;
 
         if (!s->can_process) {
                 return 0;
         }
 
+        // mux directly to the ring buffer if the free space is contiguous
+        ring_buffer_reserve_write(s->data, len, &ptr1, &size1, &ptr2, &size2);
+        if (size1 == len) {
+                dst = (char *) ptr1;
+        }
+
         for (i = 0; i < s->frame.ch_count; ++i) {
                 jack_default_audio_sample_t *in = jack_port_get_buffer(s->input_ports[i], nframes);
                 float2int((char *) in, (char *) in, channel_size);
-                mux_channel(s->tmp, (char *) in, sizeof(int32_t), channel_size, s->frame.ch_count, i, 1.0);
+                mux_channel(dst, (char *) in, sizeof(int32_t), channel_size, s->frame.ch_count, i, 1.0);
         }
 
-        ring_buffer_write(s->data, s->tmp, channel_size * s->frame.ch_count);
+        if (dst == s->tmp) {
+                ring_buffer_write(s->data, s->tmp, len);
+        } else {
+                ring_buffer_commit_write(s->data, len);
+        }
 
         return 0;
 }
@@ -217,7 +231,7 @@ static void * audio_cap_jack_init(const char *cfg)
 
         s->tmp = malloc(s->frame.max_size);
 
-        s->data = ring_buffer_init(s->frame.max_size);
+        s->data = ring_buffer_init_mirrored(s->frame.max_size);
         
         if(jack_set_sample_rate_callback(s->client, jack_samplerate_changed_callback, (void *) s)) {
                 fprintf(stderr, "[JACK capture] Registring callback problem.\n");
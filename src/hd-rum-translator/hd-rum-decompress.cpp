@@ -20,6 +20,7 @@
 #include "capture_filter.h"
 #include "debug.h"
 #include "host.h"
+#include "lib_common.h"
 #include "rtp/rtp.h"
 
 #include "video.h"
@@ -206,8 +207,13 @@ void *hd_rum_decompress_init(struct module *parent, struct hd_rum_output_conf co
                 assert (initialize_video_display(parent, "proxy", cfg, 0, NULL, &s->display) == 0);
                 break;
         case CONFERENCE:
-                snprintf(cfg, sizeof cfg, "pipe:%p#%i:%i:%i", s, conf.width, conf.height, conf.fps);
-                assert (initialize_video_display(parent, "conference", cfg, 0, NULL, &s->display) == 0);
+                {
+                        // GPU conference display requires OpenCV with CUDA, fall back to CPU composition
+                        const char *display = load_library("conference", LIBRARY_CLASS_VIDEO_DISPLAY,
+                                        VIDEO_DISPLAY_ABI_VERSION) ? "conference" : "conference_cpu";
+                        snprintf(cfg, sizeof cfg, "pipe:%p#%i:%i:%i", s, conf.width, conf.height, conf.fps);
+                        assert (initialize_video_display(parent, display, cfg, 0, NULL, &s->display) == 0);
+                }
                 break;
         }
 
@@ -22,11 +22,17 @@
 #include "module.h"
 #include "rtp/net_udp.h"
 #include "utils/misc.h"
+#include "utils/mpmc_queue.h"
 #include "tv.h"
 
+#include <atomic>
+#include <chrono>
 #include <cinttypes>
 #include <map>
+#include <memory>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 using namespace std;
@@ -35,8 +41,25 @@ struct item;
 
 #define REPLICA_MAGIC 0xd2ff3323
 
+/**
+ * Specifies what happens when a replica doesn't consume packets fast enough
+ * and its queue gets full.
+ */
+enum overflow_policy {
+    OVERFLOW_DROP_OLDEST, ///< oldest queued packet is discarded
+    OVERFLOW_DROP_FRAME,  ///< whole frame (delimited by RTP marker bit) is discarded
+    OVERFLOW_DISCONNECT   ///< replica is disconnected until reenabled with "sock" message
+};
+
+static const char *overflow_policy_names[] = { "drop-oldest", "drop-frame", "disconnect" };
+
+static struct item *qinit(int qsize);
+static void qdestroy(struct item *queue);
+static void *replica_sender(void *arg);
+
 struct replica {
-    replica(const char *addr, uint16_t tx_port, int bufsize, struct module *parent) {
+    replica(const char *addr, uint16_t tx_port, int bufsize, int qsize, struct module *parent,
+            enum overflow_policy policy = OVERFLOW_DROP_OLDEST, long long bitrate = RATE_UNLIMITED) {
         magic = REPLICA_MAGIC;
         host = addr;
         m_tx_port = tx_port;
@@ -55,10 +78,38 @@ struct replica {
         module_register(&mod, parent);
         type = replica::type_t::NONE;
         recompress = nullptr;
+
+        overflow_policy = policy;
+        this->bitrate = bitrate > 0 ? bitrate : 0; // RATE_AUTO makes no sense for forwarding
+        this->qsize = qsize;
+        queue = qinit(qsize);
+        qhead = qlen = 0;
+        should_exit = false;
+        disconnected = false;
+        skip_frame = false;
+        pthread_mutex_init(&qmtx, NULL);
+        pthread_cond_init(&qcond, NULL);
+        if (pthread_create(&sender, NULL, replica_sender, this) != 0) {
+            pthread_mutex_destroy(&qmtx);
+            pthread_cond_destroy(&qcond);
+            qdestroy(queue);
+            module_done(&mod);
+            free(mod.name);
+            udp_exit(sock);
+            throw string("Cannot create sender thread!\n");
+        }
     }
 
     ~replica() {
         assert(magic == REPLICA_MAGIC);
+        pthread_mutex_lock(&qmtx);
+        should_exit = true;
+        pthread_cond_signal(&qcond);
+        pthread_mutex_unlock(&qmtx);
+        pthread_join(sender, NULL);
+        pthread_mutex_destroy(&qmtx);
+        pthread_cond_destroy(&qcond);
+        qdestroy(queue);
         module_done(&mod);
         udp_exit(sock);
     }
@@ -76,48 +127,63 @@ struct replica {
     enum type_t type;
     socket_udp *sock;
     void *recompress;
+
+    /// @name forwarding queue
+    /// Packets to be forwarded are queued by the writer and sent by a per-replica
+    /// sender thread so that a slow receiver doesn't stall the other ones.
+    /// @{
+    struct item *queue;
+    int qsize;
+    int qhead;          ///< index of the oldest queued packet
+    int qlen;           ///< number of queued packets
+    bool should_exit;
+    bool disconnected;  ///< set by OVERFLOW_DISCONNECT
+    bool skip_frame;    ///< set by OVERFLOW_DROP_FRAME - drop until end of current frame
+    pthread_mutex_t qmtx;
+    pthread_cond_t qcond;
+    pthread_t sender;
+    /// @}
+
+    enum overflow_policy overflow_policy;
+    long long bitrate;  ///< pacing bitrate in bps, 0 if unlimited
+
+    struct {
+        atomic<uint64_t> sent_pkts{0};
+        atomic<uint64_t> sent_bytes{0};
+        uint64_t dropped_pkts = 0;   ///< protected by qmtx
+        uint64_t dropped_frames = 0; ///< protected by qmtx
+        uint64_t disconnects = 0;    ///< protected by qmtx
+        int max_qlen = 0;            ///< protected by qmtx
+    } stats;
 };
 
 struct hd_rum_translator_state {
-    hd_rum_translator_state() : mod(), control_state(nullptr), queue(nullptr), qhead(nullptr),
-            qtail(nullptr), qempty(1), qfull(0), decompress(nullptr) {
+    hd_rum_translator_state() : mod(), control_state(nullptr), queue(nullptr),
+            replica_qsize(0), decompress(nullptr) {
         module_init_default(&mod);
         mod.cls = MODULE_CLASS_ROOT;
-        pthread_mutex_init(&qempty_mtx, NULL);
-        pthread_mutex_init(&qfull_mtx, NULL);
-        pthread_cond_init(&qempty_cond, NULL);
-        pthread_cond_init(&qfull_cond, NULL);
     }
     ~hd_rum_translator_state() {
-        pthread_mutex_destroy(&qempty_mtx);
-        pthread_mutex_destroy(&qfull_mtx);
-        pthread_cond_destroy(&qempty_cond);
-        pthread_cond_destroy(&qfull_cond);
         module_done(&mod);
     }
     struct module mod;
     struct control_state *control_state;
-    struct item *queue;
-    struct item *qhead;
-    struct item *qtail;
-    int qempty;
-    int qfull;
-    pthread_mutex_t qempty_mtx;
-    pthread_mutex_t qfull_mtx;
-    pthread_cond_t qempty_cond;
-    pthread_cond_t qfull_cond;
+    struct item *queue; ///< packet buffers, each is either in free_items or in filled_items
+    unique_ptr<mpmc_queue<struct item *>> free_items;   ///< buffers to be received to
+    unique_ptr<mpmc_queue<struct item *>> filled_items; ///< received packets to be sent by writer
 
     vector<replica *> replicas;
+    int replica_qsize; ///< length of per-replica forwarding queue
     void *decompress;
 };
 
 /*
  * Prototypes
  */
-static struct item *qinit(int qsize);
-static void qdestroy(struct item *queue);
 static void *writer(void *arg);
 static void signal_handler(int signal);
+static bool parse_bitrate(const char *str, int64_t *bitrate);
+static bool parse_overflow_policy(const char *str, enum overflow_policy *policy);
 void exit_uv(int status);
 
 /*
@@ -158,17 +224,7 @@ static void signal_handler(int signal)
 
 #define MAX_PKT_SIZE 10000
 
-#ifdef WIN32
-struct wsa_aux_storage {
-    WSAOVERLAPPED *overlapped;
-    int ref;
-};
-#define ALIGNMENT std::alignment_of<wsa_aux_storage>::value
-#define OFFSET ((MAX_PKT_SIZE + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT)
-#define SIZE (OFFSET + sizeof(wsa_aux_storage))
-#else
 #define SIZE MAX_PKT_SIZE
-#endif
 
 struct item {
     struct item *next;
@@ -208,6 +264,161 @@ static void qdestroy(struct item *queue)
     free(queue);
 }
 
+static inline bool is_frame_end(const char *buf, long size)
+{
+    return size >= 2 && (buf[1] & 0x80) != 0; // RTP marker bit
+}
+
+/**
+ * Enqueues packet to replica forwarding queue. If the queue is full, replica
+ * overflow policy is applied. This function never blocks on the replica
+ * socket.
+ */
+static void replica_enqueue(struct replica *r, const char *buf, long size)
+{
+    pthread_mutex_lock(&r->qmtx);
+    if (r->disconnected) {
+        pthread_mutex_unlock(&r->qmtx);
+        return;
+    }
+
+    if (r->skip_frame) {
+        r->stats.dropped_pkts += 1;
+        r->skip_frame = !is_frame_end(buf, size);
+        pthread_mutex_unlock(&r->qmtx);
+        return;
+    }
+
+    if (r->qlen == r->qsize) {
+        switch (r->overflow_policy) {
+        case OVERFLOW_DROP_OLDEST:
+            r->qhead = (r->qhead + 1) % r->qsize;
+            r->qlen -= 1;
+            r->stats.dropped_pkts += 1;
+            break;
+        case OVERFLOW_DROP_FRAME:
+            // discard the not yet sent part of the incomplete frame at the end
+            // of the queue together with the rest of that frame (or the whole
+            // incoming frame if the queue ends with a complete one)
+            while (r->qlen > 0) {
+                struct item *last = &r->queue[(r->qhead + r->qlen - 1) % r->qsize];
+                if (is_frame_end(last->buf, last->size)) {
+                    break;
+                }
+                r->qlen -= 1;
+                r->stats.dropped_pkts += 1;
+            }
+            r->stats.dropped_pkts += 1;
+            r->stats.dropped_frames += 1;
+            r->skip_frame = !is_frame_end(buf, size);
+            pthread_mutex_unlock(&r->qmtx);
+            return;
+        case OVERFLOW_DISCONNECT:
+            r->stats.dropped_pkts += r->qlen + 1;
+            r->stats.disconnects += 1;
+            r->qlen = 0;
+            r->disconnected = true;
+            pthread_mutex_unlock(&r->qmtx);
+            log_msg(LOG_LEVEL_WARNING, "Output port %s is too slow, disconnecting. "
+                    "Send \"sock\" message to reenable.\n", r->mod.name);
+            return;
+        }
+    }
+
+    struct item *it = &r->queue[(r->qhead + r->qlen) % r->qsize];
+    memcpy(it->buf, buf, size);
+    it->size = size;
+    r->qlen += 1;
+    r->stats.max_qlen = max(r->stats.max_qlen, r->qlen);
+    pthread_cond_signal(&r->qcond);
+    pthread_mutex_unlock(&r->qmtx);
+}
+
+/**
+ * Sends packets queued for the replica, optionally paced to replica bitrate.
+ */
+static void *replica_sender(void *arg)
+{
+    struct replica *r = (struct replica *) arg;
+    char *buf = (char *) malloc(SIZE);
+    chrono::steady_clock::time_point next_send = chrono::steady_clock::now();
+
+    while (1) {
+        bool idle = false;
+        pthread_mutex_lock(&r->qmtx);
+        while (r->qlen == 0 && !r->should_exit) {
+            pthread_cond_wait(&r->qcond, &r->qmtx);
+            idle = true;
+        }
+        if (r->should_exit) {
+            pthread_mutex_unlock(&r->qmtx);
+            break;
+        }
+        // take over the buffer so that the writer may reuse the slot while we are sending
+        struct item *it = &r->queue[r->qhead];
+        swap(buf, it->buf);
+        long size = it->size;
+        r->qhead = (r->qhead + 1) % r->qsize;
+        r->qlen -= 1;
+        pthread_mutex_unlock(&r->qmtx);
+
+        if (r->bitrate > 0) {
+            auto now = chrono::steady_clock::now();
+            if (next_send > now) {
+                this_thread::sleep_until(next_send);
+            } else if (idle) {
+                next_send = now; // do not burst after being idle
+            }
+            next_send += chrono::nanoseconds(size * 8 * 1000000000ll / r->bitrate);
+        }
+
+        ssize_t ret = udp_send(r->sock, buf, size);
+        if (ret < 0) {
+            perror("Hd-rum-translator send");
+        } else {
+            r->stats.sent_pkts += 1;
+            r->stats.sent_bytes += size;
+        }
+    }
+
+    free(buf);
+    return NULL;
+}
+
+static void report_replica_stats(struct hd_rum_translator_state *s, double seconds)
+{
+    for (auto r : s->replicas) {
+        if (r->type != replica::type_t::USE_SOCK) {
+            continue;
+        }
+        pthread_mutex_lock(&r->qmtx);
+        uint64_t dropped_pkts = r->stats.dropped_pkts;
+        uint64_t dropped_frames = r->stats.dropped_frames;
+        uint64_t disconnects = r->stats.disconnects;
+        int qlen = r->qlen;
+        int max_qlen = r->stats.max_qlen;
+        r->stats.max_qlen = qlen;
+        pthread_mutex_unlock(&r->qmtx);
+        uint64_t sent_bytes = r->stats.sent_bytes.exchange(0);
+
+        string statline = "FWD-PORT " + string(r->mod.name) +
+            " policy " + overflow_policy_names[r->overflow_policy] +
+            " sentPackets " + to_string(r->stats.sent_pkts) +
+            " droppedPackets " + to_string(dropped_pkts) +
+            " droppedFrames " + to_string(dropped_frames) +
+            " disconnects " + to_string(disconnects) +
+            " queueLength " + to_string(qlen) +
+            " maxQueueLength " + to_string(max_qlen);
+        control_report_stats(s->control_state, statline);
+        log_msg(dropped_pkts > 0 ? LOG_LEVEL_INFO : LOG_LEVEL_VERBOSE,
+                "[%s] Sent %g B/s, queue %d/%d (max %d), %s: %" PRIu64 " packets dropped, "
+                "%" PRIu64 " frames dropped, %" PRIu64 " disconnects.\n",
+                r->mod.name, sent_bytes / seconds, qlen, r->qsize, max_qlen,
+                overflow_policy_names[r->overflow_policy], dropped_pkts,
+                dropped_frames, disconnects);
+    }
+}
+
 struct response *change_replica_type(struct hd_rum_translator_state *s,
         struct module *mod, struct message *msg, int index)
 {
@@ -217,6 +428,10 @@ struct response *change_replica_type(struct hd_rum_translator_state *s,
 
     if (strcasecmp(data->text, "sock") == 0) {
         r->type = replica::type_t::USE_SOCK;
+        pthread_mutex_lock(&r->qmtx);
+        r->disconnected = false;
+        r->skip_frame = false;
+        pthread_mutex_unlock(&r->qmtx);
         log_msg(LOG_LEVEL_NOTICE, "Output port %d is now forwarding.\n", index);
     } else if (strcasecmp(data->text, "recompress") == 0) {
         r->type = replica::type_t::RECOMPRESS;
@@ -232,22 +447,11 @@ struct response *change_replica_type(struct hd_rum_translator_state *s,
     return new_response(RESPONSE_OK, NULL);
 }
 
-#ifdef WIN32
-static VOID CALLBACK wsa_deleter(DWORD /* dwErrorCode */,
-        DWORD /* dwNumberOfBytesTransfered */,
-        LPOVERLAPPED lpOverlapped, long unsigned int) {
-    struct wsa_aux_storage *aux = (struct wsa_aux_storage *) ((char *) lpOverlapped->Pointer + OFFSET);
-    if (--aux->ref == 0) {
-        free(aux->overlapped);
-        free(lpOverlapped->Pointer);
-    }
-}
-#endif
-
 static void *writer(void *arg)
 {
     struct hd_rum_translator_state *s =
         (struct hd_rum_translator_state *) arg;
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
 
     while (1) {
         // first check messages
@@ -293,9 +497,10 @@ static void *writer(void *arg)
                 }
             } else if (strncasecmp(msg->text, "create-port", strlen("create-port")) == 0) {
                 // format of parameters is either:
-                // <host>:<port> [<compression>]
+                // <host>:<port> [<compression>] [-l <bitrate>] [-o <overflow_policy>]
                 // or (for compat with older CoUniverse version)
-                // <host> <port> [<compression>]
+                // <host> <port> [<compression>] [-l <bitrate>] [-o <overflow_policy>]
+                // with the same defaults as hosts given on command-line
                 char *host_port, *port_str = NULL, *save_ptr;
                 char *host;
                 int tx_port;
@@ -321,10 +526,31 @@ static void *writer(void *arg)
                     free_message((struct message *) msg, new_response(RESPONSE_BAD_REQUEST, err_msg));
                     continue;
                 }
-                char *compress = strtok_r(NULL, " ", &save_ptr);
+                char *compress = NULL;
+                int64_t bitrate = RATE_UNLIMITED;
+                enum overflow_policy policy = OVERFLOW_DROP_OLDEST;
+                bool opts_ok = true;
+                char *item;
+                while (opts_ok && (item = strtok_r(NULL, " ", &save_ptr)) != NULL) {
+                    if (strcmp(item, "-l") == 0 || strcmp(item, "-o") == 0) {
+                        char *val = strtok_r(NULL, " ", &save_ptr);
+                        opts_ok = val != NULL && (item[1] == 'l' ? parse_bitrate(val, &bitrate) :
+                                parse_overflow_policy(val, &policy));
+                    } else if (compress == NULL) {
+                        compress = item;
+                    } else {
+                        opts_ok = false;
+                    }
+                }
+                if (!opts_ok) {
+                    const char *err_msg = "wrong format of port options";
+                    log_msg(LOG_LEVEL_ERROR, "%s\n", err_msg);
+                    free_message((struct message *) msg, new_response(RESPONSE_BAD_REQUEST, err_msg));
+                    continue;
+                }
                 struct replica *rep;
                 try {
-                    rep = new replica(host, tx_port, 100*1000, &s->mod);
+                    rep = new replica(host, tx_port, 100*1000, s->replica_qsize, &s->mod, policy, bitrate);
                 } catch (string const & s) {
                     fputs(s.c_str(), stderr);
                     const char *err_msg = "cannot create output port (wrong address?)";
@@ -339,7 +565,7 @@ static void *writer(void *arg)
                     char *fec = NULL;
                     rep->recompress = recompress_init(&rep->mod,
                             host, compress,
-                            0, tx_port, 1500, fec, RATE_UNLIMITED);
+                            0, tx_port, 1500, fec, bitrate);
                     if (!rep->recompress) {
                         delete s->replicas[s->replicas.size() - 1];
                         s->replicas.erase(s->replicas.end() - 1);
@@ -356,7 +582,7 @@ static void *writer(void *arg)
                     char *fec = NULL;
                     rep->recompress = recompress_init(&rep->mod,
                             host, compress,
-                            0, tx_port, 1500, fec, RATE_UNLIMITED);
+                            0, tx_port, 1500, fec, bitrate);
                     hd_rum_decompress_append_port(s->decompress, rep->recompress);
                     hd_rum_decompress_set_active(s->decompress, rep->recompress, false);
                     log_msg(LOG_LEVEL_NOTICE, "Created new forwarding output port %s:%d.\n", host, tx_port);
@@ -368,70 +594,39 @@ static void *writer(void *arg)
             free_message((struct message *) msg, r ? r : new_response(RESPONSE_OK, NULL));
         }
 
-        // then process incoming packets
-        while (s->qhead != s->qtail) {
-            if(s->qhead->size == 0) { // poisoned pill
-                return NULL;
-            }
-
-            // pass it for transcoding if needed
-            if (hd_rum_decompress_get_num_active_ports(s->decompress) > 0) {
-                ssize_t ret = hd_rum_decompress_write(s->decompress, s->qhead->buf, s->qhead->size);
-                if (ret < 0) {
-                    perror("hd_rum_decompress_write");
+        // then process incoming packets (wake up at least once a second to
+        // handle messages and stats even if there is no traffic)
+        struct item *it;
+        if (s->filled_items->timed_pop(it, chrono::seconds(1))) {
+            do {
+                if(it->size == 0) { // poisoned pill
+                    return NULL;
                 }
-            }
 
-            // distribute it to output ports that don't need transcoding
-#ifdef WIN32
-            // send it asynchronously in MSW (performance optimalization)
-            SleepEx(0, TRUE); // allow system to call our completion routines in APC
-            int ref = 0;
-            for (unsigned int i = 0; i < s->replicas.size(); i++) {
-                if(s->replicas[i]->type == replica::type_t::USE_SOCK) {
-                    ref++;
-                }
-            }
-            struct wsa_aux_storage *aux = (struct wsa_aux_storage *) ((char *) s->qhead->buf + OFFSET);
-            memset(aux, 0, sizeof *aux);
-            aux->overlapped = (WSAOVERLAPPED *) calloc(ref, sizeof(WSAOVERLAPPED));
-            aux->ref = ref;
-            int overlapped_idx = 0;
-            for (unsigned int i = 0; i < s->replicas.size(); i++) {
-                if(s->replicas[i]->type == replica::type_t::USE_SOCK) {
-                    aux->overlapped[overlapped_idx].Pointer = s->qhead->buf;
-                    ssize_t ret = udp_send_wsa_async(s->replicas[i]->sock, s->qhead->buf, s->qhead->size, wsa_deleter, &aux->overlapped[overlapped_idx]);
+                // pass it for transcoding if needed
+                if (hd_rum_decompress_get_num_active_ports(s->decompress) > 0) {
+                    ssize_t ret = hd_rum_decompress_write(s->decompress, it->buf, it->size);
                     if (ret < 0) {
-                        perror("Hd-rum-translator send");
+                        perror("hd_rum_decompress_write");
                     }
-                    overlapped_idx += 1;
                 }
-            }
-            // reallocate the buffer since the last one will be freeed automaticaly
-            s->qhead->buf = (char *) malloc(SIZE);
-#else
-            for (unsigned int i = 0; i < s->replicas.size(); i++) {
-                if(s->replicas[i]->type == replica::type_t::USE_SOCK) {
-                    ssize_t ret = udp_send(s->replicas[i]->sock, s->qhead->buf, s->qhead->size);
-                    if (ret < 0) {
-                        perror("Hd-rum-translator send");
+
+                // distribute it to output ports that don't need transcoding
+                for (unsigned int i = 0; i < s->replicas.size(); i++) {
+                    if(s->replicas[i]->type == replica::type_t::USE_SOCK) {
+                        replica_enqueue(s->replicas[i], it->buf, it->size);
                     }
                 }
-            }
-#endif
-            s->qhead = s->qhead->next;
-
-            pthread_mutex_lock(&s->qfull_mtx);
-            s->qfull = 0;
-            pthread_cond_signal(&s->qfull_cond);
-            pthread_mutex_unlock(&s->qfull_mtx);
+                s->free_items->push(it);
+            } while ((it = s->filled_items->pop(true)) != nullptr);
         }
 
-        pthread_mutex_lock(&s->qempty_mtx);
-        if (s->qempty)
-            pthread_cond_wait(&s->qempty_cond, &s->qempty_mtx);
-        s->qempty = 1;
-        pthread_mutex_unlock(&s->qempty_mtx);
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        double seconds = chrono::duration_cast<chrono::duration<double>>(now - t0).count();
+        if (seconds > 5.0) {
+            report_replica_stats(s, seconds);
+            t0 = now;
+        }
     }
 
     return NULL;
@@ -451,9 +646,11 @@ static void usage(const char *progname) {
         printf("\tand hostX_options may be:\n"
                 "\t\t-P <port> - TX port to be used\n"
                 "\t\t-c <compression> - compression\n"
+                "\t\t-l <limiting_bitrate> - bitrate to be shaped to\n"
+                "\t\t-o drop-oldest|drop-frame|disconnect - policy applied when the host\n"
+                "\t\t\tcannot keep up with forwarded stream (default drop-oldest)\n"
                 "\t\tFollowing options will be used only if '-c' parameter is set:\n"
                 "\t\t-m <mtu> - MTU size\n"
-                "\t\t-l <limiting_bitrate> - bitrate to be shaped to\n"
                 "\t\t-f <fec> - FEC that will be used for transmission.\n"
               );
         printf("\tPlease note that blending and capture filter is used only for host for which\n"
@@ -469,6 +666,7 @@ struct host_opts {
     char *compression;
     char *fec;
     int64_t bitrate;
+    enum overflow_policy overflow_policy;
 };
 
 struct cmdline_parameters {
@@ -483,6 +681,42 @@ struct cmdline_parameters {
     bool verbose = false;
 };
 
+/**
+ * Parses limiting bitrate of a host (option -l).
+ * @retval false wrong value
+ */
+static bool parse_bitrate(const char *str, int64_t *bitrate)
+{
+    if (strcmp(str, "unlimited") == 0) {
+        *bitrate = RATE_UNLIMITED;
+    } else if (strcmp(str, "auto") == 0) {
+        *bitrate = RATE_AUTO;
+    } else {
+        *bitrate = unit_evaluate(str);
+        if (*bitrate <= 0) {
+            fprintf(stderr, "Error: wrong bitrate '%s'\n", str);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Parses overflow policy of a host (option -o).
+ * @retval false unknown policy
+ */
+static bool parse_overflow_policy(const char *str, enum overflow_policy *policy)
+{
+    for (unsigned int j = 0; j < sizeof overflow_policy_names / sizeof overflow_policy_names[0]; ++j) {
+        if (strcmp(str, overflow_policy_names[j]) == 0) {
+            *policy = (enum overflow_policy) j;
+            return true;
+        }
+    }
+    fprintf(stderr, "Error: unknown overflow policy '%s'\n", str);
+    return false;
+}
+
 /**
  * @todo
  * Use rather getopt() than manual parsing.
@@ -568,6 +802,7 @@ static bool parse_fmt(int argc, char **argv, struct cmdline_parameters *parsed)
     for(int i = 0; i < parsed->host_count; ++i) {
         parsed->hosts[i].bitrate = RATE_UNLIMITED;
         parsed->hosts[i].mtu = 1500;
+        parsed->hosts[i].overflow_policy = OVERFLOW_DROP_OLDEST;
     }
 
     int host_idx = 0;
@@ -587,13 +822,13 @@ static bool parse_fmt(int argc, char **argv, struct cmdline_parameters *parsed)
                     parsed->hosts[host_idx].fec = argv[i + 1];
                     break;
                 case 'l':
-                    if (strcmp(argv[i + 1], "unlimited") == 0) {
-                        parsed->hosts[host_idx].bitrate = RATE_UNLIMITED;
-                    } else if (strcmp(argv[i + 1], "auto") == 0) {
-                        parsed->hosts[host_idx].bitrate = RATE_AUTO;
-                    } else {
-                        parsed->hosts[host_idx].bitrate = unit_evaluate(argv[i + 1]);
-                        assert(parsed->hosts[host_idx].bitrate > 0);
+                    if (!parse_bitrate(argv[i + 1], &parsed->hosts[host_idx].bitrate)) {
+                        exit(EXIT_FAIL_USAGE);
+                    }
+                    break;
+                case 'o':
+                    if (!parse_overflow_policy(argv[i + 1], &parsed->hosts[host_idx].overflow_policy)) {
+                        exit(EXIT_FAIL_USAGE);
                     }
                     break;
                 default:
@@ -695,7 +930,13 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    state.qhead = state.qtail = state.queue = qinit(qsize);
+    state.queue = qinit(qsize);
+    state.free_items.reset(new mpmc_queue<struct item *>(qsize));
+    state.filled_items.reset(new mpmc_queue<struct item *>(qsize));
+    for (int i = 0; i < qsize; i++) {
+        state.free_items->push(&state.queue[i]);
+    }
+    state.replica_qsize = qsize;
 
     /* input socket */
     if ((sock_in = udp_init_if("::1", NULL, params.port, 0, 255, false, false)) == NULL) {
@@ -732,7 +973,8 @@ int main(int argc, char **argv)
         }
 
         try {
-            state.replicas[i] = new replica(params.hosts[i].addr, tx_port, bufsize, &state.mod);
+            state.replicas[i] = new replica(params.hosts[i].addr, tx_port, bufsize, qsize, &state.mod,
+                    params.hosts[i].overflow_policy, params.hosts[i].bitrate);
         } catch (string const &s) {
             fputs(s.c_str(), stderr);
             return EXIT_FAILURE;
@@ -778,20 +1020,19 @@ int main(int argc, char **argv)
     unsigned long long int last_data = 0ull;
 
     /* main loop */
+    struct item *it = nullptr;
     while (!should_exit) {
         struct timeval timeout = { 1, 0 };
-        while (state.qtail->next != state.qhead
-               && (state.qtail->size = udp_recv_timeout(sock_in, state.qtail->buf, SIZE, &timeout)) > 0
+        if (it == nullptr) { // blocks if all buffers are waiting for the writer
+            it = state.free_items->pop();
+        }
+        while ((it->size = udp_recv_timeout(sock_in, it->buf, SIZE, &timeout)) > 0
                && !should_exit) {
-            received_data += state.qtail->size;
+            received_data += it->size;
             received_pkts += 1;
 
-            state.qtail = state.qtail->next;
-
-            pthread_mutex_lock(&state.qempty_mtx);
-            state.qempty = 0;
-            pthread_cond_signal(&state.qempty_cond);
-            pthread_mutex_unlock(&state.qempty_mtx);
+            state.filled_items->push(it);
+            it = state.free_items->pop();
 
             struct timeval t;
             gettimeofday(&t, NULL);
@@ -811,30 +1052,19 @@ int main(int argc, char **argv)
             }
             timeout = { 1, 0 };
         }
-
-        if (state.qtail->size <= 0)
-            continue;
-
-        pthread_mutex_lock(&state.qfull_mtx);
-        if (state.qfull)
-            pthread_cond_wait(&state.qfull_cond, &state.qfull_mtx);
-        state.qfull = 1;
-        pthread_mutex_unlock(&state.qfull_mtx);
     }
 
-    if (state.qtail->size < 0 && !should_exit) {
+    if (it != nullptr && it->size < 0 && !should_exit) {
         printf("read: %s\n", strerror(err));
         return 2;
     }
 
     // pass poisoned pill to the worker
-    state.qtail->size = 0;
-    state.qtail = state.qtail->next;
-
-    pthread_mutex_lock(&state.qempty_mtx);
-    state.qempty = 0;
-    pthread_cond_signal(&state.qempty_cond);
-    pthread_mutex_unlock(&state.qempty_mtx);
+    if (it == nullptr) {
+        it = state.free_items->pop();
+    }
+    it->size = 0;
+    state.filled_items->push(it);
 
     pthread_join(thread, NULL);
 
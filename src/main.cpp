@@ -76,9 +76,11 @@
 #include "rtp/rtp.h"
 #include "rtsp/rtsp_utils.h"
 #include "ug_runtime_error.h"
+#include "utils/capture_frame_pool.h"
 #include "utils/misc.h"
+#include "utils/pipeline_stats.h"
 #include "utils/net.h"
-#include "utils/wait_obj.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_capture.h"
 #include "video_display.h"
@@ -97,6 +99,7 @@
 #define PORT_BASE               5004
 
 #define DEFAULT_AUDIO_FEC       "none"
+#define DEFAULT_CAPTURE_POOL_FRAMES 6
 static constexpr const char *DEFAULT_VIDEO_COMPRESSION = "none";
 static constexpr const char *DEFAULT_AUDIO_CODEC = "PCM";
 #define AUDIO_PROTOCOLS "ultragrid_rtp, JACK or rtsp" // available audio protocols
@@ -129,7 +132,7 @@ static constexpr const char *DEFAULT_AUDIO_CODEC = "PCM";
 using namespace std;
 
 struct state_uv {
-        state_uv() : capture_device{}, display_device{}, audio{}, state_video_rxtx{} {
+        state_uv() : capture_device{}, capture_pool{}, display_device{}, audio{}, state_video_rxtx{} {
                 module_init_default(&root_module);
                 root_module.cls = MODULE_CLASS_ROOT;
                 root_module.priv_data = this;
@@ -139,6 +142,8 @@ struct state_uv {
         }
 
         struct vidcap *capture_device;
+        /// must outlive state_video_rxtx, which may hold captured frames
+        unique_ptr<capture_frame_pool> capture_pool;
         struct display *display_device;
 
         struct state_audio *audio;
@@ -338,51 +343,44 @@ static void usage(const char *exec_path)
  *
  * @param[in] arg pointer to UltraGrid (root) module
  */
+ADD_TO_PARAM(capture_pool_frames, "capture-pool-frames",
+                "* capture-pool-frames=<n>\n"
+                "  Maximal number of captured frames being processed concurrently (default 6).\n"
+                "  Frames of capturers that reuse their buffers are copied to allow this.\n");
+ADD_TO_PARAM(capture_zero_copy, "capture-zero-copy",
+                "* capture-zero-copy\n"
+                "  Do not copy captured frames, block capture until the frame is processed instead.\n");
+ADD_TO_PARAM(worker_affinity, "worker-affinity",
+                "* worker-affinity[=<cpu_list>]\n"
+                "  Pin worker pool threads to CPUs (eg. 0,2-5; all CPUs if list omitted), Linux only.\n");
+
 static void *capture_thread(void *arg)
 {
         struct module *uv_mod = (struct module *)arg;
         struct state_uv *uv = (struct state_uv *) uv_mod->priv_data;
-        struct wait_obj *wait_obj;
-
-        wait_obj = wait_obj_init();
 
         while (!should_exit) {
                 /* Capture and transmit video... */
                 struct audio_frame *audio;
+                uint64_t t0 = pipeline_stats_begin();
                 struct video_frame *tx_frame = vidcap_grab(uv->capture_device, &audio);
                 if (tx_frame != NULL) {
                         if(audio) {
                                 audio_sdi_send(uv->audio, audio);
                         }
-                        //tx_frame = vf_get_copy(tx_frame);
-                        bool wait_for_cur_uncompressed_frame;
-                        shared_ptr<video_frame> frame;
-                        if (!tx_frame->dispose) {
-                                wait_obj_reset(wait_obj);
-                                wait_for_cur_uncompressed_frame = true;
-                                frame = shared_ptr<video_frame>(tx_frame, [wait_obj](struct video_frame *) {
-                                                        wait_obj_notify(wait_obj);
-                                                });
-                        } else {
-                                wait_for_cur_uncompressed_frame = false;
-                                frame = shared_ptr<video_frame>(tx_frame, tx_frame->dispose);
-                        }
+                        // frames without dispose are invalidated by the next grab so they are
+                        // either copied or we wait until the frame is processed, eg. by
+                        // compress or sender (uncompressed video)
+                        shared_ptr<video_frame> frame = uv->capture_pool->get(tx_frame);
+                        pipeline_stats_end(PIPELINE_STAGE_CAPTURE, t0);
+                        pipeline_stats_frame(PIPELINE_STAGE_CAPTURE);
 
                         uv->state_video_rxtx->send(move(frame)); // std::move really important here (!)
 
-                        // wait for frame frame to be processed, eg. by compress
-                        // or sender (uncompressed video). Grab invalidates previous frame
-                        // (if not defined dispose function).
-                        if (wait_for_cur_uncompressed_frame) {
-                                wait_obj_wait(wait_obj);
-                                tx_frame->dispose = NULL;
-                                tx_frame->dispose_udata = NULL;
-                        }
+                        uv->capture_pool->wait_released();
                 }
         }
 
-        wait_obj_done(wait_obj);
-
         return NULL;
 }
 
@@ -895,6 +893,13 @@ int main(int argc, char *argv[])
                 audio_host = requested_receiver;
         }
 
+        pipeline_stats_init();
+
+        if (get_commandline_param("worker-affinity") != nullptr &&
+                        !task_set_cpu_affinity(get_commandline_param("worker-affinity"))) {
+                log_msg(LOG_LEVEL_WARNING, "Unable to set worker affinity.\n");
+        }
+
         if (!set_output_buffering()) {
                 log_msg(LOG_LEVEL_WARNING, "Cannot set console output buffering!\n");
         }
@@ -1179,6 +1184,11 @@ int main(int argc, char *argv[])
                 }
 
                 if (video_rxtx_mode & MODE_SENDER) {
+                        const char *pool_frames = get_commandline_param("capture-pool-frames");
+                        uv.capture_pool = unique_ptr<capture_frame_pool>(new capture_frame_pool(
+                                                vidcap_params_get_driver(vidcap_params_head),
+                                                pool_frames ? atoi(pool_frames) : DEFAULT_CAPTURE_POOL_FRAMES,
+                                                get_commandline_param("capture-zero-copy") != NULL));
                         if (pthread_create
                                         (&capture_thread_id, NULL, capture_thread,
                                          (void *) &uv.root_module) != 0) {
@@ -1250,6 +1260,7 @@ cleanup:
         if(uv.audio)
                 audio_done(uv.audio);
         delete uv.state_video_rxtx;
+        uv.capture_pool = nullptr;
 
         if (uv.capture_device)
                 vidcap_done(uv.capture_device);
@@ -1267,6 +1278,8 @@ cleanup:
                 vidcap_params_head = next;
         }
 
+        pipeline_stats_done();
+
         printf("Exit\n");
 
         return exit_status;
@@ -0,0 +1,307 @@
+/**
+ * @file   rtp/net_impair.cpp
+ * @brief  Deterministic network impairment of outgoing UDP datagrams
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "debug.h"
+#include "host.h"
+#include "rtp/net_impair.h"
+#include "utils/misc.h"
+
+#define MOD_NAME "[udp impair] "
+#define DEFAULT_SEED 1
+
+using namespace std;
+using namespace std::chrono;
+
+ADD_TO_PARAM(udp_impair, "udp-impair",
+                "* udp-impair=<opt>[:<opt>...]\n"
+                "  Impair outgoing UDP packets, use \"udp-impair=help\" for options\n");
+
+static int64_t now_ns()
+{
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void show_help()
+{
+        printf("Emulates an impaired network path for sent UDP packets (including RTCP).\n"
+                        "Usage:\n"
+                        "\t--param udp-impair=<opt>[:<opt>...]\n"
+                        "where <opt> is one of:\n"
+                        "\tseed=<n>                  seed of the random generator (default %d)\n"
+                        "\tport=<p>                  impair only packets sent to port <p> (eg. one of paths)\n"
+                        "\tloss=<pct>                random (Bernoulli) loss\n"
+                        "\tge=<p>/<r>[/<lg>/<lb>]    Gilbert-Elliott burst loss - <p> and <r> are percentual\n"
+                        "\t                          probabilities of transition good->bad and bad->good,\n"
+                        "\t                          <lg> and <lb> loss in good and bad state (default 0 and 100)\n"
+                        "\tdup=<pct>                 duplicated packets\n"
+                        "\treorder=<pct>[/<ms>]      packets delayed additionally by <ms> (default 1)\n"
+                        "\tdelay=<ms>[/<jitter_ms>]  constant delay with uniform jitter (may reorder)\n"
+                        "\trate=<bps>[/<queue_ms>]   rate limit (k/M/G suffix accepted) with tail-drop\n"
+                        "\t                          when the queue exceeds <queue_ms> (default 50)\n"
+                        "Each socket draws the decisions from its own generator, so the impairment is\n"
+                        "reproducible for the same seed and packet sequence.\n",
+                        DEFAULT_SEED);
+}
+
+static bool parse_pct(const char *val, double *out)
+{
+        char *end;
+        *out = strtod(val, &end) / 100.0;
+        return end != val && *out >= 0.0 && *out <= 1.0;
+}
+
+static bool parse_ms(const char *val, int64_t *out)
+{
+        char *end;
+        double ms = strtod(val, &end);
+        *out = ms * 1000000.0;
+        return end != val && ms >= 0.0;
+}
+
+bool net_impair::parse(const char *cfg)
+{
+        string tmp = cfg;
+        char *save_ptr = NULL;
+        char *item;
+        char *str = &tmp[0];
+        uint64_t seed = DEFAULT_SEED;
+
+        while ((item = strtok_r(str, ":", &save_ptr))) {
+                str = NULL;
+                char *val = strchr(item, '=');
+                if (val == NULL) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Missing value for option %s!\n", item);
+                        return false;
+                }
+                *val++ = '\0';
+                char *second = strchr(val, '/');
+                if (second != NULL) {
+                        *second++ = '\0';
+                }
+                bool ok = true;
+                if (strcmp(item, "seed") == 0) {
+                        seed = strtoull(val, NULL, 0);
+                } else if (strcmp(item, "port") == 0) {
+                        only_port = atoi(val);
+                        ok = only_port != 0;
+                } else if (strcmp(item, "loss") == 0) {
+                        ok = parse_pct(val, &loss_good);
+                } else if (strcmp(item, "ge") == 0) {
+                        ok = parse_pct(val, &p_good_to_bad) && second != NULL;
+                        if (ok) {
+                                char *lg = strchr(second, '/');
+                                if (lg != NULL) {
+                                        *lg++ = '\0';
+                                }
+                                ok = parse_pct(second, &p_bad_to_good);
+                                if (ok && lg != NULL) {
+                                        char *lb = strchr(lg, '/');
+                                        ok = lb != NULL && (*lb++ = '\0', true) &&
+                                                parse_pct(lg, &loss_good) && parse_pct(lb, &loss_bad);
+                                }
+                        }
+                } else if (strcmp(item, "dup") == 0) {
+                        ok = parse_pct(val, &duplicate);
+                } else if (strcmp(item, "reorder") == 0) {
+                        ok = parse_pct(val, &reorder) && (second == NULL || parse_ms(second, &reorder_ns));
+                } else if (strcmp(item, "delay") == 0) {
+                        ok = parse_ms(val, &delay_ns) && (second == NULL || parse_ms(second, &jitter_ns));
+                } else if (strcmp(item, "rate") == 0) {
+                        rate_bps = unit_evaluate(val);
+                        ok = rate_bps > 0.0 && (second == NULL || parse_ms(second, &queue_ns));
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option: %s\n", item);
+                        return false;
+                }
+                if (!ok) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong value of option %s!\n", item);
+                        return false;
+                }
+        }
+
+        rng_state ^= seed * 0x9E3779B97F4A7C15ull;
+        if (rng_state == 0) { // xorshift state must not be zero
+                rng_state = DEFAULT_SEED;
+        }
+        return true;
+}
+
+/**
+ * @param salt distinguishes sockets using the same configuration (eg. the
+ *             destination port), so that their decisions are not correlated
+ * @returns    NULL on wrong config or if help was requested
+ */
+net_impair *net_impair::create(const char *cfg, fd_t fd, uint64_t salt)
+{
+        if (strcmp(cfg, "help") == 0) {
+                show_help();
+                return NULL;
+        }
+        net_impair *s = new net_impair();
+        s->fd = fd;
+        s->rng_state = salt;
+        if (!s->parse(cfg)) {
+                delete s;
+                return NULL;
+        }
+        return s;
+}
+
+net_impair::~net_impair()
+{
+        if (thread.joinable()) {
+                unique_lock<mutex> lk(lock);
+                should_exit = true;
+                lk.unlock();
+                cv.notify_one();
+                thread.join();
+        }
+        if (stat_sent == 0) {
+                return;
+        }
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "%llu packets sent, %llu lost, %llu dropped by rate limit, "
+                        "%llu duplicated, %llu reordered\n", (unsigned long long) stat_sent,
+                        (unsigned long long) stat_lost, (unsigned long long) stat_queue_drop,
+                        (unsigned long long) stat_duplicated, (unsigned long long) stat_reordered);
+}
+
+/// xorshift64* - cheap and, unlike <random> distributions, identical on all platforms
+double net_impair::next_random()
+{
+        rng_state ^= rng_state >> 12;
+        rng_state ^= rng_state << 25;
+        rng_state ^= rng_state >> 27;
+        return ((rng_state * 0x2545F4914F6CDD1Dull) >> 11) * (1.0 / (1ull << 53));
+}
+
+bool net_impair::lost()
+{
+        if (p_good_to_bad > 0.0) {
+                double r = next_random();
+                bad_state = bad_state ? r >= p_bad_to_good : r < p_good_to_bad;
+        }
+        double loss = bad_state ? loss_bad : loss_good;
+        return loss > 0.0 && next_random() < loss;
+}
+
+void net_impair::send(const char *buffer, int len, const struct sockaddr *dst, socklen_t addrlen)
+{
+        // the socket may be used by more threads (eg. RTCP and RTP send)
+        unique_lock<mutex> lk(lock);
+        stat_sent += 1;
+        // all random numbers are drawn for every packet to keep the sequence independent of timing
+        bool drop = lost();
+        int copies = duplicate > 0.0 && next_random() < duplicate ? 2 : 1;
+        bool reordered = reorder > 0.0 && next_random() < reorder;
+        double jitter = jitter_ns > 0 ? next_random() : 0.5;
+
+        if (drop) {
+                stat_lost += 1;
+                return;
+        }
+        stat_duplicated += copies - 1;
+        stat_reordered += reordered;
+
+        int64_t now = now_ns();
+        int64_t departure = now;
+        if (rate_bps > 0.0) {
+                if (link_free - now > queue_ns) {
+                        stat_queue_drop += 1;
+                        return;
+                }
+                link_free = max(link_free, now) + (int64_t) (len * 8 * 1e9 / rate_bps);
+                departure = link_free;
+        }
+        departure += delay_ns + (int64_t) ((2.0 * jitter - 1.0) * jitter_ns) + (reordered ? reorder_ns : 0);
+
+        if (departure <= now) {
+                lk.unlock();
+                for (int i = 0; i < copies; ++i) {
+                        sendto(fd, buffer, len, 0, dst, addrlen);
+                }
+                return;
+        }
+
+        bool wake = delayed.empty() || departure < delayed.top().departure;
+        for (int i = 0; i < copies; ++i) {
+                packet p{ departure, seq++, vector<char>(buffer, buffer + len), {}, addrlen };
+                memcpy(&p.dst, dst, addrlen);
+                delayed.push(move(p));
+        }
+        if (!thread.joinable()) {
+                thread = std::thread(&net_impair::sender, this);
+        }
+        lk.unlock();
+        if (wake) {
+                cv.notify_one();
+        }
+}
+
+void net_impair::sender()
+{
+        unique_lock<mutex> lk(lock);
+        while (!should_exit) {
+                if (delayed.empty()) {
+                        cv.wait(lk);
+                        continue;
+                }
+                int64_t departure = delayed.top().departure;
+                if (departure > now_ns()) {
+                        cv.wait_until(lk, steady_clock::time_point(
+                                                duration_cast<steady_clock::duration>(nanoseconds(departure))));
+                        continue;
+                }
+                packet p = delayed.top();
+                delayed.pop();
+                lk.unlock();
+                // errors are ignored as in udp_send() (eg. ECONNREFUSED when nobody listens)
+                sendto(fd, p.data.data(), p.data.size(), 0, (struct sockaddr *) &p.dst, p.addrlen);
+                lk.lock();
+        }
+}
+
@@ -0,0 +1,130 @@
+/**
+ * @file   rtp/net_impair.h
+ * @brief  Deterministic network impairment of outgoing UDP datagrams
+ *
+ * Emulates a lossy, jittery or rate-limited path in-process, so that FEC,
+ * playout buffer and decoder recovery can be tested reproducibly over
+ * loopback without netem (see "udp-impair" parameter).
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef NET_IMPAIR_H_
+#define NET_IMPAIR_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#ifdef __cplusplus
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/**
+ * Impairment of datagrams sent from one socket. Decisions (loss,
+ * duplication, reordering, jitter) are drawn from a generator seeded by
+ * the configured seed and the salt, so they depend only on the order of
+ * packets. Delayed packets are sent by a separate thread. send() may be
+ * called concurrently.
+ */
+struct net_impair {
+        static net_impair *create(const char *cfg, fd_t fd, uint64_t salt);
+        ~net_impair();
+
+        /// Passes a datagram to the emulated path (buffer is copied if the packet is delayed)
+        void send(const char *buffer, int len, const struct sockaddr *dst, socklen_t addrlen);
+        /// @returns false if the impairment is restricted to other destination port
+        bool applies_to(uint16_t port) const { return only_port == 0 || only_port == port; }
+
+private:
+        struct packet {
+                int64_t departure; ///< steady_clock ns
+                uint64_t seq;
+                std::vector<char> data;
+                struct sockaddr_storage dst;
+                socklen_t addrlen;
+                bool operator>(const packet &other) const {
+                        return departure > other.departure ||
+                                (departure == other.departure && seq > other.seq);
+                }
+        };
+
+        net_impair() = default;
+        bool parse(const char *cfg);
+        double next_random();
+        bool lost();
+        void sender();
+
+        fd_t fd;
+        uint64_t rng_state;
+        uint16_t only_port = 0;          ///< 0 - all sockets
+
+        // Gilbert-Elliott loss model, probabilities in range [0, 1]
+        double p_good_to_bad = 0.0;
+        double p_bad_to_good = 1.0;
+        double loss_good = 0.0;
+        double loss_bad = 1.0;
+        bool bad_state = false;
+
+        double duplicate = 0.0;
+        double reorder = 0.0;
+        int64_t reorder_ns = 1000000;
+        int64_t delay_ns = 0;
+        int64_t jitter_ns = 0;
+        double rate_bps = 0.0;           ///< 0 - unlimited
+        int64_t queue_ns = 50000000;     ///< max queueing delay of the rate limiter (tail drop)
+        int64_t link_free = 0;           ///< time when the rate limited link becomes idle
+
+        uint64_t seq = 0;
+        uint64_t stat_sent = 0;
+        uint64_t stat_lost = 0;
+        uint64_t stat_queue_drop = 0;
+        uint64_t stat_duplicated = 0;
+        uint64_t stat_reordered = 0;
+
+        std::mutex lock;                 ///< protects the generator, link state, statistics and queue
+        std::condition_variable cv;
+        std::priority_queue<packet, std::vector<packet>, std::greater<packet>> delayed;
+        std::thread thread;
+        bool should_exit = false;
+};
+#endif // __cplusplus
+
+#endif // NET_IMPAIR_H_
+
@@ -54,22 +54,36 @@
 #include "compat/vsnprintf.h"
 #include "net_udp.h"
 #include "rtp.h"
+#include "rtp/net_impair.h"
 
 #ifdef NEED_ADDRINFO_H
 #include "addrinfo.h"
 #endif
 
 #include <algorithm>
+#include <atomic>
 #include <condition_variable>
 #include <chrono>
 #include <mutex>
 #include <queue>
+#include <vector>
+
+#if defined HAVE_LINUX && defined SO_TXTIME
+#include <ifaddrs.h>
+#include <linux/net_tstamp.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#define UDP_TXTIME_SUPPORTED 1
+#endif
 
+using std::atomic;
 using std::condition_variable;
 using std::max;
 using std::mutex;
 using std::queue;
+using std::lock_guard;
 using std::unique_lock;
+using std::vector;
 
 #define DEFAULT_MAX_UDP_READER_QUEUE_LEN (1920/3*8*1080/1152) //< 10-bit FullHD frame divided by 1280 MTU packets (minus headers)
 
@@ -147,6 +161,9 @@ struct socket_udp_local {
         mutex lock;
         condition_variable boss_cv;
         condition_variable reader_cv;
+        struct socket_udp_local *queue_owner; ///< local whose queue receives the packets - itself or
+                                              ///< primary socket of a path (see udp_init_path())
+        atomic<uint64_t> rx_packets;
 
         bool should_exit;
         fd_t should_exit_fd[2];
@@ -162,6 +179,8 @@ struct _socket_udp {
         struct socket_udp_local *local;
         bool local_is_slave; // whether is the local
 
+        struct net_impair *impair; ///< emulated impaired path, NULL if not requested
+
 #ifdef WIN32
         WSAOVERLAPPED *overlapped;
         WSAEVENT *overlapped_events;
@@ -170,9 +189,23 @@ struct _socket_udp {
         int overlapped_max;
         int overlapped_count;
 #endif
+#ifdef UDP_TXTIME_SUPPORTED
+        struct paced_packet {
+                struct iovec iov[3];
+                alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(uint64_t))];
+                void *d;
+        };
+        int txtime;             ///< SO_TXTIME state: 0 - not set yet, 1 - enabled, -1 - unsupported
+        bool paced_active;
+        uint64_t paced_next;    ///< departure time of the next packet (CLOCK_MONOTONIC, ns)
+        uint64_t paced_interval;
+        vector<paced_packet> paced_packets;
+        vector<struct mmsghdr> paced_msgs;
+#endif
 };
 
 static void udp_clean_async_state(socket_udp *s);
+static bool udp_init_impair(socket_udp *s);
 
 #ifdef WIN32
 /* Want to use both Winsock 1 and 2 socket options, but since
@@ -686,6 +719,7 @@ socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
         socket_udp *s = new socket_udp();
         s->local = new socket_udp_local();
         s->local->fd = INVALID_SOCKET;
+        s->local->queue_owner = s->local;
 
 	if (!address_is_ipv6(addr) && !use_ipv6) {
                 s->local->mode = IPv4;
@@ -827,6 +861,11 @@ socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
                 pthread_create(&s->local->thread_id, NULL, udp_reader, s);
         }
 
+        if (!udp_init_impair(s)) {
+                udp_exit(s);
+                return NULL;
+        }
+
         return s;
 
 error:
@@ -838,6 +877,46 @@ error:
         return NULL;
 }
 
+/**
+ * Creates a socket for an additional path of a striped session. Datagrams
+ * received by the socket are queued to the primary socket, so that they are
+ * read together by udp_recv_data(primary). Sending works as with any other
+ * socket.
+ *
+ * @param primary the socket that the packets are received with, must receive
+ *                in a separate thread (otherwise nobody would read the path)
+ * @returns       a pointer to a socket_udp structure on success, NULL otherwise.
+ */
+socket_udp *udp_init_path(socket_udp *primary, const char *addr, const char *iface,
+                uint16_t rx_port, uint16_t tx_port, int ttl, bool use_ipv6)
+{
+        if (!primary->local->multithreaded) {
+                log_msg(LOG_LEVEL_ERROR, "[NET UDP] udp_init_path: primary socket doesn't receive "
+                                "in a separate thread, path wouldn't be read!\n");
+                return NULL;
+        }
+        socket_udp *s = udp_init_if(addr, iface, rx_port, tx_port, ttl, use_ipv6, false);
+        if (s == NULL) {
+                return NULL;
+        }
+
+        s->local->multithreaded = true;
+        s->local->queue_owner = primary->local->queue_owner;
+        platform_pipe_init(s->local->should_exit_fd);
+        pthread_create(&s->local->thread_id, NULL, udp_reader, s);
+
+        return s;
+}
+
+/**
+ * @returns number of datagrams received by the socket (counted only for
+ *          multithreaded receiving)
+ */
+uint64_t udp_get_rx_packets(socket_udp *s)
+{
+        return s->local->rx_packets;
+}
+
 socket_udp *udp_init_with_local(struct socket_udp_local *l, struct sockaddr *sa, socklen_t len)
 {
         if ((sa->sa_family == AF_INET && l->mode != IPv4) ||
@@ -854,9 +933,39 @@ socket_udp *udp_init_with_local(struct socket_udp_local *l, struct sockaddr *sa,
         memcpy(&s->sock, sa, len);
         s->sock_len = len;
 
+        if (!udp_init_impair(s)) {
+                delete s;
+                return NULL;
+        }
+
         return s;
 }
 
+/**
+ * Sets up network impairment emulation if requested by "udp-impair" param.
+ */
+static bool udp_init_impair(socket_udp *s)
+{
+        const char *cfg = get_commandline_param("udp-impair");
+        if (cfg == NULL) {
+                return true;
+        }
+        // destination port is used as a salt so that eg. audio and video
+        // streams are impaired independently
+        uint16_t port = s->sock.ss_family == AF_INET6 ?
+                ntohs(((struct sockaddr_in6 *) &s->sock)->sin6_port) :
+                ntohs(((struct sockaddr_in *) &s->sock)->sin_port);
+        s->impair = net_impair::create(cfg, s->local->fd, port);
+        if (s->impair == NULL) {
+                return false;
+        }
+        if (!s->impair->applies_to(port)) {
+                delete s->impair;
+                s->impair = NULL;
+        }
+        return true;
+}
+
 
 static fd_set rfd;
 static fd_t max_fd;
@@ -888,6 +997,8 @@ void udp_fd_zero_r(struct udp_fd_r *fd_struct)
  **/
 void udp_exit(socket_udp * s)
 {
+        delete s->impair; // sends from the socket, must be stopped before closing it
+
         switch (s->local->mode) {
         case IPv4:
                 udp_leave_mcast_grp4(((struct sockaddr_in *)&s->sock)->sin_addr.s_addr, s->local->fd);
@@ -901,11 +1012,15 @@ void udp_exit(socket_udp * s)
 
         if (!s->local_is_slave) {
                 if (s->local->multithreaded) {
+                        struct socket_udp_local *q = s->local->queue_owner;
                         char c = 0;
                         int ret = send(s->local->should_exit_fd[1], &c, 1, 0);
                         assert (ret == 1);
-                        s->local->should_exit = true;
-                        s->local->reader_cv.notify_one();
+                        {
+                                lock_guard<mutex> lk(q->lock);
+                                s->local->should_exit = true;
+                        }
+                        q->reader_cv.notify_all(); // readers of paths may wait for the same queue
                         pthread_join(s->local->thread_id, NULL);
                         while (!s->local->packets.empty()) {
                                 auto it = s->local->packets.front();
@@ -939,15 +1054,45 @@ int udp_send(socket_udp * s, char *buffer, int buflen)
         assert(buffer != NULL);
         assert(buflen > 0);
 
-        return sendto(s->local->fd, buffer, buflen, 0, (struct sockaddr *)&s->sock,
-                      s->sock_len);
+        return udp_sendto(s, buffer, buflen, (struct sockaddr *)&s->sock, s->sock_len);
 }
 
 int udp_sendto(socket_udp * s, char *buffer, int buflen, struct sockaddr *dst_addr, socklen_t addrlen)
 {
+        if (s->impair) {
+                s->impair->send(buffer, buflen, dst_addr, addrlen);
+                return buflen;
+        }
         return sendto(s->local->fd, buffer, buflen, 0, dst_addr, addrlen);
 }
 
+/**
+ * Passes a scatter-gather datagram to impairment emulation.
+ */
+#ifdef WIN32
+static int udp_sendv_impaired(socket_udp *s, LPWSABUF vector, int count)
+#else
+static int udp_sendv_impaired(socket_udp *s, struct iovec *vector, int count)
+#endif
+{
+        char buffer[RTP_MAX_PACKET_LEN];
+        int len = 0;
+        for (int i = 0; i < count; ++i) {
+#ifdef WIN32
+                size_t iov_len = vector[i].len;
+                const char *iov_base = vector[i].buf;
+#else
+                size_t iov_len = vector[i].iov_len;
+                const char *iov_base = (const char *) vector[i].iov_base;
+#endif
+                assert(len + iov_len <= sizeof buffer);
+                memcpy(buffer + len, iov_base, iov_len);
+                len += iov_len;
+        }
+        s->impair->send(buffer, len, (struct sockaddr *) &s->sock, s->sock_len);
+        return len;
+}
+
 #ifdef WIN32
 int udp_sendv(socket_udp * s, LPWSABUF vector, int count, void *d)
 {
@@ -955,6 +1100,12 @@ int udp_sendv(socket_udp * s, LPWSABUF vector, int count, void *d)
 
         assert(!s->overlapping_active || s->overlapped_count < s->overlapped_max);
 
+        if (s->impair) {
+                udp_sendv_impaired(s, vector, count);
+                free(d);
+                return 0;
+        }
+
 	DWORD bytesSent;
 	int ret = WSASendTo(s->local->fd, vector, count, &bytesSent, 0,
 		(struct sockaddr *) &s->sock,
@@ -978,6 +1129,39 @@ int udp_sendv(socket_udp * s, struct iovec *vector, int count, void *d)
 
         assert(s != NULL);
 
+        if (s->impair) {
+                int ret = udp_sendv_impaired(s, vector, count);
+                free(d);
+                return ret;
+        }
+
+#ifdef UDP_TXTIME_SUPPORTED
+        if (s->paced_active) {
+                assert(count <= 3);
+                s->paced_packets.emplace_back();
+                auto &p = s->paced_packets.back();
+                int len = 0;
+                for (int i = 0; i < count; ++i) {
+                        p.iov[i] = vector[i];
+                        len += vector[i].iov_len;
+                }
+                struct cmsghdr *cmsg = (struct cmsghdr *) p.control;
+                cmsg->cmsg_level = SOL_SOCKET;
+                cmsg->cmsg_type = SCM_TXTIME;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+                memcpy(CMSG_DATA(cmsg), &s->paced_next, sizeof(uint64_t));
+                s->paced_next += s->paced_interval;
+                p.d = d;
+                struct mmsghdr mmsg{};
+                mmsg.msg_hdr.msg_name = (void *) &s->sock;
+                mmsg.msg_hdr.msg_namelen = s->sock_len;
+                mmsg.msg_hdr.msg_iovlen = count;
+                mmsg.msg_hdr.msg_controllen = sizeof p.control;
+                s->paced_msgs.push_back(mmsg);
+                return len;
+        }
+#endif
+
         msg.msg_name = (void *) & s->sock;
         msg.msg_namelen = s->sock_len;
         msg.msg_iov = vector;
@@ -1000,6 +1184,7 @@ int udp_sendv(socket_udp * s, struct iovec *vector, int count, void *d)
 static void *udp_reader(void *arg)
 {
         socket_udp *s = (socket_udp *) arg;
+        struct socket_udp_local *q = s->local->queue_owner;
 
         while (1) {
                 fd_set fds;
@@ -1032,17 +1217,19 @@ static void *udp_reader(void *arg)
                         continue;
                 }
 
-                unique_lock<mutex> lk(s->local->lock);
-                s->local->reader_cv.wait(lk, [s]{return s->local->packets.size() < s->local->max_packets || s->local->should_exit;});
+                s->local->rx_packets += 1;
+
+                unique_lock<mutex> lk(q->lock);
+                q->reader_cv.wait(lk, [s, q]{return q->packets.size() < q->max_packets || s->local->should_exit;});
                 if (s->local->should_exit) {
                         free(packet);
                         break;
                 }
 
-                s->local->packets.emplace(packet, size);
+                q->packets.emplace(packet, size);
 
                 lk.unlock();
-                s->local->boss_cv.notify_one();
+                q->boss_cv.notify_one();
         }
 
         platform_pipe_close(s->local->should_exit_fd[0]);
@@ -1410,8 +1597,206 @@ void udp_async_start(socket_udp *s, int nr_packets)
 #endif
 }
 
+#ifdef UDP_TXTIME_SUPPORTED
+static void udp_paced_flush(socket_udp *s)
+{
+        // pointers are filled only now since the vector may have been reallocated
+        for (unsigned int i = 0; i < s->paced_msgs.size(); ++i) {
+                s->paced_msgs[i].msg_hdr.msg_iov = s->paced_packets[i].iov;
+                s->paced_msgs[i].msg_hdr.msg_control = s->paced_packets[i].control;
+        }
+        unsigned int sent = 0;
+        while (sent < s->paced_msgs.size()) {
+                int ret = sendmmsg(s->local->fd, s->paced_msgs.data() + sent,
+                                s->paced_msgs.size() - sent, 0);
+                if (ret < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        socket_error("sendmmsg");
+                        break;
+                }
+                sent += ret;
+        }
+        for (auto &p : s->paced_packets) {
+                free(p.d);
+        }
+        s->paced_packets.clear();
+        s->paced_msgs.clear();
+        s->paced_active = false;
+}
+#endif
+
+#ifdef UDP_TXTIME_SUPPORTED
+/**
+ * @returns index of the interface the packets to s->sock leave through, 0 if unknown
+ */
+static unsigned int udp_egress_ifindex(socket_udp *s)
+{
+        unsigned int ifindex = 0;
+        int fd = socket(s->sock.ss_family, SOCK_DGRAM, 0);
+        if (fd == -1) {
+                return 0;
+        }
+        struct sockaddr_storage local;
+        socklen_t local_len = sizeof local;
+        // connecting an UDP socket only resolves the route, nothing is sent
+        if (connect(fd, (struct sockaddr *) &s->sock, s->sock_len) != 0 ||
+                        getsockname(fd, (struct sockaddr *) &local, &local_len) != 0) {
+                close(fd);
+                return 0;
+        }
+        close(fd);
+
+        struct ifaddrs *ifa_list;
+        if (getifaddrs(&ifa_list) != 0) {
+                return 0;
+        }
+        for (struct ifaddrs *ifa = ifa_list; ifa != NULL && ifindex == 0; ifa = ifa->ifa_next) {
+                if (ifa->ifa_addr == NULL || ifa->ifa_addr->sa_family != local.ss_family) {
+                        continue;
+                }
+                bool match = local.ss_family == AF_INET ?
+                        ((struct sockaddr_in *) ifa->ifa_addr)->sin_addr.s_addr ==
+                        ((struct sockaddr_in *) &local)->sin_addr.s_addr :
+                        memcmp(&((struct sockaddr_in6 *) ifa->ifa_addr)->sin6_addr,
+                                        &((struct sockaddr_in6 *) &local)->sin6_addr, sizeof(struct in6_addr)) == 0;
+                if (match) {
+                        ifindex = if_nametoindex(ifa->ifa_name);
+                }
+        }
+        freeifaddrs(ifa_list);
+        return ifindex;
+}
+
+/**
+ * Checks (using rtnetlink) whether there is a qdisc honoring SO_TXTIME
+ * departure times (fq or etf) on the egress interface.
+ *
+ * @retval  1 present
+ * @retval  0 not present
+ * @retval -1 cannot be determined
+ */
+static int udp_pacing_qdisc_present(socket_udp *s)
+{
+        unsigned int ifindex = udp_egress_ifindex(s);
+        if (ifindex == 0) {
+                return -1;
+        }
+        int fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+        if (fd == -1) {
+                return -1;
+        }
+        struct {
+                struct nlmsghdr nh;
+                struct tcmsg tcm;
+        } req{};
+        req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg));
+        req.nh.nlmsg_type = RTM_GETQDISC;
+        req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+        req.tcm.tcm_family = AF_UNSPEC;
+        if (send(fd, &req, req.nh.nlmsg_len, 0) < 0) {
+                close(fd);
+                return -1;
+        }
+
+        int ret = 0;
+        bool done = false;
+        char buf[16384];
+        while (!done) {
+                int len = recv(fd, buf, sizeof buf, 0);
+                if (len <= 0) {
+                        ret = -1;
+                        break;
+                }
+                for (struct nlmsghdr *nh = (struct nlmsghdr *) buf; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+                        if (nh->nlmsg_type == NLMSG_DONE || nh->nlmsg_type == NLMSG_ERROR) {
+                                ret = nh->nlmsg_type == NLMSG_DONE ? ret : -1;
+                                done = true;
+                                break;
+                        }
+                        struct tcmsg *tcm = (struct tcmsg *) NLMSG_DATA(nh);
+                        if (nh->nlmsg_type != RTM_NEWQDISC || (unsigned int) tcm->tcm_ifindex != ifindex) {
+                                continue;
+                        }
+                        int attr_len = TCA_PAYLOAD(nh);
+                        for (struct rtattr *rta = TCA_RTA(tcm); RTA_OK(rta, attr_len); rta = RTA_NEXT(rta, attr_len)) {
+                                if (rta->rta_type == TCA_KIND && (strcmp((char *) RTA_DATA(rta), "fq") == 0 ||
+                                                        strcmp((char *) RTA_DATA(rta), "etf") == 0)) {
+                                        ret = 1;
+                                }
+                        }
+                }
+        }
+        close(fd);
+        return ret;
+}
+#endif
+
+/**
+ * Starts sending of a bulk of packets (eg. a video frame) paced by the kernel.
+ * Each packet sent by udp_sendv() up to udp_async_wait() is stamped with a
+ * departure time (SO_TXTIME) interval_ns after the previous one and all
+ * packets are then passed to the kernel at once in udp_async_wait(). The
+ * pacing itself is performed by fq or etf qdisc, without it the packets
+ * leave immediately.
+ *
+ * Same constraints as for udp_async_start() apply - data must not be altered
+ * until udp_async_wait() returns.
+ *
+ * @retval false SO_TXTIME not supported, caller should use udp_async_start()
+ *               and pace the packets itself
+ */
+bool udp_async_start_paced(socket_udp *s, int nr_packets, uint64_t interval_ns)
+{
+#ifdef UDP_TXTIME_SUPPORTED
+        if (s->impair) { // impairment schedules the packets on its own
+                return false;
+        }
+        if (s->txtime == 0) {
+                struct sock_txtime cfg{};
+                cfg.clockid = CLOCK_MONOTONIC; // fq qdisc requires monotonic clock
+                if (SETSOCKOPT(s->local->fd, SOL_SOCKET, SO_TXTIME, (sockopt_t) &cfg, sizeof cfg) == 0) {
+                        s->txtime = 1;
+                        if (udp_pacing_qdisc_present(s) == 0) {
+                                log_msg(LOG_LEVEL_WARNING, "[NET UDP] SO_TXTIME set but there is no fq or etf "
+                                                "qdisc on the output interface, packets won't be paced "
+                                                "(eg. tc qdisc replace dev <iface> root fq).\n");
+                        }
+                } else {
+                        socket_error("setsockopt SO_TXTIME");
+                        s->txtime = -1;
+                }
+        }
+        if (s->txtime != 1) {
+                return false;
+        }
+
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        uint64_t now = (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+        // continue the schedule of the previous bulk if it hasn't departed yet
+        s->paced_next = max(now, s->paced_next);
+        s->paced_interval = interval_ns;
+        s->paced_packets.reserve(nr_packets);
+        s->paced_msgs.reserve(nr_packets);
+        s->paced_active = true;
+        return true;
+#else
+        UNUSED(s);
+        UNUSED(nr_packets);
+        UNUSED(interval_ns);
+        return false;
+#endif
+}
+
 void udp_async_wait(socket_udp *s)
 {
+#ifdef UDP_TXTIME_SUPPORTED
+        if (s->paced_active) {
+                udp_paced_flush(s);
+        }
+#endif
 #ifdef WIN32
         if (!s->overlapping_active)
                 return;
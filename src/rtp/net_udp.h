@@ -66,6 +66,7 @@ int         udp_sendto(socket_udp *s, char *buffer, int buflen, struct sockaddr
 
 int         udp_recvv(socket_udp *s, struct msghdr *m);
 void        udp_async_start(socket_udp *s, int nr_packets);
+bool        udp_async_start_paced(socket_udp *s, int nr_packets, uint64_t interval_ns);
 void        udp_async_wait(socket_udp *s);
 #ifdef WIN32
 int         udp_sendv(socket_udp *s, LPWSABUF vector, int count, void *d);
@@ -108,6 +109,8 @@ int         udp_send_wsa_async(socket_udp *s, char *buffer, int buflen, LPWSAOVE
 
 struct socket_udp_local *udp_get_local(socket_udp *s);
 socket_udp *udp_init_with_local(struct socket_udp_local *l, struct sockaddr *sa, socklen_t len);
+socket_udp *udp_init_path(socket_udp *primary, const char *addr, const char *iface, uint16_t rx_port, uint16_t tx_port, int ttl, bool use_ipv6);
+uint64_t    udp_get_rx_packets(socket_udp *s);
 
 /*************************************************************************************************/
 #if defined(__cplusplus)
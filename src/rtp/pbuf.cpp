@@ -63,10 +63,20 @@
 #include "rtp/ptime.h"
 #include "rtp/pbuf.h"
 
+#include <map>
+
 #define PBUF_MAGIC	0xcafebabe
 
 #define STATS_INTERVAL 100
 
+#define NACK_MAX_GAP 1000       ///< larger jump in seq numbers is considered a stream restart
+#define NACK_MAX_MISSING 8192   ///< max number of tracked lost packets
+#define NACK_MAX_RETRIES 3
+#define NACK_REORDER_US 1000    ///< wait for reordered packets before the first request
+
+using std::chrono::high_resolution_clock;
+using std::chrono::microseconds;
+
 struct pbuf_node {
         struct pbuf_node *nxt;
         struct pbuf_node *prv;
@@ -95,6 +105,17 @@ struct pbuf {
         int received_pkts_last, expected_pkts_last; // values for last interval
         long long int received_pkts_cum, expected_pkts_cum; // cumulative values
         uint32_t last_display_ts;
+
+        // retransmission requests
+        struct nack_entry {
+                high_resolution_clock::time_point deadline; ///< packet is useless afterwards
+                high_resolution_clock::time_point next_request;
+                int requests;
+        };
+        microseconds nack_window;        ///< zero if disabled
+        int highest_seq;                 ///< -1 if not yet known
+        std::map<uint16_t, nack_entry> missing;
+        int nack_requested, nack_recovered; // statistics
 };
 
 static void free_cdata(struct coded_data *head);
@@ -159,7 +180,7 @@ struct pbuf *pbuf_init(volatile int *delay_ms)
 {
         struct pbuf *playout_buf = NULL;
 
-        playout_buf = (struct pbuf *) calloc(1, sizeof(struct pbuf));
+        playout_buf = new struct pbuf();
         if (playout_buf != NULL) {
                 playout_buf->frst = NULL;
                 playout_buf->last = NULL;
@@ -169,6 +190,7 @@ struct pbuf *pbuf_init(volatile int *delay_ms)
                 playout_buf->offset_ms = delay_ms;
                 playout_buf->playout_delay_us = 0.032 * 1000 * 1000;
                 playout_buf->last_rtp_seq = -1;
+                playout_buf->highest_seq = -1;
         } else {
                 debug_msg("Failed to allocate memory for playout buffer\n");
         }
@@ -200,7 +222,7 @@ void pbuf_destroy(struct pbuf *playout_buf) {
                         delete curr;
                         curr = temp;
                 }
-                free(playout_buf);
+                delete playout_buf;
         }
 }
 
@@ -294,6 +316,44 @@ static struct pbuf_node *create_new_pnode(rtp_packet * pkt, long long playout_de
         return tmp;
 }
 
+/**
+ * Records sequence numbers skipped since the highest seen one as missing and
+ * removes late (reordered or retransmitted) packets from the missing list.
+ */
+static void track_missing(struct pbuf *playout_buf, uint16_t seq)
+{
+        if (playout_buf->highest_seq == -1) {
+                playout_buf->highest_seq = seq;
+                return;
+        }
+
+        int16_t diff = seq - (uint16_t) playout_buf->highest_seq;
+        if (diff <= 0) {
+                auto it = playout_buf->missing.find(seq);
+                if (it != playout_buf->missing.end()) {
+                        if (it->second.requests > 0) {
+                                playout_buf->nack_recovered += 1;
+                        }
+                        playout_buf->missing.erase(it);
+                }
+                return;
+        }
+
+        if (diff > NACK_MAX_GAP) {
+                playout_buf->missing.clear();
+        } else {
+                auto now = high_resolution_clock::now();
+                for (uint16_t s = playout_buf->highest_seq + 1; s != seq; ++s) {
+                        if (playout_buf->missing.size() >= NACK_MAX_MISSING) {
+                                break;
+                        }
+                        playout_buf->missing[s] = { now + playout_buf->nack_window,
+                                now + microseconds(NACK_REORDER_US), 0 };
+                }
+        }
+        playout_buf->highest_seq = seq;
+}
+
 void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
 {
         struct pbuf_node *tmp;
@@ -337,15 +397,25 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
                                 playout_buf->expected_pkts,
                                 (double) playout_buf->received_pkts /
                                 playout_buf->expected_pkts * 100.0);
+                if (playout_buf->nack_window.count() > 0) {
+                        log_msg(LOG_LEVEL_INFO, "SSRC %08x: %d packets requested for retransmission, "
+                                        "%d recovered.\n", pkt->ssrc,
+                                        playout_buf->nack_requested, playout_buf->nack_recovered);
+                        playout_buf->nack_requested = playout_buf->nack_recovered = 0;
+                }
                 playout_buf->received_pkts_last = playout_buf->received_pkts;
                 playout_buf->expected_pkts_last = playout_buf->expected_pkts;
                 playout_buf->expected_pkts = playout_buf->received_pkts = 0;
                 playout_buf->last_display_ts = pkt->ts;
         }
 
+        if (playout_buf->nack_window.count() > 0) {
+                track_missing(playout_buf, pkt->seq);
+        }
+
         if (playout_buf->frst == NULL && playout_buf->last == NULL) {
                 /* playout buffer is empty - add new frame */
-                playout_buf->frst = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
+                playout_buf->frst = create_new_pnode(pkt, playout_buf->playout_delay_us + playout_buf->nack_window.count() + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
                 playout_buf->last = playout_buf->frst;
                 return;
         }
@@ -357,7 +427,7 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
         } else {
                 if (playout_buf->last->rtp_timestamp < pkt->ts) {
                         /* Packet belongs to a new frame... */
-                        tmp = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
+                        tmp = create_new_pnode(pkt, playout_buf->playout_delay_us + playout_buf->nack_window.count() + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
                         playout_buf->last->nxt = tmp;
                         playout_buf->last->completed = true;
                         tmp->prv = playout_buf->last;
@@ -508,3 +578,36 @@ void pbuf_set_playout_delay(struct pbuf *playout_buf, double playout_delay)
         playout_buf->playout_delay_us = playout_delay * 1000 * 1000;
 }
 
+void pbuf_set_nack_window(struct pbuf *playout_buf, std::chrono::microseconds window)
+{
+        playout_buf->nack_window = window;
+        if (window.count() == 0) {
+                playout_buf->missing.clear();
+        }
+}
+
+int pbuf_get_nacks(struct pbuf *playout_buf, std::chrono::high_resolution_clock::time_point const & curr_time,
+                uint16_t *seqs, int max)
+{
+        auto retry_interval = playout_buf->nack_window / NACK_MAX_RETRIES;
+        int count = 0;
+
+        for (auto it = playout_buf->missing.begin(); it != playout_buf->missing.end(); ) {
+                auto &entry = it->second;
+                if (curr_time > entry.deadline || (entry.requests == NACK_MAX_RETRIES &&
+                                        curr_time >= entry.next_request)) {
+                        it = playout_buf->missing.erase(it);
+                        continue;
+                }
+                if (count < max && entry.requests < NACK_MAX_RETRIES && curr_time >= entry.next_request) {
+                        seqs[count++] = it->first;
+                        entry.requests += 1;
+                        entry.next_request = curr_time + retry_interval;
+                        playout_buf->nack_requested += 1;
+                }
+                ++it;
+        }
+
+        return count;
+}
+
@@ -136,6 +136,18 @@ int 	 	 pbuf_decode(struct pbuf *playout_buf, std::chrono::high_resolution_clock
                              //struct video_frame *framebuffer, int i, struct state_decoder *decoder);
 void		 pbuf_remove(struct pbuf *playout_buf, std::chrono::high_resolution_clock::time_point const & curr_time);
 void		 pbuf_set_playout_delay(struct pbuf *playout_buf, double playout_delay);
+/**
+ * Enables tracking of lost packets for retransmission requests. Playout delay
+ * is extended by window so that the retransmitted packets arrive in time.
+ */
+void		 pbuf_set_nack_window(struct pbuf *playout_buf, std::chrono::microseconds window);
+/**
+ * Returns up to max sequence numbers of lost packets that should be requested
+ * now (see rtp_send_nack()). Each packet is requested at most few times and
+ * not after its playout deadline.
+ */
+int		 pbuf_get_nacks(struct pbuf *playout_buf, std::chrono::high_resolution_clock::time_point const & curr_time,
+                                uint16_t *seqs, int max);
 
 #endif
 
@@ -0,0 +1,104 @@
+/**
+ * @file   rtp/rate_control.cpp
+ * @brief  Loss-driven bitrate control of the video encoder
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cmath>
+
+#include "rtp/rate_control.h"
+
+#define LOSS_DECREASE 0.02
+#define LOSS_INCREASE 0.005
+#define DECREASE_MARGIN 0.9     ///< new bitrate relative to the delivered one
+#define INCREASE_STEP 0.05
+#define INCREASE_STEP_NEAR 0.01 ///< step used close to the bitrate of the last decrease
+#define NEAR_CONGESTED 1.1
+#define MIN_CHANGE 0.03         ///< smaller changes are not propagated to the encoder
+
+using namespace std;
+using namespace std::chrono;
+
+/// reports received sooner still reflect the bitrate before the decrease
+static const steady_clock::duration DECREASE_HOLD = milliseconds(500);
+static const steady_clock::duration INCREASE_HOLD = seconds(2); ///< after a decrease
+static const steady_clock::duration INCREASE_INTERVAL = seconds(1);
+
+rate_control::rate_control(long long max_bitrate, long long min_bitrate) :
+        max_bitrate(max_bitrate), min_bitrate(min(min_bitrate, max_bitrate)),
+        current(max_bitrate), target(max_bitrate)
+{
+}
+
+long long rate_control::update(double loss, steady_clock::time_point now)
+{
+        // loss that appeared after an increase was caused by it, otherwise
+        // loss up to LOSS_DECREASE is tolerated (eg. random loss of the link)
+        if (loss > LOSS_DECREASE || (probing && loss >= LOSS_INCREASE)) {
+                if (now - last_decrease < DECREASE_HOLD) {
+                        return 0;
+                }
+                // the encoder is assumed to meet its bitrate, so the path
+                // delivered current * (1 - loss)
+                target = max<double>(min_bitrate, current * (1.0 - loss) * DECREASE_MARGIN);
+                last_congested = current;
+                last_decrease = now;
+                probing = false;
+        } else if (loss < LOSS_INCREASE) {
+                if (now - last_decrease < INCREASE_HOLD || now - last_increase < INCREASE_INTERVAL) {
+                        return 0;
+                }
+                bool near = current < last_congested * NEAR_CONGESTED;
+                target = min<double>(max_bitrate, target * (1.0 + (near ? INCREASE_STEP_NEAR : INCREASE_STEP)));
+                last_increase = now;
+        } else {
+                return 0;
+        }
+
+        long long bitrate = llround(target);
+        if (bitrate == current || (fabs(target - current) < current * MIN_CHANGE &&
+                                bitrate != max_bitrate && bitrate != min_bitrate)) {
+                return 0;
+        }
+        probing = bitrate > current;
+        current = bitrate;
+        return current;
+}
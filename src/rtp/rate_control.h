@@ -0,0 +1,74 @@
+/**
+ * @file   rtp/rate_control.h
+ * @brief  Loss-driven bitrate control of the video encoder
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RATE_CONTROL_H_
+#define RATE_CONTROL_H_
+
+#ifdef __cplusplus
+#include <chrono>
+
+/**
+ * Computes the encoder bitrate from the fraction of packets lost on the path
+ * as reported by the receiver (see rtp_get_loss()). The bitrate is lowered
+ * to slightly less than the throughput delivered when the loss exceeds
+ * LOSS_DECREASE (or LOSS_INCREASE just after an increase) and probed upwards
+ * when it is below LOSS_INCREASE. Other loss between the two thresholds holds
+ * the bitrate, which together with the hold times, smaller steps near the
+ * last congested bitrate and the minimal propagated change prevents
+ * oscillation.
+ */
+struct rate_control {
+        rate_control(long long max_bitrate, long long min_bitrate);
+        /**
+         * @param loss fraction of lost packets since the previous report
+         * @returns    new bitrate to be set to the encoder, 0 if unchanged
+         */
+        long long update(double loss, std::chrono::steady_clock::time_point now);
+
+private:
+        long long max_bitrate;
+        long long min_bitrate;
+        long long current;              ///< bitrate set to the encoder
+        double target;                  ///< may differ from current by less than MIN_CHANGE
+        long long last_congested = 0;   ///< bitrate of the last decrease
+        bool probing = false;           ///< last change was an increase
+        std::chrono::steady_clock::time_point last_decrease;
+        std::chrono::steady_clock::time_point last_increase;
+};
+#endif // __cplusplus
+
+#endif // RATE_CONTROL_H_
@@ -106,6 +106,7 @@ static int des_encrypt(struct rtp *session, unsigned char *data,
                        unsigned int size, unsigned char *initVec);
 static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
                uint8_t *buffer, rtp_packet *packet, int buflen);
+static int send_rtcp_feedback(struct rtp *session, uint8_t *buffer, int len);
 
 #define MAX_DROPOUT    3000
 #define MAX_MISORDER   100
@@ -126,6 +127,9 @@ static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
 #define RTCP_BYE  203
 #define RTCP_APP  204
 #define RTCP_RX   205
+#define RTCP_RTPFB 205          /* RFC 4585 transport layer feedback, shares PT with legacy TFRC RX */
+
+#define RTCP_RTPFB_NACK 1       /* FMT of generic NACK */
 
 typedef struct {
 #ifdef WORDS_BIGENDIAN
@@ -316,6 +320,9 @@ struct rtp {
         rtp_callback callback;
         struct msghdr *mhdr;
         bool mt_recv; /* whether the receiver uses separate thread for receiving */
+        struct rtp_rtx *rtx;    /* retransmission ring, NULL if disabled */
+        struct rtp_stripe *stripe; /* additional paths, NULL if not striped */
+        struct rtp_loss_fb *loss_fb; /* loss reports for rate control, NULL if disabled */
         uint32_t magic;         /* For debugging...  */
 };
 
@@ -1971,6 +1978,291 @@ static void process_rtcp_rr(struct rtp *session, rtcp_t * packet)
         }
 }
 
+/*
+ * Retransmission of lost packets requested by RFC 4585 generic NACKs.
+ *
+ * Sender keeps a copy of the last sent packets in a ring indexed by the
+ * sequence number and sends the packet again (unchanged, ie. with the
+ * original sequence number and SSRC) when it is requested by the receiver
+ * and not older than max_age. Receiver drops duplicates in the playout
+ * buffer.
+ */
+#define RTX_STATS_INTERVAL (5 * 90000)
+
+struct rtx_slot {
+        uint8_t *buf;
+        int len;
+        int alloc_len;
+        uint16_t seq;
+        bool valid;
+        uint32_t sent_ts;       /* get_local_mediatime() at sending */
+};
+
+struct rtp_rtx {
+        pthread_mutex_t lock;   /* NACKs may be processed by other thread than the sending one */
+        struct rtx_slot *slots;
+        int size;
+        uint32_t max_age;       /* in 90 kHz units */
+
+        /* statistics */
+        unsigned long long requested, resent;
+        uint32_t last_stats_ts;
+};
+
+static void rtx_store(struct rtp_rtx *rtx, uint16_t seq, uint8_t *hdr, int hdr_len,
+                char *phdr, int phdr_len, char *data, int data_len)
+{
+        struct rtx_slot *slot = &rtx->slots[seq % rtx->size];
+        int len = hdr_len + phdr_len + data_len;
+
+        pthread_mutex_lock(&rtx->lock);
+        if (slot->alloc_len < len) {
+                free(slot->buf);
+                slot->buf = (uint8_t *) malloc(len);
+                slot->alloc_len = slot->buf ? len : 0;
+        }
+        if (slot->buf == NULL) {
+                slot->valid = false;
+                pthread_mutex_unlock(&rtx->lock);
+                return;
+        }
+        memcpy(slot->buf, hdr, hdr_len);
+        if (phdr_len > 0) {
+                memcpy(slot->buf + hdr_len, phdr, phdr_len);
+        }
+        if (data_len > 0) {
+                memcpy(slot->buf + hdr_len + phdr_len, data, data_len);
+        }
+        slot->len = len;
+        slot->seq = seq;
+        slot->sent_ts = get_local_mediatime();
+        slot->valid = true;
+        pthread_mutex_unlock(&rtx->lock);
+}
+
+/* must be called with rtx->lock held */
+static void rtx_resend(struct rtp *session, uint16_t seq, uint32_t now)
+{
+        struct rtp_rtx *rtx = session->rtx;
+        struct rtx_slot *slot = &rtx->slots[seq % rtx->size];
+
+        rtx->requested += 1;
+        if (!slot->valid || slot->seq != seq || now - slot->sent_ts > rtx->max_age) {
+                return;
+        }
+        if (udp_send(session->rtp_socket, (char *) slot->buf, slot->len) > 0) {
+                rtx->resent += 1;
+        }
+}
+
+static void process_rtcp_nack(struct rtp *session, rtcp_t * packet)
+{
+        struct rtp_rtx *rtx = session->rtx;
+        uint32_t *words = (uint32_t *) packet;
+        int len = ntohs(packet->common.length);
+        uint32_t now;
+
+        /* sender SSRC, media SSRC and at least one FCI */
+        if (rtx == NULL || len < 3 || ntohl(words[2]) != session->my_ssrc) {
+                return;
+        }
+
+        now = get_local_mediatime();
+        pthread_mutex_lock(&rtx->lock);
+        for (int i = 3; i <= len; ++i) {
+                uint32_t fci = ntohl(words[i]);
+                uint16_t pid = fci >> 16;
+                uint16_t blp = fci & 0xffff;
+
+                rtx_resend(session, pid, now);
+                for (int bit = 0; bit < 16; ++bit) {
+                        if (blp & (1 << bit)) {
+                                rtx_resend(session, pid + bit + 1, now);
+                        }
+                }
+        }
+        if (now - rtx->last_stats_ts > RTX_STATS_INTERVAL) {
+                log_msg(LOG_LEVEL_INFO, "[RTP] Retransmission: %llu packets requested, %llu resent.\n",
+                                rtx->requested, rtx->resent);
+                rtx->requested = rtx->resent = 0;
+                rtx->last_stats_ts = now;
+        }
+        pthread_mutex_unlock(&rtx->lock);
+}
+
+/*
+ * Multipath striping
+ *
+ * Packets of the session (single SSRC and sequence number space) are spread
+ * over several paths, each with its own socket. Sender picks the path of
+ * every packet by smooth weighted round-robin. Receiver counts packets
+ * received on each path and reports the counts periodically in an RTCP APP
+ * packet. Sender then scales weight of a path by the fraction of packets
+ * it delivered (ie. to the throughput it achieved) and slowly increases the
+ * weights of paths without loss to probe for more capacity.
+ */
+#define RTP_MAX_PATHS 8
+#define STRIPE_REPORT_INTERVAL (90000 / 10)
+#define STRIPE_STATS_INTERVAL (5 * 90000)
+#define STRIPE_MIN_WEIGHT 0.02
+#define STRIPE_PROBE_WEIGHT 0.05        /* added to paths without loss on each report */
+#define STRIPE_MAX_LOSS 0.02            /* tolerated without lowering the weight */
+#define STRIPE_MIN_SAMPLE 20            /* packets sent over a path to evaluate the report */
+
+static const uint8_t stripe_app_name[4] = { 'U', 'G', 'S', 'P' };
+
+struct rtp_path {
+        socket_udp *socket;     /* path 0 is the rtp_socket of the session */
+        double weight;          /* weights of all paths sum to 1 */
+        double credit;
+        uint32_t sent;
+        uint32_t sent_reported; /* value of sent when last report was received */
+        uint32_t received_reported;
+        double delivered;       /* fraction of packets delivered according to last report */
+};
+
+struct rtp_stripe {
+        pthread_mutex_t lock;   /* reports may be processed by other thread than the sending one */
+        int count;
+        struct rtp_path paths[RTP_MAX_PATHS];
+        uint32_t last_report_ts;
+        uint32_t last_stats_ts;
+};
+
+static socket_udp *stripe_next_socket(struct rtp_stripe *stripe)
+{
+        int best = 0;
+
+        pthread_mutex_lock(&stripe->lock);
+        for (int i = 0; i < stripe->count; ++i) {
+                stripe->paths[i].credit += stripe->paths[i].weight;
+                if (stripe->paths[i].credit > stripe->paths[best].credit) {
+                        best = i;
+                }
+        }
+        stripe->paths[best].credit -= 1.0;
+        stripe->paths[best].sent += 1;
+        pthread_mutex_unlock(&stripe->lock);
+
+        return stripe->paths[best].socket;
+}
+
+static void process_rtcp_stripe(struct rtp *session, rtcp_t * packet)
+{
+        struct rtp_stripe *stripe = session->stripe;
+        int count = ntohs(packet->common.length) - 2;
+        double sum = 0.0;
+        uint32_t now;
+
+        if (stripe == NULL || count != stripe->count) {
+                return;
+        }
+
+        pthread_mutex_lock(&stripe->lock);
+        for (int i = 0; i < count; ++i) {
+                struct rtp_path *p = &stripe->paths[i];
+                uint32_t received;
+                memcpy(&received, packet->r.app.data + 4 * i, sizeof received);
+                received = ntohl(received);
+                uint32_t sent = p->sent - p->sent_reported;
+                if (sent >= STRIPE_MIN_SAMPLE) {
+                        p->delivered = (double) (uint32_t) (received - p->received_reported) / sent;
+                        if (p->delivered > 1.0) { // in flight during previous report
+                                p->delivered = 1.0;
+                        }
+                        if (p->delivered < 1.0 - STRIPE_MAX_LOSS) {
+                                p->weight *= p->delivered;
+                        } else {
+                                p->weight += STRIPE_PROBE_WEIGHT;
+                        }
+                        p->sent_reported = p->sent;
+                        p->received_reported = received;
+                }
+                if (p->weight < STRIPE_MIN_WEIGHT) {
+                        p->weight = STRIPE_MIN_WEIGHT;
+                }
+                sum += p->weight;
+        }
+        for (int i = 0; i < count; ++i) {
+                stripe->paths[i].weight /= sum;
+        }
+
+        now = get_local_mediatime();
+        if (now - stripe->last_stats_ts > STRIPE_STATS_INTERVAL) {
+                char buf[RTP_MAX_PATHS * 40] = "";
+                for (int i = 0; i < count; ++i) {
+                        snprintf(buf + strlen(buf), sizeof buf - strlen(buf), " %d: %.1f %% (delivered %.1f %%)",
+                                        i, stripe->paths[i].weight * 100.0, stripe->paths[i].delivered * 100.0);
+                }
+                log_msg(LOG_LEVEL_INFO, "[RTP] Striping shares -%s\n", buf);
+                stripe->last_stats_ts = now;
+        }
+        pthread_mutex_unlock(&stripe->lock);
+}
+
+/*
+ * Loss reports
+ *
+ * RTCP receiver reports are sent at most once in 5 seconds, which is too
+ * seldom to drive the rate control of the sender. Therefore, the receiver
+ * reports extended highest sequence number and count of packets received
+ * from each sender in an RTCP APP packet every LOSS_REPORT_INTERVAL. Sender
+ * computes the fraction of packets lost between two consecutive reports.
+ */
+#define LOSS_REPORT_INTERVAL (90000 / 10)
+#define LOSS_REPORT_MAX_SOURCES 8
+#define LOSS_MIN_SAMPLE 20              /* packets expected to evaluate the report */
+
+static const uint8_t loss_app_name[4] = { 'U', 'G', 'L', 'R' };
+
+struct rtp_loss_fb {
+        pthread_mutex_t lock;   /* reports may be processed by other thread than the sending one */
+        uint32_t last_report_ts;        /* receiver */
+        int have_prior;                 /* sender - values of the previous evaluated report */
+        uint32_t expected_prior;
+        uint32_t received_prior;
+        double loss;
+        int fresh;                      /* loss not yet read by rtp_get_loss() */
+};
+
+static void process_rtcp_loss(struct rtp *session, rtcp_t * packet)
+{
+        struct rtp_loss_fb *fb = session->loss_fb;
+        int words = ntohs(packet->common.length) - 2;
+
+        if (fb == NULL) {
+                return;
+        }
+
+        for (int i = 0; i + 3 <= words; i += 3) {
+                uint32_t block[3];
+                memcpy(block, packet->r.app.data + 4 * i, sizeof block);
+                if (ntohl(block[0]) != session->my_ssrc) {
+                        continue;
+                }
+                uint32_t expected = ntohl(block[1]);
+                uint32_t received = ntohl(block[2]);
+
+                pthread_mutex_lock(&fb->lock);
+                uint32_t expected_interval = expected - fb->expected_prior;
+                if (!fb->have_prior || (int32_t) expected_interval < 0) { // first report or receiver restarted
+                        fb->have_prior = TRUE;
+                        fb->expected_prior = expected;
+                        fb->received_prior = received;
+                } else if (expected_interval >= LOSS_MIN_SAMPLE) {
+                        uint32_t received_interval = received - fb->received_prior;
+                        // received may include duplicates (eg. retransmissions)
+                        fb->loss = received_interval >= expected_interval ? 0.0 :
+                                1.0 - (double) received_interval / expected_interval;
+                        fb->fresh = TRUE;
+                        fb->expected_prior = expected;
+                        fb->received_prior = received;
+                }
+                pthread_mutex_unlock(&fb->lock);
+                return;
+        }
+}
+
 static void process_rtcp_rx(struct rtp *session, rtcp_t * packet)
 {
         uint32_t ssrc;
@@ -2184,6 +2476,10 @@ static void rtp_process_ctrl(struct rtp *session, uint8_t * buffer, int buflen)
                                         process_rtcp_rr(session, packet);
                                         break;
                                 case RTCP_RX:
+                                        if (!session->tfrc_on && packet->common.count == RTCP_RTPFB_NACK) {
+                                                process_rtcp_nack(session, packet);
+                                                break;
+                                        }
                                         /* am not sending up a RX_RTCP_START... */
                                         process_rtcp_rx(session, packet);
                                         if (session->tfrc_on) {
@@ -2236,6 +2532,14 @@ static void rtp_process_ctrl(struct rtp *session, uint8_t * buffer, int buflen)
                                         process_rtcp_bye(session, packet);
                                         break;
                                 case RTCP_APP:
+                                        if (memcmp(packet->r.app.name, stripe_app_name, 4) == 0) {
+                                                process_rtcp_stripe(session, packet);
+                                                break;
+                                        }
+                                        if (memcmp(packet->r.app.name, loss_app_name, 4) == 0) {
+                                                process_rtcp_loss(session, packet);
+                                                break;
+                                        }
                                         if (first
                                             && !filter_event(session,
                                                              ntohl(packet->r.
@@ -2894,7 +3198,13 @@ rtp_send_data_hdr(struct rtp *session,
                                          buffer_len, initVec);
         }
 
-        rc = udp_sendv(session->rtp_socket, send_vector, send_vector_len, d);
+        if (session->rtx) {
+                rtx_store(session->rtx, session->rtp_seq - 1, buffer + RTP_PACKET_HEADER_SIZE, buffer_len,
+                                phdr, phdr != NULL ? phdr_len : 0, data, data_len);
+        }
+
+        rc = udp_sendv(session->stripe ? stripe_next_socket(session->stripe) : session->rtp_socket,
+                        send_vector, send_vector_len, d);
         if (rc == -1) {
                 perror("sending RTP packet");
         }
@@ -3679,6 +3989,28 @@ void rtp_done(struct rtp *session)
          }
          */
 
+        if (session->rtx) {
+                for (i = 0; i < session->rtx->size; i++) {
+                        free(session->rtx->slots[i].buf);
+                }
+                free(session->rtx->slots);
+                pthread_mutex_destroy(&session->rtx->lock);
+                free(session->rtx);
+        }
+
+        if (session->stripe) {
+                for (i = 1; i < session->stripe->count; i++) {
+                        udp_exit(session->stripe->paths[i].socket);
+                }
+                pthread_mutex_destroy(&session->stripe->lock);
+                free(session->stripe);
+        }
+
+        if (session->loss_fb) {
+                pthread_mutex_destroy(&session->loss_fb->lock);
+                free(session->loss_fb);
+        }
+
         udp_exit(session->rtp_socket);
         udp_exit(session->rtcp_socket);
         free(session->opt);
@@ -3924,7 +4256,11 @@ static int rijndael_decrypt(struct rtp *session, unsigned char *data,
  */
 int rtp_set_recv_buf(struct rtp *session, int bufsize)
 {
-        return udp_set_recv_buf(session->rtp_socket, bufsize);
+        int ret = udp_set_recv_buf(session->rtp_socket, bufsize);
+        for (int i = 1; session->stripe && i < session->stripe->count; ++i) {
+                ret = udp_set_recv_buf(session->stripe->paths[i].socket, bufsize) && ret;
+        }
+        return ret;
 }
 
 /**
@@ -3937,7 +4273,11 @@ int rtp_set_recv_buf(struct rtp *session, int bufsize)
  */
 int rtp_set_send_buf(struct rtp *session, int bufsize)
 {
-        return udp_set_send_buf(session->rtp_socket, bufsize);
+        int ret = udp_set_send_buf(session->rtp_socket, bufsize);
+        for (int i = 1; session->stripe && i < session->stripe->count; ++i) {
+                ret = udp_set_send_buf(session->stripe->paths[i].socket, bufsize) && ret;
+        }
+        return ret;
 }
 
 /**
@@ -4005,11 +4345,330 @@ bool rtp_is_ipv6(struct rtp *session)
 void rtp_async_start(struct rtp *session, int nr_packets)
 {
        udp_async_start(session->rtp_socket, nr_packets);
+       for (int i = 1; session->stripe && i < session->stripe->count; ++i) {
+               udp_async_start(session->stripe->paths[i].socket, nr_packets);
+       }
+}
+
+/*
+ * When striped, every path is paced on its own - a path carrying share w
+ * of the packets gets them with interval interval_ns / w.
+ */
+bool rtp_async_start_paced(struct rtp *session, int nr_packets, uint64_t interval_ns)
+{
+        if (session->stripe == NULL) {
+                return udp_async_start_paced(session->rtp_socket, nr_packets, interval_ns);
+        }
+
+        struct rtp_stripe *stripe = session->stripe;
+        double weights[RTP_MAX_PATHS];
+        pthread_mutex_lock(&stripe->lock);
+        for (int i = 0; i < stripe->count; ++i) {
+                weights[i] = stripe->paths[i].weight;
+        }
+        pthread_mutex_unlock(&stripe->lock);
+        for (int i = 0; i < stripe->count; ++i) {
+                if (!udp_async_start_paced(stripe->paths[i].socket, nr_packets, interval_ns / weights[i])) {
+                        for (int j = 0; j < i; ++j) { // flush already started paths
+                                udp_async_wait(stripe->paths[j].socket);
+                        }
+                        return false;
+                }
+        }
+        return true;
+}
+
+/**
+ * Adds a path to the session, over which sent packets are striped (the
+ * session itself is the first path). On the receiving side, packets
+ * received on all paths are processed as if received by the session.
+ */
+bool rtp_add_path(struct rtp *session, const char *addr, const char *iface,
+                uint16_t rx_port, uint16_t tx_port, int ttl, bool use_ipv6)
+{
+        struct rtp_stripe *stripe = session->stripe;
+        socket_udp *s;
+
+        if (!session->mt_recv) {
+                log_msg(LOG_LEVEL_ERROR, "[RTP] Paths can be added only to a session with multithreaded receiving.\n");
+                return false;
+        }
+        if (stripe == NULL) {
+                stripe = (struct rtp_stripe *) calloc(1, sizeof(struct rtp_stripe));
+                if (stripe == NULL) {
+                        return false;
+                }
+                pthread_mutex_init(&stripe->lock, NULL);
+                stripe->count = 1;
+                stripe->paths[0].socket = session->rtp_socket;
+                stripe->last_report_ts = stripe->last_stats_ts = get_local_mediatime();
+                session->stripe = stripe;
+        }
+        if (stripe->count == RTP_MAX_PATHS) {
+                log_msg(LOG_LEVEL_ERROR, "[RTP] Maximum of %d paths supported.\n", RTP_MAX_PATHS);
+                return false;
+        }
+        s = udp_init_path(session->rtp_socket, addr, iface, rx_port, tx_port, ttl, use_ipv6);
+        if (s == NULL) {
+                return false;
+        }
+
+        pthread_mutex_lock(&stripe->lock);
+        stripe->paths[stripe->count++].socket = s;
+        for (int i = 0; i < stripe->count; ++i) {
+                stripe->paths[i].weight = 1.0 / stripe->count;
+                stripe->paths[i].credit = 0.0;
+                stripe->paths[i].delivered = 1.0;
+        }
+        pthread_mutex_unlock(&stripe->lock);
+        return true;
+}
+
+/**
+ * Sends the counts of packets received over individual paths to the sender.
+ * Does nothing if called sooner than STRIPE_REPORT_INTERVAL after the last
+ * report.
+ */
+void rtp_send_path_report(struct rtp *session)
+{
+        struct rtp_stripe *stripe = session->stripe;
+        uint8_t buffer[RTP_MAX_PACKET_LEN];
+        rtcp_t *rr = (rtcp_t *) buffer;
+        rtcp_t *app = (rtcp_t *) (buffer + 8);
+        uint32_t now;
+
+        if (stripe == NULL || session->encryption_enabled) {
+                return;
+        }
+        now = get_local_mediatime();
+        if (now - stripe->last_report_ts < STRIPE_REPORT_INTERVAL) {
+                return;
+        }
+        stripe->last_report_ts = now;
+
+        rr->common.version = 2;
+        rr->common.p = 0;
+        rr->common.count = 0;
+        rr->common.pt = RTCP_RR;
+        rr->common.length = htons(1);
+        rr->r.rr.ssrc = htonl(session->my_ssrc);
+
+        app->common.version = 2;
+        app->common.p = 0;
+        app->common.count = 0;
+        app->common.pt = RTCP_APP;
+        app->common.length = htons(2 + stripe->count);
+        app->r.app.ssrc = htonl(session->my_ssrc);
+        memcpy(app->r.app.name, stripe_app_name, 4);
+        for (int i = 0; i < stripe->count; ++i) {
+                uint32_t received = htonl((uint32_t) udp_get_rx_packets(stripe->paths[i].socket));
+                memcpy(app->r.app.data + 4 * i, &received, sizeof received);
+        }
+
+        if (send_rtcp_feedback(session, buffer, 8 + 12 + 4 * stripe->count) == -1) {
+                perror("sending RTCP path report");
+        }
+}
+
+bool rtp_enable_loss_reports(struct rtp *session)
+{
+        struct rtp_loss_fb *fb;
+
+        assert(session->loss_fb == NULL);
+        fb = (struct rtp_loss_fb *) calloc(1, sizeof(struct rtp_loss_fb));
+        if (fb == NULL) {
+                return false;
+        }
+        pthread_mutex_init(&fb->lock, NULL);
+        fb->last_report_ts = get_local_mediatime();
+        session->loss_fb = fb;
+        return true;
+}
+
+/**
+ * Sends extended highest sequence numbers and counts of received packets of
+ * the senders to them. Does nothing if called sooner than
+ * LOSS_REPORT_INTERVAL after the last report.
+ */
+void rtp_send_loss_report(struct rtp *session)
+{
+        struct rtp_loss_fb *fb = session->loss_fb;
+        uint8_t buffer[RTP_MAX_PACKET_LEN];
+        rtcp_t *rr = (rtcp_t *) buffer;
+        rtcp_t *app = (rtcp_t *) (buffer + 8);
+        uint32_t now;
+        int count = 0;
+        source *s;
+
+        if (fb == NULL || session->encryption_enabled) {
+                return;
+        }
+        now = get_local_mediatime();
+        if (now - fb->last_report_ts < LOSS_REPORT_INTERVAL) {
+                return;
+        }
+        fb->last_report_ts = now;
+
+        for (int h = 0; h < RTP_DB_SIZE && count < LOSS_REPORT_MAX_SOURCES; h++) {
+                for (s = session->db[h]; s != NULL && count < LOSS_REPORT_MAX_SOURCES; s = s->next) {
+                        if (s->received == 0) { // own SSRC is received over loopback
+                                continue;
+                        }
+                        uint32_t block[3] = { htonl(s->ssrc), htonl(s->cycles + s->max_seq),
+                                htonl((uint32_t) s->received) };
+                        memcpy(app->r.app.data + 12 * count, block, sizeof block);
+                        count += 1;
+                }
+        }
+        if (count == 0) {
+                return;
+        }
+
+        rr->common.version = 2;
+        rr->common.p = 0;
+        rr->common.count = 0;
+        rr->common.pt = RTCP_RR;
+        rr->common.length = htons(1);
+        rr->r.rr.ssrc = htonl(session->my_ssrc);
+
+        app->common.version = 2;
+        app->common.p = 0;
+        app->common.count = 0;
+        app->common.pt = RTCP_APP;
+        app->common.length = htons(2 + 3 * count);
+        app->r.app.ssrc = htonl(session->my_ssrc);
+        memcpy(app->r.app.name, loss_app_name, 4);
+
+        if (send_rtcp_feedback(session, buffer, 8 + 12 + 12 * count) == -1) {
+                perror("sending RTCP loss report");
+        }
+}
+
+/**
+ * Returns the fraction of lost packets computed from the last loss report.
+ *
+ * @retval false no new report was received since the last call
+ */
+bool rtp_get_loss(struct rtp *session, double *loss)
+{
+        struct rtp_loss_fb *fb = session->loss_fb;
+        bool ret = false;
+
+        if (fb == NULL) {
+                return false;
+        }
+        pthread_mutex_lock(&fb->lock);
+        if (fb->fresh) {
+                *loss = fb->loss;
+                fb->fresh = FALSE;
+                ret = true;
+        }
+        pthread_mutex_unlock(&fb->lock);
+        return ret;
+}
+
+bool rtp_enable_retransmission(struct rtp *session, int ring_size, int max_age_ms)
+{
+        struct rtp_rtx *rtx;
+
+        assert(session->rtx == NULL && ring_size > 0);
+        rtx = (struct rtp_rtx *) calloc(1, sizeof(struct rtp_rtx));
+        if (rtx == NULL) {
+                return false;
+        }
+        rtx->slots = (struct rtx_slot *) calloc(ring_size, sizeof(struct rtx_slot));
+        if (rtx->slots == NULL) {
+                free(rtx);
+                return false;
+        }
+        rtx->size = ring_size;
+        rtx->max_age = max_age_ms * 90;
+        rtx->last_stats_ts = get_local_mediatime();
+        pthread_mutex_init(&rtx->lock, NULL);
+        session->rtx = rtx;
+        return true;
+}
+
+/*
+ * Sends receiver feedback (compound RTCP packet) to the sender.
+ * Returns 0 if the destination is not known yet.
+ */
+static int send_rtcp_feedback(struct rtp *session, uint8_t *buffer, int len)
+{
+        if (!session->send_rtcp_to_origin) {
+                return udp_send(session->rtcp_socket, (char *) buffer, len);
+        }
+        if (session->rtcp_dest_len > 0) {
+                return udp_sendto(session->rtcp_socket, (char *) buffer, len,
+                                (struct sockaddr *) &session->rtcp_dest, session->rtcp_dest_len);
+        }
+        return 0;
+}
+
+int rtp_send_nack(struct rtp *session, uint32_t media_ssrc, const uint16_t *seqs, int count)
+{
+        /* Compound packet consisting of an empty RR followed by RTPFB generic NACK */
+        uint8_t buffer[RTP_MAX_PACKET_LEN];
+        rtcp_t *rr = (rtcp_t *) buffer;
+        rtcp_t *fb = (rtcp_t *) (buffer + 8);
+        uint32_t *fci = (uint32_t *) fb + 3;
+        int max_fci = (RTP_MAX_PACKET_LEN - 8 - 12) / 4;
+        int nfci = 0;
+        uint16_t pid = 0;
+        uint16_t blp = 0;
+        int sent = 0;
+        int rc;
+
+        if (count <= 0 || session->encryption_enabled) {
+                return 0;
+        }
+
+        rr->common.version = 2;
+        rr->common.p = 0;
+        rr->common.count = 0;
+        rr->common.pt = RTCP_RR;
+        rr->common.length = htons(1);
+        rr->r.rr.ssrc = htonl(session->my_ssrc);
+
+        fb->common.version = 2;
+        fb->common.p = 0;
+        fb->common.count = RTCP_RTPFB_NACK;
+        fb->common.pt = RTCP_RTPFB;
+        ((uint32_t *) fb)[1] = htonl(session->my_ssrc);
+        ((uint32_t *) fb)[2] = htonl(media_ssrc);
+
+        /* each FCI holds a PID and a bitmask of following 16 lost packets */
+        for (int i = 0; i < count; ++i) {
+                uint16_t offset = seqs[i] - pid - 1;
+                if (nfci > 0 && offset < 16) {
+                        blp |= 1 << offset;
+                        fci[nfci - 1] = htonl((uint32_t) pid << 16 | blp);
+                        sent = i + 1;
+                        continue;
+                }
+                if (nfci == max_fci) {
+                        break;
+                }
+                pid = seqs[i];
+                blp = 0;
+                fci[nfci++] = htonl((uint32_t) pid << 16);
+                sent = i + 1;
+        }
+        fb->common.length = htons(2 + nfci);
+
+        rc = send_rtcp_feedback(session, buffer, 8 + 12 + 4 * nfci);
+        if (rc == -1) {
+                perror("sending RTCP NACK");
+        }
+        return rc > 0 ? sent : 0;
 }
 
 void rtp_async_wait(struct rtp *session)
 {
        udp_async_wait(session->rtp_socket);
+       for (int i = 1; session->stripe && i < session->stripe->count; ++i) {
+               udp_async_wait(session->stripe->paths[i].socket);
+       }
 }
 
 struct socket_udp_local *rtp_get_udp_local_socket(struct rtp *session)
@@ -301,12 +301,62 @@ bool             rtp_is_ipv6(struct rtp *session);
  * be altered up to rtp_async_wait() call, which waits upon completition of async operations
  * started after rtp_async_start(). Caller is responsible that rtp_send_data_hdr() is not called
  * more than nr_packet times.
+ *
+ * rtp_async_start_paced() is an alternative to rtp_async_start() where packets
+ * are stamped with departure times interval_ns apart and handed over to the
+ * kernel at once in rtp_async_wait(). Returns false if not supported (Linux
+ * SO_TXTIME only), rtp_async_start() should be used then.
  */
 void             rtp_async_start(struct rtp *session, int nr_packets);
+bool             rtp_async_start_paced(struct rtp *session, int nr_packets, uint64_t interval_ns);
 void             rtp_async_wait(struct rtp *session);
 
 struct socket_udp_local *rtp_get_udp_local_socket(struct rtp *session);
 
+/*
+ * Retransmission (RFC 4585 generic NACK)
+ *
+ * rtp_enable_retransmission() makes the sender keep last ring_size sent
+ * packets. Packets requested by a NACK are sent again if they are not older
+ * than max_age_ms.
+ *
+ * rtp_send_nack() requests retransmission of packets with sequence numbers
+ * seqs (preferably in ascending order) from media_ssrc. Returns number of
+ * sequence numbers that fit into the packet. Not supported with RTP-level
+ * encryption.
+ */
+bool             rtp_enable_retransmission(struct rtp *session, int ring_size, int max_age_ms);
+int              rtp_send_nack(struct rtp *session, uint32_t media_ssrc, const uint16_t *seqs, int count);
+
+/*
+ * Multipath striping
+ *
+ * rtp_add_path() adds a path (socket with its own address and ports) to the
+ * session. Sent packets are then spread over the session socket and all
+ * added paths, weighted by the throughput the paths deliver. Received
+ * packets of all paths are processed together, which requires multithreaded
+ * receiving - rtp_add_path() fails otherwise. Both sides must add the same
+ * number of paths.
+ *
+ * rtp_send_path_report() is called periodically by the receiver to report
+ * packets received per path to the sender (rate limited internally).
+ */
+bool             rtp_add_path(struct rtp *session, const char *addr, const char *iface,
+                              uint16_t rx_port, uint16_t tx_port, int ttl, bool use_ipv6);
+void             rtp_send_path_report(struct rtp *session);
+
+/*
+ * Loss reports (sender rate control)
+ *
+ * After rtp_enable_loss_reports(), receiver calls rtp_send_loss_report()
+ * periodically (rate limited internally) and sender polls the fraction of
+ * lost packets with rtp_get_loss(), which returns false if no new report
+ * arrived since the last call. Not supported with RTP-level encryption.
+ */
+bool             rtp_enable_loss_reports(struct rtp *session);
+void             rtp_send_loss_report(struct rtp *session);
+bool             rtp_get_loss(struct rtp *session, double *loss);
+
 #ifdef __cplusplus
 }
 #endif
@@ -54,187 +54,264 @@
 #include "utils/bs.h"
 #include "video_frame.h"
 
+#define SPS_CACHE_SIZE 4
+#define MIN_BUFFER_SIZE (64 * 1024)
+
 static const uint8_t start_sequence[] = { 0, 0, 0, 1 };
 
-int fill_coded_frame_from_sps(struct video_frame *rx_data, unsigned char *data, int data_len);
+struct sps_cache_entry {
+    uint32_t hash;
+    int len;
+    int width;
+    int height;
+};
 
-int decode_frame_h264(struct coded_data *cdata, void *decode_data) {
-    rtp_packet *pckt = NULL;
-    struct coded_data *orig = cdata;
+struct rtpdec_h264_state {
+    unsigned char *buf;         ///< pooled output buffer
+    int buf_size;
+    double avg_len;             ///< running average of assembled frame size
+    int out_len;
 
-    uint8_t nal;
-    uint8_t type;
-    uint8_t nri;
+    struct sps_cache_entry sps_cache[SPS_CACHE_SIZE];
+    int sps_cache_next;
+};
 
-    int pass;
-    int total_length = 0;
+static int sps_dimensions(const unsigned char *data, int data_len, int *width_out, int *height_out);
 
-    unsigned char *dst = NULL;
-    int src_len;
+struct rtpdec_h264_state *rtpdec_h264_init(void)
+{
+    return (struct rtpdec_h264_state *) calloc(1, sizeof(struct rtpdec_h264_state));
+}
 
-    struct decode_data_h264 *data = (struct decode_data_h264 *) decode_data;
-    struct video_frame *frame = data->frame;
-    frame->frame_type = BFRAME;
+void rtpdec_h264_done(struct rtpdec_h264_state *state)
+{
+    if (!state) {
+        return;
+    }
+    free(state->buf);
+    free(state);
+}
+
+static void ensure_buffer(struct rtpdec_h264_state *state, int size)
+{
+    if (size <= state->buf_size) {
+        return;
+    }
+    int new_size = state->buf_size * 2;
+    if (new_size < size) {
+        new_size = size;
+    }
+    state->buf = (unsigned char *) realloc(state->buf, new_size);
+    state->buf_size = new_size;
+}
 
-    for (pass = 0; pass < 2; pass++) {
+static void append(struct rtpdec_h264_state *state, const uint8_t *data, int len)
+{
+    ensure_buffer(state, state->out_len + len);
+    memcpy(state->buf + state->out_len, data, len);
+    state->out_len += len;
+}
+
+static uint32_t hash_fnv1a(const uint8_t *data, int len)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < len; ++i) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
 
-        if (pass > 0) {
-            cdata = orig;
-            if(frame->frame_type == INTRA){
-                total_length+=data->offset_len;
-            }
-            frame->tiles[0].data_len = total_length;
-            dst = (unsigned char *) frame->tiles[0].data + total_length;
+/**
+ * Updates frame dimensions from SPS. Parsed SPS are cached by their content
+ * hash because the SPS is usually repeated before every IDR frame.
+ */
+static void update_from_sps(struct rtpdec_h264_state *state, struct video_frame *frame,
+        const uint8_t *data, int len)
+{
+    uint32_t hash = hash_fnv1a(data, len);
+    struct sps_cache_entry *entry = NULL;
+
+    for (int i = 0; i < SPS_CACHE_SIZE; ++i) {
+        if (state->sps_cache[i].len == len && state->sps_cache[i].hash == hash) {
+            entry = &state->sps_cache[i];
+            break;
         }
+    }
 
-        while (cdata != NULL) {
-            pckt = cdata->data;
+    if (!entry) {
+        int width = 0, height = 0;
+        if (sps_dimensions(data, len, &width, &height) != 0) {
+            return;
+        }
+        entry = &state->sps_cache[state->sps_cache_next];
+        state->sps_cache_next = (state->sps_cache_next + 1) % SPS_CACHE_SIZE;
+        entry->hash = hash;
+        entry->len = len;
+        entry->width = width;
+        entry->height = height;
+    }
 
-            if (pckt->pt != PT_H264) {
-                error_msg("Wrong Payload type: %u\n", pckt->pt);
-                return FALSE;
-            }
+    if ((unsigned) entry->width != frame->tiles[0].width || (unsigned) entry->height != frame->tiles[0].height) {
+        vf_get_tile(frame, 0)->width = entry->width;
+        vf_get_tile(frame, 0)->height = entry->height;
+    }
+}
 
-            nal = (uint8_t) pckt->data[0];
-            type = nal & 0x1f;
-            nri = nal & 0x60;
+static void update_frame_type(struct video_frame *frame, uint8_t nal_header, uint8_t type)
+{
+    if (frame->frame_type != INTRA && (type == 5 || type == 6)) {
+        frame->frame_type = INTRA;
+    } else if (frame->frame_type == BFRAME && (nal_header & 0x60) != 0) {
+        frame->frame_type = OTHER;
+    }
+}
 
-            if (type == 7){
-                fill_coded_frame_from_sps(frame, (unsigned char*) pckt->data, pckt->data_len);
-            }
+/**
+ * Appends one complete NAL unit (prefixed with start code)
+ */
+static void append_nal(struct rtpdec_h264_state *state, struct video_frame *frame,
+        const uint8_t *nal, int len)
+{
+    uint8_t type = nal[0] & 0x1f;
 
-            if (type >= 1 && type <= 23) {
-                if(frame->frame_type != INTRA && (type == 5 || type == 6)) {
-                    frame->frame_type = INTRA;
-                } else if (frame->frame_type == BFRAME && nri != 0){
-                    frame->frame_type = OTHER;
-                }
+    if (type == 7) {
+        update_from_sps(state, frame, nal, len);
+    }
+    if (type >= 1 && type <= 23) {
+        update_frame_type(frame, nal[0], type);
+    }
+    append(state, start_sequence, sizeof(start_sequence));
+    append(state, nal, len);
+}
 
-                type = 1;
-            }
-
-            const uint8_t *src = NULL;
-
-            switch (type) {
-                case 0:
-                case 1:
-                    if (pass == 0) {
-                        debug_msg("NAL type 1\n");
-                        total_length += sizeof(start_sequence) + pckt->data_len;
-                    } else {
-                        dst -= pckt->data_len + sizeof(start_sequence);
-                        memcpy(dst, start_sequence, sizeof(start_sequence));
-                        memcpy(dst + sizeof(start_sequence), pckt->data, pckt->data_len);
-                    }
-                    break;
-                case 24:
-                    src = (const uint8_t *) pckt->data;
-                    src_len = pckt->data_len;
-
-                    src++;
-                    src_len--;
-
-                    while (src_len > 2) {
-                        //TODO: Not properly tested
-                        //TODO: bframes and iframes detection
-                        uint16_t nal_size;
-                        memcpy(&nal_size, src, sizeof(uint16_t));
-
-                        src += 2;
-                        src_len -= 2;
-
-                        if (nal_size <= src_len) {
-                            if (pass == 0) {
-                                total_length += sizeof(start_sequence) + nal_size;
-                            } else {
-                                dst -= nal_size + sizeof(start_sequence);
-                                memcpy(dst, start_sequence, sizeof(start_sequence));
-                                memcpy(dst + sizeof(start_sequence), src, nal_size);
-                            }
-                        } else {
-                            error_msg("NAL size exceeds length: %u %d\n", nal_size, src_len);
-                            return FALSE;
-                        }
-                        src += nal_size;
-                        src_len -= nal_size;
-
-                        if (src_len < 0) {
-                            error_msg("Consumed more bytes than we got! (%d)\n", src_len);
-                            return FALSE;
-                        }
-                    }
-                    break;
+static bool unpack_stap_a(struct rtpdec_h264_state *state, struct video_frame *frame,
+        const uint8_t *src, int src_len)
+{
+    // skip the STAP-A NAL header
+    src++;
+    src_len--;
+
+    while (src_len > 2) {
+        uint16_t nal_size = src[0] << 8 | src[1];
+
+        src += 2;
+        src_len -= 2;
+
+        if (nal_size > src_len) {
+            error_msg("NAL size exceeds length: %u %d\n", nal_size, src_len);
+            return false;
+        }
+        if (nal_size > 0) {
+            append_nal(state, frame, src, nal_size);
+        }
+
+        src += nal_size;
+        src_len -= nal_size;
+    }
+
+    return true;
+}
+
+int decode_frame_h264(struct coded_data *cdata, void *decode_data) {
+    struct decode_data_h264 *data = (struct decode_data_h264 *) decode_data;
+    struct rtpdec_h264_state *state = data->state;
+    struct video_frame *frame = data->frame;
+    frame->frame_type = BFRAME;
+
+    // Packets are stored in descending sequence number order - walk from the
+    // tail so that the output is assembled in a single forward pass.
+    while (cdata != NULL && cdata->nxt != NULL) {
+        cdata = cdata->nxt;
+    }
+
+    // Room for out-of-band parameter sets is reserved at the beginning, it
+    // is used only if the frame turns out to be an intra frame.
+    int offset_len = data->offset_len;
+    state->out_len = offset_len;
+    int expected = state->avg_len * 3 / 2;
+    ensure_buffer(state, offset_len + (expected > MIN_BUFFER_SIZE ? expected : MIN_BUFFER_SIZE));
+
+    for ( ; cdata != NULL; cdata = cdata->prv) {
+        rtp_packet *pckt = cdata->data;
+        const uint8_t *src = (const uint8_t *) pckt->data;
+        int src_len = pckt->data_len;
+
+        if (pckt->pt != PT_H264) {
+            error_msg("Wrong Payload type: %u\n", pckt->pt);
+            return FALSE;
+        }
+        if (src_len < 1) {
+            continue;
+        }
 
-                case 25:
-                case 26:
-                case 27:
-                case 29:
-                    error_msg("Unhandled NAL type\n");
+        uint8_t nal = src[0];
+        uint8_t type = nal & 0x1f;
+
+        switch (type) {
+            case 0:
+                append(state, start_sequence, sizeof(start_sequence));
+                append(state, src, src_len);
+                break;
+            case 24:
+                if (!unpack_stap_a(state, frame, src, src_len)) {
                     return FALSE;
-                case 28:
-                    src = (const uint8_t *) pckt->data;
-                    src_len = pckt->data_len;
-
-                    src++;
-                    src_len--;
-
-                    if (src_len > 1) {
-                        uint8_t fu_header = *src;
-                        uint8_t start_bit = fu_header >> 7;
-                        //uint8_t end_bit       = (fu_header & 0x40) >> 6;
-                        uint8_t nal_type = fu_header & 0x1f;
-                        uint8_t reconstructed_nal;
-
-                        if(frame->frame_type != INTRA && (nal_type == 5 || nal_type == 6)){
-                            frame->frame_type = INTRA;
-                        } else if (frame->frame_type == BFRAME && nri != 0){
-                            frame->frame_type = OTHER;
-                        }
+                }
+                break;
+            case 25:
+            case 26:
+            case 27:
+            case 29:
+                error_msg("Unhandled NAL type\n");
+                return FALSE;
+            case 28:
+                if (src_len > 2) {
+                    uint8_t fu_header = src[1];
+                    uint8_t start_bit = fu_header >> 7;
+                    uint8_t nal_type = fu_header & 0x1f;
 
+                    update_frame_type(frame, nal, nal_type);
+
+                    if (start_bit) {
                         // Reconstruct this packet's true nal; only the data follows.
                         /* The original nal forbidden bit and NRI are stored in this
                          * packet's nal. */
-                        reconstructed_nal = nal & 0xe0;
-                        reconstructed_nal |= nal_type;
-
-                        // skip the fu_header
-                        src++;
-                        src_len--;
-
-                        if (pass == 0) {
-                            if (start_bit) {
-                                total_length += sizeof(start_sequence) + sizeof(reconstructed_nal) + src_len;
-                            } else {
-                                total_length += src_len;
-                            }
-                        } else {
-                            if (start_bit) {
-                                dst -= sizeof(start_sequence) + sizeof(reconstructed_nal) + src_len;
-                                memcpy(dst, start_sequence, sizeof(start_sequence));
-                                memcpy(dst + sizeof(start_sequence), &reconstructed_nal, sizeof(reconstructed_nal));
-                                memcpy(dst + sizeof(start_sequence) + sizeof(reconstructed_nal), src, src_len);
-                            } else {
-                                dst -= src_len;
-                                memcpy(dst, src, src_len);
-                            }
-                        }
-                    } else {
-                        error_msg("Too short data for FU-A H264 RTP packet\n");
-                        return FALSE;
+                        uint8_t reconstructed_nal = (nal & 0xe0) | nal_type;
+                        append(state, start_sequence, sizeof(start_sequence));
+                        append(state, &reconstructed_nal, 1);
                     }
-                    break;
-                default:
-                    error_msg("Unknown NAL type\n");
+                    // skip the FU indicator and FU header
+                    append(state, src + 2, src_len - 2);
+                } else {
+                    error_msg("Too short data for FU-A H264 RTP packet\n");
                     return FALSE;
-            }
-            cdata = cdata->nxt;
+                }
+                break;
+            default:
+                if (type <= 23) {
+                    append_nal(state, frame, src, src_len);
+                    break;
+                }
+                error_msg("Unknown NAL type\n");
+                return FALSE;
         }
     }
 
+    int len = state->out_len - offset_len;
+    state->avg_len = state->avg_len == 0.0 ? len : 0.9 * state->avg_len + 0.1 * len;
+
+    if (frame->frame_type == INTRA) {
+        len += offset_len;
+    }
+    frame->tiles[0].data_len = len;
+    frame->tiles[0].data = (char *) state->buf + state->out_len - len;
+
     return TRUE;
 }
 
-int fill_coded_frame_from_sps(struct video_frame *rx_data, unsigned char *data, int data_len){
+/**
+ * Parses frame dimensions from SPS NAL unit
+ */
+static int sps_dimensions(const unsigned char *data, int data_len, int *width_out, int *height_out){
     uint32_t width, height;
     sps_t* sps = (sps_t*)malloc(sizeof(sps_t));
     uint8_t* rbsp_buf = (uint8_t*)malloc(data_len);
@@ -259,12 +336,8 @@ int fill_coded_frame_from_sps(struct video_frame *rx_data, unsigned char *data,
         height -= (sps->frame_crop_top_offset*2 + sps->frame_crop_bottom_offset*2);
     }
 
-    if((width != rx_data->tiles[0].width) || (height != rx_data->tiles[0].height)) {
-        vf_get_tile(rx_data, 0)->width = width;
-        vf_get_tile(rx_data, 0)->height = height;
-//        free(rx_data->tiles[0].data);
-//        rx_data->tiles[0].data = calloc(1, rx_data->h264_width * rx_data->h264_height);
-    }
+    *width_out = width;
+    *height_out = height;
 
     bs_free(b);
     free(rbsp_buf);
@@ -274,33 +347,14 @@ int fill_coded_frame_from_sps(struct video_frame *rx_data, unsigned char *data,
 }
 
 int width_height_from_SDP(int *widthOut, int *heightOut , unsigned char *data, int data_len){
-    uint32_t width, height;
-    sps_t* sps = (sps_t*)malloc(sizeof(sps_t));
-    uint8_t* rbsp_buf = (uint8_t*)malloc(data_len);
-    if (nal_to_rbsp(data, &data_len, rbsp_buf, &data_len) < 0){
-        free(rbsp_buf);
-        free(sps);
-        return -1;
-    }
-    bs_t* b = bs_new(rbsp_buf, data_len);
-    if(read_seq_parameter_set_rbsp(sps,b) < 0){
-        bs_free(b);
-        free(rbsp_buf);
-        free(sps);
+    int width, height;
+
+    if (sps_dimensions(data, data_len, &width, &height) != 0) {
         return -1;
     }
-    width = (sps->pic_width_in_mbs_minus1 + 1) * 16;
-    height = (2 - sps->frame_mbs_only_flag) * (sps->pic_height_in_map_units_minus1 + 1) * 16;
-    //NOTE: frame_mbs_only_flag = 1 --> only progressive frames
-    //      frame_mbs_only_flag = 0 --> some type of interlacing (there are 3 types contemplated in the standard)
-    if (sps->frame_cropping_flag){
-        width -= (sps->frame_crop_left_offset*2 + sps->frame_crop_right_offset*2);
-        height -= (sps->frame_crop_top_offset*2 + sps->frame_crop_bottom_offset*2);
-    }
 
     debug_msg("\n\n[width_height_from_SDP] width: %d   height: %d\n\n",width,height);
 
-
     if(width > 0){
         *widthOut = width;
     }
@@ -308,9 +362,5 @@ int width_height_from_SDP(int *widthOut, int *heightOut , unsigned char *data, i
         *heightOut = height;
     }
 
-    bs_free(b);
-    free(rbsp_buf);
-    free(sps);
-
     return 0;
 }
@@ -49,12 +49,22 @@ extern "C" {
 #endif
 
 struct video_frame;
+struct rtpdec_h264_state;
 
 struct decode_data_h264 {
         struct video_frame *frame;
-        int offset_len;
+        int offset_len;                  ///< space reserved for out-of-band SPS/PPS in intra frames
+        struct rtpdec_h264_state *state;
 };
 
+struct rtpdec_h264_state *rtpdec_h264_init(void);
+void rtpdec_h264_done(struct rtpdec_h264_state *state);
+
+/**
+ * Depacketizes H.264 frame to Annex-B byte stream in a single forward pass.
+ * Tile data is set to point to internal buffer that remains valid until next
+ * call.
+ */
 int decode_frame_h264(struct coded_data *cdata, void *decode_data);
 int width_height_from_SDP(int *widthOut, int *heightOut , unsigned char *data, int data_len);
 
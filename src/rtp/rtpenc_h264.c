@@ -44,152 +44,126 @@
 #include "config.h"
 #include "config_unix.h"
 #endif // HAVE_CONFIG_H
-#include "debug.h"
-#include "perf.h"
-#include "transmit.h"
-#include "module.h"
-#include "tv.h"
-#include "rtp/rtp.h"
-#include "rtp/rtp_callback.h"
-#include "rtp/pbuf.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "rtp/rtpenc_h264.h"
-#include "video.h"
-#include "video_codec.h"
-#include "compat/platform_spin.h"
-#include "video_frame.h"
-
-//UTILS DECLARATIONS
-uint32_t test4Bytes(struct rtpenc_h264_state *rtpench264state);
-unsigned char* startOfFrame(struct rtpenc_h264_state *rtpench264state);
-unsigned char* nextToParse(struct rtpenc_h264_state *rtpench264state);
-void checkEndOfFrame(struct rtpenc_h264_state *rtpench264state,
-		unsigned numBytesNeeded);
-uint8_t get1Byte(struct rtpenc_h264_state *rtpench264state);
-void setFromState(struct rtpenc_h264_state *rtpench264state);
-void setToState(struct rtpenc_h264_state *rtpench264state);
-void skipBytes(struct rtpenc_h264_state *rtpench264state, unsigned numBytes);
-bool haveSeenEOF(struct rtpenc_h264_state *rtpench264state); //EndOfFrame
-unsigned curNALSize(struct rtpenc_h264_state *rtpench264state);
 
-struct rtpenc_h264_state * rtpenc_h264_init_state() {
-	struct rtpenc_h264_state *rtpench264state;
+#define STAP_A_TYPE 24
 
-	rtpench264state = calloc(1, sizeof(struct rtpenc_h264_state));
-	rtpench264state->curParserIndex = 0;
-	rtpench264state->curParserIndexOffset = 0;
-	rtpench264state->haveSeenFirstStartCode = false;
-	rtpench264state->inputFrameSize = 0;
-	rtpench264state->haveSeenEOF = false;
+struct rtpenc_h264_state * rtpenc_h264_init_state() {
+	return calloc(1, sizeof(struct rtpenc_h264_state));
+}
 
-	return rtpench264state;
+void rtpenc_h264_destroy_state(struct rtpenc_h264_state *rtpench264state) {
+	if (!rtpench264state) {
+		return;
+	}
+	free(rtpench264state->nals);
+	free(rtpench264state->stap_a);
+	free(rtpench264state);
 }
 
-unsigned rtpenc_h264_frame_parse(struct rtpenc_h264_state *rtpench264state,	uint8_t *buf_in, int size) {
-
-	uint32_t next4Bytes = 0l;
-
-	if (!rtpench264state->haveSeenFirstStartCode) {
-		//reset pointers and params of interest for this new frame to parse and send
-		rtpench264state->startOfFrame = rtpench264state->from = rtpench264state->to = buf_in;
-		rtpench264state->curParserIndex = 0;
-		rtpench264state->inputFrameSize = size;
-		rtpench264state->curParserIndexOffset = 0;
-		// The frame must start with a 0x00000001:
-		// Skip over any input bytes that precede the first 0x00000001 and assert it
-		while (test4Bytes(rtpench264state) != 0x00000001) {
-			get1Byte(rtpench264state);
-			if(haveSeenEOF(rtpench264state)){
-				error_msg("No NAL found!\n");
-				return 0; //this shouldn't happen -> this would mean that we got new frame but no start code was found inside....
-			}
-		}
-		skipBytes(rtpench264state, 4); // skip this initial code
-		setFromState(rtpench264state); //set 'from' pointer of curr input frame
-		rtpench264state->haveSeenFirstStartCode = true;
-
-	} else {
-		//CONTINUE WITH THE SAME FRAME
-		// Assert: next4Bytes starts with 0x00000001 or 0x000001, and we've saved and sent all previous bytes (forming a complete NAL unit).
-		// Skip over these remaining bytes
-		if (test4Bytes(rtpench264state) == 0x00000001) {
-			skipBytes(rtpench264state, 4);
-		} else {
-			skipBytes(rtpench264state, 3);
+/**
+ * Returns pointer to the first 0x000001 sequence in [p, end) or end if there
+ * is none.
+ *
+ * Byte 0x01 is rare in coded data so we let (vectorized) memchr find it and
+ * check the preceding bytes afterwards. This is faster than hand-written SSE2
+ * comparison of all three bytes.
+ */
+static const uint8_t *find_start_code(const uint8_t *p, const uint8_t *end) {
+	while (end - p >= 3) {
+		const uint8_t *one = memchr(p + 2, 1, end - p - 2);
+		if (!one) {
+			break;
 		}
-		if(haveSeenEOF(rtpench264state)){
-			error_msg("No NAL found!\n");
-			return 0; //this shouldn't happen -> this would mean that we got more to parse but we run out of space....
+		if (one[-1] == 0 && one[-2] == 0) {
+			return one - 2;
 		}
+		p = one - 1;
+	}
+	return end;
+}
 
-		setFromState(rtpench264state); //re-set 'from' pointer of current input data
+static void add_nal(struct rtpenc_h264_state *rtpench264state, const uint8_t *data, unsigned size) {
+	if (rtpench264state->nal_count == rtpench264state->nals_allocated) {
+		rtpench264state->nals_allocated = rtpench264state->nals_allocated ? rtpench264state->nals_allocated * 2 : 16;
+		rtpench264state->nals = realloc(rtpench264state->nals,
+				rtpench264state->nals_allocated * sizeof(struct rtpenc_h264_nal));
 	}
+	rtpench264state->nals[rtpench264state->nal_count].data = data;
+	rtpench264state->nals[rtpench264state->nal_count].size = size;
+	rtpench264state->nal_count += 1;
+}
 
-	// Then save everything up until the next 0x00000001 (4 bytes) or 0x000001 (3 bytes), or we hit EOF.
-	// Also make note of the first byte, because it contains the "nal_unit_type":
-	next4Bytes = test4Bytes(rtpench264state);
-	rtpench264state->firstByteOfNALUnit = next4Bytes >> 24;
-
-	while (next4Bytes != 0x00000001 && (next4Bytes & 0xFFFFFF00) != 0x00000100 && !haveSeenEOF(rtpench264state)) {
-		// We save at least some of "next4Bytes".
-		if ((unsigned) (next4Bytes & 0xFF) > 1) {
-			// Common case: 0x00000001 or 0x000001 definitely doesn't begin anywhere in "next4Bytes", so we save all of it:
-			skipBytes(rtpench264state, 4);
-		} else {
-			// Save the first byte, and continue testing the rest:
-			skipBytes(rtpench264state, 1);
+unsigned rtpenc_h264_frame_parse(struct rtpenc_h264_state *rtpench264state, const uint8_t *buf_in, int size) {
+	const uint8_t *end = buf_in + size;
+	const uint8_t *nal = find_start_code(buf_in, end);
+
+	rtpench264state->nal_count = 0;
+
+	while (nal != end) {
+		nal += 3; // skip start code
+		const uint8_t *next = find_start_code(nal, end);
+		const uint8_t *nal_end = next;
+		// leading zero of a 4-byte start code doesn't belong to the NAL unit
+		if (next != end && nal_end > nal && nal_end[-1] == 0) {
+			nal_end--;
 		}
-		next4Bytes = test4Bytes(rtpench264state);
+		if (nal_end > nal) {
+			add_nal(rtpench264state, nal, nal_end - nal);
+		}
+		nal = next;
 	}
-	setToState(rtpench264state);
 
-	return curNALSize(rtpench264state);
+	return rtpench264state->nal_count;
 }
 
-//UTILS
-uint32_t test4Bytes(struct rtpenc_h264_state *rtpench264state) {
-	checkEndOfFrame(rtpench264state, 4);
+unsigned rtpenc_h264_stap_a_count(const struct rtpenc_h264_state *rtpench264state, unsigned first, unsigned max_size) {
+	unsigned len = 1; // STAP-A NAL header
+	unsigned count = 0;
 
-	unsigned char const* ptr = nextToParse(rtpench264state);
-	return (ptr[0] << 24) | (ptr[1] << 16) | (ptr[2] << 8) | ptr[3];
-}
-unsigned char* startOfFrame(struct rtpenc_h264_state *rtpench264state) {
-	return rtpench264state->startOfFrame;
-}
-unsigned char* nextToParse(struct rtpenc_h264_state *rtpench264state) {
-	return &startOfFrame(rtpench264state)[rtpench264state->curParserIndex];
-}
-void checkEndOfFrame(struct rtpenc_h264_state *rtpench264state,
-		unsigned numBytesNeeded) {
-	// assure EOF check
-	if (rtpench264state->curParserIndex + numBytesNeeded
-			>= rtpench264state->inputFrameSize){
-		rtpench264state->haveSeenEOF = true;
+	while (first + count < rtpench264state->nal_count) {
+		len += 2 + rtpench264state->nals[first + count].size;
+		if (len > max_size) {
+			break;
+		}
+		count += 1;
 	}
+
+	return count > 1 ? count : 1;
 }
-uint8_t get1Byte(struct rtpenc_h264_state *rtpench264state) { // byte-aligned
-	checkEndOfFrame(rtpench264state, 1);
-	return startOfFrame(rtpench264state)[rtpench264state->curParserIndex++];
-}
-void setFromState(struct rtpenc_h264_state *rtpench264state) {
-	rtpench264state->from = rtpench264state->startOfFrame
-			+ rtpench264state->curParserIndex;
-	rtpench264state->curParserIndexOffset = rtpench264state->curParserIndex;
-}
-void setToState(struct rtpenc_h264_state *rtpench264state) {
-	if(haveSeenEOF(rtpench264state)) {
-		rtpench264state->to = rtpench264state->startOfFrame + rtpench264state->inputFrameSize;
-	} else {
-		rtpench264state->to = rtpench264state->from
-			+ (rtpench264state->curParserIndex - rtpench264state->curParserIndexOffset);
+
+const uint8_t *rtpenc_h264_stap_a(struct rtpenc_h264_state *rtpench264state, unsigned first, unsigned count, unsigned *len) {
+	unsigned total = 1;
+	for (unsigned i = first; i < first + count; ++i) {
+		total += 2 + rtpench264state->nals[i].size;
 	}
-}
-void skipBytes(struct rtpenc_h264_state *rtpench264state, unsigned numBytes) {
-	checkEndOfFrame(rtpench264state, numBytes);
-	rtpench264state->curParserIndex += numBytes;
-}
-bool haveSeenEOF(struct rtpenc_h264_state *rtpench264state) {
-	return rtpench264state->haveSeenEOF;
-}
-unsigned curNALSize(struct rtpenc_h264_state *rtpench264state) {
-	return (rtpench264state->to - rtpench264state->from);
+	if (total > rtpench264state->stap_a_allocated) {
+		rtpench264state->stap_a = realloc(rtpench264state->stap_a, total);
+		rtpench264state->stap_a_allocated = total;
+	}
+
+	uint8_t *out = rtpench264state->stap_a;
+	uint8_t f = 0, nri = 0;
+	*out++ = 0; // filled below
+	for (unsigned i = first; i < first + count; ++i) {
+		const struct rtpenc_h264_nal *nal = &rtpench264state->nals[i];
+		f |= nal->data[0] & 0x80;
+		if ((nal->data[0] & 0x60) > nri) {
+			nri = nal->data[0] & 0x60;
+		}
+		*out++ = nal->size >> 8;
+		*out++ = nal->size & 0xFF;
+		memcpy(out, nal->data, nal->size);
+		out += nal->size;
+	}
+	rtpench264state->stap_a[0] = f | nri | STAP_A_TYPE;
+
+	*len = total;
+	return rtpench264state->stap_a;
 }
@@ -44,29 +44,46 @@
 #ifndef _RTP_ENC_H264_H
 #define _RTP_ENC_H264_H
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define RTPENC_H264_PT 96
 
+struct rtpenc_h264_nal {
+	const uint8_t *data; ///< NAL unit (starting with NAL header) without start code
+	unsigned size;
+};
+
 struct rtpenc_h264_state {
-	bool haveSeenFirstStartCode;
-	uint8_t firstByteOfNALUnit;
-	unsigned char* startOfFrame;
-	unsigned char* to;
-	unsigned char* from;
-	unsigned maxPacketSize;
-	unsigned curNALOffset;
-	bool lastNALUnitFragment;
-	unsigned curParserIndex; // <= inputFrameSize
-	unsigned curParserIndexOffset;
-	unsigned inputFrameSize;
-	bool haveSeenEOF;
+	struct rtpenc_h264_nal *nals; ///< NAL units of the last parsed frame
+	unsigned nal_count;
+	unsigned nals_allocated;
+	uint8_t *stap_a;              ///< buffer for STAP-A packet assembly
+	unsigned stap_a_allocated;
 };
 
 struct rtpenc_h264_state * rtpenc_h264_init_state(void);
-unsigned rtpenc_h264_frame_parse(struct rtpenc_h264_state *rtpench264state, uint8_t *buf_in, int size);
+void rtpenc_h264_destroy_state(struct rtpenc_h264_state *rtpench264state);
+/**
+ * Splits Annex-B byte stream into NAL units in one pass. Data preceding the
+ * first start code are skipped.
+ *
+ * @returns number of NAL units found (stored in rtpench264state->nals)
+ */
+unsigned rtpenc_h264_frame_parse(struct rtpenc_h264_state *rtpench264state, const uint8_t *buf_in, int size);
+/**
+ * @returns number of NAL units starting with index first that fit into one
+ * STAP-A packet of at most max_size bytes, 1 if aggregation is not possible
+ */
+unsigned rtpenc_h264_stap_a_count(const struct rtpenc_h264_state *rtpench264state, unsigned first, unsigned max_size);
+/**
+ * Assembles STAP-A payload of count NAL units starting with index first.
+ * The returned buffer is valid until next call.
+ */
+const uint8_t *rtpenc_h264_stap_a(struct rtpenc_h264_state *rtpench264state, unsigned first, unsigned count, unsigned *len);
 
 #ifdef __cplusplus
 }
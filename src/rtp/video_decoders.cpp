@@ -89,6 +89,8 @@
 #include "rtp/rtp_callback.h"
 #include "rtp/pbuf.h"
 #include "rtp/video_decoders.h"
+#include "utils/mpmc_queue.h"
+#include "utils/pipeline_stats.h"
 #include "utils/synchronized_queue.h"
 #include "utils/timed_message.h"
 #include "video.h"
@@ -243,6 +245,7 @@ struct frame_msg {
         struct reported_statistics_cumul &stats;
         unsigned long long int nanoPerFrameDecompress = 0;
         unsigned long long int nanoPerFrameExpected = 0;
+        uint32_t rtp_ts = 0;
         bool is_displayed = false;
         bool is_corrupted = false;
 };
@@ -301,12 +304,12 @@ struct state_video_decoder
                               * has been processed and we can write to a new one */
         condition_variable buffer_swapped_cv; ///< condition variable associated with @ref buffer_swapped
 
-        synchronized_queue<unique_ptr<frame_msg>, 1> decompress_queue;
+        mpmc_queue<unique_ptr<frame_msg>, 1> decompress_queue;
 
         codec_t           out_codec = VIDEO_CODEC_NONE;
         int               pitch = 0;
 
-        synchronized_queue<unique_ptr<frame_msg>, 1> fec_queue;
+        mpmc_queue<unique_ptr<frame_msg>, 1> fec_queue;
 
         enum video_mode   video_mode = {} ;  ///< video mode set for this decoder
         bool          merged_fb = false; ///< flag if the display device driver requires tiled video or not
@@ -359,6 +362,7 @@ static void *fec_thread(void *args) {
 
                 struct video_frame *frame = decoder->frame;
                 struct tile *tile = NULL;
+                uint64_t cpu_start = pipeline_stats_begin();
 
                 if (data->recv_frame->fec_params.type != FEC_NONE) {
                         if(!fec_state || desc.k != data->recv_frame->fec_params.k ||
@@ -479,9 +483,11 @@ static void *fec_thread(void *args) {
                         }
                 }
 
+                pipeline_stats_end(PIPELINE_STAGE_DECODE, cpu_start);
                 decoder->decompress_queue.push(move(data));
+                continue;
 cleanup:
-                ;
+                pipeline_stats_end(PIPELINE_STAGE_DECODE, cpu_start);
         }
 
         delete fec_state;
@@ -501,6 +507,7 @@ static void *decompress_thread(void *args) {
                 }
 
                 auto t0 = std::chrono::high_resolution_clock::now();
+                uint64_t cpu_start = pipeline_stats_begin();
 
                 if(decoder->decoder_type == EXTERNAL_DECODER) {
                         int tile_width = decoder->received_vid_desc.width; // get_video_mode_tiles_x(decoder->video_mode);
@@ -548,6 +555,7 @@ static void *decompress_thread(void *args) {
                                                         decoder->out_codec), tile->height, &decoder->change_il_state[i]);
                         }
                 }
+                pipeline_stats_end(PIPELINE_STAGE_DECODE, cpu_start);
 
                 {
                         int putf_flags = PUTF_NONBLOCK;
@@ -569,12 +577,18 @@ static void *decompress_thread(void *args) {
                         }
 
                         decoder->frame->ssrc = msg->nofec_frame->ssrc;
+                        cpu_start = pipeline_stats_begin();
                         int ret = display_put_frame(decoder->display,
                                         decoder->frame, putf_flags);
                         if (ret == 0) {
                                 msg->is_displayed = true;
+                                pipeline_stats_latency(msg->rtp_ts);
                         }
                         decoder->frame = display_get_frame(decoder->display);
+                        pipeline_stats_end(PIPELINE_STAGE_DISPLAY, cpu_start);
+                        if (ret == 0) {
+                                pipeline_stats_frame(PIPELINE_STAGE_DISPLAY);
+                        }
                 }
 
 skip_frame:
@@ -1232,7 +1246,9 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
         int prints=0;
         int max_substreams = decoder->max_substreams;
         uint32_t ssrc;
+        uint32_t rtp_ts = 0;
         unsigned int frame_size = 0;
+        size_t received_bytes = 0;
 
         vector<uint32_t> buffer_num(max_substreams);
         // the following is just FEC related optimalization - normally we fill up
@@ -1256,6 +1272,8 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                 return FALSE;
         }
 
+        uint64_t cpu_start = pipeline_stats_begin();
+
 #ifdef RECONFIGURE_IN_FUTURE_THREAD
         // check if we are not in the middle of reconfiguration
         if (decoder->reconfiguration_in_progress) {
@@ -1312,6 +1330,8 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                 buffer_number = tmp & 0x3fffff;
                 buffer_length = ntohl(hdr[2]);
                 ssrc = pckt->ssrc;
+                rtp_ts = pckt->ts;
+                received_bytes += pckt->data_len;
 
                 if (pt == PT_VIDEO_LDGM || pt == PT_ENCRYPT_VIDEO_LDGM || pt == PT_VIDEO_RS) {
                         tmp = ntohl(hdr[3]);
@@ -1559,6 +1579,7 @@ next_packet:
                 fec_msg->pckt_list = std::move(pckt_list);
                 fec_msg->received_pkts_cum = stats->received_pkts_cum;
                 fec_msg->expected_pkts_cum = stats->expected_pkts_cum;
+                fec_msg->rtp_ts = rtp_ts;
 
                 auto t0 = std::chrono::high_resolution_clock::now();
                 decoder->fec_queue.push(move(fec_msg));
@@ -1592,6 +1613,9 @@ cleanup:
         }
         decoder->last_buffer_number = buffer_number;
 
+        pipeline_stats_end(PIPELINE_STAGE_DECODE, cpu_start);
+        pipeline_stats_bytes(PIPELINE_STAGE_RECEIVE, received_bytes);
+
         return ret;
 }
 
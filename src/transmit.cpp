@@ -77,6 +77,7 @@
 #include "rtp/rtpenc_h264.h"
 #include "tv.h"
 #include "transmit.h"
+#include "utils/pipeline_stats.h"
 #include "video.h"
 #include "video_codec.h"
 
@@ -145,6 +146,7 @@ struct tx {
         const struct openssl_encrypt_info *enc_funcs;
         struct openssl_encrypt *encryption;
         long long int bitrate;
+        bool kernel_pacing; ///< pace with SO_TXTIME instead of busy-waiting
 		
 #ifdef HAVE_RTSP_SERVER
         struct rtpenc_h264_state *rtpenc_h264_state;
@@ -194,6 +196,10 @@ static void tx_update(struct tx *tx, struct video_frame *frame, int substream)
         }
 }
 
+ADD_TO_PARAM(tx_pacing, "tx-pacing",
+                "* tx-pacing={shaper|txtime}\n"
+                "  Video packet pacing - busy-waiting shaper (default) or kernel pacing with SO_TXTIME\n"
+                "  (Linux, needs fq or etf qdisc on the interface; not used with encryption)\n");
 struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media_type,
                 const char *fec, const char *encryption, long long int bitrate)
 {
@@ -244,6 +250,14 @@ struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media
                 }
 
                 tx->bitrate = bitrate;
+                const char *pacing = get_commandline_param("tx-pacing");
+                if (pacing && strcmp(pacing, "txtime") == 0) {
+                        tx->kernel_pacing = true;
+                } else if (pacing && strcmp(pacing, "shaper") != 0) {
+                        log_msg(LOG_LEVEL_ERROR, "Unknown pacing: %s\n", pacing);
+                        module_done(&tx->mod);
+                        return NULL;
+                }
 #ifdef HAVE_RTSP_SERVER
                 tx->rtpenc_h264_state = rtpenc_h264_init_state();
 #endif
@@ -348,6 +362,9 @@ static void tx_done(struct module *mod)
 {
         struct tx *tx = (struct tx *) mod->priv_data;
         assert(tx->magic == TRANSMIT_MAGIC);
+#ifdef HAVE_RTSP_SERVER
+        rtpenc_h264_destroy_state(tx->rtpenc_h264_state);
+#endif
         free(tx);
 }
 
@@ -510,6 +527,7 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
         int mult_pos[FEC_MAX_MULT];
         int mult_index = 0;
         int mult_first_sent = 0;
+        size_t bytes_sent = 0;
 
         int hdrs_len = (rtp_is_ipv6(rtp_session) ? 40 : 20) + 8 + 12; // IP hdr size + UDP hdr size + RTP hdr size
         unsigned int fec_symbol_size = frame->fec_params.symbol_size;
@@ -638,8 +656,21 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
         }
         rtp_hdr_packet = (uint32_t *) rtp_headers;
 
+        // encrypted packets are not kept until rtp_async_wait() so they need
+        // to be paced here
+        bool kernel_paced = false;
         if (!tx->encryption) {
-                rtp_async_start(rtp_session, packet_count);
+                if (tx->kernel_pacing) {
+                        kernel_paced = rtp_async_start_paced(rtp_session, packet_count, packet_rate);
+                        if (!kernel_paced) {
+                                log_msg(LOG_LEVEL_WARNING, "Kernel pacing (SO_TXTIME) not available, "
+                                                "falling back to busy-wait shaper.\n");
+                                tx->kernel_pacing = false;
+                        }
+                }
+                if (!kernel_paced) {
+                        rtp_async_start(rtp_session, packet_count);
+                }
         }
 
         do {
@@ -678,6 +709,7 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                         rtp_send_data_hdr(rtp_session, ts, pt, m, 0, 0,
                                   (char *) rtp_hdr_packet, rtp_hdr_len,
                                   data, data_len, 0, 0, 0);
+                        bytes_sent += rtp_hdr_len + data_len;
                 }
 
                 if(tx->fec_scheme == FEC_MULT) {
@@ -694,7 +726,7 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 rtp_hdr_packet += rtp_hdr_len / sizeof(uint32_t);
 
                 // TRAFFIS SHAPER
-                if (pos < (unsigned int) tile->data_len) { // wait for all but last packet
+                if (!kernel_paced && pos < (unsigned int) tile->data_len) { // wait for all but last packet
                         do {
                                 GET_STOPTIME;
                                 GET_DELTA;
@@ -708,6 +740,8 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 rtp_async_wait(rtp_session);
         }
         free(rtp_headers);
+
+        pipeline_stats_bytes(PIPELINE_STAGE_SEND, bytes_sent);
 }
 
 /* 
@@ -981,96 +1015,73 @@ static void tx_send_base_h264(struct tx *tx, struct video_frame *frame,
 	char *extn = 0;
 	uint16_t extn_len = 0;
 	uint16_t extn_type = 0;
-	unsigned nalsize = 0;
-	uint8_t *data = (uint8_t *) tile->data;
-	int data_len = tile->data_len;
-	tx->rtpenc_h264_state->maxPacketSize = tx->mtu - 40;
-	tx->rtpenc_h264_state->haveSeenEOF = false;
-	tx->rtpenc_h264_state->haveSeenFirstStartCode = false;
-
-	while ((nalsize = rtpenc_h264_frame_parse(tx->rtpenc_h264_state, data, data_len)) > 0) {
-
-		tx->rtpenc_h264_state->curNALOffset = 0;
-		tx->rtpenc_h264_state->lastNALUnitFragment = false; // by default
-
-		while(!tx->rtpenc_h264_state->lastNALUnitFragment){
-			// We have NAL unit data in the buffer.  There are three cases to consider:
-			// 1. There is a new NAL unit in the buffer, and it's small enough to deliver
-			//    to the RTP sink (as is).
-			// 2. There is a new NAL unit in the buffer, but it's too large to deliver to
-			//    the RTP sink in its entirety.  Deliver the first fragment of this data,
-			//    as a FU packet, with one extra preceding header byte (for the "FU header").
-			// 3. There is a NAL unit in the buffer, and we've already delivered some
-			//    fragment(s) of this.  Deliver the next fragment of this data,
-			//    as a FU packet, with two (H.264) extra preceding header bytes
-			//    (for the "NAL header" and the "FU header").
-			if (tx->rtpenc_h264_state->curNALOffset == 0) { // case 1 or 2
-				if (nalsize	<= tx->rtpenc_h264_state->maxPacketSize) { // case 1
-
-					if (tx->rtpenc_h264_state->haveSeenEOF) m = 1;
-					if (rtp_send_data(rtp_session, ts, pt, m, cc, &csrc,
-							(char *) tx->rtpenc_h264_state->from, nalsize,
-							extn, extn_len, extn_type) < 0) {
-						error_msg("There was a problem sending the RTP packet\n");
-					}
-					tx->rtpenc_h264_state->lastNALUnitFragment = true;
-				} else { // case 2
-					// We need to send the NAL unit data as FU packets.  Deliver the first
-					// packet now.  Note that we add "NAL header" and "FU header" bytes to the front
-					// of the packet (overwriting the existing "NAL header").
-					hdr[0] = (tx->rtpenc_h264_state->firstByteOfNALUnit & 0xE0) | 28; //FU indicator
-					hdr[1] = 0x80 | (tx->rtpenc_h264_state->firstByteOfNALUnit & 0x1F); // FU header (with S bit)
-
-					if (rtp_send_data_hdr(rtp_session, ts, pt, m, cc, &csrc,
-									(char *) hdr, 2,
-									(char *) tx->rtpenc_h264_state->from + 1, tx->rtpenc_h264_state->maxPacketSize - 2,
-									extn, extn_len, extn_type) < 0) {
-										error_msg("There was a problem sending the RTP packet\n");
-					}
-					tx->rtpenc_h264_state->curNALOffset += tx->rtpenc_h264_state->maxPacketSize - 1;
-					tx->rtpenc_h264_state->lastNALUnitFragment = false;
-					nalsize -= tx->rtpenc_h264_state->maxPacketSize - 1;
-				}
-			} else { // case 3
-				// We are sending this NAL unit data as FU packets.  We've already sent the
-				// first packet (fragment).  Now, send the next fragment.  Note that we add
-				// "NAL header" and "FU header" bytes to the front.  (We reuse these bytes that
-				// we already sent for the first fragment, but clear the S bit, and add the E
-				// bit if this is the last fragment.)
-				hdr[1] = hdr[1] & ~0x80;// FU header (no S bit)
-
-				if (nalsize + 1 > tx->rtpenc_h264_state->maxPacketSize) {
-					// We can't send all of the remaining data this time:
-					if (rtp_send_data_hdr(rtp_session, ts, pt, m, cc, &csrc,
-							(char *) hdr, 2,
-							(char *) tx->rtpenc_h264_state->from + tx->rtpenc_h264_state->curNALOffset,
-							tx->rtpenc_h264_state->maxPacketSize - 2, extn, extn_len,
-							extn_type) < 0) {
-								error_msg("There was a problem sending the RTP packet\n");
-					}
-					tx->rtpenc_h264_state->curNALOffset += tx->rtpenc_h264_state->maxPacketSize - 2;
-					tx->rtpenc_h264_state->lastNALUnitFragment = false;
-					nalsize -= tx->rtpenc_h264_state->maxPacketSize - 2;
-
-				} else {
-					// This is the last fragment:
-					if (tx->rtpenc_h264_state->haveSeenEOF) m = 1;
-
-					hdr[1] |= 0x40;// set the E bit in the FU header
-
-					if (rtp_send_data_hdr(rtp_session, ts, pt, m, cc, &csrc,
-									(char *) hdr, 2,
-									(char *) tx->rtpenc_h264_state->from + tx->rtpenc_h264_state->curNALOffset,
-									nalsize, extn, extn_len, extn_type) < 0) {
-										error_msg("There was a problem sending the RTP packet\n");
-					}
-					tx->rtpenc_h264_state->lastNALUnitFragment = true;
-				}
+	struct rtpenc_h264_state *state = tx->rtpenc_h264_state;
+	unsigned maxPacketSize = tx->mtu - 40;
+
+	unsigned nal_count = rtpenc_h264_frame_parse(state, (uint8_t *) tile->data, tile->data_len);
+	if (nal_count == 0) {
+		error_msg("No NAL found!\n");
+		return;
+	}
+
+	for (unsigned i = 0; i < nal_count; ) {
+		// Small NAL units (parameter sets, SEI) are aggregated to a STAP-A packet.
+		unsigned stap_a_count = rtpenc_h264_stap_a_count(state, i, maxPacketSize);
+		if (stap_a_count > 1) {
+			unsigned len;
+			const uint8_t *stap_a = rtpenc_h264_stap_a(state, i, stap_a_count, &len);
+			i += stap_a_count;
+			m = i == nal_count;
+			if (rtp_send_data(rtp_session, ts, pt, m, cc, &csrc,
+						(char *) stap_a, len,
+						extn, extn_len, extn_type) < 0) {
+				error_msg("There was a problem sending the RTP packet\n");
+			}
+			continue;
+		}
+
+		const uint8_t *nal = state->nals[i].data;
+		unsigned nalsize = state->nals[i].size;
+		i += 1;
+		bool last_nal = i == nal_count;
+
+		if (nalsize <= maxPacketSize) {
+			// The NAL unit is small enough to deliver to the RTP sink (as is).
+			m = last_nal;
+			if (rtp_send_data(rtp_session, ts, pt, m, cc, &csrc,
+						(char *) nal, nalsize,
+						extn, extn_len, extn_type) < 0) {
+				error_msg("There was a problem sending the RTP packet\n");
 			}
+			continue;
 		}
 
-		if (tx->rtpenc_h264_state->haveSeenEOF){
-			return;
+		// The NAL unit is too large - send it as FU-A packets. The "NAL header"
+		// is replaced by "FU indicator" and "FU header" bytes. The S bit is set in
+		// the first fragment and the E bit in the last one.
+		hdr[0] = (nal[0] & 0xE0) | 28; //FU indicator
+		hdr[1] = 0x80 | (nal[0] & 0x1F); // FU header (with S bit)
+		unsigned offset = 1;
+		unsigned remaining = nalsize - 1;
+		while (remaining > 0) {
+			unsigned len = remaining;
+			if (len > maxPacketSize - 2) {
+				len = maxPacketSize - 2;
+			}
+			m = 0;
+			if (len == remaining) {
+				hdr[1] |= 0x40; // set the E bit in the FU header
+				m = last_nal;
+			}
+			if (rtp_send_data_hdr(rtp_session, ts, pt, m, cc, &csrc,
+						(char *) hdr, 2,
+						(char *) nal + offset, len,
+						extn, extn_len, extn_type) < 0) {
+				error_msg("There was a problem sending the RTP packet\n");
+			}
+			hdr[1] &= ~0x80; // FU header (no S bit)
+			offset += len;
+			remaining -= len;
 		}
 	}
 #else
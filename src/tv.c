@@ -51,6 +51,18 @@
 #include "crypto/random.h"
 #include "tv.h"
 
+static int mediatime_wallclock = 0;
+
+/**
+ * Makes get_local_mediatime() return wall-clock time (without random offset)
+ * so that timestamps of processes on the same host are comparable. Intended for
+ * measurements, must be called before first get_local_mediatime() call.
+ */
+void set_local_mediatime_wallclock(void)
+{
+        mediatime_wallclock = 1;
+}
+
 uint32_t get_local_mediatime(void)
 {
         static struct timeval start_time;
@@ -59,6 +71,11 @@ uint32_t get_local_mediatime(void)
 
         struct timeval curr_time;
 
+        if (mediatime_wallclock) {
+                gettimeofday(&curr_time, NULL);
+                return (uint32_t) ((uint64_t) curr_time.tv_sec * 90000 + (uint64_t) curr_time.tv_usec * 9 / 100);
+        }
+
         if (first == 0) {
                 gettimeofday(&start_time, NULL);
                 random_offset = lbl_random();
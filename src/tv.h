@@ -49,6 +49,7 @@ extern "C" {
 #endif
 
 uint32_t get_local_mediatime(void);
+void     set_local_mediatime_wallclock(void);
 double   tv_diff(struct timeval curr_time, struct timeval prev_time);
 uint32_t tv_diff_usec(struct timeval curr_time, struct timeval prev_time);
 void     tv_add(struct timeval *ts, double offset_secs);
@@ -42,12 +42,16 @@
 #endif
 
 #include "audio/types.h"
+#include "audio/utils.h"
 #include "debug.h"
 #include "host.h"
 #include "utils/audio_buffer.h"
 #include "utils/ring_buffer.h"
 
+#include <speex/speex_resampler.h>
+
 #define WINDOW 50
+#define OCCUPANCY_WINDOW 50
 
 #undef max
 #undef min
@@ -55,12 +59,36 @@
 #define min(a, b)      (((a) < (b))? (a): (b))
 
 #define BUF_LAST_UNDERRUN_MAX 1000000000
-#define BUF_LAST_UNDERRUN_THRESHOLD 10000
-#define AGGRESIVITY_MAX 4
-#define AGGRESIVITY_STEP 100
 
-static const int occupacy_windows[3] = { 50, 200 };
+/**
+ * Resampler quality (0-10). Since the ratio is always close to 1, low quality
+ * is sufficient and keeps the resampler delay at about 1 ms.
+ */
+#define RESAMPLER_QUALITY 3
+#define RATIO_DEN 10000        ///< resampling ratio denominator, ratio resolution is 100 ppm
+#define RATIO_UPDATE_MS 100    ///< minimal interval between resampling ratio changes
+#define MAX_DRIFT 0.005        ///< maximal compensated relative rate difference (0.5 %)
+/// @name drift controller gains
+/// Occupancy error is measured in seconds, the loop is critically damped with
+/// time constant of 1/DRIFT_KP seconds.
+/// @{
+#define DRIFT_KP 0.1
+#define DRIFT_KI (DRIFT_KP * DRIFT_KP / 4)
+/// @}
+/// If occupancy exceeds requested latency this many times (eg. after a network
+/// stall), the excess is dropped at once rather than slowly resampled away.
+#define OVERFLOW_FACTOR 4
 
+/**
+ * Audio buffer compensating clock drift between the sender and the local
+ * sound card.
+ *
+ * Instead of dropping samples, the consumer side resamples the stream with
+ * ratio (input rate / output rate) driven by a PI controller that keeps
+ * buffer occupancy at the requested latency. The integral term converges to
+ * the relative difference between producer and consumer rate so the buffer
+ * runs steadily both when the producer is faster and when it is slower.
+ */
 struct audio_buffer {
         struct audio_desc desc;
         ring_buffer_t *ring;
@@ -69,10 +97,22 @@ struct audio_buffer {
         // moving averages
         int in_pkt_size;
         int out_pkt_size;
-        int avg_occupancy[2]; // at read time
+        double avg_occupancy; // at read time, in frames
         int last_underrun; // last underrun n output frames ago
-        int aggresivity;
-        int last_aggresivity_change;
+
+        SpeexResamplerState *resampler;
+        double drift;        ///< integral term - estimated relative rate difference of producer and consumer
+        uint32_t ratio_num;  ///< current resampling ratio numerator (denominator is RATIO_DEN)
+        int since_ratio_update; ///< frames output since last ratio change
+        /// input frames already read from the ring but not yet consumed by the resampler
+        char *staging;
+        int staging_frames;
+        int staging_max_frames;
+        /// float buffers for sample formats other than 16 bit
+        float *float_in;
+        float *float_out;
+        int float_in_samples;
+        int float_out_samples;
 };
 
 struct audio_buffer *audio_buffer_init(int sample_rate, int bps, int ch_count, int suggested_latency_ms)
@@ -88,8 +128,16 @@ struct audio_buffer *audio_buffer_init(int sample_rate, int bps, int ch_count, i
 
         buf->suggested_latency_ms = suggested_latency_ms;
 
-        buf->aggresivity = 1;
-        buf->last_aggresivity_change = AGGRESIVITY_STEP;
+        int err = 0;
+        buf->ratio_num = RATIO_DEN;
+        buf->resampler = speex_resampler_init_frac(ch_count, RATIO_DEN, RATIO_DEN,
+                        sample_rate, sample_rate, RESAMPLER_QUALITY, &err);
+        if (err != RESAMPLER_ERR_SUCCESS) {
+                log_msg(LOG_LEVEL_ERROR, "Audio buffer: cannot initialize resampler: %s\n",
+                                speex_resampler_strerror(err));
+                abort();
+        }
+        speex_resampler_skip_zeros(buf->resampler);
 
         return buf;
 }
@@ -98,11 +146,115 @@ void audio_buffer_destroy(struct audio_buffer *buf)
 {
         if (buf) {
                 ring_buffer_destroy(buf->ring);
+                speex_resampler_destroy(buf->resampler);
+                free(buf->staging);
+                free(buf->float_in);
+                free(buf->float_out);
+                free(buf);
+        }
+}
+
+static void ensure_float_buffers(struct audio_buffer *buf, int in_samples, int out_samples)
+{
+        if (buf->float_in_samples < in_samples) {
+                free(buf->float_in);
+                buf->float_in = malloc(in_samples * sizeof(float));
+                buf->float_in_samples = in_samples;
+        }
+        if (buf->float_out_samples < out_samples) {
+                free(buf->float_out);
+                buf->float_out = malloc(out_samples * sizeof(float));
+                buf->float_out_samples = out_samples;
+        }
+}
+
+/**
+ * Resamples staged frames to out.
+ *
+ * Channels are processed one by one instead of using
+ * speex_resampler_process_interleaved_*() because the bundled version doesn't
+ * restore input length between channels so that the channels may get out of
+ * sync when not all input is consumed (which is our usual case).
+ *
+ * @param[in,out] in_frames  available input frames, consumed frames on return
+ * @param[in,out] out_frames output space in frames, produced frames on return
+ */
+static void resample(struct audio_buffer *buf, char *out, uint32_t *in_frames, uint32_t *out_frames)
+{
+        int ch_count = buf->desc.ch_count;
+        int bps = buf->desc.bps;
+        uint32_t in_len = *in_frames;
+        uint32_t out_len = *out_frames;
+
+        speex_resampler_set_input_stride(buf->resampler, ch_count);
+        speex_resampler_set_output_stride(buf->resampler, ch_count);
+
+        if (bps == 2) {
+                for (int i = 0; i < ch_count; ++i) {
+                        *in_frames = in_len;
+                        *out_frames = out_len;
+                        speex_resampler_process_int(buf->resampler, i,
+                                        (spx_int16_t *)(void *) buf->staging + i, in_frames,
+                                        (spx_int16_t *)(void *) out + i, out_frames);
+                }
+                return;
+        }
+
+        int in_samples = in_len * ch_count;
+        int out_samples = out_len * ch_count;
+        ensure_float_buffers(buf, in_samples, out_samples);
+
+        change_bps((char *) buf->float_in, sizeof(int32_t), buf->staging, bps, in_samples * bps);
+        int2float((char *) buf->float_in, (char *) buf->float_in, in_samples * sizeof(int32_t));
+        for (int i = 0; i < ch_count; ++i) {
+                *in_frames = in_len;
+                *out_frames = out_len;
+                speex_resampler_process_float(buf->resampler, i, buf->float_in + i, in_frames,
+                                buf->float_out + i, out_frames);
+        }
+        out_samples = *out_frames * ch_count;
+        for (int i = 0; i < out_samples; ++i) { // avoid overflow in float2int()
+                buf->float_out[i] = max(min(buf->float_out[i], 1.0f), -1.0f);
+        }
+        float2int((char *) buf->float_out, (char *) buf->float_out, out_samples * sizeof(int32_t));
+        change_bps(out, bps, (char *) buf->float_out, sizeof(int32_t), out_samples * sizeof(int32_t));
+}
+
+/**
+ * Updates resampling ratio according to current buffer occupancy.
+ */
+static void update_ratio(struct audio_buffer *buf, int occupancy_frames, int requested_frames, int out_frames)
+{
+        if (buf->avg_occupancy > 0) {
+                buf->avg_occupancy = (occupancy_frames + buf->avg_occupancy * (OCCUPANCY_WINDOW - 1)) / OCCUPANCY_WINDOW;
+        } else {
+                buf->avg_occupancy = occupancy_frames;
+        }
+
+        double error = (buf->avg_occupancy - requested_frames) / buf->desc.sample_rate;
+        double dt = (double) out_frames / buf->desc.sample_rate;
+
+        buf->drift = max(min(buf->drift + DRIFT_KI * error * dt, MAX_DRIFT), -MAX_DRIFT);
+        double ratio = 1.0 + max(min(buf->drift + DRIFT_KP * error, MAX_DRIFT), -MAX_DRIFT);
+
+        buf->since_ratio_update += out_frames;
+        if (buf->since_ratio_update < buf->desc.sample_rate * RATIO_UPDATE_MS / 1000) {
+                return;
+        }
+
+        uint32_t ratio_num = (uint32_t) (ratio * RATIO_DEN + 0.5);
+        if (ratio_num != buf->ratio_num) {
+                buf->ratio_num = ratio_num;
+                buf->since_ratio_update = 0;
+                speex_resampler_set_rate_frac(buf->resampler, ratio_num, RATIO_DEN,
+                                buf->desc.sample_rate, buf->desc.sample_rate);
         }
 }
 
 int audio_buffer_read(struct audio_buffer *buf, char *out, int max_len)
 {
+        int frame_size = buf->desc.bps * buf->desc.ch_count;
+
         if (buf->out_pkt_size > 0) {
                 buf->out_pkt_size = (max_len + (buf->out_pkt_size * (WINDOW-1))) / WINDOW;
         } else {
@@ -110,16 +262,9 @@ int audio_buffer_read(struct audio_buffer *buf, char *out, int max_len)
         }
 
         int ring_size = ring_get_current_size(buf->ring);
+        int occupancy = ring_size + buf->staging_frames * frame_size;
 
-        for (unsigned int i = 0; i < sizeof buf->avg_occupancy / sizeof buf->avg_occupancy; ++i) {
-                if (buf->avg_occupancy[i] > 0) {
-                        buf->avg_occupancy[i] = (ring_size + (buf->avg_occupancy[i] * (occupacy_windows[i] -1))) / occupacy_windows[i];
-                } else {
-                        buf->avg_occupancy[i] = ring_size;
-                }
-        }
-
-        if (ring_size < max_len) {
+        if (occupancy < max_len) {
                 buf->last_underrun = 0;
         } else {
                 if (buf->last_underrun < BUF_LAST_UNDERRUN_MAX) {
@@ -130,32 +275,43 @@ int audio_buffer_read(struct audio_buffer *buf, char *out, int max_len)
         int suggested_latency_bytes = buf->suggested_latency_ms * buf->desc.bps * buf->desc.ch_count * buf->desc.sample_rate / 1000;
         int requested_latency_bytes = max(suggested_latency_bytes, 2*max(buf->in_pkt_size, buf->out_pkt_size));
 
-        int ret = ring_buffer_read(buf->ring, out, max_len);
-
-        int remaining_bytes = ring_size - ret;
-
-        if (buf->last_aggresivity_change >= AGGRESIVITY_STEP) {
-                buf->last_aggresivity_change = 0;
-                if ((buf->avg_occupancy[0] > buf->avg_occupancy[1] && buf->last_underrun > BUF_LAST_UNDERRUN_THRESHOLD / 10)) {
-                        buf->aggresivity = min(buf->aggresivity + 1, AGGRESIVITY_MAX);
-                } else if (buf->avg_occupancy[0] < buf->avg_occupancy[1] || buf->last_underrun < BUF_LAST_UNDERRUN_THRESHOLD / 100) {
-                        buf->aggresivity = max(buf->aggresivity - 1, 1);
-                }
-        } else {
-                buf->last_aggresivity_change += 1;
+        if (occupancy > OVERFLOW_FACTOR * requested_latency_bytes) {
+                int len_drop = (occupancy - requested_latency_bytes) / frame_size * frame_size;
+                len_drop = min(len_drop, ring_size);
+                char *tmp = malloc(len_drop);
+                ring_buffer_read(buf->ring, tmp, len_drop);
+                free(tmp);
+                log_msg(LOG_LEVEL_VERBOSE, "Audio buffer: dropped %d bytes of excessive data\n", len_drop);
+                ring_size -= len_drop;
+                occupancy -= len_drop;
+                buf->avg_occupancy = (double) occupancy / frame_size;
         }
 
-        if (requested_latency_bytes < remaining_bytes) {
-                int len_drop = (1<<buf->aggresivity) * buf->desc.bps * buf->desc.ch_count;
-                len_drop = min(len_drop, remaining_bytes / 2);
+        uint32_t out_frames = max_len / frame_size;
+        update_ratio(buf, occupancy / frame_size, requested_latency_bytes / frame_size, out_frames);
 
-                char *tmp = alloca(len_drop);
-                ring_buffer_read(buf->ring, tmp, len_drop);
+        // fill staging buffer with (a bit more than) input needed to produce max_len
+        int needed_frames = (int) ((double) out_frames * buf->ratio_num / RATIO_DEN) + 2;
+        if (buf->staging_max_frames < needed_frames) {
+                buf->staging = realloc(buf->staging, needed_frames * frame_size);
+                buf->staging_max_frames = needed_frames;
         }
+        if (buf->staging_frames < needed_frames) {
+                int read_len = ring_buffer_read(buf->ring, buf->staging + buf->staging_frames * frame_size,
+                                min((needed_frames - buf->staging_frames) * frame_size, ring_size / frame_size * frame_size));
+                buf->staging_frames += read_len / frame_size;
+        }
+
+        uint32_t in_frames = buf->staging_frames;
+        resample(buf, out, &in_frames, &out_frames);
+        buf->staging_frames -= in_frames;
+        memmove(buf->staging, buf->staging + in_frames * frame_size, buf->staging_frames * frame_size);
 
-        log_msg(LOG_LEVEL_DEBUG, "buf - in avg %d, out avg %d, occupancy avg %d, last underrun %d, aggresivity %d\n", buf->in_pkt_size, buf->out_pkt_size, buf->avg_occupancy[0], buf->last_underrun, buf->aggresivity);
+        log_msg(LOG_LEVEL_DEBUG, "buf - in avg %d, out avg %d, occupancy avg %g, last underrun %d, ratio %g\n",
+                        buf->in_pkt_size, buf->out_pkt_size, buf->avg_occupancy, buf->last_underrun,
+                        (double) buf->ratio_num / RATIO_DEN);
 
-        return ret;
+        return out_frames * frame_size;
 }
 
 void audio_buffer_write(struct audio_buffer *buf, const char *in, int len)
@@ -168,3 +324,12 @@ void audio_buffer_write(struct audio_buffer *buf, const char *in, int len)
         ring_buffer_write(buf->ring, in, len);
 }
 
+
+/**
+ * @returns current resampling ratio (input rate / output rate), ie. estimated
+ *          producer rate relative to the consumer once the buffer settles
+ */
+double audio_buffer_get_ratio(struct audio_buffer *buf)
+{
+        return (double) buf->ratio_num / RATIO_DEN;
+}
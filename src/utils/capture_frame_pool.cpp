@@ -0,0 +1,181 @@
+/**
+ * @file   utils/capture_frame_pool.cpp
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <string.h>
+
+#include "debug.h"
+#include "utils/capture_frame_pool.h"
+#include "utils/wait_obj.h"
+#include "video.h"
+
+#define MOD_NAME "[capture] "
+#define STATS_INTERVAL_SEC 5
+/// waiting shorter than this is not considered to be blocking (just lock contention)
+#define BLOCKED_THRESHOLD_US 500
+
+using namespace std;
+using namespace std::chrono;
+
+capture_frame_pool::capture_frame_pool(const char *capturer_name, unsigned int max_frames, bool zero_copy) :
+        m_name(capturer_name), m_zero_copy(zero_copy), m_pool(max_frames), m_desc(), m_data_len(0),
+        m_wait_obj(wait_obj_init()), m_waiting_frame(nullptr),
+        m_stats_start(clock::now()), m_blocked(), m_copying(), m_blocked_total(),
+        m_frames(0), m_blocked_frames(0)
+{
+}
+
+capture_frame_pool::~capture_frame_pool()
+{
+        wait_released();
+        print_stats(true);
+        wait_obj_done(m_wait_obj);
+}
+
+void capture_frame_pool::reconfigure(struct video_frame *frame, size_t data_len)
+{
+        m_desc = video_desc_from_frame(frame);
+        m_data_len = data_len;
+        m_pool.reconfigure(m_desc, m_data_len);
+}
+
+shared_ptr<video_frame> capture_frame_pool::get(struct video_frame *grabbed)
+{
+        m_frames += 1;
+
+        if (grabbed->dispose) {
+                return shared_ptr<video_frame>(grabbed, grabbed->dispose);
+        }
+
+        if (m_zero_copy) {
+                wait_obj_reset(m_wait_obj);
+                m_waiting_frame = grabbed;
+                struct wait_obj *wait_obj = m_wait_obj;
+                return shared_ptr<video_frame>(grabbed, [wait_obj](struct video_frame *) {
+                                wait_obj_notify(wait_obj);
+                                });
+        }
+
+        size_t data_len = 0;
+        for (unsigned int i = 0; i < grabbed->tile_count; ++i) {
+                data_len = max<size_t>(data_len, grabbed->tiles[i].data_len);
+        }
+        if (!video_desc_eq(video_desc_from_frame(grabbed), m_desc) || data_len > m_data_len) {
+                reconfigure(grabbed, data_len);
+        }
+
+        auto t0 = clock::now();
+        shared_ptr<video_frame> pooled = m_pool.get_frame();
+        auto t1 = clock::now();
+        if (t1 - t0 > microseconds(BLOCKED_THRESHOLD_US)) {
+                m_blocked += t1 - t0;
+                m_blocked_frames += 1;
+        }
+
+        struct video_frame *out = pooled.get();
+        for (unsigned int i = 0; i < grabbed->tile_count; ++i) {
+                memcpy(out->tiles[i].data, grabbed->tiles[i].data, grabbed->tiles[i].data_len);
+                out->tiles[i].data_len = grabbed->tiles[i].data_len;
+        }
+        char vf_metadata[VF_METADATA_SIZE];
+        vf_store_metadata(grabbed, vf_metadata);
+        vf_restore_metadata(out, vf_metadata);
+        m_copying += clock::now() - t1;
+
+        // the frame is handed over with its own dispose so that downstream (eg. compress)
+        // knows that it may keep it
+        out->dispose_udata = new shared_ptr<video_frame>(pooled);
+        out->dispose = [](struct video_frame *f) { delete static_cast<shared_ptr<video_frame> *>(f->dispose_udata); };
+
+        print_stats(false);
+
+        return shared_ptr<video_frame>(out, out->dispose);
+}
+
+void capture_frame_pool::wait_released()
+{
+        if (!m_waiting_frame) {
+                return;
+        }
+
+        auto t0 = clock::now();
+        wait_obj_wait(m_wait_obj);
+        auto blocked = clock::now() - t0;
+        if (blocked > microseconds(BLOCKED_THRESHOLD_US)) {
+                m_blocked += blocked;
+                m_blocked_frames += 1;
+        }
+        m_waiting_frame->dispose = NULL;
+        m_waiting_frame->dispose_udata = NULL;
+        m_waiting_frame = nullptr;
+
+        print_stats(false);
+}
+
+void capture_frame_pool::print_stats(bool final)
+{
+        auto now = clock::now();
+        auto interval = now - m_stats_start;
+        if (!final && interval < seconds(STATS_INTERVAL_SEC)) {
+                return;
+        }
+
+        m_blocked_total += m_blocked;
+        if (final) {
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "%s: capture was blocked by processing for %.1f s in total.\n",
+                                m_name.c_str(), duration_cast<duration<double>>(m_blocked_total).count());
+                return;
+        }
+
+        double interval_s = duration_cast<duration<double>>(interval).count();
+        log_msg(m_blocked_frames > 0 ? LOG_LEVEL_INFO : LOG_LEVEL_VERBOSE,
+                        MOD_NAME "%s: %d frames, blocked %.1f%% of time (%d frames)%s, copying %.1f%% of time.\n",
+                        m_name.c_str(), m_frames,
+                        100.0 * duration_cast<duration<double>>(m_blocked).count() / interval_s,
+                        m_blocked_frames, m_zero_copy ? " waiting for frame release" : " waiting for free frame",
+                        100.0 * duration_cast<duration<double>>(m_copying).count() / interval_s);
+
+        m_stats_start = now;
+        m_blocked = m_copying = clock::duration();
+        m_frames = m_blocked_frames = 0;
+}
+
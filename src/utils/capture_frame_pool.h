@@ -0,0 +1,103 @@
+/**
+ * @file   utils/capture_frame_pool.h
+ * @brief  Decouples capture from processing of captured frames.
+ *
+ * Many capturers return frames without a dispose callback, i.e. frame data
+ * are valid only until the next grab. This adapter copies such frames to
+ * pooled frames owned by the consumer so that the capture thread may grab
+ * next frame while the previous one is being compressed or sent.
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_CAPTURE_FRAME_POOL_H_
+#define UTILS_CAPTURE_FRAME_POOL_H_
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "utils/video_frame_pool.h"
+
+struct wait_obj;
+
+class capture_frame_pool {
+public:
+        /**
+         * @param capturer_name name used in statistics
+         * @param max_frames    maximal number of frames in flight, capture blocks
+         *                      when reached
+         * @param zero_copy     do not copy frames but block until the frame is
+         *                      released (legacy behavior)
+         */
+        capture_frame_pool(const char *capturer_name, unsigned int max_frames, bool zero_copy);
+        ~capture_frame_pool();
+
+        /**
+         * Returns frame that may outlive next grab. Frames with dispose callback
+         * are passed as they are.
+         *
+         * wait_released() must be called before next grab.
+         */
+        std::shared_ptr<video_frame> get(struct video_frame *grabbed);
+        /**
+         * Waits until the frame returned by get() has been released if it is
+         * still owned by the capturer (only in zero-copy mode).
+         */
+        void wait_released();
+
+private:
+        typedef std::chrono::steady_clock clock;
+
+        void reconfigure(struct video_frame *frame, size_t data_len);
+        void print_stats(bool final);
+
+        std::string m_name;
+        bool m_zero_copy;
+        video_frame_pool<default_data_allocator> m_pool;
+        struct video_desc m_desc;
+        size_t m_data_len;
+
+        struct wait_obj *m_wait_obj;
+        struct video_frame *m_waiting_frame;
+
+        clock::time_point m_stats_start;
+        clock::duration m_blocked;
+        clock::duration m_copying;
+        clock::duration m_blocked_total;
+        int m_frames;
+        int m_blocked_frames;
+};
+
+#endif // UTILS_CAPTURE_FRAME_POOL_H_
+
@@ -0,0 +1,345 @@
+/**
+ * @file   utils/dxt_cpu.cpp
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cassert>
+#include <thread>
+#include <vector>
+
+#include "utils/dxt_cpu.h"
+#include "utils/dxt_cpu_kernel.h"
+#include "utils/worker.h"
+
+/// block rows processed by one task at minimum
+#define MIN_STRIPE_BLOCK_ROWS 8
+
+using namespace std;
+
+namespace {
+
+struct dxt_stripe {
+        enum dxt_cpu_type type;
+        const unsigned char *src;
+        unsigned char *dst;
+        int width;
+        int height;
+        int pitch;
+        codec_t codec;
+        int row_start; ///< first block row
+        int row_end;
+        dxt_cpu_encode_row_t encode_row;
+};
+
+dxt_cpu_encode_row_t select_encoder()
+{
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+        if (dxt_cpu_encode_row_avx2 && __builtin_cpu_supports("avx2")) {
+                return dxt_cpu_encode_row_avx2;
+        }
+#endif
+#ifdef __SSE4_1__
+        return dxt_encoder_impl<dxt_sse4::backend>::encode_row;
+#else
+        return dxt_encoder_impl<dxt_scalar::backend>::encode_row;
+#endif
+}
+
+/**
+ * Copies pixels of one block row to planes (see dxt_cpu_kernel.h), pixels
+ * outside of the image are replaced by the nearest edge pixel.
+ */
+void fill_planes(const struct dxt_stripe *st, int block_row, uint8_t *planes, size_t stride)
+{
+        int blocks = (st->width + 3) / 4;
+        for (int i = 0; i < 4; ++i) {
+                int y = min(block_row * 4 + i, st->height - 1);
+                const unsigned char *line = st->src + (size_t) y * st->pitch;
+                for (int j = 0; j < 4; ++j) {
+                        uint8_t *c0 = planes + ((i * 4 + j) * 3 + 0) * stride;
+                        uint8_t *c1 = c0 + stride;
+                        uint8_t *c2 = c1 + stride;
+                        switch (st->codec) {
+                        case UYVY:
+                                for (int b = 0; b < blocks; ++b) {
+                                        int x = min(b * 4 + j, st->width - 1);
+                                        const unsigned char *pair = line + (x / 2) * 4;
+                                        c0[b] = pair[1 + (x % 2) * 2];
+                                        c1[b] = pair[0];
+                                        c2[b] = pair[2];
+                                }
+                                break;
+                        case RGB:
+                        case RGBA:
+                        {
+                                int bpp = st->codec == RGB ? 3 : 4;
+                                for (int b = 0; b < blocks; ++b) {
+                                        const unsigned char *px = line + min(b * 4 + j, st->width - 1) * bpp;
+                                        c0[b] = px[0];
+                                        c1[b] = px[1];
+                                        c2[b] = px[2];
+                                }
+                                break;
+                        }
+                        default:
+                                abort();
+                        }
+                }
+        }
+}
+
+void *encode_stripe(void *arg)
+{
+        auto st = static_cast<struct dxt_stripe *>(arg);
+        int blocks = (st->width + 3) / 4;
+        size_t stride = (blocks + 7) / 8 * 8; // whole vectors may be loaded
+        size_t block_size = st->type == DXT_CPU_DXT1 ? 8 : 16;
+        vector<uint8_t> planes(stride * 16 * 3);
+
+        for (int row = st->row_start; row < st->row_end; ++row) {
+                fill_planes(st, row, planes.data(), stride);
+                st->encode_row(st->type, st->codec == UYVY, planes.data(), stride, blocks,
+                                st->dst + row * blocks * block_size);
+        }
+
+        return st;
+}
+
+inline uint8_t expand5(unsigned int c) {
+        return (c << 3) | (c >> 2);
+}
+
+inline uint8_t expand6(unsigned int c) {
+        return (c << 2) | (c >> 4);
+}
+
+inline uint8_t clamp_int(int x) {
+        return x < 0 ? 0 : x > 255 ? 255 : x;
+}
+
+/**
+ * Decodes palette and indices of a DXT1 color block.
+ *
+ * @param always_4_colors  color block of DXT5, which doesn't use 3-color mode
+ */
+uint32_t decode_color_palette(const unsigned char *block, bool always_4_colors, uint8_t pal[4][3])
+{
+        unsigned int w0 = block[0] | block[1] << 8;
+        unsigned int w1 = block[2] | block[3] << 8;
+        pal[0][0] = expand5(w0 >> 11);
+        pal[0][1] = expand6((w0 >> 5) & 0x3f);
+        pal[0][2] = expand5(w0 & 0x1f);
+        pal[1][0] = expand5(w1 >> 11);
+        pal[1][1] = expand6((w1 >> 5) & 0x3f);
+        pal[1][2] = expand5(w1 & 0x1f);
+        for (int c = 0; c < 3; ++c) {
+                if (w0 > w1 || always_4_colors) {
+                        pal[2][c] = (2 * pal[0][c] + pal[1][c] + 1) / 3;
+                        pal[3][c] = (pal[0][c] + 2 * pal[1][c] + 1) / 3;
+                } else {
+                        pal[2][c] = (pal[0][c] + pal[1][c] + 1) / 2;
+                        pal[3][c] = 0;
+                }
+        }
+        return block[4] | block[5] << 8 | block[6] << 16 | (uint32_t) block[7] << 24;
+}
+
+void decode_dxt1_block(const unsigned char *block, uint8_t out[16][4])
+{
+        uint8_t pal[4][3];
+        uint32_t indices = decode_color_palette(block, false, pal);
+        for (int i = 0; i < 16; ++i) {
+                const uint8_t *c = pal[(indices >> (2 * i)) & 3];
+                out[i][0] = c[0];
+                out[i][1] = c[1];
+                out[i][2] = c[2];
+                out[i][3] = 255;
+        }
+}
+
+/**
+ * Decodes a YCoCg-DXT5 block to RGBA, Y is stored in the alpha block, Co, Cg
+ * and scale in R, G and B of the color block. Conversion follows
+ * display_dxt5ycocg_fp.glsl (in 16.16 fixed point).
+ */
+void decode_dxt5_ycocg_block(const unsigned char *block, uint8_t out[16][4])
+{
+        unsigned int a0 = block[0];
+        unsigned int a1 = block[1];
+        uint64_t y_indices = 0;
+        for (int i = 0; i < 6; ++i) {
+                y_indices |= (uint64_t) block[2 + i] << (8 * i);
+        }
+        int y_pal[8] = { (int) a0 << 16, (int) a1 << 16 };
+        if (a0 > a1) {
+                for (int i = 2; i < 8; ++i) {
+                        y_pal[i] = (((8 - i) * a0 + (i - 1) * a1 + 3) / 7) << 16;
+                }
+        } else {
+                for (int i = 2; i < 6; ++i) {
+                        y_pal[i] = (((6 - i) * a0 + (i - 1) * a1 + 2) / 5) << 16;
+                }
+                y_pal[6] = 0;
+                y_pal[7] = 255 << 16;
+        }
+
+        uint8_t pal[4][3];
+        uint32_t indices = decode_color_palette(block + 8, true, pal);
+        int diff[4][3]; // RGB minus Y
+        for (int i = 0; i < 4; ++i) {
+                int scale = (8 << 16) / (pal[i][2] + 8); // 1 / (31.875 * B + 1)
+                int co = (pal[i][0] - 128) * scale;
+                int cg = (pal[i][1] - 128) * scale;
+                diff[i][0] = co - cg + (1 << 15);
+                diff[i][1] = cg + (1 << 15);
+                diff[i][2] = -co - cg + (1 << 15);
+        }
+
+        for (int i = 0; i < 16; ++i) {
+                int y = y_pal[(y_indices >> (3 * i)) & 7];
+                const int *d = diff[(indices >> (2 * i)) & 3];
+                out[i][0] = clamp_int((y + d[0]) >> 16);
+                out[i][1] = clamp_int((y + d[1]) >> 16);
+                out[i][2] = clamp_int((y + d[2]) >> 16);
+                out[i][3] = 255;
+        }
+}
+
+/// fixed point (16.16) coefficient of RGB->YUV conversion in rgba_to_yuv422.glsl
+constexpr int yuv_coef(double coef) {
+        return coef * 65536.0 + (coef < 0 ? -0.5 : 0.5);
+}
+
+/// writes two RGB pixels as UYVY as rgba_to_yuv422.glsl
+void rgb_to_uyvy(const uint8_t *p1, const uint8_t *p2, unsigned char *dst)
+{
+        int r = p1[0] + p2[0], g = p1[1] + p2[1], b = p1[2] + p2[2];
+        // chroma is averaged, hence the halved coefficients applied to sums
+        dst[0] = clamp_int((yuv_coef(127.5 + 0.5) + r * yuv_coef(-0.1145 * 0.8784 / 2)
+                                + g * yuv_coef(-0.3854 * 0.8784 / 2) + b * yuv_coef(0.5 * 0.8784 / 2)) >> 16);
+        dst[2] = clamp_int((yuv_coef(127.5 + 0.5) + r * yuv_coef(0.5 * 0.8784 / 2)
+                                + g * yuv_coef(-0.4541 * 0.8784 / 2) + b * yuv_coef(-0.0458 * 0.8784 / 2)) >> 16);
+        dst[1] = clamp_int((yuv_coef(255.0 / 16 + 0.5) + p1[0] * yuv_coef(0.2126 * 0.8588)
+                                + p1[1] * yuv_coef(0.7152 * 0.8588) + p1[2] * yuv_coef(0.0722 * 0.8588)) >> 16);
+        dst[3] = clamp_int((yuv_coef(255.0 / 16 + 0.5) + p2[0] * yuv_coef(0.2126 * 0.8588)
+                                + p2[1] * yuv_coef(0.7152 * 0.8588) + p2[2] * yuv_coef(0.0722 * 0.8588)) >> 16);
+}
+
+void *decode_stripe(void *arg)
+{
+        auto st = static_cast<struct dxt_stripe *>(arg);
+        int blocks = (st->width + 3) / 4;
+        size_t block_size = st->type == DXT_CPU_DXT1 ? 8 : 16;
+        // one block row of RGBA, UYVY is converted from it
+        vector<uint8_t> rgba(blocks * 4 * 4 * 4);
+        size_t rgba_linesize = blocks * 4 * 4;
+
+        for (int row = st->row_start; row < st->row_end; ++row) {
+                const unsigned char *src = st->src + row * blocks * block_size;
+                for (int b = 0; b < blocks; ++b) {
+                        uint8_t px[16][4];
+                        if (st->type == DXT_CPU_DXT1) {
+                                decode_dxt1_block(src + b * block_size, px);
+                        } else {
+                                decode_dxt5_ycocg_block(src + b * block_size, px);
+                        }
+                        for (int i = 0; i < 4; ++i) {
+                                memcpy(&rgba[i * rgba_linesize + b * 16], px[i * 4], 16);
+                        }
+                }
+                int lines = min(4, st->height - row * 4);
+                for (int i = 0; i < lines; ++i) {
+                        unsigned char *out = st->dst + (size_t) (row * 4 + i) * st->pitch;
+                        const uint8_t *in = &rgba[i * rgba_linesize];
+                        if (st->codec == RGBA) {
+                                memcpy(out, in, st->width * 4);
+                        } else {
+                                for (int x = 0; x < st->width; x += 2) {
+                                        rgb_to_uyvy(in + x * 4, in + min(x + 1, st->width - 1) * 4, out + x * 2);
+                                }
+                        }
+                }
+        }
+
+        return st;
+}
+
+void run_stripes(runnable_t task, struct dxt_stripe templ)
+{
+        int rows = (templ.height + 3) / 4;
+        int count = max<int>(1, min<int>(thread::hardware_concurrency() * 2, rows / MIN_STRIPE_BLOCK_ROWS));
+        vector<struct dxt_stripe> stripes(count, templ);
+        for (int i = 0; i < count; ++i) {
+                stripes[i].row_start = rows * i / count;
+                stripes[i].row_end = rows * (i + 1) / count;
+        }
+        task_run_parallel(task, count, stripes.data(), sizeof stripes[0], NULL);
+}
+
+} // end of anonymous namespace
+
+bool dxt_cpu_encoder_supports(codec_t codec)
+{
+        return codec == RGB || codec == RGBA || codec == UYVY;
+}
+
+size_t dxt_cpu_get_size(int width, int height, enum dxt_cpu_type type)
+{
+        return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * (type == DXT_CPU_DXT1 ? 8 : 16);
+}
+
+void dxt_cpu_encode(enum dxt_cpu_type type, const unsigned char *src, int width, int height,
+                int pitch, codec_t codec, unsigned char *dst)
+{
+        static const dxt_cpu_encode_row_t encode_row = select_encoder();
+        assert(dxt_cpu_encoder_supports(codec));
+
+        run_stripes(encode_stripe, { type, src, dst, width, height, pitch, codec, 0, 0, encode_row });
+}
+
+void dxt_cpu_decode(enum dxt_cpu_type type, const unsigned char *src, int width, int height,
+                unsigned char *dst, int pitch, codec_t out_codec)
+{
+        assert(out_codec == RGBA || out_codec == UYVY);
+
+        run_stripes(decode_stripe, { type, src, dst, width, height, pitch, out_codec, 0, 0, nullptr });
+}
+
@@ -0,0 +1,90 @@
+/**
+ * @file   utils/dxt_cpu.h
+ *
+ * @brief CPU DXT1 and YCoCg-DXT5 encoder and decoder.
+ *
+ * Blocks are encoded with the same algorithm (and float arithmetic) as the
+ * GLSL encoder in dxt_compress/ (J.M.P. van Waveren's real-time DXT and
+ * YCoCg-DXT), so the output is interchangeable with RTDXT. Several horizontally
+ * adjacent blocks are encoded at once in SIMD lanes (SSE4.1 or AVX2, chosen at
+ * runtime) and block rows are distributed to the worker pool.
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_DXT_CPU_H_
+#define UTILS_DXT_CPU_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum dxt_cpu_type {
+        DXT_CPU_DXT1,       ///< RGB DXT1 (8 bytes per 4x4 block)
+        DXT_CPU_DXT5_YCOCG, ///< YCoCg DXT5 (16 bytes per 4x4 block)
+};
+
+/**
+ * Tells whether the encoder can compress given pixel format directly
+ * (RGB, RGBA and UYVY).
+ */
+bool dxt_cpu_encoder_supports(codec_t codec);
+/**
+ * @returns size of the compressed frame in bytes
+ */
+size_t dxt_cpu_get_size(int width, int height, enum dxt_cpu_type type);
+/**
+ * @param src   uncompressed frame with lines pitch bytes apart
+ * @param dst   output buffer of dxt_cpu_get_size() bytes
+ */
+void dxt_cpu_encode(enum dxt_cpu_type type, const unsigned char *src, int width, int height,
+                int pitch, codec_t codec, unsigned char *dst);
+/**
+ * Decodes to RGBA or UYVY.
+ *
+ * @param dst   output buffer, must hold height lines pitch bytes apart
+ */
+void dxt_cpu_decode(enum dxt_cpu_type type, const unsigned char *src, int width, int height,
+                unsigned char *dst, int pitch, codec_t out_codec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_DXT_CPU_H_
+
@@ -0,0 +1,480 @@
+/**
+ * @file   utils/dxt_cpu_kernel.h
+ *
+ * @brief DXT block encoder shared by dxt_cpu.cpp (scalar and SSE4.1) and
+ * dxt_cpu_avx2.cpp (compiled with -mavx2).
+ *
+ * The encoder is a port of compress_dxt1_fp.glsl and
+ * compress_dxt5ycocg_fp.glsl. It is written once against a small vector
+ * interface (float vector "vf" and 32-bit integer vector "vi") and each lane
+ * encodes one block, as a fragment does on the GPU.
+ *
+ * Input is planar - for every block position p (0..15, row-major) and channel
+ * c, bytes of consecutive blocks are stored at planes[(p * 3 + c) * stride].
+ * Channels are RGB or YUV (4:4:4, chroma of UYVY duplicated as the GLSL
+ * encoder does).
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_DXT_CPU_KERNEL_H_
+#define UTILS_DXT_CPU_KERNEL_H_
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined __SSE4_1__ || defined __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "utils/dxt_cpu.h"
+
+/**
+ * Encodes a row of blocks.
+ *
+ * @param planes  planar input (see above), must be readable for blocks rounded up to 8
+ * @param dst     output, 8 (DXT1) or 16 (DXT5) bytes per block
+ */
+typedef void (*dxt_cpu_encode_row_t)(enum dxt_cpu_type type, bool yuv, const uint8_t *planes,
+                size_t stride, int blocks, unsigned char *dst);
+
+/// defined in dxt_cpu_avx2.cpp, NULL if not compiled with AVX2
+extern const dxt_cpu_encode_row_t dxt_cpu_encode_row_avx2;
+
+namespace {
+
+namespace dxt_scalar {
+struct vf { float v; };
+struct vi { uint32_t v; };
+
+inline vf set(float x) { return { x }; }
+inline vi seti(uint32_t x) { return { x }; }
+inline vf operator+(vf a, vf b) { return { a.v + b.v }; }
+inline vf operator-(vf a, vf b) { return { a.v - b.v }; }
+inline vf operator*(vf a, vf b) { return { a.v * b.v }; }
+inline vf operator/(vf a, vf b) { return { a.v / b.v }; }
+inline vf vmin(vf a, vf b) { return { b.v < a.v ? b.v : a.v }; }
+inline vf vmax(vf a, vf b) { return { b.v > a.v ? b.v : a.v }; }
+inline vf vabs(vf a) { return { std::fabs(a.v) }; }
+inline vf vround(vf a) { return { std::nearbyint(a.v) }; } // to nearest even
+inline vi lt(vf a, vf b) { return { a.v < b.v ? ~0u : 0u }; }
+inline vi le(vf a, vf b) { return { a.v <= b.v ? ~0u : 0u }; }
+inline vi gt(vf a, vf b) { return { a.v > b.v ? ~0u : 0u }; }
+inline vi lti(vi a, vi b) { return { (int32_t) a.v < (int32_t) b.v ? ~0u : 0u }; }
+inline vf select(vi m, vf a, vf b) { return m.v ? a : b; }
+inline vi operator&(vi a, vi b) { return { a.v & b.v }; }
+inline vi operator|(vi a, vi b) { return { a.v | b.v }; }
+inline vi operator^(vi a, vi b) { return { a.v ^ b.v }; }
+inline vi operator+(vi a, vi b) { return { a.v + b.v }; }
+inline vi operator-(vi a, vi b) { return { a.v - b.v }; }
+inline vi shl(vi a, int n) { return { a.v << n }; }
+inline vi shr(vi a, int n) { return { a.v >> n }; }
+inline vi to_int(vf a) { return { (uint32_t) a.v }; }
+inline vf load_u8(const uint8_t *p) { return { *p / 255.0f }; }
+inline void store(vi a, uint32_t *p) { *p = a.v; }
+struct backend {
+        typedef dxt_scalar::vf vf;
+        typedef dxt_scalar::vi vi;
+        enum { LANES = 1 };
+        static vf set(float x) { return dxt_scalar::set(x); }
+        static vi seti(uint32_t x) { return dxt_scalar::seti(x); }
+        static vf load_u8(const uint8_t *p) { return dxt_scalar::load_u8(p); }
+};
+} // end of namespace dxt_scalar
+
+#ifdef __SSE4_1__
+namespace dxt_sse4 {
+struct vf { __m128 v; };
+struct vi { __m128i v; };
+
+inline vf set(float x) { return { _mm_set1_ps(x) }; }
+inline vi seti(uint32_t x) { return { _mm_set1_epi32(x) }; }
+inline vf operator+(vf a, vf b) { return { _mm_add_ps(a.v, b.v) }; }
+inline vf operator-(vf a, vf b) { return { _mm_sub_ps(a.v, b.v) }; }
+inline vf operator*(vf a, vf b) { return { _mm_mul_ps(a.v, b.v) }; }
+inline vf operator/(vf a, vf b) { return { _mm_div_ps(a.v, b.v) }; }
+inline vf vmin(vf a, vf b) { return { _mm_min_ps(a.v, b.v) }; }
+inline vf vmax(vf a, vf b) { return { _mm_max_ps(a.v, b.v) }; }
+inline vf vabs(vf a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+inline vf vround(vf a) { return { _mm_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC) }; }
+inline vi lt(vf a, vf b) { return { _mm_castps_si128(_mm_cmplt_ps(a.v, b.v)) }; }
+inline vi le(vf a, vf b) { return { _mm_castps_si128(_mm_cmple_ps(a.v, b.v)) }; }
+inline vi gt(vf a, vf b) { return { _mm_castps_si128(_mm_cmpgt_ps(a.v, b.v)) }; }
+inline vi lti(vi a, vi b) { return { _mm_cmplt_epi32(a.v, b.v) }; }
+inline vf select(vi m, vf a, vf b) { return { _mm_blendv_ps(b.v, a.v, _mm_castsi128_ps(m.v)) }; }
+inline vi operator&(vi a, vi b) { return { _mm_and_si128(a.v, b.v) }; }
+inline vi operator|(vi a, vi b) { return { _mm_or_si128(a.v, b.v) }; }
+inline vi operator^(vi a, vi b) { return { _mm_xor_si128(a.v, b.v) }; }
+inline vi operator+(vi a, vi b) { return { _mm_add_epi32(a.v, b.v) }; }
+inline vi operator-(vi a, vi b) { return { _mm_sub_epi32(a.v, b.v) }; }
+inline vi shl(vi a, int n) { return { _mm_sll_epi32(a.v, _mm_cvtsi32_si128(n)) }; }
+inline vi shr(vi a, int n) { return { _mm_srl_epi32(a.v, _mm_cvtsi32_si128(n)) }; }
+inline vi to_int(vf a) { return { _mm_cvttps_epi32(a.v) }; }
+inline vf load_u8(const uint8_t *p) {
+        int32_t x;
+        memcpy(&x, p, sizeof x);
+        return { _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(x))), _mm_set1_ps(255.0f)) };
+}
+inline void store(vi a, uint32_t *p) { _mm_storeu_si128((__m128i *) p, a.v); }
+struct backend {
+        typedef dxt_sse4::vf vf;
+        typedef dxt_sse4::vi vi;
+        enum { LANES = 4 };
+        static vf set(float x) { return dxt_sse4::set(x); }
+        static vi seti(uint32_t x) { return dxt_sse4::seti(x); }
+        static vf load_u8(const uint8_t *p) { return dxt_sse4::load_u8(p); }
+};
+} // end of namespace dxt_sse4
+#endif // defined __SSE4_1__
+
+#ifdef __AVX2__
+namespace dxt_avx2 {
+struct vf { __m256 v; };
+struct vi { __m256i v; };
+
+inline vf set(float x) { return { _mm256_set1_ps(x) }; }
+inline vi seti(uint32_t x) { return { _mm256_set1_epi32(x) }; }
+inline vf operator+(vf a, vf b) { return { _mm256_add_ps(a.v, b.v) }; }
+inline vf operator-(vf a, vf b) { return { _mm256_sub_ps(a.v, b.v) }; }
+inline vf operator*(vf a, vf b) { return { _mm256_mul_ps(a.v, b.v) }; }
+inline vf operator/(vf a, vf b) { return { _mm256_div_ps(a.v, b.v) }; }
+inline vf vmin(vf a, vf b) { return { _mm256_min_ps(a.v, b.v) }; }
+inline vf vmax(vf a, vf b) { return { _mm256_max_ps(a.v, b.v) }; }
+inline vf vabs(vf a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) }; }
+inline vf vround(vf a) { return { _mm256_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC) }; }
+inline vi lt(vf a, vf b) { return { _mm256_castps_si256(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)) }; }
+inline vi le(vf a, vf b) { return { _mm256_castps_si256(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)) }; }
+inline vi gt(vf a, vf b) { return { _mm256_castps_si256(_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)) }; }
+inline vi lti(vi a, vi b) { return { _mm256_cmpgt_epi32(b.v, a.v) }; }
+inline vf select(vi m, vf a, vf b) { return { _mm256_blendv_ps(b.v, a.v, _mm256_castsi256_ps(m.v)) }; }
+inline vi operator&(vi a, vi b) { return { _mm256_and_si256(a.v, b.v) }; }
+inline vi operator|(vi a, vi b) { return { _mm256_or_si256(a.v, b.v) }; }
+inline vi operator^(vi a, vi b) { return { _mm256_xor_si256(a.v, b.v) }; }
+inline vi operator+(vi a, vi b) { return { _mm256_add_epi32(a.v, b.v) }; }
+inline vi operator-(vi a, vi b) { return { _mm256_sub_epi32(a.v, b.v) }; }
+inline vi shl(vi a, int n) { return { _mm256_sll_epi32(a.v, _mm_cvtsi32_si128(n)) }; }
+inline vi shr(vi a, int n) { return { _mm256_srl_epi32(a.v, _mm_cvtsi32_si128(n)) }; }
+inline vi to_int(vf a) { return { _mm256_cvttps_epi32(a.v) }; }
+inline vf load_u8(const uint8_t *p) {
+        return { _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) p))),
+                        _mm256_set1_ps(255.0f)) };
+}
+inline void store(vi a, uint32_t *p) { _mm256_storeu_si256((__m256i *) p, a.v); }
+struct backend {
+        typedef dxt_avx2::vf vf;
+        typedef dxt_avx2::vi vi;
+        enum { LANES = 8 };
+        static vf set(float x) { return dxt_avx2::set(x); }
+        static vi seti(uint32_t x) { return dxt_avx2::seti(x); }
+        static vf load_u8(const uint8_t *p) { return dxt_avx2::load_u8(p); }
+};
+} // end of namespace dxt_avx2
+#endif // defined __AVX2__
+
+/**
+ * Encoder for one vector backend, functions follow the GLSL shaders.
+ */
+template<typename B>
+struct dxt_encoder_impl {
+        typedef typename B::vf vf;
+        typedef typename B::vi vi;
+        enum { LANES = B::LANES };
+        static vf set(float x) { return B::set(x); }
+        static vi seti(uint32_t x) { return B::seti(x); }
+        static vf load_u8(const uint8_t *p) { return B::load_u8(p); }
+
+        struct vec3 { vf x, y, z; };
+
+        /// exact for a == b (as GLSL mix), so that equal endpoints give equal distances
+        static vf lerp(vf a, vf b, float t) {
+                return a + (b - a) * set(t);
+        }
+
+        static vf clamp01(vf a) {
+                return vmin(vmax(a, set(0.0f)), set(1.0f));
+        }
+
+        static void swap_if(vi m, vf &a, vf &b) {
+                vf tmp = a;
+                a = select(m, b, a);
+                b = select(m, tmp, b);
+        }
+
+        static void load_block(vec3 col[16], bool yuv, bool ycocg, const uint8_t *planes, size_t stride) {
+                for (int p = 0; p < 16; ++p) {
+                        vf c0 = load_u8(planes + (p * 3 + 0) * stride);
+                        vf c1 = load_u8(planes + (p * 3 + 1) * stride);
+                        vf c2 = load_u8(planes + (p * 3 + 2) * stride);
+                        if (yuv) { // ConvertYUVToRGB
+                                vf Y = set(1.1643f) * (c0 - set(0.0625f));
+                                vf U = c1 - set(0.5f);
+                                vf V = c2 - set(0.5f);
+                                c0 = Y + set(1.7926f) * V;
+                                c1 = Y - set(0.2132f) * U - set(0.5328f) * V;
+                                c2 = Y + set(2.1124f) * U;
+                        }
+                        if (ycocg) { // ConvertRGBToYCoCg
+                                const vf offset = set(128.0f / 255.0f);
+                                vf Y = (c0 + set(2.0f) * c1 + c2) * set(0.25f);
+                                vf Co = (set(2.0f) * c0 - set(2.0f) * c2) * set(0.25f) + offset;
+                                vf Cg = (set(0.0f) - c0 + set(2.0f) * c1 - c2) * set(0.25f) + offset;
+                                c0 = Y; c1 = Co; c2 = Cg;
+                        }
+                        col[p] = { c0, c1, c2 };
+                }
+        }
+
+        static void find_min_max(const vec3 col[16], vec3 &mincol, vec3 &maxcol) {
+                mincol = maxcol = col[0];
+                for (int i = 1; i < 16; ++i) {
+                        mincol = { vmin(mincol.x, col[i].x), vmin(mincol.y, col[i].y), vmin(mincol.z, col[i].z) };
+                        maxcol = { vmax(maxcol.x, col[i].x), vmax(maxcol.y, col[i].y), vmax(maxcol.z, col[i].z) };
+                }
+        }
+
+        /// 2-bit index of the closest of the 4 palette colors (dist computed by caller)
+        static vi color_index(vf d0, vf d1, vf d2, vf d3) {
+                vi bx = gt(d0, d3);
+                vi by = gt(d1, d2);
+                vi bz = gt(d0, d2);
+                vi bw = gt(d1, d3);
+                vi b4 = gt(d2, d3);
+                return (bx & b4 & seti(1)) | (((by & bz) | (bx & bw)) & seti(2));
+        }
+
+        /// RoundAndExpand, returns 565 value in w
+        static void round_and_expand(vec3 &v, vf &w) {
+                vf r = vround(v.x * set(31.0f));
+                vf g = vround(v.y * set(63.0f));
+                vf b = vround(v.z * set(31.0f));
+                w = r * set(2048.0f) + g * set(32.0f) + b;
+                // (c << 3) | (c >> 2) and (c << 2) | (c >> 4) on integral floats
+                r = r * set(8.0f) + vround_down(r * set(0.25f));
+                g = g * set(4.0f) + vround_down(g * set(0.0625f));
+                b = b * set(8.0f) + vround_down(b * set(0.25f));
+                v = { r * set(1.0f / 255.0f), g * set(1.0f / 255.0f), b * set(1.0f / 255.0f) };
+        }
+
+        /// floor of a non-negative value
+        static vf vround_down(vf a) {
+                vf r = vround(a);
+                return r - select(gt(r, a), set(1.0f), set(0.0f));
+        }
+
+        static void encode_dxt1(const vec3 col[16], uint32_t *out0, uint32_t *out1) {
+                vec3 mincol, maxcol;
+                find_min_max(col, mincol, maxcol);
+
+                // SelectDiagonal
+                vec3 center = { (mincol.x + maxcol.x) * set(0.5f), (mincol.y + maxcol.y) * set(0.5f),
+                        (mincol.z + maxcol.z) * set(0.5f) };
+                vf covx = set(0.0f), covy = set(0.0f);
+                for (int i = 0; i < 16; ++i) {
+                        vec3 t = { col[i].x - center.x, col[i].y - center.y, col[i].z - center.z };
+                        covx = covx + t.x * t.z;
+                        covy = covy + t.y * t.z;
+                }
+                swap_if(lt(covx, set(0.0f)), maxcol.x, mincol.x);
+                swap_if(lt(covy, set(0.0f)), maxcol.y, mincol.y);
+
+                // InsetBBox
+                const vf inset_bias = set((8.0f / 255.0f) / 16.0f);
+                vec3 inset = { (maxcol.x - mincol.x) / set(16.0f) - inset_bias,
+                        (maxcol.y - mincol.y) / set(16.0f) - inset_bias,
+                        (maxcol.z - mincol.z) / set(16.0f) - inset_bias };
+                mincol = { clamp01(mincol.x + inset.x), clamp01(mincol.y + inset.y), clamp01(mincol.z + inset.z) };
+                maxcol = { clamp01(maxcol.x - inset.x), clamp01(maxcol.y - inset.y), clamp01(maxcol.z - inset.z) };
+
+                // EmitEndPointsDXT1
+                vf w0, w1;
+                round_and_expand(maxcol, w0);
+                round_and_expand(mincol, w1);
+                vi swap = lt(w0, w1);
+                swap_if(swap, maxcol.x, mincol.x);
+                swap_if(swap, maxcol.y, mincol.y);
+                swap_if(swap, maxcol.z, mincol.z);
+                swap_if(swap, w0, w1);
+                store(to_int(w0) | shl(to_int(w1), 16), out0);
+
+                // EmitIndicesDXT1
+                vec3 c2 = { lerp(maxcol.x, mincol.x, 1.0f / 3.0f), lerp(maxcol.y, mincol.y, 1.0f / 3.0f),
+                        lerp(maxcol.z, mincol.z, 1.0f / 3.0f) };
+                vec3 c3 = { lerp(maxcol.x, mincol.x, 2.0f / 3.0f), lerp(maxcol.y, mincol.y, 2.0f / 3.0f),
+                        lerp(maxcol.z, mincol.z, 2.0f / 3.0f) };
+                vi indices = seti(0);
+                for (int i = 0; i < 16; ++i) {
+                        indices = indices | shl(color_index(dist(col[i], maxcol), dist(col[i], mincol),
+                                                dist(col[i], c2), dist(col[i], c3)), 2 * i);
+                }
+                // w0 == w1 is decoded in 3-color mode where index 3 is black
+                store(indices & lt(w1, w0), out1);
+        }
+
+        static vf dist(const vec3 &a, const vec3 &b) {
+                vf dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+                return dx * dx + dy * dy + dz * dz;
+        }
+
+        static vf dist2(vf ay, vf az, vf by, vf bz) {
+                vf dy = ay - by, dz = az - bz;
+                return dy * dy + dz * dz;
+        }
+
+        static void encode_dxt5_ycocg(const vec3 block[16], uint32_t *out0, uint32_t *out1,
+                        uint32_t *out2, uint32_t *out3) {
+                const vf offset = set(128.0f / 255.0f);
+                vec3 mincol, maxcol;
+                find_min_max(block, mincol, maxcol);
+
+                // SelectYCoCgDiagonal
+                vf midy = (maxcol.y + mincol.y) * set(0.5f);
+                vf midz = (maxcol.z + mincol.z) * set(0.5f);
+                vf cov = set(0.0f);
+                for (int i = 0; i < 16; ++i) {
+                        cov = cov + (block[i].y - midy) * (block[i].z - midz);
+                }
+                swap_if(lt(cov, set(0.0f)), maxcol.z, mincol.z);
+
+                // ScaleYCoCg
+                vf m = vmax(vmax(vabs(mincol.y - offset), vabs(mincol.z - offset)),
+                                vmax(vabs(maxcol.y - offset), vabs(maxcol.z - offset)));
+                vf scale = set(1.0f);
+                scale = select(lt(m, set(64.0f / 255.0f)), set(2.0f), scale);
+                scale = select(lt(m, set(32.0f / 255.0f)), set(4.0f), scale);
+
+                // EmitEndPointsYCoCgDXT5
+                vf maxy = (maxcol.y - offset) * scale + offset;
+                vf maxz = (maxcol.z - offset) * scale + offset;
+                vf miny = (mincol.y - offset) * scale + offset;
+                vf minz = (mincol.z - offset) * scale + offset;
+                const vf inset_bias = set((8.0f / 255.0f) / 16.0f);
+                vf insety = (maxy - miny) / set(16.0f) - inset_bias;
+                vf insetz = (maxz - minz) / set(16.0f) - inset_bias;
+                miny = clamp01(miny + insety);
+                minz = clamp01(minz + insetz);
+                maxy = clamp01(maxy - insety);
+                maxz = clamp01(maxz - insetz);
+                maxy = vround(maxy * set(31.0f));
+                maxz = vround(maxz * set(63.0f));
+                miny = vround(miny * set(31.0f));
+                minz = vround(minz * set(63.0f));
+                vi scale_bits = to_int(scale) - seti(1);
+                vi endpoints = (shl(to_int(maxy), 11) | shl(to_int(maxz), 5) | scale_bits) |
+                        shl(shl(to_int(miny), 11) | shl(to_int(minz), 5) | scale_bits, 16);
+                store(endpoints, out2);
+                maxy = (maxy * set(8.0f) + vround_down(maxy * set(0.25f))) * set(1.0f / 255.0f);
+                maxz = (maxz * set(4.0f) + vround_down(maxz * set(0.0625f))) * set(1.0f / 255.0f);
+                miny = (miny * set(8.0f) + vround_down(miny * set(0.25f))) * set(1.0f / 255.0f);
+                minz = (minz * set(4.0f) + vround_down(minz * set(0.0625f))) * set(1.0f / 255.0f);
+                maxy = (maxy - offset) / scale + offset;
+                maxz = (maxz - offset) / scale + offset;
+                miny = (miny - offset) / scale + offset;
+                minz = (minz - offset) / scale + offset;
+
+                // EmitIndicesYCoCgDXT5
+                vf c2y = lerp(maxy, miny, 1.0f / 3.0f), c2z = lerp(maxz, minz, 1.0f / 3.0f);
+                vf c3y = lerp(maxy, miny, 2.0f / 3.0f), c3z = lerp(maxz, minz, 2.0f / 3.0f);
+                vi indices = seti(0);
+                for (int i = 0; i < 16; ++i) {
+                        vf y = block[i].y, z = block[i].z;
+                        indices = indices | shl(color_index(dist2(y, z, maxy, maxz), dist2(y, z, miny, minz),
+                                                dist2(y, z, c2y, c2z), dist2(y, z, c3y, c3z)), 2 * i);
+                }
+                store(indices, out3);
+
+                // InsetYBBox
+                vf inset = (maxcol.x - mincol.x) / set(32.0f) - set((16.0f / 255.0f) / 32.0f);
+                vf min_alpha = clamp01(mincol.x + inset);
+                vf max_alpha = clamp01(maxcol.x - inset);
+
+                // EmitAlphaEndPointsYCoCgDXT5
+                vi alpha = shl(to_int(vround(min_alpha * set(255.0f))), 8) | to_int(vround(max_alpha * set(255.0f)));
+
+                // EmitAlphaIndicesYCoCgDXT5
+                const float ALPHA_RANGE = 7.0f;
+                vf mid = (max_alpha - min_alpha) / set(2.0f * ALPHA_RANGE);
+                vf ab[7];
+                ab[0] = min_alpha + mid;
+                for (int k = 1; k < 7; ++k) {
+                        ab[k] = (set(7.0f - k) * max_alpha + set((float) k) * min_alpha) * set(1.0f / ALPHA_RANGE) + mid;
+                }
+                vi alpha_hi = seti(0);
+                for (int i = 0; i < 16; ++i) {
+                        vi index = seti(1);
+                        for (int k = 0; k < 7; ++k) {
+                                index = index - le(block[i].x, ab[k]); // mask is -1
+                        }
+                        index = index & seti(7);
+                        index = index ^ (lti(index, seti(2)) & seti(1));
+                        if (i < 6) {
+                                alpha = alpha | shl(index, 3 * i + 16);
+                                if (i == 5) {
+                                        alpha_hi = shr(index, 1);
+                                }
+                        } else {
+                                alpha_hi = alpha_hi | shl(index, 3 * i - 16);
+                        }
+                }
+                store(alpha, out0);
+                store(alpha_hi, out1);
+        }
+
+        static void encode_row(enum dxt_cpu_type type, bool yuv, const uint8_t *planes,
+                        size_t stride, int blocks, unsigned char *dst) {
+                const int words = type == DXT_CPU_DXT1 ? 2 : 4;
+                for (int b = 0; b < blocks; b += LANES) {
+                        vec3 col[16];
+                        uint32_t out[4][LANES];
+                        load_block(col, yuv, type == DXT_CPU_DXT5_YCOCG, planes + b, stride);
+                        if (type == DXT_CPU_DXT1) {
+                                encode_dxt1(col, out[0], out[1]);
+                        } else {
+                                encode_dxt5_ycocg(col, out[0], out[1], out[2], out[3]);
+                        }
+                        int count = blocks - b < LANES ? blocks - b : LANES;
+                        for (int l = 0; l < count; ++l) {
+                                for (int w = 0; w < words; ++w) {
+                                        uint32_t val = out[w][l];
+                                        unsigned char *p = dst + ((b + l) * words + w) * 4;
+                                        p[0] = val; p[1] = val >> 8; p[2] = val >> 16; p[3] = val >> 24;
+                                }
+                        }
+                }
+        }
+};
+
+} // end of anonymous namespace
+
+#endif // UTILS_DXT_CPU_KERNEL_H_
+
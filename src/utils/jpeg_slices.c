@@ -0,0 +1,836 @@
+/**
+ * @file   utils/jpeg_slices.c
+ *
+ * @brief Multithreaded CPU JPEG encoder and decoder based on libjpeg(-turbo).
+ *
+ * Encoder compresses every slice as a standalone JPEG with the same tables and
+ * restart interval, then takes headers of the first one (with patched height)
+ * and appends entropy-coded data of all slices separated by RST markers. Since
+ * both a restart marker and the beginning of a scan reset DC predictors, the
+ * result is identical to a single-threaded encoding.
+ *
+ * Decoder does the opposite - locates restart markers and hands every slice to
+ * a libjpeg instance as a standalone JPEG (original headers with patched height).
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <jpeglib.h>
+
+#include "utils/jpeg_slices.h"
+#include "utils/worker.h"
+
+#define MOD_NAME "[JPEG slices] "
+
+#define M_SOF0 0xC0
+#define M_SOF1 0xC1
+#define M_DHT  0xC4
+#define M_JPG  0xC8
+#define M_DAC  0xCC
+#define M_RST0 0xD0
+#define M_RST7 0xD7
+#define M_SOI  0xD8
+#define M_EOI  0xD9
+#define M_SOS  0xDA
+#define M_DRI  0xDD
+#define M_TEM  0x01
+
+/// GPUJPEG defaults (MCUs)
+#define DEFAULT_RESTART_INTERVAL_YCBCR 4
+#define DEFAULT_RESTART_INTERVAL_RGB   8
+
+/**
+ * Information gathered from JPEG headers (everything preceding entropy-coded data)
+ */
+struct jpeg_header_info {
+        size_t sof_off;       ///< offset of SOF marker
+        size_t data_off;      ///< offset of entropy-coded data (just after SOS segment)
+        int width;
+        int height;
+        int comp_count;
+        int scan_comp_count;  ///< number of components in the first scan
+        int mcu_width;
+        int mcu_height;
+        int restart_interval; ///< 0 if not present
+        bool sequential;      ///< baseline or extended sequential Huffman
+};
+
+struct slice_error_mgr {
+        struct jpeg_error_mgr pub;
+        jmp_buf jmp;
+};
+
+struct enc_slice {
+        struct jpeg_compress_struct cinfo;
+        struct slice_error_mgr err;
+
+        unsigned char *buf;         ///< compressed slice (standalone JPEG)
+        unsigned long buf_size;     ///< allocated size of buf
+        unsigned long len;          ///< length of compressed slice
+        unsigned char *prev_buf;    ///< buf passed to libjpeg (it may allocate a bigger one)
+        struct jpeg_header_info hdr;
+        unsigned char *line;        ///< converted line (UYVY input only)
+
+        int y_start;
+        int y_end;
+        int first_interval;         ///< index of the first restart interval in the frame
+
+        unsigned char *src;
+        int pitch;
+        bool ok;
+};
+
+struct jpeg_slices_encoder {
+        int quality;
+        int requested_restart_interval;
+        int max_slices;
+
+        int width;
+        int height;
+        codec_t codec;
+        int slice_count;
+
+        struct enc_slice *slices;
+};
+
+struct dec_slice {
+        struct jpeg_decompress_struct cinfo;
+        struct slice_error_mgr err;
+
+        const struct jpeg_header_info *hdr; ///< NULL if the frame is not sliced
+        const unsigned char *src;   ///< whole frame
+        size_t src_len;
+        const size_t *restart_pos;  ///< offsets of RST markers inside the slice
+        int restart_count;          ///< number of RST markers inside the slice
+        size_t data_start;          ///< entropy-coded data of the slice in src
+        size_t data_end;
+
+        unsigned char *buf;         ///< standalone JPEG of the slice
+        size_t buf_size;
+        unsigned char *line;        ///< YCbCr line (UYVY output only)
+        size_t line_size;
+
+        int y_start;
+        int y_end;
+        unsigned char *dst;
+        int pitch;
+        codec_t out_codec;
+        bool ok;
+};
+
+struct jpeg_slices_decoder {
+        int max_slices;
+        struct dec_slice *slices;
+        size_t *restart_pos;
+        size_t restart_pos_size;
+};
+
+static int get_cpu_count(void)
+{
+#ifdef WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwNumberOfProcessors;
+#else
+        long ret = sysconf(_SC_NPROCESSORS_ONLN);
+        return ret > 0 ? ret : 1;
+#endif
+}
+
+static void slice_error_exit(j_common_ptr cinfo)
+{
+        struct slice_error_mgr *err = (struct slice_error_mgr *) cinfo->err;
+        char msg[JMSG_LENGTH_MAX];
+
+        (*cinfo->err->format_message)(cinfo, msg);
+        fprintf(stderr, MOD_NAME "%s\n", msg);
+        longjmp(err->jmp, 1);
+}
+
+static inline int read_be16(const unsigned char *p)
+{
+        return p[0] << 8 | p[1];
+}
+
+static inline unsigned char clamp_u8(int val)
+{
+        return val < 0 ? 0 : val > 255 ? 255 : val;
+}
+
+static int gcd(int a, int b)
+{
+        while (b != 0) {
+                int t = a % b;
+                a = b;
+                b = t;
+        }
+        return a;
+}
+
+/**
+ * Walks marker segments from SOI up to (and including) the first SOS.
+ */
+static bool parse_header(const unsigned char *p, size_t len, struct jpeg_header_info *info)
+{
+        memset(info, 0, sizeof *info);
+        if (len < 4 || p[0] != 0xFF || p[1] != M_SOI) {
+                return false;
+        }
+        size_t off = 2;
+        bool sof_seen = false;
+        while (off + 4 <= len) {
+                if (p[off] != 0xFF) {
+                        return false;
+                }
+                int marker = p[off + 1];
+                if (marker == 0xFF) { // fill byte
+                        off += 1;
+                        continue;
+                }
+                if (marker == M_TEM || (marker >= M_RST0 && marker <= M_RST7)) {
+                        off += 2;
+                        continue;
+                }
+                size_t seg_len = read_be16(p + off + 2);
+                if (seg_len < 2 || off + 2 + seg_len > len) {
+                        return false;
+                }
+                const unsigned char *seg = p + off + 4;
+                if (marker >= M_SOF0 && marker <= M_SOF0 + 15 && marker != M_DHT &&
+                                marker != M_JPG && marker != M_DAC) {
+                        if (seg_len < 8) {
+                                return false;
+                        }
+                        info->sof_off = off;
+                        info->sequential = marker == M_SOF0 || marker == M_SOF1;
+                        info->height = read_be16(seg + 1);
+                        info->width = read_be16(seg + 3);
+                        info->comp_count = seg[5];
+                        if (info->comp_count == 0 || seg_len < 8 + 3 * (size_t) info->comp_count) {
+                                return false;
+                        }
+                        int max_h = 1, max_v = 1;
+                        for (int i = 0; i < info->comp_count; ++i) {
+                                int h = seg[7 + 3 * i] >> 4;
+                                int v = seg[7 + 3 * i] & 0xF;
+                                max_h = h > max_h ? h : max_h;
+                                max_v = v > max_v ? v : max_v;
+                        }
+                        info->mcu_width = info->comp_count == 1 ? 8 : 8 * max_h;
+                        info->mcu_height = info->comp_count == 1 ? 8 : 8 * max_v;
+                        sof_seen = true;
+                } else if (marker == M_DRI) {
+                        info->restart_interval = read_be16(seg);
+                } else if (marker == M_SOS) {
+                        info->scan_comp_count = seg[0];
+                        info->data_off = off + 2 + seg_len;
+                        return sof_seen && info->width > 0 && info->height > 0;
+                }
+                off += 2 + seg_len;
+        }
+        return false;
+}
+
+/**
+ * Splits the frame into slices. Boundaries are placed on MCU rows that begin
+ * with a new restart interval, all slices but the last have equal number of
+ * such groups of MCU rows.
+ *
+ * @param[out] y_start  slice boundaries in lines, must hold max_slices + 1 items
+ * @returns             number of slices
+ */
+static int plan_slices(int height, int mcu_height, int mcus_per_row, int restart_interval,
+                int max_slices, int *y_start)
+{
+        int slices = 1;
+        if (restart_interval > 0) {
+                int mcu_rows = (height + mcu_height - 1) / mcu_height;
+                int group_rows = restart_interval / gcd(mcus_per_row, restart_interval);
+                int groups = mcu_rows / group_rows;
+                slices = groups < max_slices ? groups : max_slices;
+                slices = slices < 1 ? 1 : slices;
+                for (int i = 0; i < slices; ++i) {
+                        y_start[i] = groups * i / slices * group_rows * mcu_height;
+                }
+        }
+        y_start[0] = 0;
+        y_start[slices] = height;
+        return slices;
+}
+
+/*
+ * Conversion between limited range BT.709 (UYVY) and full range BT.601 (JFIF),
+ * 2.14 fixed point. Luma doesn't affect chroma in either direction.
+ */
+static void uyvy_to_jfif_ycbcr(unsigned char *dst, const unsigned char *src, int width)
+{
+        for (int x = 0; x < width; x += 2) {
+                int u = src[0] - 128;
+                int y0 = src[1] - 16;
+                int v = src[2] - 128;
+                int y1 = src[3] - 16;
+                int yc = 1895 * u + 3657 * v + (1 << 13);
+                unsigned char cb = clamp_u8(128 + ((18462 * u - 2064 * v + (1 << 13)) >> 14));
+                unsigned char cr = clamp_u8(128 + ((-1351 * u + 18342 * v + (1 << 13)) >> 14));
+                dst[0] = clamp_u8((19077 * y0 + yc) >> 14);
+                dst[1] = cb;
+                dst[2] = cr;
+                if (x + 1 < width) {
+                        dst[3] = clamp_u8((19077 * y1 + yc) >> 14);
+                        dst[4] = cb;
+                        dst[5] = cr;
+                }
+                src += 4;
+                dst += 6;
+        }
+}
+
+static void jfif_ycbcr_to_uyvy(unsigned char *dst, const unsigned char *src, int width)
+{
+        for (int x = 0; x < width; x += 2) {
+                const unsigned char *next = x + 1 < width ? src + 3 : src;
+                int u = ((src[1] + next[1] + 1) >> 1) - 128;
+                int v = ((src[2] + next[2] + 1) >> 1) - 128;
+                int yc = -1663 * u - 2993 * v + (16 << 14) + (1 << 13);
+                dst[0] = clamp_u8(128 + ((14660 * u + 1650 * v + (1 << 13)) >> 14));
+                dst[1] = clamp_u8((14071 * src[0] + yc) >> 14);
+                dst[2] = clamp_u8(128 + ((1080 * u + 14757 * v + (1 << 13)) >> 14));
+                dst[3] = clamp_u8((14071 * next[0] + yc) >> 14);
+                src += 6;
+                dst += 4;
+        }
+}
+
+/**
+ * Changes numbers of RST markers in entropy-coded data by offset (modulo 8).
+ */
+static void renumber_restart_markers(unsigned char *data, size_t len, int offset)
+{
+        if (offset % 8 == 0) {
+                return;
+        }
+        unsigned char *end = data + len - 1;
+        while (data < end && (data = (unsigned char *) memchr(data, 0xFF, end - data)) != NULL) {
+                if (data[1] >= M_RST0 && data[1] <= M_RST7) {
+                        data[1] = M_RST0 + ((data[1] - M_RST0 + offset) & 7);
+                }
+                data += 2;
+        }
+}
+
+/*  _____ _   _  ____ ___  ____  _____ ____
+ * | ____| \ | |/ ___/ _ \|  _ \| ____|  _ \
+ * |  _| |  \| | |  | | | | | | |  _| | |_) |
+ * | |___| |\  | |__| |_| | |_| | |___|  _ <
+ * |_____|_| \_|\____\___/|____/|_____|_| \_\
+ */
+bool jpeg_slices_encoder_supports(codec_t codec)
+{
+        switch (codec) {
+        case UYVY:
+        case RGB:
+#ifdef JCS_EXTENSIONS
+        case RGBA:
+        case BGR:
+#endif
+                return true;
+        default:
+                return false;
+        }
+}
+
+struct jpeg_slices_encoder *jpeg_slices_encoder_create(int quality, int restart_interval, int slices)
+{
+        struct jpeg_slices_encoder *s = (struct jpeg_slices_encoder *) calloc(1, sizeof *s);
+        s->quality = quality;
+        s->requested_restart_interval = restart_interval;
+        s->max_slices = slices > 0 ? slices : get_cpu_count();
+        s->codec = VIDEO_CODEC_NONE;
+        s->slices = (struct enc_slice *) calloc(s->max_slices, sizeof(struct enc_slice));
+        for (int i = 0; i < s->max_slices; ++i) {
+                struct enc_slice *sl = &s->slices[i];
+                sl->cinfo.err = jpeg_std_error(&sl->err.pub);
+                sl->err.pub.error_exit = slice_error_exit;
+                jpeg_create_compress(&sl->cinfo);
+        }
+        return s;
+}
+
+/**
+ * Sets libjpeg compression parameters of a single slice.
+ */
+static bool slice_set_params(struct enc_slice *sl, int quality, int width, int height,
+                codec_t codec, int restart_interval)
+{
+        struct jpeg_compress_struct *cinfo = &sl->cinfo;
+
+        if (setjmp(sl->err.jmp)) {
+                return false;
+        }
+        cinfo->image_width = width;
+        cinfo->image_height = height;
+        cinfo->input_components = 3;
+        switch (codec) {
+        case UYVY:
+                cinfo->in_color_space = JCS_YCbCr;
+                break;
+        case RGB:
+                cinfo->in_color_space = JCS_RGB;
+                break;
+#ifdef JCS_EXTENSIONS
+        case RGBA:
+                cinfo->in_color_space = JCS_EXT_RGBX;
+                cinfo->input_components = 4;
+                break;
+        case BGR:
+                cinfo->in_color_space = JCS_EXT_BGR;
+                break;
+#endif
+        default:
+                return false;
+        }
+        jpeg_set_defaults(cinfo);
+        jpeg_set_colorspace(cinfo, JCS_YCbCr);
+        jpeg_set_quality(cinfo, quality, TRUE);
+        // 4:2:2 for YCbCr input, 4:4:4 for RGB (as GPUJPEG does)
+        cinfo->comp_info[0].h_samp_factor = codec == UYVY ? 2 : 1;
+        cinfo->comp_info[0].v_samp_factor = 1;
+        for (int c = 1; c < 3; ++c) {
+                cinfo->comp_info[c].h_samp_factor = 1;
+                cinfo->comp_info[c].v_samp_factor = 1;
+        }
+        cinfo->restart_interval = restart_interval;
+        cinfo->optimize_coding = FALSE; // all slices must use the same Huffman tables
+        cinfo->dct_method = JDCT_ISLOW;
+
+        return true;
+}
+
+static bool encoder_configure(struct jpeg_slices_encoder *s, int width, int height, codec_t codec)
+{
+        int y_start[s->max_slices + 1];
+        int restart_interval = s->requested_restart_interval;
+        if (restart_interval < 0) {
+                restart_interval = codec == UYVY ? DEFAULT_RESTART_INTERVAL_YCBCR
+                        : DEFAULT_RESTART_INTERVAL_RGB;
+        }
+        int mcu_width = codec == UYVY ? 16 : 8;
+        int mcus_per_row = (width + mcu_width - 1) / mcu_width;
+
+        s->slice_count = plan_slices(height, 8, mcus_per_row, restart_interval, s->max_slices, y_start);
+
+        for (int i = 0; i < s->slice_count; ++i) {
+                struct enc_slice *sl = &s->slices[i];
+
+                if (!slice_set_params(sl, s->quality, width, y_start[i + 1] - y_start[i],
+                                        codec, restart_interval)) {
+                        return false;
+                }
+
+                sl->y_start = y_start[i];
+                sl->y_end = y_start[i + 1];
+                sl->first_interval = restart_interval > 0 ?
+                        y_start[i] / 8 * mcus_per_row / restart_interval : 0;
+                free(sl->line);
+                sl->line = codec == UYVY ? (unsigned char *) malloc(3 * (width + 1)) : NULL;
+        }
+
+        s->width = width;
+        s->height = height;
+        s->codec = codec;
+
+        return true;
+}
+
+static void *encode_slice(void *arg)
+{
+        struct enc_slice *sl = (struct enc_slice *) arg;
+        struct jpeg_compress_struct *cinfo = &sl->cinfo;
+
+        sl->ok = false;
+        if (setjmp(sl->err.jmp)) {
+                jpeg_abort_compress(cinfo);
+                if (sl->buf != sl->prev_buf) { // buffer allocated by libjpeg, size unknown
+                        free(sl->buf);
+                        sl->buf = NULL;
+                }
+                free(sl->prev_buf);
+                sl->prev_buf = NULL;
+                sl->buf_size = 0;
+                return sl;
+        }
+
+        sl->prev_buf = sl->buf;
+        sl->len = sl->buf_size;
+        jpeg_mem_dest(cinfo, &sl->buf, &sl->len);
+        jpeg_start_compress(cinfo, TRUE);
+        while (cinfo->next_scanline < cinfo->image_height) {
+                JSAMPROW row = sl->src + (size_t) (sl->y_start + cinfo->next_scanline) * sl->pitch;
+                if (sl->line) {
+                        uyvy_to_jfif_ycbcr(sl->line, row, cinfo->image_width);
+                        row = sl->line;
+                }
+                jpeg_write_scanlines(cinfo, &row, 1);
+        }
+        jpeg_finish_compress(cinfo);
+
+        if (sl->buf != sl->prev_buf) {
+                free(sl->prev_buf);
+                sl->buf_size = sl->len;
+        }
+        sl->prev_buf = NULL;
+
+        if (!parse_header(sl->buf, sl->len, &sl->hdr) || sl->len < sl->hdr.data_off + 2) {
+                fprintf(stderr, MOD_NAME "Cannot parse encoded slice!\n");
+                return sl;
+        }
+        renumber_restart_markers(sl->buf + sl->hdr.data_off, sl->len - 2 - sl->hdr.data_off,
+                        sl->first_interval);
+        sl->ok = true;
+
+        return sl;
+}
+
+size_t jpeg_slices_encode(struct jpeg_slices_encoder *s, unsigned char *src,
+                int width, int height, int pitch, codec_t codec,
+                unsigned char *dst, size_t dst_len)
+{
+        if (s->width != width || s->height != height || s->codec != codec) {
+                if (!encoder_configure(s, width, height, codec)) {
+                        s->codec = VIDEO_CODEC_NONE;
+                        return 0;
+                }
+        }
+
+        for (int i = 0; i < s->slice_count; ++i) {
+                s->slices[i].src = src;
+                s->slices[i].pitch = pitch;
+        }
+        task_run_parallel(encode_slice, s->slice_count, s->slices, sizeof s->slices[0], NULL);
+        bool ok = true;
+        for (int i = 0; i < s->slice_count; ++i) {
+                ok = ok && s->slices[i].ok;
+        }
+        if (!ok) {
+                return 0;
+        }
+
+        // join slices - headers from the first one, entropy-coded data separated with RSTs
+        const struct enc_slice *first = &s->slices[0];
+        size_t total = first->hdr.data_off + 2;
+        for (int i = 0; i < s->slice_count; ++i) {
+                total += s->slices[i].len - 2 - s->slices[i].hdr.data_off + (i > 0 ? 2 : 0);
+        }
+        if (total > dst_len) {
+                fprintf(stderr, MOD_NAME "Output buffer too small (%zu B needed)!\n", total);
+                return 0;
+        }
+
+        unsigned char *out = dst;
+        memcpy(out, first->buf, first->hdr.data_off);
+        out[first->hdr.sof_off + 5] = height >> 8;
+        out[first->hdr.sof_off + 6] = height & 0xFF;
+        out += first->hdr.data_off;
+        for (int i = 0; i < s->slice_count; ++i) {
+                const struct enc_slice *sl = &s->slices[i];
+                if (i > 0) {
+                        *out++ = 0xFF;
+                        *out++ = M_RST0 + ((sl->first_interval - 1) & 7);
+                }
+                size_t len = sl->len - 2 - sl->hdr.data_off;
+                memcpy(out, sl->buf + sl->hdr.data_off, len);
+                out += len;
+        }
+        *out++ = 0xFF;
+        *out++ = M_EOI;
+
+        return out - dst;
+}
+
+void jpeg_slices_encoder_destroy(struct jpeg_slices_encoder *s)
+{
+        if (!s) {
+                return;
+        }
+        for (int i = 0; i < s->max_slices; ++i) {
+                jpeg_destroy_compress(&s->slices[i].cinfo);
+                free(s->slices[i].buf);
+                free(s->slices[i].line);
+        }
+        free(s->slices);
+        free(s);
+}
+
+/*  ____  _____ ____ ___  ____  _____ ____
+ * |  _ \| ____/ ___/ _ \|  _ \| ____|  _ \
+ * | | | |  _|| |  | | | | | | |  _| | |_) |
+ * | |_| | |__| |__| |_| | |_| | |___|  _ <
+ * |____/|_____\____\___/|____/|_____|_| \_\
+ */
+struct jpeg_slices_decoder *jpeg_slices_decoder_create(int slices)
+{
+        struct jpeg_slices_decoder *s = (struct jpeg_slices_decoder *) calloc(1, sizeof *s);
+        s->max_slices = slices > 0 ? slices : get_cpu_count();
+        s->slices = (struct dec_slice *) calloc(s->max_slices, sizeof(struct dec_slice));
+        for (int i = 0; i < s->max_slices; ++i) {
+                struct dec_slice *sl = &s->slices[i];
+                sl->cinfo.err = jpeg_std_error(&sl->err.pub);
+                sl->err.pub.error_exit = slice_error_exit;
+                jpeg_create_decompress(&sl->cinfo);
+        }
+        return s;
+}
+
+bool jpeg_slices_get_dimensions(const unsigned char *src, size_t src_len, int *width, int *height)
+{
+        struct jpeg_header_info hdr;
+        if (!parse_header(src, src_len, &hdr)) {
+                return false;
+        }
+        *width = hdr.width;
+        *height = hdr.height;
+        return true;
+}
+
+/**
+ * Finds all RST markers in entropy-coded data.
+ * @returns number of markers found, -1 if entropy-coded data doesn't end with EOI
+ */
+static int find_restart_markers(struct jpeg_slices_decoder *s, const unsigned char *src, size_t len,
+                size_t data_off, size_t *data_end)
+{
+        int count = 0;
+        const unsigned char *p = src + data_off;
+        const unsigned char *end = src + len - 1;
+
+        while (p < end && (p = (const unsigned char *) memchr(p, 0xFF, end - p)) != NULL) {
+                if (p[1] == 0x00 || p[1] == 0xFF) { // stuffed byte or fill
+                        p += 1 + (p[1] == 0x00);
+                        continue;
+                }
+                if (p[1] < M_RST0 || p[1] > M_RST7) {
+                        *data_end = p - src;
+                        return p[1] == M_EOI ? count : -1;
+                }
+                if ((size_t) count == s->restart_pos_size) {
+                        s->restart_pos_size = s->restart_pos_size ? 2 * s->restart_pos_size : 1024;
+                        s->restart_pos = (size_t *) realloc(s->restart_pos, s->restart_pos_size * sizeof(size_t));
+                }
+                s->restart_pos[count++] = p - src;
+                p += 2;
+        }
+        return -1;
+}
+
+/**
+ * Creates standalone JPEG from a part of the frame - original headers (with
+ * patched height) followed by restart intervals of the slice renumbered from 0.
+ */
+static void make_slice_jpeg(struct dec_slice *sl)
+{
+        const struct jpeg_header_info *hdr = sl->hdr;
+        size_t len = hdr->data_off + (sl->data_end - sl->data_start) + 2;
+
+        if (sl->buf_size < len) {
+                free(sl->buf);
+                sl->buf_size = len + len / 4;
+                sl->buf = (unsigned char *) malloc(sl->buf_size);
+        }
+        memcpy(sl->buf, sl->src, hdr->data_off);
+        int height = sl->y_end - sl->y_start;
+        sl->buf[hdr->sof_off + 5] = height >> 8;
+        sl->buf[hdr->sof_off + 6] = height & 0xFF;
+        memcpy(sl->buf + hdr->data_off, sl->src + sl->data_start, sl->data_end - sl->data_start);
+        for (int i = 0; i < sl->restart_count; ++i) {
+                size_t pos = sl->restart_pos[i] - sl->data_start + hdr->data_off;
+                sl->buf[pos + 1] = M_RST0 + (i & 7);
+        }
+        sl->buf[len - 2] = 0xFF;
+        sl->buf[len - 1] = M_EOI;
+        sl->src = sl->buf;
+        sl->src_len = len;
+}
+
+static void *decode_slice(void *arg)
+{
+        struct dec_slice *sl = (struct dec_slice *) arg;
+        struct jpeg_decompress_struct *cinfo = &sl->cinfo;
+
+        sl->ok = false;
+        if (setjmp(sl->err.jmp)) {
+                jpeg_abort_decompress(cinfo);
+                return sl;
+        }
+
+        if (sl->hdr) {
+                make_slice_jpeg(sl);
+        }
+        jpeg_mem_src(cinfo, sl->src, sl->src_len);
+        jpeg_read_header(cinfo, TRUE);
+        if ((int) cinfo->image_height != sl->y_end - sl->y_start) {
+                fprintf(stderr, MOD_NAME "Unexpected slice height %u!\n", cinfo->image_height);
+                jpeg_abort_decompress(cinfo);
+                return sl;
+        }
+        if (sl->out_codec == UYVY) {
+                if (cinfo->jpeg_color_space != JCS_YCbCr) {
+                        fprintf(stderr, MOD_NAME "Only YCbCr JPEG can be decoded to UYVY!\n");
+                        jpeg_abort_decompress(cinfo);
+                        return sl;
+                }
+                cinfo->out_color_space = JCS_YCbCr;
+                cinfo->do_fancy_upsampling = FALSE;
+        } else {
+                cinfo->out_color_space = JCS_RGB;
+        }
+        cinfo->dct_method = JDCT_ISLOW;
+
+        jpeg_start_decompress(cinfo);
+        while (cinfo->output_scanline < cinfo->output_height) {
+                unsigned char *dst_line = sl->dst + (size_t) (sl->y_start + cinfo->output_scanline) * sl->pitch;
+                JSAMPROW row = sl->out_codec == UYVY ? sl->line : dst_line;
+                jpeg_read_scanlines(cinfo, &row, 1);
+                if (sl->out_codec == UYVY) {
+                        jfif_ycbcr_to_uyvy(dst_line, sl->line, cinfo->output_width);
+                }
+        }
+        jpeg_finish_decompress(cinfo);
+        sl->ok = true;
+
+        return sl;
+}
+
+bool jpeg_slices_decode(struct jpeg_slices_decoder *s, const unsigned char *src, size_t src_len,
+                unsigned char *dst, int pitch, codec_t out_codec)
+{
+        struct jpeg_header_info hdr;
+        int y_start[s->max_slices + 1];
+        int slice_count = 1;
+        int restart_count = 0;
+        size_t data_end = 0;
+
+        if (out_codec != UYVY && out_codec != RGB) {
+                return false;
+        }
+        if (!parse_header(src, src_len, &hdr)) {
+                fprintf(stderr, MOD_NAME "Cannot parse JPEG header!\n");
+                return false;
+        }
+
+        y_start[0] = 0;
+        y_start[1] = hdr.height;
+        int mcus_per_row = (hdr.width + hdr.mcu_width - 1) / hdr.mcu_width;
+        if (s->max_slices > 1 && hdr.sequential && hdr.restart_interval > 0 &&
+                        hdr.scan_comp_count == hdr.comp_count) {
+                slice_count = plan_slices(hdr.height, hdr.mcu_height, mcus_per_row,
+                                hdr.restart_interval, s->max_slices, y_start);
+        }
+        if (slice_count > 1) {
+                int mcu_count = mcus_per_row * ((hdr.height + hdr.mcu_height - 1) / hdr.mcu_height);
+                int interval_count = (mcu_count + hdr.restart_interval - 1) / hdr.restart_interval;
+                restart_count = find_restart_markers(s, src, src_len, hdr.data_off, &data_end);
+                if (restart_count != interval_count - 1) {
+                        // missing or superfluous restart markers (damaged frame?) - let libjpeg deal with it
+                        slice_count = 1;
+                        y_start[1] = hdr.height;
+                }
+        }
+
+        size_t line_size = 3 * (hdr.width + 1);
+        for (int i = 0; i < slice_count; ++i) {
+                struct dec_slice *sl = &s->slices[i];
+                sl->src = src;
+                sl->src_len = src_len;
+                sl->hdr = slice_count > 1 ? &hdr : NULL;
+                if (slice_count > 1) {
+                        // interval i ends with marker i - 1 (except the last one)
+                        int first = y_start[i] / hdr.mcu_height * mcus_per_row / hdr.restart_interval;
+                        int end = i == slice_count - 1 ? restart_count + 1 :
+                                y_start[i + 1] / hdr.mcu_height * mcus_per_row / hdr.restart_interval;
+                        sl->data_start = first == 0 ? hdr.data_off : s->restart_pos[first - 1] + 2;
+                        sl->data_end = end == restart_count + 1 ? data_end : s->restart_pos[end - 1];
+                        sl->restart_pos = s->restart_pos + first;
+                        sl->restart_count = end - first - 1;
+                }
+                sl->y_start = y_start[i];
+                sl->y_end = y_start[i + 1];
+                sl->dst = dst;
+                sl->pitch = pitch;
+                sl->out_codec = out_codec;
+                if (out_codec == UYVY && sl->line_size < line_size) {
+                        free(sl->line);
+                        sl->line = (unsigned char *) malloc(line_size);
+                        sl->line_size = line_size;
+                }
+        }
+
+        task_run_parallel(decode_slice, slice_count, s->slices, sizeof s->slices[0], NULL);
+        bool ok = true;
+        for (int i = 0; i < slice_count; ++i) {
+                ok = ok && s->slices[i].ok;
+        }
+
+        return ok;
+}
+
+void jpeg_slices_decoder_destroy(struct jpeg_slices_decoder *s)
+{
+        if (!s) {
+                return;
+        }
+        for (int i = 0; i < s->max_slices; ++i) {
+                jpeg_destroy_decompress(&s->slices[i].cinfo);
+                free(s->slices[i].buf);
+                free(s->slices[i].line);
+        }
+        free(s->slices);
+        free(s->restart_pos);
+        free(s);
+}
@@ -0,0 +1,116 @@
+/**
+ * @file   utils/jpeg_slices.h
+ *
+ * @brief Multithreaded CPU JPEG encoder and decoder based on libjpeg(-turbo).
+ *
+ * Frame is split into horizontal slices whose boundaries coincide with restart
+ * markers. Every slice is encoded (or decoded) by its own libjpeg instance in
+ * the worker pool and the slices are joined into (or cut out of) one baseline
+ * JPEG stream with restart interval, which is also what GPUJPEG produces and
+ * accepts.
+ *
+ * Color components are stored as full range BT.601 YCbCr (JFIF), UYVY is
+ * treated as limited range BT.709 (as elsewhere in UltraGrid).
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_JPEG_SLICES_H_
+#define UTILS_JPEG_SLICES_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JPEG_SLICES_DEFAULT_QUALITY 75
+
+struct jpeg_slices_encoder;
+struct jpeg_slices_decoder;
+
+/**
+ * @param quality          JPEG quality [1-100]
+ * @param restart_interval restart interval in MCUs, -1 for default (same as GPUJPEG),
+ *                         0 disables restart markers (and thus also slicing)
+ * @param slices           maximal number of slices, 0 means number of CPU cores
+ */
+struct jpeg_slices_encoder *jpeg_slices_encoder_create(int quality, int restart_interval, int slices);
+/**
+ * Tells whether the encoder can compress given pixel format directly
+ * (UYVY, RGB and, with libjpeg-turbo, also RGBA and BGR).
+ */
+bool jpeg_slices_encoder_supports(codec_t codec);
+/**
+ * @param src     uncompressed frame with lines pitch bytes apart
+ * @param dst     output buffer
+ * @param dst_len size of the output buffer
+ * @returns       length of the resulting JPEG or 0 on error
+ */
+size_t jpeg_slices_encode(struct jpeg_slices_encoder *s, unsigned char *src,
+                int width, int height, int pitch, codec_t codec,
+                unsigned char *dst, size_t dst_len);
+void jpeg_slices_encoder_destroy(struct jpeg_slices_encoder *s);
+
+/**
+ * @param slices maximal number of slices, 0 means number of CPU cores
+ */
+struct jpeg_slices_decoder *jpeg_slices_decoder_create(int slices);
+/**
+ * Reads dimensions of a JPEG stream.
+ */
+bool jpeg_slices_get_dimensions(const unsigned char *src, size_t src_len, int *width, int *height);
+/**
+ * Decodes JPEG to UYVY or RGB.
+ *
+ * Stream is decoded in parallel if it has a single interleaved sequential scan
+ * and restart interval that allows cutting it at MCU row boundaries, otherwise
+ * it is decoded by a single thread.
+ *
+ * @param dst   output buffer, must hold height lines pitch bytes apart
+ * @returns     true if decoded successfully
+ */
+bool jpeg_slices_decode(struct jpeg_slices_decoder *s, const unsigned char *src, size_t src_len,
+                unsigned char *dst, int pitch, codec_t out_codec);
+void jpeg_slices_decoder_destroy(struct jpeg_slices_decoder *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_JPEG_SLICES_H_
+
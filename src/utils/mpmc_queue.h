@@ -0,0 +1,274 @@
+/**
+ * @file   utils/mpmc_queue.h
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MPMC_QUEUE_H_
+#define MPMC_QUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+/**
+ * @brief bounded lock-free multi-producer multi-consumer queue
+ *
+ * Drop-in replacement of synchronized_queue for hot paths (frames passed
+ * between pipeline threads). Push and pop are lock-free (D. Vyukov's bounded
+ * MPMC queue). When the queue is full (push) or empty (pop), the caller spins
+ * for a while and then blocks on a condition variable. The mutex is touched
+ * by the other side only if somebody is actually blocked.
+ *
+ * Spin length adapts to the traffic - it grows while spinning succeeds and
+ * shrinks when the caller has to block anyway. On a single CPU, the caller
+ * only yields once to let the other side run.
+ *
+ * @tparam T type to be stored, must be default constructible and movable
+ * @tparam max_len default capacity of the queue (cannot be unlimited)
+ */
+template<typename T, int max_len = 1>
+class mpmc_queue {
+public:
+        /**
+         * @param capacity maximal number of queued elements, push blocks when reached
+         */
+        explicit mpmc_queue(size_t capacity = max_len) : m_capacity(capacity), m_cells(new cell[capacity]),
+                m_enqueue_pos(0), m_dequeue_pos(0), m_push_waiters(0), m_pop_waiters(0),
+                m_max_spin(std::thread::hardware_concurrency() > 1 ? MAX_SPIN : 0), m_spin(m_max_spin / 4)
+        {
+                static_assert(max_len > 0, "mpmc_queue must be bounded");
+                assert(capacity > 0);
+                for (size_t i = 0; i < capacity; ++i) {
+                        m_cells[i].seq.store(2 * i, std::memory_order_relaxed);
+                }
+        }
+
+        /// @returns approximate number of queued elements
+        int size()
+        {
+                size_t deq = m_dequeue_pos.load(std::memory_order_relaxed);
+                size_t enq = m_enqueue_pos.load(std::memory_order_relaxed);
+                return enq > deq ? enq - deq : 0;
+        }
+
+        void push(T const & message)
+        {
+                T copy(message);
+                push(std::move(copy));
+        }
+
+        void push(T && message)
+        {
+                if (spin([&]{return try_enqueue(message);})) {
+                        notify(m_pop_waiters, m_queue_incremented);
+                        return;
+                }
+                std::unique_lock<std::mutex> l(m_lock);
+                m_push_waiters.fetch_add(1);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                m_queue_decremented.wait(l, [&]{return try_enqueue(message);});
+                m_push_waiters.fetch_sub(1);
+                l.unlock();
+                notify(m_pop_waiters, m_queue_incremented);
+        }
+
+        /// @retval false if the queue is full, message is left untouched
+        bool try_push(T && message)
+        {
+                if (!try_enqueue(message)) {
+                        return false;
+                }
+                notify(m_pop_waiters, m_queue_incremented);
+                return true;
+        }
+
+        T pop(bool nonblocking = false)
+        {
+                T ret{};
+                if (nonblocking) {
+                        if (try_dequeue(ret)) {
+                                notify(m_push_waiters, m_queue_decremented);
+                        }
+                        return ret;
+                }
+                if (!spin([&]{return try_dequeue(ret);})) {
+                        std::unique_lock<std::mutex> l(m_lock);
+                        m_pop_waiters.fetch_add(1);
+                        std::atomic_thread_fence(std::memory_order_seq_cst);
+                        m_queue_incremented.wait(l, [&]{return try_dequeue(ret);});
+                        m_pop_waiters.fetch_sub(1);
+                }
+                notify(m_push_waiters, m_queue_decremented);
+                return ret;
+        }
+
+        /// @retval false if no element arrived within timeout
+        template<class Rep, class Period>
+        bool timed_pop(T & ret, std::chrono::duration<Rep, Period> const & timeout)
+        {
+                if (!spin([&]{return try_dequeue(ret);})) {
+                        std::unique_lock<std::mutex> l(m_lock);
+                        m_pop_waiters.fetch_add(1);
+                        std::atomic_thread_fence(std::memory_order_seq_cst);
+                        bool success = m_queue_incremented.wait_for(l, timeout, [&]{return try_dequeue(ret);});
+                        m_pop_waiters.fetch_sub(1);
+                        if (!success) {
+                                return false;
+                        }
+                }
+                notify(m_push_waiters, m_queue_decremented);
+                return true;
+        }
+
+private:
+        static constexpr int MAX_SPIN = 4000; ///< iterations, roughly tens of microseconds
+        static constexpr int MIN_SPIN = 16;
+
+        /**
+         * Cell sequence is 2*pos if the cell is free for the enqueue at pos and
+         * 2*pos+1 if it holds the element enqueued at pos (this works also for
+         * capacity 1, unlike the usual pos/pos+1).
+         */
+        struct cell {
+                std::atomic<size_t> seq;
+                T data{};
+        };
+
+        bool try_enqueue(T & message)
+        {
+                size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+                while (true) {
+                        cell &c = m_cells[pos % m_capacity];
+                        size_t seq = c.seq.load(std::memory_order_acquire);
+                        intptr_t diff = (intptr_t) seq - (intptr_t) (2 * pos);
+                        if (diff == 0) {
+                                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                                        c.data = std::move(message);
+                                        c.seq.store(2 * pos + 1, std::memory_order_release);
+                                        return true;
+                                }
+                        } else if (diff < 0) {
+                                return false;
+                        } else {
+                                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+                        }
+                }
+        }
+
+        bool try_dequeue(T & ret)
+        {
+                size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                while (true) {
+                        cell &c = m_cells[pos % m_capacity];
+                        size_t seq = c.seq.load(std::memory_order_acquire);
+                        intptr_t diff = (intptr_t) seq - (intptr_t) (2 * pos + 1);
+                        if (diff == 0) {
+                                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                                        ret = std::move(c.data);
+                                        c.seq.store(2 * (pos + m_capacity), std::memory_order_release);
+                                        return true;
+                                }
+                        } else if (diff < 0) {
+                                return false;
+                        } else {
+                                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                        }
+                }
+        }
+
+        /// retries op for the adaptive spin length
+        template<typename F>
+        bool spin(F op)
+        {
+                if (op()) {
+                        return true;
+                }
+                if (m_max_spin == 0) { // single CPU - let the other side run instead
+                        std::this_thread::yield();
+                        return op();
+                }
+                int limit = m_spin.load(std::memory_order_relaxed);
+                for (int i = 0; i < limit; ++i) {
+#if defined __x86_64__ || defined __i386__
+                        __builtin_ia32_pause();
+#endif
+                        if (op()) {
+                                // succeeded - allow spinning a bit longer next time
+                                m_spin.store(std::min(m_max_spin, limit + limit / 8 + MIN_SPIN), std::memory_order_relaxed);
+                                return true;
+                        }
+                }
+                m_spin.store(std::min(m_max_spin, std::max(MIN_SPIN, limit / 2)), std::memory_order_relaxed);
+                return false;
+        }
+
+        /// wakes the other side if it is blocked
+        void notify(std::atomic<int> & waiters, std::condition_variable & cv)
+        {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (waiters.load(std::memory_order_relaxed) > 0) {
+                        // waiter is either before the predicate check or already waiting
+                        m_lock.lock();
+                        m_lock.unlock();
+                        cv.notify_one();
+                }
+        }
+
+        const size_t              m_capacity;
+        std::unique_ptr<cell[]>   m_cells;
+        // positions are padded to separate cache lines (alignas would need
+        // aligned new of the owning structures)
+        char                      m_pad0[64];
+        std::atomic<size_t>       m_enqueue_pos;
+        char                      m_pad1[64];
+        std::atomic<size_t>       m_dequeue_pos;
+        char                      m_pad2[64];
+        std::atomic<int>          m_push_waiters;
+        std::atomic<int>          m_pop_waiters;
+        const int                 m_max_spin;
+        std::atomic<int>          m_spin;
+
+        std::mutex                m_lock;
+        std::condition_variable   m_queue_decremented;
+        std::condition_variable   m_queue_incremented;
+};
+
+#endif // MPMC_QUEUE_H_
+
@@ -0,0 +1,252 @@
+/**
+ * @file   utils/pipeline_stats.cpp
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdlib.h>
+#include <string>
+#include <time.h>
+#include <vector>
+
+#include "debug.h"
+#include "host.h"
+#include "tv.h"
+#include "utils/pipeline_stats.h"
+
+#define MOD_NAME "[pipeline] "
+#define DEFAULT_INTERVAL_SEC 5
+/// cumulative latency samples kept for the final report (almost 5 hours of 60p)
+#define MAX_TOTAL_LATENCY_SAMPLES (1<<20)
+
+using namespace std;
+using namespace std::chrono;
+
+bool pipeline_stats_on = false;
+
+ADD_TO_PARAM(pipeline_stats, "pipeline-stats",
+                "* pipeline-stats[=<interval_sec>]\n"
+                "  Print frames/s, Gbit/s, per-stage CPU usage and latency percentiles (see tools/loopback_bench.sh)\n");
+
+namespace {
+
+const char *stage_names[PIPELINE_STAGE_COUNT] = {
+        "capture", "compress", "send", "receive", "decode", "display"
+};
+
+struct snapshot {
+        steady_clock::time_point time;
+        uint64_t process_cpu_ns;
+        uint64_t cpu_ns[PIPELINE_STAGE_COUNT];
+        uint64_t frames[PIPELINE_STAGE_COUNT];
+        uint64_t bytes[PIPELINE_STAGE_COUNT];
+};
+
+struct pipeline_stats_state {
+        atomic<uint64_t> cpu_ns[PIPELINE_STAGE_COUNT];
+        atomic<uint64_t> frames[PIPELINE_STAGE_COUNT];
+        atomic<uint64_t> bytes[PIPELINE_STAGE_COUNT];
+        atomic<int64_t> next_report; ///< steady_clock ticks
+
+        steady_clock::duration interval;
+        mutex lock; ///< protects the members below
+        struct snapshot start;
+        struct snapshot last;
+        vector<uint32_t> latency_us;       ///< current interval
+        vector<uint32_t> latency_us_total;
+};
+
+struct pipeline_stats_state s;
+
+uint64_t get_cpu_time(bool thread)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+        struct timespec ts;
+        if (clock_gettime(thread ? CLOCK_THREAD_CPUTIME_ID : CLOCK_PROCESS_CPUTIME_ID, &ts) == 0) {
+                return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+        }
+#else
+        UNUSED(thread);
+#endif
+        return 0;
+}
+
+struct snapshot take_snapshot()
+{
+        struct snapshot ret;
+        ret.time = steady_clock::now();
+        ret.process_cpu_ns = get_cpu_time(false);
+        for (int i = 0; i < PIPELINE_STAGE_COUNT; ++i) {
+                ret.cpu_ns[i] = s.cpu_ns[i];
+                ret.frames[i] = s.frames[i];
+                ret.bytes[i] = s.bytes[i];
+        }
+        return ret;
+}
+
+uint32_t percentile(const vector<uint32_t> &sorted, double q)
+{
+        return sorted[min<size_t>(sorted.size() - 1, q * sorted.size())];
+}
+
+/**
+ * Prints statistics between two snapshots. Must be called with lock held.
+ */
+void print_report(const char *label, const struct snapshot &from, const struct snapshot &to,
+                vector<uint32_t> &latency_us)
+{
+        double sec = duration_cast<duration<double>>(to.time - from.time).count();
+        if (sec <= 0.0) {
+                return;
+        }
+
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "%s %.1f s: %.2f fps captured, %.2f fps displayed, "
+                        "TX %.3f Gbit/s, RX %.3f Gbit/s\n", label, sec,
+                        (to.frames[PIPELINE_STAGE_CAPTURE] - from.frames[PIPELINE_STAGE_CAPTURE]) / sec,
+                        (to.frames[PIPELINE_STAGE_DISPLAY] - from.frames[PIPELINE_STAGE_DISPLAY]) / sec,
+                        (to.bytes[PIPELINE_STAGE_SEND] - from.bytes[PIPELINE_STAGE_SEND]) * 8 / sec / 1e9,
+                        (to.bytes[PIPELINE_STAGE_RECEIVE] - from.bytes[PIPELINE_STAGE_RECEIVE]) * 8 / sec / 1e9);
+
+        // CPU usage in % of one core; "other" are threads not belonging to any
+        // stage (eg. worker pools, UDP reader, audio)
+        string cpu;
+        uint64_t stages_ns = 0;
+        for (int i = 0; i < PIPELINE_STAGE_COUNT; ++i) {
+                uint64_t ns = to.cpu_ns[i] - from.cpu_ns[i];
+                stages_ns += ns;
+                char buf[64];
+                snprintf(buf, sizeof buf, " %s %.1f", stage_names[i], ns / 1e7 / sec);
+                cpu += buf;
+        }
+        uint64_t process_ns = to.process_cpu_ns - from.process_cpu_ns;
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "%s CPU %%:%s other %.1f total %.1f\n", label, cpu.c_str(),
+                        (process_ns > stages_ns ? process_ns - stages_ns : 0) / 1e7 / sec,
+                        process_ns / 1e7 / sec);
+
+        if (latency_us.empty()) {
+                return;
+        }
+        sort(latency_us.begin(), latency_us.end());
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "%s send-to-display latency ms: p50 %.2f p90 %.2f p99 %.2f max %.2f (%zu frames)\n",
+                        label, percentile(latency_us, 0.5) / 1000.0, percentile(latency_us, 0.9) / 1000.0,
+                        percentile(latency_us, 0.99) / 1000.0, latency_us.back() / 1000.0,
+                        latency_us.size());
+}
+
+} // end of anonymous namespace
+
+void pipeline_stats_init(void)
+{
+        const char *param = get_commandline_param("pipeline-stats");
+        if (param == nullptr) {
+                return;
+        }
+        int interval = atoi(param);
+        if (interval <= 0) {
+                interval = DEFAULT_INTERVAL_SEC;
+        }
+
+        set_local_mediatime_wallclock();
+
+        s.interval = seconds(interval);
+        s.start = s.last = take_snapshot();
+        s.next_report = (s.start.time + s.interval).time_since_epoch().count();
+        pipeline_stats_on = true;
+}
+
+void pipeline_stats_done(void)
+{
+        if (!pipeline_stats_on) {
+                return;
+        }
+        lock_guard<mutex> lk(s.lock);
+        print_report("total", s.start, take_snapshot(), s.latency_us_total);
+}
+
+uint64_t pipeline_stats_begin_real(void)
+{
+        return get_cpu_time(true);
+}
+
+void pipeline_stats_end_real(enum pipeline_stage stage, uint64_t begin)
+{
+        s.cpu_ns[stage] += get_cpu_time(true) - begin;
+}
+
+void pipeline_stats_frame_real(enum pipeline_stage stage)
+{
+        s.frames[stage] += 1;
+
+        int64_t now = steady_clock::now().time_since_epoch().count();
+        if (now < s.next_report) {
+                return;
+        }
+        // do not block the pipeline thread if another one is just reporting
+        unique_lock<mutex> lk(s.lock, try_to_lock);
+        if (!lk.owns_lock() || now < s.next_report) {
+                return;
+        }
+        struct snapshot current = take_snapshot();
+        print_report("last", s.last, current, s.latency_us);
+        s.latency_us.clear();
+        s.last = current;
+        s.next_report = (current.time + s.interval).time_since_epoch().count();
+}
+
+void pipeline_stats_bytes_real(enum pipeline_stage stage, size_t bytes)
+{
+        s.bytes[stage] += bytes;
+}
+
+void pipeline_stats_latency_real(uint32_t rtp_ts)
+{
+        int32_t diff = (int32_t) (get_local_mediatime() - rtp_ts); // 90 kHz
+        uint32_t latency_us = diff > 0 ? (int64_t) diff * 1000 / 90 : 0;
+
+        lock_guard<mutex> lk(s.lock);
+        s.latency_us.push_back(latency_us);
+        if (s.latency_us_total.size() < MAX_TOTAL_LATENCY_SAMPLES) {
+                s.latency_us_total.push_back(latency_us);
+        }
+}
+
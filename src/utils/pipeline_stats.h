@@ -0,0 +1,142 @@
+/**
+ * @file   utils/pipeline_stats.h
+ * @brief  Per-stage statistics of the send/receive pipeline
+ *
+ * Enabled with "--param pipeline-stats[=<interval_sec>]". Stages measure the
+ * CPU time of the thread running them (between pipeline_stats_begin() and
+ * pipeline_stats_end()), count frames and bytes. Receiver additionally
+ * records send-to-display latency as a difference between the RTP timestamp
+ * of a frame and the media clock when the frame is passed to the display.
+ * The RTP timestamp is assigned when the frame is being sent, so capture,
+ * capture filters and compression are not included (see CPU of respective
+ * stages). With a display postprocessor, the frame is recorded when passed
+ * to the postprocessing worker, not when actually shown. When enabled,
+ * the media clock is derived from wall-clock time (see get_local_mediatime())
+ * so that the latency is also valid between two processes on the same host.
+ *
+ * Report containing frames/s, Gbit/s, per-stage CPU and latency percentiles is
+ * printed periodically and at exit. When disabled, the overhead of every hook
+ * is a test of a global flag.
+ *
+ * tools/loopback_bench.sh runs the whole pipeline over loopback with this
+ * enabled.
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_PIPELINE_STATS_H_
+#define UTILS_PIPELINE_STATS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum pipeline_stage {
+        PIPELINE_STAGE_CAPTURE,
+        PIPELINE_STAGE_COMPRESS,
+        PIPELINE_STAGE_SEND,     ///< packetization, FEC, encryption, sending
+        PIPELINE_STAGE_RECEIVE,  ///< receiving packets from network
+        PIPELINE_STAGE_DECODE,   ///< depacketization, FEC, decompression
+        PIPELINE_STAGE_DISPLAY,
+        PIPELINE_STAGE_COUNT
+};
+
+extern bool pipeline_stats_on;
+
+/**
+ * Reads the command-line parameter. Must be called before any of the pipeline
+ * threads is started.
+ */
+void pipeline_stats_init(void);
+/**
+ * Prints the final report (if enabled).
+ */
+void pipeline_stats_done(void);
+
+/**
+ * @returns current thread CPU time to be passed to pipeline_stats_end()
+ */
+uint64_t pipeline_stats_begin_real(void);
+void pipeline_stats_end_real(enum pipeline_stage stage, uint64_t begin);
+void pipeline_stats_frame_real(enum pipeline_stage stage);
+void pipeline_stats_bytes_real(enum pipeline_stage stage, size_t bytes);
+void pipeline_stats_latency_real(uint32_t rtp_ts);
+
+static inline uint64_t pipeline_stats_begin(void) {
+        return pipeline_stats_on ? pipeline_stats_begin_real() : 0;
+}
+
+static inline void pipeline_stats_end(enum pipeline_stage stage, uint64_t begin) {
+        if (pipeline_stats_on) {
+                pipeline_stats_end_real(stage, begin);
+        }
+}
+
+/**
+ * Counts a frame that has passed the stage. Periodic report is printed from
+ * here.
+ */
+static inline void pipeline_stats_frame(enum pipeline_stage stage) {
+        if (pipeline_stats_on) {
+                pipeline_stats_frame_real(stage);
+        }
+}
+
+static inline void pipeline_stats_bytes(enum pipeline_stage stage, size_t bytes) {
+        if (pipeline_stats_on) {
+                pipeline_stats_bytes_real(stage, bytes);
+        }
+}
+
+/**
+ * Records send-to-display latency of a frame passed to the display.
+ *
+ * @param rtp_ts RTP timestamp of the frame (assigned by the sender from
+ *               get_local_mediatime() when sending)
+ */
+static inline void pipeline_stats_latency(uint32_t rtp_ts) {
+        if (pipeline_stats_on) {
+                pipeline_stats_latency_real(rtp_ts);
+        }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_PIPELINE_STATS_H_
+
@@ -45,22 +45,83 @@
  *
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "debug.h"
 #include "utils/ring_buffer.h"
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define CACHE_LINE_SIZE 64
 
+/*
+ * Indices run in range [0, 2 * len) so that full and empty buffer can be
+ * distinguished without sacrificing one byte. Each index lives on its own
+ * cache line to avoid false sharing. The end index is written by the producer
+ * only, the start index by the consumer and, when ring_buffer_write()
+ * overflows, by the producer with compare-and-swap.
+ */
 struct ring_buffer {
         char *data;
         int len;
-        volatile int start, end;
+        int mirrored;
+        char pad0[CACHE_LINE_SIZE];
+        int start; ///< read index, advanced by consumer (and by producer on overflow)
+        int read_start; ///< start at the time of last ring_buffer_reserve_read(), consumer only
+        char pad1[CACHE_LINE_SIZE];
+        int end;   ///< write index, owned by producer
+        char pad2[CACHE_LINE_SIZE];
 };
 
+static inline int ring_used(struct ring_buffer *ring, int start, int end)
+{
+        int used = end - start;
+        return used < 0 ? used + 2 * ring->len : used;
+}
+
+static inline int ring_offset(struct ring_buffer *ring, int idx)
+{
+        return idx >= ring->len ? idx - ring->len : idx;
+}
+
+static inline int ring_advance(struct ring_buffer *ring, int idx, int amount)
+{
+        idx += amount;
+        return idx >= 2 * ring->len ? idx - 2 * ring->len : idx;
+}
+
+static void ring_get_regions(struct ring_buffer *ring, int idx, int len,
+                void **ptr1, int *size1, void **ptr2, int *size2)
+{
+        int offset = ring_offset(ring, idx);
+        int to_end = ring->len - offset;
+
+        *ptr1 = ring->data + offset;
+        if (ring->mirrored || len <= to_end) {
+                *size1 = len;
+                *ptr2 = NULL;
+                *size2 = 0;
+        } else {
+                *size1 = to_end;
+                *ptr2 = ring->data;
+                *size2 = len - to_end;
+        }
+}
+
 struct ring_buffer *ring_buffer_init(int size) {
         struct ring_buffer *buf;
         
-        buf = (struct ring_buffer *) malloc(sizeof(struct ring_buffer));
+        buf = (struct ring_buffer *) calloc(1, sizeof(struct ring_buffer));
         buf->data = (char *) malloc(size);
         buf->len = size;
         buf->start = 0;
@@ -68,67 +129,164 @@ struct ring_buffer *ring_buffer_init(int size) {
         return buf;
 }
 
+#ifndef WIN32
+static char *mirror_map(int len)
+{
+        int fd;
+#ifdef HAVE_MEMFD_CREATE
+        fd = memfd_create("ring_buffer", 0);
+#else
+        char name[] = "/tmp/ug-ring-XXXXXX";
+        fd = mkstemp(name);
+        if (fd != -1) {
+                unlink(name);
+        }
+#endif
+        if (fd == -1) {
+                return NULL;
+        }
+        if (ftruncate(fd, len) != 0) {
+                close(fd);
+                return NULL;
+        }
+
+        char *base = (char *) mmap(NULL, 2 * (size_t) len, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+                close(fd);
+                return NULL;
+        }
+        if (mmap(base, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+                        mmap(base + len, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+                munmap(base, 2 * (size_t) len);
+                close(fd);
+                return NULL;
+        }
+        close(fd);
+
+        return base;
+}
+#endif
+
+struct ring_buffer *ring_buffer_init_mirrored(int size) {
+#ifndef WIN32
+        long page_size = sysconf(_SC_PAGESIZE);
+        int len = (size + page_size - 1) / page_size * page_size;
+        char *data = mirror_map(len);
+
+        if (data) {
+                struct ring_buffer *buf = (struct ring_buffer *) calloc(1, sizeof(struct ring_buffer));
+                buf->data = data;
+                buf->len = len;
+                buf->mirrored = 1;
+                return buf;
+        }
+        log_msg(LOG_LEVEL_WARNING, "Unable to create mirrored ring buffer, using ordinary one.\n");
+#endif
+        return ring_buffer_init(size);
+}
+
 void ring_buffer_destroy(struct ring_buffer *ring) {
         if(ring) {
-                free(ring->data);
+#ifndef WIN32
+                if (ring->mirrored) {
+                        munmap(ring->data, 2 * (size_t) ring->len);
+                } else
+#endif
+                {
+                        free(ring->data);
+                }
                 free(ring);
         }
 }
 
-int ring_buffer_read(struct ring_buffer * ring, char *out, int max_len) {
-        int end = ring->end; /* to avoid changes under our hand */
-        int read_len = end - ring->start;
-        
-        if(read_len < 0)
-                read_len += ring->len;
+int ring_buffer_reserve_read(struct ring_buffer *ring, int max_len,
+                void **ptr1, int *size1, void **ptr2, int *size2)
+{
+        int start = __atomic_load_n(&ring->start, __ATOMIC_ACQUIRE);
+        int end = __atomic_load_n(&ring->end, __ATOMIC_ACQUIRE);
+        int read_len = ring_used(ring, start, end);
+
+        ring->read_start = start;
+
         if(read_len > max_len)
                 read_len = max_len;
-        
-        if(ring->start + read_len <= ring->len) {
-                memcpy(out, ring->data + ring->start, read_len);
-        } else {
-                int to_end = ring->len - ring->start;
-                memcpy(out, ring->data + ring->start, to_end);
-                memcpy(out + to_end, ring->data, read_len - to_end);
+        ring_get_regions(ring, start, read_len, ptr1, size1, ptr2, size2);
+        return read_len;
+}
+
+void ring_buffer_commit_read(struct ring_buffer *ring, int len)
+{
+        int start = ring->read_start;
+        // fails if the producer has already skipped the data on overflow
+        __atomic_compare_exchange_n(&ring->start, &start, ring_advance(ring, start, len), 0,
+                        __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+int ring_buffer_read(struct ring_buffer * ring, char *out, int max_len) {
+        void *ptr1, *ptr2;
+        int size1, size2;
+        int read_len = ring_buffer_reserve_read(ring, max_len, &ptr1, &size1, &ptr2, &size2);
+
+        memcpy(out, ptr1, size1);
+        if (size2 > 0) {
+                memcpy(out + size1, ptr2, size2);
         }
-        ring->start = (ring->start + read_len) % ring->len;
+        ring_buffer_commit_read(ring, read_len);
         return read_len;
 }
 
 void ring_buffer_flush(struct ring_buffer * buf) {
-        buf->start = buf->end = 0;
+        __atomic_store_n(&buf->start, __atomic_load_n(&buf->end, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
+
+int ring_buffer_reserve_write(struct ring_buffer *ring, int max_len,
+                void **ptr1, int *size1, void **ptr2, int *size2)
+{
+        int start = __atomic_load_n(&ring->start, __ATOMIC_ACQUIRE);
+        int end = ring->end;
+        int write_len = ring->len - ring_used(ring, start, end);
+
+        if(write_len > max_len)
+                write_len = max_len;
+        ring_get_regions(ring, end, write_len, ptr1, size1, ptr2, size2);
+        return write_len;
+}
+
+void ring_buffer_commit_write(struct ring_buffer *ring, int len)
+{
+        __atomic_store_n(&ring->end, ring_advance(ring, ring->end, len), __ATOMIC_RELEASE);
 }
 
 void ring_buffer_write(struct ring_buffer * ring, const char *in, int len) {
-        int to_end;
+        void *ptr1, *ptr2;
+        int size1, size2;
 
         if(len > ring->len) {
                 fprintf(stderr, "Warning: too long write request for ring buffer (%d B)!!!\n", len);
                 return;
         }
-        /* detect overrun */
+        /* detect overrun - discard the oldest data to make room for the new ones */
         {
-                int start = ring->start;
-                int read_len_old = ring->end - start;
-                int read_len_new = ((ring->end + len) % ring->len) - start;
-                
-                if(read_len_old < 0)
-                        read_len_old += ring->len;
-                if(read_len_new < 0)
-                        read_len_new += ring->len;
-                if(read_len_new < read_len_old) {
+                int start = __atomic_load_n(&ring->start, __ATOMIC_ACQUIRE);
+                int overflow = ring_used(ring, start, ring->end) + len - ring->len;
+                if (overflow > 0) {
                         fprintf(stderr, "Warning: ring buffer overflow!!!\n");
                 }
+                // retried if the consumer has read some data meanwhile
+                while (overflow > 0 && !__atomic_compare_exchange_n(&ring->start, &start,
+                                        ring_advance(ring, start, overflow), 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                        overflow = ring_used(ring, start, ring->end) + len - ring->len;
+                }
         }
-        
-        to_end = ring->len - ring->end;
-        if(len <= to_end) {
-                memcpy(ring->data + ring->end, in, len);
-        } else {
-                memcpy(ring->data + ring->end, in, to_end);
-                memcpy(ring->data, in + to_end, len - to_end);
+
+        ring_buffer_reserve_write(ring, len, &ptr1, &size1, &ptr2, &size2);
+        memcpy(ptr1, in, size1);
+        if (size2 > 0) {
+                memcpy(ptr2, in + size1, size2);
         }
-        ring->end = (ring->end + len) % ring->len;
+        ring_buffer_commit_write(ring, len);
 }
 
 int ring_get_size(struct ring_buffer * ring) {
@@ -137,6 +295,7 @@ int ring_get_size(struct ring_buffer * ring) {
 
 int ring_get_current_size(struct ring_buffer * ring)
 {
-        return (ring->end - ring->start + ring->len) % ring->len;
+        return ring_used(ring, __atomic_load_n(&ring->start, __ATOMIC_ACQUIRE),
+                        __atomic_load_n(&ring->end, __ATOMIC_ACQUIRE));
 }
 
@@ -47,8 +47,7 @@
  
  /*
   * Provides abstraction for ring buffers.
-  * Note that it doesn't offer advanced synchronization primitives and
-  * therefore is mainly intended for one producer and one consumer.
+  * The buffer is lock-free for exactly one producer and one consumer.
   */
 #ifndef __RING_BUFFER_H
 
@@ -61,11 +60,21 @@ extern "C" {
 /**
  * @warining ring_buffer is generally not thread safe. The exception is when
  * one thread reads and the other writes to the ring buffer (producer-consumer).
+ * Read and write indices are published with acquire/release semantics so
+ * no additional locking is needed in this case.
  */
 struct ring_buffer;
 typedef struct ring_buffer ring_buffer_t;
 
 struct ring_buffer *ring_buffer_init(int size);
+/**
+ * Creates ring buffer whose storage is mapped twice in a row in the virtual
+ * memory so that every region returned by reserve functions is contiguous
+ * (ptr2 is always NULL). Size is rounded up to a multiple of page size.
+ *
+ * If the platform doesn't support it, ordinary ring buffer is returned.
+ */
+struct ring_buffer *ring_buffer_init_mirrored(int size);
 void ring_buffer_destroy(struct ring_buffer * ring);
 /*
  * @param ring           ring buffer structure
@@ -74,10 +83,16 @@ void ring_buffer_destroy(struct ring_buffer * ring);
  * @return               actual data length read (ranges between 0 and max_len)
  */
 int ring_buffer_read(struct ring_buffer * ring, char *out, int max_len);
+/**
+ * Writes data to the ring buffer. If there isn't enough free space, the
+ * oldest data are discarded so that the buffer holds the most recent ones.
+ * Data being read concurrently with such an overflow may be damaged.
+ */
 void ring_buffer_write(struct ring_buffer * ring, const char *in, int len);
 int ring_get_size(struct ring_buffer * ring);
 /**
  * Flushes all data from ring buffer
+ * @note should be called from the consumer side
  */
 void ring_buffer_flush(struct ring_buffer *ring);
 /**
@@ -85,6 +100,39 @@ void ring_buffer_flush(struct ring_buffer *ring);
  */
 int ring_get_current_size(struct ring_buffer * ring);
 
+/**
+ * Returns (up to) two regions where the producer may write directly at most
+ * max_len bytes. The data become visible to the consumer only after
+ * ring_buffer_commit_write() is called. Unlike ring_buffer_write(), only
+ * free space is returned, buffered data are never discarded.
+ *
+ * @param[out] ptr1      first region
+ * @param[out] size1     size of the first region
+ * @param[out] ptr2      second (wrapped) region, NULL if not needed
+ * @param[out] size2     size of the second region
+ * @return               total size of the regions (size1 + size2)
+ */
+int ring_buffer_reserve_write(struct ring_buffer *ring, int max_len,
+                void **ptr1, int *size1, void **ptr2, int *size2);
+/**
+ * Publishes len bytes written to the regions obtained by
+ * ring_buffer_reserve_write()
+ */
+void ring_buffer_commit_write(struct ring_buffer *ring, int len);
+/**
+ * Returns (up to) two regions containing at most max_len bytes of data that
+ * the consumer may process in place.
+ *
+ * @copydetails ring_buffer_reserve_write
+ */
+int ring_buffer_reserve_read(struct ring_buffer *ring, int max_len,
+                void **ptr1, int *size1, void **ptr2, int *size2);
+/**
+ * Releases len bytes obtained by ring_buffer_reserve_read() back to the
+ * producer
+ */
+void ring_buffer_commit_read(struct ring_buffer *ring, int len);
+
 #ifdef __cplusplus
 }
 #endif
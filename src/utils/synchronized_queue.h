@@ -38,6 +38,7 @@
 #ifndef SYNCHRONIZED_QUEUE_H_
 #define SYNCHRONIZED_QUEUE_H_
 
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <queue>
@@ -105,6 +106,22 @@ public:
                 return ret;
         }
 
+        /// @retval false if no element arrived within timeout
+        template<class Rep, class Period>
+        bool timed_pop(T & result, std::chrono::duration<Rep, Period> const & timeout)
+        {
+                std::unique_lock<std::mutex> l(m_lock);
+                if (!m_queue_incremented.wait_for(l, timeout, [this]{return m_queue.size() > 0;})) {
+                        return false;
+                }
+                result = std::move(m_queue.front());
+                m_queue.pop();
+
+                l.unlock();
+                m_queue_decremented.notify_one();
+                return true;
+        }
+
 
 private:
         std::queue<T>           m_queue;
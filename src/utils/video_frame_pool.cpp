@@ -0,0 +1,227 @@
+/**
+ * @file   utils/video_frame_pool.cpp
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#ifdef HAVE_LINUX
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+#include "host.h"
+#include "utils/video_frame_pool.h"
+
+#define MOD_NAME "[frame pool] "
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define SMALL_PAGE_SIZE 4096
+#define HEADER_SIZE 64 ///< keeps the data cache-line aligned
+
+using namespace std;
+
+ADD_TO_PARAM(frame_pages, "frame-pages",
+                "* frame-pages={normal|thp|hugetlb}\n"
+                "  Pages backing video frame buffers of 2 MiB and more - normal (malloc), transparent huge pages (default)\n"
+                "  or hugetlbfs pages (need to be reserved, eg. with sysctl vm.nr_hugepages=<count>; THP are used if not available)\n");
+
+namespace {
+
+enum frame_pages {
+        FRAME_PAGES_NORMAL,
+        FRAME_PAGES_THP,
+        FRAME_PAGES_HUGETLB,
+};
+
+struct frame_allocator_state {
+        once_flag init;
+        atomic<enum frame_pages> mode{FRAME_PAGES_NORMAL}; ///< may fall back from hugetlb to THP
+        bool numa = false;          ///< system has more than one NUMA node
+};
+
+/**
+ * Stored right before the returned buffer so that frame_data_deallocate()
+ * knows how the buffer was allocated without any shared bookkeeping.
+ */
+struct frame_data_header {
+        void *base;      ///< start of the allocation (aligned_malloc'd or mmapped)
+        size_t map_len;  ///< length of the mapping, 0 if aligned_malloc'd
+};
+static_assert(sizeof(frame_data_header) <= HEADER_SIZE, "header doesn't fit");
+
+inline frame_data_header *header_of(void *data)
+{
+        return (frame_data_header *) ((char *) data - HEADER_SIZE);
+}
+
+struct frame_allocator_state s;
+
+void init()
+{
+#ifdef HAVE_LINUX
+        s.mode = FRAME_PAGES_THP;
+        s.numa = access("/sys/devices/system/node/node1", F_OK) == 0;
+#endif
+        const char *param = get_commandline_param("frame-pages");
+        if (param == nullptr) {
+                return;
+        }
+        if (strcmp(param, "normal") == 0) {
+                s.mode = FRAME_PAGES_NORMAL;
+        } else if (strcmp(param, "thp") == 0 || strcmp(param, "hugetlb") == 0) {
+#ifdef HAVE_LINUX
+                s.mode = strcmp(param, "thp") == 0 ? FRAME_PAGES_THP : FRAME_PAGES_HUGETLB;
+#else
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Huge pages are supported only on Linux.\n");
+#endif
+        } else {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Unknown frame-pages value: %s, using default.\n", param);
+        }
+}
+
+#ifdef HAVE_LINUX
+/**
+ * Sets preferred NUMA node of the (not yet touched) pages to the node of the
+ * calling thread. First touch would do the same but the buffer may be touched
+ * first by another thread than the one that fills it (eg. the zeroing memset
+ * of the capture).
+ */
+void bind_to_current_node(void *ptr, size_t len)
+{
+        unsigned cpu, node;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0 || node >= sizeof(unsigned long) * 8) {
+                return;
+        }
+        unsigned long nodemask = 1ul << node;
+        if (syscall(SYS_mbind, ptr, len, MPOL_PREFERRED, &nodemask, sizeof nodemask * 8, 0) != 0) {
+                log_msg(LOG_LEVEL_DEBUG, MOD_NAME "mbind: %s\n", strerror(errno));
+        }
+}
+
+/**
+ * @returns buffer with a header in front of it, the buffer itself is aligned to
+ *          huge page for THP (the header is in a preceding small page, so that
+ *          writing it doesn't fault the first huge page in)
+ */
+void *map_huge(size_t size)
+{
+        void *data = nullptr;
+        if (s.mode == FRAME_PAGES_HUGETLB) {
+                size_t len = (HEADER_SIZE + size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+                void *ret = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                if (ret == MAP_FAILED) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot map hugetlbfs pages (%s), using THP.\n", strerror(errno));
+                        s.mode = FRAME_PAGES_THP;
+                } else {
+                        if (s.numa) {
+                                bind_to_current_node(ret, len);
+                        }
+                        data = (char *) ret + HEADER_SIZE;
+                        *header_of(data) = { ret, len };
+                }
+        }
+        if (data == nullptr) {
+                size_t len = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+                // over-allocate and trim to have the buffer aligned to huge page
+                char *raw = (char *) mmap(nullptr, SMALL_PAGE_SIZE + len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (raw == MAP_FAILED) {
+                        return nullptr;
+                }
+                char *aligned = (char *) (((uintptr_t) raw + SMALL_PAGE_SIZE + HUGE_PAGE_SIZE - 1) & ~((uintptr_t) HUGE_PAGE_SIZE - 1));
+                char *base = aligned - SMALL_PAGE_SIZE;
+                if (base != raw) {
+                        munmap(raw, base - raw);
+                }
+                munmap(aligned + len, raw + SMALL_PAGE_SIZE + len + HUGE_PAGE_SIZE - (aligned + len));
+                madvise(aligned, len, MADV_HUGEPAGE);
+                if (s.numa) {
+                        bind_to_current_node(aligned, len);
+                }
+                data = aligned;
+                *header_of(data) = { base, SMALL_PAGE_SIZE + len };
+        }
+        return data;
+}
+#endif // defined HAVE_LINUX
+
+} // end of anonymous namespace
+
+void *frame_data_allocate(size_t size)
+{
+        call_once(s.init, init);
+#ifdef HAVE_LINUX
+        if (s.mode != FRAME_PAGES_NORMAL && size >= HUGE_PAGE_SIZE) {
+                void *ret = map_huge(size);
+                if (ret != nullptr) {
+                        return ret;
+                }
+        }
+#endif
+        void *base = aligned_malloc(HEADER_SIZE + size, HEADER_SIZE);
+        if (base == nullptr) {
+                return nullptr;
+        }
+        void *data = (char *) base + HEADER_SIZE;
+        *header_of(data) = { base, 0 };
+        return data;
+}
+
+void frame_data_deallocate(void *ptr)
+{
+        if (ptr == nullptr) {
+                return;
+        }
+        frame_data_header h = *header_of(ptr);
+#ifdef HAVE_LINUX
+        if (h.map_len > 0) {
+                munmap(h.base, h.map_len);
+                return;
+        }
+#endif
+        aligned_free(h.base);
+}
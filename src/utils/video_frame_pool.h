@@ -47,27 +47,138 @@
 #include "video.h"
 
 #ifdef __cplusplus
+extern "C" {
+#endif
 
+/**
+ * Allocates a frame data buffer according to the policy set with
+ * "--param frame-pages". Large buffers are by default backed by transparent
+ * huge pages (Linux), optionally by hugetlbfs pages and bound to the NUMA node
+ * of the calling thread (the thread that calls video_frame_pool::get_frame()
+ * is the one that fills the frame). Pages of the buffer are not touched here
+ * so that they are placed by the first write otherwise.
+ *
+ * The allocation method is recorded in a small header preceding the buffer,
+ * so the buffer must be released with frame_data_deallocate().
+ */
+void *frame_data_allocate(size_t size);
+void frame_data_deallocate(void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+
+#include <atomic>
 #include <condition_variable>
+#include <functional>
 #include <iostream>
 #include <mutex>
 #include <memory>
-#include <queue>
 #include <stdexcept>
+#include <thread>
 
 struct default_data_allocator {
         void *allocate(size_t size) {
-                return malloc(size);
+                return frame_data_allocate(size);
         }
         void deallocate(void *ptr) {
-                free(ptr);
+                frame_data_deallocate(ptr);
         }
 };
 
+/**
+ * Bounded lock-free MPMC queue of free frames (D. Vyukov's algorithm).
+ */
+class video_frame_free_list {
+        public:
+                struct item {
+                        struct video_frame *frame;
+                        int generation;
+                };
+
+                video_frame_free_list() : m_enqueue_pos(0), m_dequeue_pos(0) {
+                        for (size_t i = 0; i < SIZE; ++i) {
+                                m_cells[i].seq.store(i, std::memory_order_relaxed);
+                        }
+                }
+
+                /// @retval false if full
+                bool push(item const &it) {
+                        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+                        while (true) {
+                                cell &c = m_cells[pos & (SIZE - 1)];
+                                size_t seq = c.seq.load(std::memory_order_acquire);
+                                intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+                                if (diff == 0) {
+                                        if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                                                c.data = it;
+                                                c.seq.store(pos + 1, std::memory_order_release);
+                                                return true;
+                                        }
+                                } else if (diff < 0) {
+                                        return false;
+                                } else {
+                                        pos = m_enqueue_pos.load(std::memory_order_relaxed);
+                                }
+                        }
+                }
+
+                /// @retval false if empty
+                bool pop(item &it) {
+                        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                        while (true) {
+                                cell &c = m_cells[pos & (SIZE - 1)];
+                                size_t seq = c.seq.load(std::memory_order_acquire);
+                                intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+                                if (diff == 0) {
+                                        if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                                                it = c.data;
+                                                c.seq.store(pos + SIZE, std::memory_order_release);
+                                                return true;
+                                        }
+                                } else if (diff < 0) {
+                                        return false;
+                                } else {
+                                        pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                                }
+                        }
+                }
+
+        private:
+                static constexpr size_t SIZE = 64; ///< power of 2, frames returned to a full list are freed
+                struct cell {
+                        std::atomic<size_t> seq;
+                        item data;
+                };
+                cell m_cells[SIZE];
+                // positions are padded to separate cache lines (alignas would need
+                // aligned new of the owning structures)
+                char m_pad0[64];
+                std::atomic<size_t> m_enqueue_pos;
+                char m_pad1[64];
+                std::atomic<size_t> m_dequeue_pos;
+};
+
+/**
+ * Frames are taken from and returned to a lock-free free list. The mutex is
+ * only used when a new frame is allocated, on reconfiguration and for waiting
+ * if max_used_frames is reached.
+ *
+ * Each free frame carries the generation it was allocated for, frames of
+ * previous generations (before reconfigure()) are freed instead of being
+ * reused.
+ */
 template <typename allocator>
 struct video_frame_pool {
         public:
-                video_frame_pool() : m_generation(0), m_desc(), m_max_data_len(0), m_unreturned_frames(0) {
+                /**
+                 * @param max_used_frames maximal number of frames given out at once,
+                 *                        get_frame() blocks when reached, 0 means unlimited
+                 */
+                video_frame_pool(unsigned int max_used_frames = 0) : m_generation(0), m_desc(),
+                        m_max_data_len(0), m_unreturned_frames(0), m_waiting(0), m_releasing(0), m_max_used_frames(max_used_frames) {
                 }
 
                 virtual ~video_frame_pool() {
@@ -75,25 +186,49 @@ struct video_frame_pool {
                         remove_free_frames();
                         // wait also for all frames we gave out to return us
                         assert(m_unreturned_frames >= 0);
+                        m_waiting += 1;
                         m_frame_returned.wait(lk, [this] {return m_unreturned_frames == 0;});
+                        m_waiting -= 1;
+                        lk.unlock();
+                        // the deleter that returned the last frame may still be notifying us
+                        while (m_releasing > 0) {
+                                std::this_thread::yield();
+                        }
+                        lk.lock();
+                        remove_free_frames();
                 }
 
                 void reconfigure(struct video_desc new_desc, size_t new_size) {
                         std::unique_lock<std::mutex> lk(m_lock);
                         m_desc = new_desc;
                         m_max_data_len = new_size;
-                        remove_free_frames();
                         m_generation++;
+                        remove_free_frames();
                 }
 
                 std::shared_ptr<video_frame> get_frame() {
                         assert(m_generation != 0);
-                        struct video_frame *ret = NULL;
-                        std::unique_lock<std::mutex> lk(m_lock);
-                        if (!m_free_frames.empty()) {
-                                ret = m_free_frames.front();
-                                m_free_frames.pop();
+                        if (m_max_used_frames > 0) {
+                                reserve_frame();
                         } else {
+                                m_unreturned_frames += 1;
+                        }
+
+                        struct video_frame *ret = NULL;
+                        int generation = m_generation;
+                        video_frame_free_list::item it;
+                        while (m_free_frames.pop(it)) {
+                                if (it.generation == generation) {
+                                        ret = it.frame;
+                                        break;
+                                }
+                                std::unique_lock<std::mutex> lk(m_lock);
+                                deallocate_frame(it.frame);
+                        }
+
+                        if (ret == NULL) {
+                                std::unique_lock<std::mutex> lk(m_lock);
+                                generation = m_generation;
                                 try {
                                         ret = vf_alloc_desc(m_desc);
                                         for (unsigned int i = 0; i < m_desc.tile_count; ++i) {
@@ -107,22 +242,22 @@ struct video_frame_pool {
                                 } catch (std::exception &e) {
                                         std::cerr << e.what() << std::endl;
                                         deallocate_frame(ret);
+                                        lk.unlock();
+                                        release_frame();
                                         throw e;
                                 }
                         }
-                        m_unreturned_frames += 1;
-                        return std::shared_ptr<video_frame>(ret, std::bind([this](struct video_frame *frame, int generation) {
-                                        std::unique_lock<std::mutex> lk(m_lock);
-
-                                        m_unreturned_frames -= 1;
-                                        m_frame_returned.notify_one();
 
-                                        if (this->m_generation != generation) {
+                        return std::shared_ptr<video_frame>(ret, std::bind([this](struct video_frame *frame, int generation) {
+                                        m_releasing += 1;
+                                        if (this->m_generation != generation ||
+                                                        !m_free_frames.push({frame, generation})) {
+                                                std::unique_lock<std::mutex> lk(m_lock);
                                                 this->deallocate_frame(frame);
-                                        } else {
-                                                m_free_frames.push(frame);
                                         }
-                                }, std::placeholders::_1, m_generation));
+                                        release_frame();
+                                        m_releasing -= 1; // must be the last access to this
+                                }, std::placeholders::_1, generation));
                 }
 
                 allocator & get_allocator() {
@@ -130,11 +265,38 @@ struct video_frame_pool {
                 }
 
         private:
+                /// waits until a frame can be given out without exceeding m_max_used_frames
+                void reserve_frame() {
+                        int unreturned = m_unreturned_frames;
+                        while (true) {
+                                if (unreturned < (int) m_max_used_frames) {
+                                        if (m_unreturned_frames.compare_exchange_weak(unreturned, unreturned + 1)) {
+                                                return;
+                                        }
+                                        continue;
+                                }
+                                std::unique_lock<std::mutex> lk(m_lock);
+                                m_waiting += 1;
+                                m_frame_returned.wait(lk, [this] {
+                                                return m_unreturned_frames < (int) m_max_used_frames;});
+                                m_waiting -= 1;
+                                unreturned = m_unreturned_frames;
+                        }
+                }
+
+                void release_frame() {
+                        m_unreturned_frames -= 1;
+                        if (m_waiting > 0) {
+                                std::unique_lock<std::mutex> lk(m_lock);
+                                m_frame_returned.notify_all();
+                        }
+                }
+
+                /// must be called with m_lock held
                 void remove_free_frames() {
-                        while (!m_free_frames.empty()) {
-                                struct video_frame *frame = m_free_frames.front();
-                                m_free_frames.pop();
-                                deallocate_frame(frame);
+                        video_frame_free_list::item it;
+                        while (m_free_frames.pop(it)) {
+                                deallocate_frame(it.frame);
                         }
                 }
 
@@ -147,13 +309,16 @@ struct video_frame_pool {
                         vf_free(frame);
                 }
 
-                std::queue<struct video_frame *> m_free_frames;
+                video_frame_free_list m_free_frames;
                 std::mutex        m_lock;
                 std::condition_variable m_frame_returned;
-                int               m_generation;
+                std::atomic<int>  m_generation;
                 struct video_desc m_desc;
                 size_t            m_max_data_len;
-                int               m_unreturned_frames;
+                std::atomic<int>  m_unreturned_frames;
+                std::atomic<int>  m_waiting;   ///< threads waiting for m_frame_returned
+                std::atomic<int>  m_releasing; ///< deleters currently running
+                unsigned int      m_max_used_frames;
                 allocator         m_allocator;
 };
 #endif //  __cplusplus
@@ -51,209 +51,516 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+/**
+ * @file
+ * Work-stealing task pool.
+ *
+ * Every worker has its own deque of tasks. Tasks submitted from a worker
+ * (nested tasks) are pushed to its own deque, other tasks are distributed
+ * round-robin. A worker pops tasks from the back of its deque and steals from
+ * the front of the others. Idle workers spin for a while before they park,
+ * so that tasks submitted at high rate do not pay a wakeup, the same holds for
+ * wait_task(). Every queued task that a spinning worker won't pick up wakes
+ * a parked one. wait_task() runs the awaited task itself if no worker has
+ * started it yet.
+ *
+ * The pool grows as before - a submitted task claims one of the free workers
+ * or a new worker is created (up to MAX_WORKERS). Thus a task that blocks
+ * (eg. waits for another task) never prevents other tasks from running.
+ */
+
 #include "utils/worker.h"
 
 #include <algorithm>
-#include <queue>
-#include <set>
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <pthread.h>
+#include <thread>
+#include <vector>
+
+#define MAX_WORKERS 256
+#define SPIN_ITERATIONS 4000 ///< roughly tens of microseconds
+#define SPINLOCK_SPINS 100
 
 using namespace std;
 
-struct wp_worker;
+namespace {
+
+inline void cpu_relax()
+{
+#if defined __x86_64__ || defined __i386__
+        __builtin_ia32_pause();
+#endif
+}
 
-struct worker_state_observer {
-        virtual ~worker_state_observer() {}
-        virtual void notify(wp_worker *) = 0;
+class spinlock {
+public:
+        void lock() {
+                for (int i = 0; m_flag.test_and_set(memory_order_acquire); ++i) {
+                        if (i < SPINLOCK_SPINS) {
+                                cpu_relax();
+                        } else { // holder has probably been preempted
+                                this_thread::yield();
+                        }
+                }
+        }
+        void unlock() {
+                m_flag.clear(memory_order_release);
+        }
+private:
+        atomic_flag m_flag = ATOMIC_FLAG_INIT;
 };
 
 /**
  * @brief Holds data to be passed to worker.
  */
-struct wp_task_data {
-        wp_task_data(runnable_t task, void *data, wp_worker *w, bool detached) : m_task(task), m_data(data),
-                m_result(0), m_returned(false), m_w(w), m_detached(detached) {}
+class worker_pool;
+struct wp_worker;
+
+struct wp_task {
+        wp_task(runnable_t task, void *data, bool detached) : m_task(task), m_data(data),
+                m_result(nullptr), m_done(false), m_detached(detached), m_queue(nullptr) {}
         runnable_t m_task;
         void *m_data;
         void *m_result;
-        bool m_returned;
-        struct wp_worker *m_w;
+        atomic<bool> m_done;
         bool m_detached;
+        wp_worker *m_queue; ///< worker the task has been queued to
 };
 
-/**
- * @brief This class represents a worker that is called from within the pool
- */
 struct wp_worker {
-        wp_worker(worker_state_observer &observer) :
-                m_state_observer(observer)
-        {
-                int ret;
-                ret = pthread_mutex_init(&m_lock, NULL);
-                assert(ret == 0);
-                ret = pthread_cond_init(&m_task_ready_cv, NULL);
-                assert(ret == 0);
-                ret = pthread_cond_init(&m_task_completed_cv, NULL);
-                assert(ret == 0);
-
-                ret = pthread_create(&m_thread_id, NULL, wp_worker::enter_loop, this);
-                assert(ret == 0);
+        wp_worker(worker_pool *pool, int id) : m_pool(pool), m_id(id), m_woken(false) {
+                pthread_cond_init(&m_park_cv, NULL);
         }
         ~wp_worker() {
-                wp_task_data *poisoned = new wp_task_data(NULL, NULL, this, false);
-                this->push(poisoned);
-
-                pthread_join(m_thread_id, NULL);
-                pthread_mutex_destroy(&m_lock);
-                pthread_cond_destroy(&m_task_ready_cv);
-                pthread_cond_destroy(&m_task_completed_cv);
+                pthread_cond_destroy(&m_park_cv);
         }
-        static void      *enter_loop(void *args);
-        void              run();
+        worker_pool      *m_pool;
+        int               m_id;
+        pthread_t         m_thread_id;
+        pthread_cond_t    m_park_cv; ///< signalized when the worker is unparked
+        bool              m_woken;   ///< protected by worker_pool::m_park_lock
+        spinlock          m_lock; ///< protects m_tasks
+        deque<wp_task *>  m_tasks;
+        atomic<int>       m_size{0}; ///< size of m_tasks, to skip empty deques without locking
+};
 
-        void              push(wp_task_data *);
-        void             *pop(wp_task_data *);
+/// index of the worker running in the current thread, -1 if not a worker
+thread_local int current_worker = -1;
 
-        queue<wp_task_data*> m_data;
-        pthread_mutex_t   m_lock;
-        pthread_cond_t    m_task_ready_cv;
-        pthread_cond_t    m_task_completed_cv;
-        pthread_t         m_thread_id;
+class worker_pool
+{
+        public:
+                worker_pool();
+                ~worker_pool();
 
-        worker_state_observer &m_state_observer;
+                task_result_handle_t run_async(runnable_t task, void *data, bool detached);
+                void *wait_task(task_result_handle_t handle);
+                bool set_affinity(const char *cpu_list);
+
+        private:
+                static void *enter_loop(void *args);
+                void run(wp_worker *w);
+                wp_task *take(wp_worker *w);
+                bool take_queued(wp_task *t);
+                bool spin();
+                void execute(wp_task *t);
+                void spawn_worker();
+                void park(wp_worker *w);
+                void unpark_one();
+                void pin(wp_worker *w);
+
+                atomic<wp_worker *> m_workers[MAX_WORKERS];
+                atomic<int>      m_worker_count;
+                atomic<int>      m_free;      ///< workers not running any task minus queued tasks
+                atomic<int>      m_queued;
+                atomic<int>      m_spinning;
+                atomic<int>      m_parked;
+                atomic<int>      m_parked_waiters;
+                atomic<unsigned> m_next_queue;
+                atomic<bool>     m_exit;
+                int              m_max_spinning;
+
+                pthread_mutex_t  m_park_lock;
+                vector<wp_worker *> m_parked_workers; ///< stack, protected by m_park_lock
+                pthread_mutex_t  m_done_lock;
+                pthread_cond_t   m_done_cv;
+                pthread_mutex_t  m_spawn_lock; ///< protects worker creation and m_cpus
+                vector<int>      m_cpus;
 };
 
-void *wp_worker::enter_loop(void *args) {
-        wp_worker *instance = (wp_worker *) args;
-        instance->run();
+worker_pool::worker_pool() : m_worker_count(0), m_free(0), m_queued(0), m_spinning(0),
+        m_parked(0), m_parked_waiters(0), m_next_queue(0), m_exit(false)
+{
+        // spinning only makes sense if there is another CPU to submit the task
+        unsigned cpus = thread::hardware_concurrency();
+        m_max_spinning = cpus > 1 ? max<int>(1, cpus / 2) : 0;
+
+        pthread_mutex_init(&m_park_lock, NULL);
+        pthread_mutex_init(&m_done_lock, NULL);
+        pthread_cond_init(&m_done_cv, NULL);
+        pthread_mutex_init(&m_spawn_lock, NULL);
+}
+
+worker_pool::~worker_pool()
+{
+        // workers finish all queued tasks before exiting
+        pthread_mutex_lock(&m_park_lock);
+        m_exit = true;
+        for (auto w : m_parked_workers) {
+                pthread_cond_signal(&w->m_park_cv);
+        }
+        pthread_mutex_unlock(&m_park_lock);
+
+        for (int i = 0; i < m_worker_count; ++i) {
+                pthread_join(m_workers[i].load()->m_thread_id, NULL);
+                delete m_workers[i].load();
+        }
 
+        pthread_mutex_destroy(&m_spawn_lock);
+        pthread_cond_destroy(&m_done_cv);
+        pthread_mutex_destroy(&m_done_lock);
+        pthread_mutex_destroy(&m_park_lock);
+}
+
+void *worker_pool::enter_loop(void *args)
+{
+        wp_worker *w = (wp_worker *) args;
+        w->m_pool->run(w);
         return NULL;
 }
 
-void wp_worker::run() {
-        while(1) {
-                struct wp_task_data *data;
-                pthread_mutex_lock(&m_lock);
-                while(m_data.empty()) {
-                        pthread_cond_wait(&m_task_ready_cv, &m_lock);
-                }
-                data = m_data.front();
-                m_data.pop();
-                pthread_mutex_unlock(&m_lock);
+void worker_pool::spawn_worker()
+{
+        pthread_mutex_lock(&m_spawn_lock);
+        int id = m_worker_count;
+        if (id == MAX_WORKERS) { // tasks will wait for a worker to finish
+                pthread_mutex_unlock(&m_spawn_lock);
+                return;
+        }
+        wp_worker *w = new wp_worker(this, id);
+        int ret = pthread_create(&w->m_thread_id, NULL, worker_pool::enter_loop, w);
+        assert(ret == 0);
+        (void) ret;
+        pin(w);
+        m_workers[id] = w;
+        m_worker_count = id + 1;
+        m_free += 1;
+        pthread_mutex_unlock(&m_spawn_lock);
+}
 
-                // poisoned pill
-                if(data->m_task == NULL) {
-                        delete data;
-                        return;
-                }
+/// must be called with m_spawn_lock held
+void worker_pool::pin(wp_worker *w)
+{
+#ifdef HAVE_LINUX
+        if (m_cpus.empty()) {
+                return;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(m_cpus[w->m_id % m_cpus.size()], &set);
+        pthread_setaffinity_np(w->m_thread_id, sizeof set, &set);
+#else
+        (void) w;
+#endif
+}
+
+task_result_handle_t worker_pool::run_async(runnable_t task, void *data, bool detached)
+{
+        wp_task *t = new wp_task(task, data, detached);
+
+        // claim a free worker or create a new one
+        if (m_free.fetch_sub(1) <= 0) {
+                spawn_worker();
+        }
+
+        int count = m_worker_count;
+        int idx = current_worker >= 0 ? current_worker : m_next_queue++ % count;
+        wp_worker *w = m_workers[idx];
+        t->m_queue = w;
+        w->m_lock.lock();
+        w->m_tasks.push_back(t);
+        w->m_size += 1;
+        w->m_lock.unlock();
+
+        // wake a parked worker for every task that a spinning one won't pick up
+        if (m_queued.fetch_add(1) >= m_spinning && m_parked > 0) {
+                unpark_one();
+        }
 
-                void *res = data->m_task(data->m_data);
+        return t;
+}
 
-                pthread_mutex_lock(&m_lock);
-                data->m_result = res;
-                data->m_returned = true;
-                pthread_cond_signal(&m_task_completed_cv);
-                m_state_observer.notify(this);
-                if (data->m_detached) {
-                        delete data;
+/**
+ * Pops a task from the back of own deque or steals one from the front of
+ * other's.
+ */
+wp_task *worker_pool::take(wp_worker *w)
+{
+        wp_task *t = nullptr;
+        int count = m_worker_count;
+        for (int i = 0; i < count && t == nullptr; ++i) {
+                wp_worker *victim = m_workers[(w->m_id + i) % count];
+                if (victim->m_size == 0) {
+                        continue;
                 }
-                pthread_mutex_unlock(&m_lock);
+                victim->m_lock.lock();
+                if (!victim->m_tasks.empty()) {
+                        victim->m_size -= 1;
+                        if (victim == w) {
+                                t = victim->m_tasks.back();
+                                victim->m_tasks.pop_back();
+                        } else {
+                                t = victim->m_tasks.front();
+                                victim->m_tasks.pop_front();
+                        }
+                }
+                victim->m_lock.unlock();
         }
+        if (t) {
+                m_queued -= 1;
+        }
+        return t;
 }
 
-void wp_worker::push(wp_task_data *data) {
-        pthread_mutex_lock(&m_lock);
-        assert(m_data.size() == 0);
-        m_data.push(data);
-        pthread_cond_signal(&m_task_ready_cv);
-        pthread_mutex_unlock(&m_lock);
+/**
+ * Removes the task from its deque if no worker has taken it yet.
+ */
+bool worker_pool::take_queued(wp_task *t)
+{
+        wp_worker *w = t->m_queue;
+        if (w->m_size == 0) {
+                return false;
+        }
+        bool found = false;
+        w->m_lock.lock();
+        // nested tasks are pushed to the back, so search from there
+        for (auto it = w->m_tasks.rbegin(); it != w->m_tasks.rend(); ++it) {
+                if (*it == t) {
+                        w->m_tasks.erase(next(it).base());
+                        w->m_size -= 1;
+                        found = true;
+                        break;
+                }
+        }
+        w->m_lock.unlock();
+        if (found) {
+                m_queued -= 1;
+        }
+        return found;
 }
 
-void *wp_worker::pop(wp_task_data *d) {
-        void *res = NULL;
+/**
+ * @retval true a task has been queued meanwhile
+ */
+bool worker_pool::spin()
+{
+        if (m_spinning.fetch_add(1) >= m_max_spinning) {
+                m_spinning -= 1;
+                return false;
+        }
+        bool ret = false;
+        for (int i = 0; i < SPIN_ITERATIONS; ++i) {
+                if (m_queued > 0) {
+                        ret = true;
+                        break;
+                }
+                cpu_relax();
+        }
+        m_spinning -= 1;
+        return ret;
+}
 
-        pthread_mutex_lock(&m_lock);
-        while(!d->m_returned) {
-                pthread_cond_wait(&m_task_completed_cv, &m_lock);
+void worker_pool::execute(wp_task *t)
+{
+        void *res = t->m_task(t->m_data);
+        if (t->m_detached) {
+                delete t;
+                return;
+        }
+        t->m_result = res;
+        t->m_done = true;
+        if (m_parked_waiters > 0) {
+                pthread_mutex_lock(&m_done_lock);
+                pthread_cond_broadcast(&m_done_cv);
+                pthread_mutex_unlock(&m_done_lock);
         }
-        res = d->m_result;
-        delete d;
-        pthread_mutex_unlock(&m_lock);
+}
 
-        return res;
+/**
+ * Parks the worker until a task is queued. The most recently parked worker is
+ * woken first - its cache is the warmest and the others may stay asleep.
+ */
+void worker_pool::park(wp_worker *w)
+{
+        pthread_mutex_lock(&m_park_lock);
+        m_parked_workers.push_back(w);
+        m_parked += 1;
+        // pairs with the check of m_parked in run_async() after m_queued is incremented
+        if (m_queued == 0 && !m_exit) {
+                while (!w->m_woken && !m_exit) {
+                        pthread_cond_wait(&w->m_park_cv, &m_park_lock);
+                }
+        }
+        if (w->m_woken) { // removed by unpark_one()
+                w->m_woken = false;
+        } else {
+                m_parked_workers.erase(find(m_parked_workers.begin(), m_parked_workers.end(), w));
+                m_parked -= 1;
+        }
+        pthread_mutex_unlock(&m_park_lock);
 }
 
-static void func_delete(wp_worker *arg) {
-        delete arg;
+void worker_pool::unpark_one()
+{
+        pthread_mutex_lock(&m_park_lock);
+        if (!m_parked_workers.empty()) {
+                wp_worker *w = m_parked_workers.back();
+                m_parked_workers.pop_back();
+                m_parked -= 1;
+                w->m_woken = true;
+                pthread_cond_signal(&w->m_park_cv);
+        }
+        pthread_mutex_unlock(&m_park_lock);
 }
 
-class worker_pool : public worker_state_observer
+void worker_pool::run(wp_worker *w)
 {
-        public:
-                worker_pool() {
-                        pthread_mutex_init(&m_lock, NULL);
-                        pthread_cond_init(&m_worker_finished, NULL);
+        current_worker = w->m_id;
+
+        while (true) {
+                wp_task *t = take(w);
+                if (t) {
+                        execute(t);
+                        m_free += 1;
+                        continue;
+                }
+                if (spin()) {
+                        continue;
                 }
 
-                ~worker_pool() {
-                        pthread_mutex_lock(&m_lock);
-                        while (m_occupied_workers.size() > 0) {
-                                pthread_cond_wait(&m_worker_finished, &m_lock);
-                        }
-                        pthread_mutex_unlock(&m_lock);
+                park(w);
+                if (m_exit && m_queued == 0) {
+                        return;
+                }
+        }
+}
 
-                        for_each(m_empty_workers.begin(),
-                                        m_empty_workers.end(), func_delete);
-                        pthread_cond_destroy(&m_worker_finished);
-                        pthread_mutex_destroy(&m_lock);
+void *worker_pool::wait_task(task_result_handle_t handle)
+{
+        wp_task *t = (wp_task *) handle;
+
+        // Run the task in the waiting thread if it hasn't been started yet. This
+        // saves a wakeup and a context switch and, since the waiting thread
+        // doesn't block on a queued task, nested waits cannot deadlock even if
+        // all MAX_WORKERS workers are waiting.
+        if (!t->m_done && take_queued(t)) {
+                execute(t);
+                m_free += 1;
+        }
+
+        for (int i = 0; m_max_spinning > 0 && i < SPIN_ITERATIONS && !t->m_done; ++i) {
+                cpu_relax();
+        }
+        if (!t->m_done) {
+                pthread_mutex_lock(&m_done_lock);
+                m_parked_waiters += 1;
+                while (!t->m_done) {
+                        pthread_cond_wait(&m_done_cv, &m_done_lock);
                 }
+                m_parked_waiters -= 1;
+                pthread_mutex_unlock(&m_done_lock);
+        }
+
+        void *res = t->m_result;
+        delete t;
+        return res;
+}
 
-                void notify(wp_worker *w) {
-                        pthread_mutex_lock(&m_lock);
-                        m_occupied_workers.erase(w);
-                        m_empty_workers.insert(w);
-                        pthread_mutex_unlock(&m_lock);
-                        pthread_cond_signal(&m_worker_finished);
+/**
+ * @param cpu_list comma-separated list of CPUs or ranges (eg. "0,2-5"), all online CPUs if empty
+ */
+bool worker_pool::set_affinity(const char *cpu_list)
+{
+#ifdef HAVE_LINUX
+        vector<int> cpus;
+        if (strlen(cpu_list) == 0) {
+                for (unsigned i = 0; i < thread::hardware_concurrency(); ++i) {
+                        cpus.push_back(i);
                 }
+        } else {
+                const char *item = cpu_list;
+                while (*item != '\0') {
+                        char *end;
+                        long first = strtol(item, &end, 10);
+                        long last = first;
+                        if (end == item) {
+                                return false;
+                        }
+                        if (*end == '-') {
+                                item = end + 1;
+                                last = strtol(item, &end, 10);
+                                if (end == item) {
+                                        return false;
+                                }
+                        }
+                        if (first < 0 || last < first || last >= CPU_SETSIZE) {
+                                return false;
+                        }
+                        for (long i = first; i <= last; ++i) {
+                                cpus.push_back(i);
+                        }
+                        item = *end == ',' ? end + 1 : end;
+                        if (*end != ',' && *end != '\0') {
+                                return false;
+                        }
+                }
+        }
+        if (cpus.empty()) {
+                return false;
+        }
 
-                task_result_handle_t run_async(runnable_t task, void *data, bool detached);
-                void *wait_task(task_result_handle_t handle);
+        pthread_mutex_lock(&m_spawn_lock);
+        m_cpus = cpus;
+        for (int i = 0; i < m_worker_count; ++i) {
+                pin(m_workers[i]);
+        }
+        pthread_mutex_unlock(&m_spawn_lock);
+        return true;
+#else
+        (void) cpu_list;
+        return false;
+#endif
+}
 
-        private:
-                set<wp_worker*>    m_empty_workers;
-                set<wp_worker*>    m_occupied_workers;
-                pthread_mutex_t m_lock;
-                pthread_cond_t     m_worker_finished;
+struct parallel_job {
+        runnable_t task;
+        char *data;
+        size_t data_len;
+        void **res;
+        int count;
+        atomic<int> next;
 };
 
-task_result_handle_t worker_pool::run_async(runnable_t task, void *data, bool detached)
+void *parallel_job_run(void *arg)
 {
-        wp_worker *w;
-        pthread_mutex_lock(&m_lock);
-        if(m_empty_workers.empty()) {
-                m_empty_workers.insert(new wp_worker(*this));
-        }
-        set<wp_worker*>::iterator it = m_empty_workers.begin();
-        assert(it != m_empty_workers.end());
-        w = *it;
-        /// @todo: really weird - it seems like that 'it' instead of 'w' caused some problems
-        m_empty_workers.erase(w);
-        m_occupied_workers.insert(w);
-
-        wp_task_data *d = new wp_task_data(task, data, w, detached);
-        w->push(d);
-        pthread_mutex_unlock(&m_lock);
-
-        return d;
+        parallel_job *job = (parallel_job *) arg;
+        int i;
+        while ((i = job->next++) < job->count) {
+                void *res = job->task(job->data + i * job->data_len);
+                if (job->res) {
+                        job->res[i] = res;
+                }
+        }
+        return NULL;
 }
 
-void *worker_pool::wait_task(task_result_handle_t handle)
-{
-        wp_task_data *d = (wp_task_data *) handle;
-        wp_worker *w = d->m_w;
-        return w->pop(d);
-}
+} // end of anonymous namespace
 
-static class worker_pool instance;
+static worker_pool instance;
 
 /**
  * @brief Runs task asynchronously.
@@ -286,3 +593,45 @@ void *wait_task(task_result_handle_t handle)
         return instance.wait_task(handle);
 }
 
+/**
+ * @brief Runs task for every item of an array in parallel and waits for all.
+ *
+ * Items are assigned dynamically to the calling thread and at most (number of
+ * CPUs - 1) pool workers, so the function is suitable also for many small
+ * items (eg. lines).
+ *
+ * @param task     callback to be run
+ * @param count    number of items
+ * @param data     array of count items, each data_len bytes long
+ * @param data_len size of one item
+ * @param res      array of count items where the results are stored, may be NULL
+ */
+void task_run_parallel(runnable_t task, int count, void *data, size_t data_len, void **res)
+{
+        if (count <= 0) {
+                return;
+        }
+        parallel_job job;
+        job.task = task;
+        job.data = (char *) data;
+        job.data_len = data_len;
+        job.res = res;
+        job.count = count;
+        job.next = 0;
+
+        int helpers = min<int>(count, max<unsigned>(thread::hardware_concurrency(), 1)) - 1;
+        vector<task_result_handle_t> handles(helpers);
+        for (int i = 0; i < helpers; ++i) {
+                handles[i] = task_run_async(parallel_job_run, &job);
+        }
+        parallel_job_run(&job);
+        for (auto h : handles) {
+                wait_task(h);
+        }
+}
+
+bool task_set_cpu_affinity(const char *cpu_list)
+{
+        return instance.set_affinity(cpu_list);
+}
+
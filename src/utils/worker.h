@@ -54,6 +54,9 @@
 #ifndef WORKER_H_
 #define WORKER_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -67,6 +70,16 @@ task_result_handle_t task_run_async(runnable_t task, void *data);
  */
 void task_run_async_detached(runnable_t task, void *data);
 void *wait_task(task_result_handle_t handle);
+/**
+ * Fork/join helper - runs task for each of count items of data (data_len bytes
+ * each) in parallel, calling thread participates.
+ */
+void task_run_parallel(runnable_t task, int count, void *data, size_t data_len, void **res);
+/**
+ * Pins workers to given CPUs (comma-separated list or ranges, all CPUs if
+ * empty), Linux only.
+ */
+bool task_set_cpu_affinity(const char *cpu_list);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,449 @@
+/**
+ * @file   utils/yadif.cpp
+ *
+ * Both UYVY and v210 have samples in order U Y V Y, so the same kernel is
+ * used for both - UYVY with 8-bit samples as they are, v210 unpacked to
+ * 16-bit samples. Neighboring samples of the same component are SAMPLE_STEP
+ * samples apart, which is what the edge-directed interpolation compares (for
+ * luma this means directions with step of 2 pixels).
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "utils/worker.h"
+#include "utils/yadif.h"
+#include "video.h"
+
+#define SAMPLE_STEP 4 ///< distance of neighboring samples of the same component
+#define HISTORY 3
+#define MIN_STRIPE_LINES 32
+
+using namespace std;
+
+struct yadif_stripe;
+
+struct yadif {
+        codec_t codec;
+        int height;
+        int linesize;      ///< length of a line of the input/output frame (bytes)
+        int samples;       ///< samples per line
+        size_t frame_size; ///< size of a frame in history (bytes)
+        unique_ptr<unsigned char []> frames[HISTORY];
+        int pushed;        ///< number of frames pushed so far
+        bool simd;         ///< use SIMD kernels if available
+
+        vector<yadif_stripe> stripes;
+};
+
+struct yadif_stripe {
+        struct yadif *s;
+        int y_start, y_end;
+        unique_ptr<uint16_t []> line; ///< for v210 output
+
+        const unsigned char *src;
+        unsigned char *dst;
+        int dst_pitch;
+        bool second_field;
+};
+
+namespace {
+template<typename T>
+struct yadif_line {
+        const T *cur_m, *cur_p;   ///< lines above and below in current frame
+        const T *prev_m, *prev_p; ///< the same lines in previous frame
+        const T *next_m, *next_p; ///< and in the next one
+        const T *prev2, *next2;   ///< interpolated line in frames temporally adjacent to the missing field
+        const T *prev2_mm, *next2_mm, *prev2_pp, *next2_pp; ///< lines two lines above and below of those
+};
+} // end of anonymous namespace
+
+static inline int idx(int x, int k, int n)
+{
+        int i = x + k * SAMPLE_STEP;
+        return i < 0 || i >= n ? x : i;
+}
+
+template<typename T>
+static inline int yadif_sample(const yadif_line<T> &l, int x, int n)
+{
+        auto m = [&](int k) { return (int) l.cur_m[idx(x, k, n)]; };
+        auto p = [&](int k) { return (int) l.cur_p[idx(x, k, n)]; };
+        int c = l.cur_m[x];
+        int e = l.cur_p[x];
+        int d = (l.prev2[x] + l.next2[x]) >> 1;
+        int td0 = abs(l.prev2[x] - l.next2[x]);
+        int td1 = (abs(l.prev_m[x] - c) + abs(l.prev_p[x] - e)) >> 1;
+        int td2 = (abs(l.next_m[x] - c) + abs(l.next_p[x] - e)) >> 1;
+        int diff = max(td0 >> 1, max(td1, td2));
+
+        int pred = (c + e) >> 1;
+        int score = abs(m(-1) - p(-1)) + abs(c - e) + abs(m(1) - p(1)) - 1;
+        int s = abs(m(-2) - p(0)) + abs(m(-1) - p(1)) + abs(m(0) - p(2));
+        if (s < score) {
+                score = s;
+                pred = (m(-1) + p(1)) >> 1;
+                s = abs(m(-3) - p(1)) + abs(m(-2) - p(2)) + abs(m(-1) - p(3));
+                if (s < score) {
+                        score = s;
+                        pred = (m(-2) + p(2)) >> 1;
+                }
+        }
+        s = abs(m(0) - p(-2)) + abs(m(1) - p(-1)) + abs(m(2) - p(0));
+        if (s < score) {
+                score = s;
+                pred = (m(1) + p(-1)) >> 1;
+                s = abs(m(1) - p(-3)) + abs(m(2) - p(-2)) + abs(m(3) - p(-1));
+                if (s < score) {
+                        pred = (m(2) + p(-2)) >> 1;
+                }
+        }
+
+        int b = (l.prev2_mm[x] + l.next2_mm[x]) >> 1;
+        int f = (l.prev2_pp[x] + l.next2_pp[x]) >> 1;
+        int mx = max(max(d - e, d - c), min(b - c, f - e));
+        int mn = min(min(d - e, d - c), max(b - c, f - e));
+        diff = max(diff, max(mn, -mx));
+
+        return min(max(pred, d - diff), d + diff);
+}
+
+#ifdef __SSE2__
+static inline __m128i load8(const uint8_t *p)
+{
+        return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) p), _mm_setzero_si128());
+}
+
+static inline __m128i load8(const uint16_t *p)
+{
+        return _mm_loadu_si128((const __m128i *) p);
+}
+
+static inline void store8(uint8_t *p, __m128i v)
+{
+        _mm_storel_epi64((__m128i *) p, _mm_packus_epi16(v, v));
+}
+
+static inline void store8(uint16_t *p, __m128i v)
+{
+        _mm_storeu_si128((__m128i *) p, v);
+}
+
+static inline __m128i absdiff(__m128i a, __m128i b)
+{
+        return _mm_max_epi16(_mm_sub_epi16(a, b), _mm_sub_epi16(b, a));
+}
+
+static inline __m128i avg(__m128i a, __m128i b)
+{
+        return _mm_srai_epi16(_mm_add_epi16(a, b), 1);
+}
+
+static inline __m128i blend(__m128i mask, __m128i a, __m128i b)
+{
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/**
+ * Computes 8 samples at x, x + 3 * SAMPLE_STEP + 8 must not exceed line length
+ * and x must be at least 3 * SAMPLE_STEP.
+ */
+template<typename T>
+static inline void yadif_8samples(const yadif_line<T> &l, int x, T *out)
+{
+        auto m = [&](int k) { return load8(l.cur_m + x + k * SAMPLE_STEP); };
+        auto p = [&](int k) { return load8(l.cur_p + x + k * SAMPLE_STEP); };
+        __m128i c = m(0);
+        __m128i e = p(0);
+        __m128i prev2 = load8(l.prev2 + x);
+        __m128i next2 = load8(l.next2 + x);
+        __m128i d = avg(prev2, next2);
+        __m128i td0 = _mm_srai_epi16(absdiff(prev2, next2), 1);
+        __m128i td1 = _mm_srai_epi16(_mm_add_epi16(absdiff(load8(l.prev_m + x), c),
+                                absdiff(load8(l.prev_p + x), e)), 1);
+        __m128i td2 = _mm_srai_epi16(_mm_add_epi16(absdiff(load8(l.next_m + x), c),
+                                absdiff(load8(l.next_p + x), e)), 1);
+        __m128i diff = _mm_max_epi16(td0, _mm_max_epi16(td1, td2));
+
+        __m128i pred = avg(c, e);
+        __m128i score = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(absdiff(m(-1), p(-1)), absdiff(c, e)),
+                                absdiff(m(1), p(1))), _mm_set1_epi16(1));
+        __m128i s = _mm_add_epi16(_mm_add_epi16(absdiff(m(-2), p(0)), absdiff(m(-1), p(1))), absdiff(m(0), p(2)));
+        __m128i mask = _mm_cmplt_epi16(s, score);
+        score = blend(mask, s, score);
+        pred = blend(mask, avg(m(-1), p(1)), pred);
+        s = _mm_add_epi16(_mm_add_epi16(absdiff(m(-3), p(1)), absdiff(m(-2), p(2))), absdiff(m(-1), p(3)));
+        mask = _mm_and_si128(mask, _mm_cmplt_epi16(s, score));
+        score = blend(mask, s, score);
+        pred = blend(mask, avg(m(-2), p(2)), pred);
+
+        s = _mm_add_epi16(_mm_add_epi16(absdiff(m(0), p(-2)), absdiff(m(1), p(-1))), absdiff(m(2), p(0)));
+        mask = _mm_cmplt_epi16(s, score);
+        score = blend(mask, s, score);
+        pred = blend(mask, avg(m(1), p(-1)), pred);
+        s = _mm_add_epi16(_mm_add_epi16(absdiff(m(1), p(-3)), absdiff(m(2), p(-2))), absdiff(m(3), p(-1)));
+        mask = _mm_and_si128(mask, _mm_cmplt_epi16(s, score));
+        pred = blend(mask, avg(m(2), p(-2)), pred);
+
+        __m128i b = avg(load8(l.prev2_mm + x), load8(l.next2_mm + x));
+        __m128i f = avg(load8(l.prev2_pp + x), load8(l.next2_pp + x));
+        __m128i de = _mm_sub_epi16(d, e);
+        __m128i dc = _mm_sub_epi16(d, c);
+        __m128i bc = _mm_sub_epi16(b, c);
+        __m128i fe = _mm_sub_epi16(f, e);
+        __m128i mx = _mm_max_epi16(_mm_max_epi16(de, dc), _mm_min_epi16(bc, fe));
+        __m128i mn = _mm_min_epi16(_mm_min_epi16(de, dc), _mm_max_epi16(bc, fe));
+        diff = _mm_max_epi16(diff, _mm_max_epi16(mn, _mm_sub_epi16(_mm_setzero_si128(), mx)));
+
+        pred = _mm_min_epi16(_mm_max_epi16(pred, _mm_sub_epi16(d, diff)), _mm_add_epi16(d, diff));
+        store8(out, pred);
+}
+#endif // defined __SSE2__
+
+template<typename T>
+static void yadif_interpolate_line(const yadif_line<T> &l, T *out, int n, bool simd)
+{
+        int x = 0;
+#ifdef __SSE2__
+        if (simd) {
+                for ( ; x < 3 * SAMPLE_STEP; ++x) {
+                        out[x] = yadif_sample(l, x, n);
+                }
+                for ( ; x + 8 + 3 * SAMPLE_STEP <= n; x += 8) {
+                        yadif_8samples(l, x, out + x);
+                }
+        }
+#else
+        (void) simd;
+#endif
+        for ( ; x < n; ++x) {
+                out[x] = yadif_sample(l, x, n);
+        }
+}
+
+static void unpack_v210(uint16_t *dst, const unsigned char *src, int linesize)
+{
+        for (int i = 0; i < linesize / 4; ++i) {
+                uint32_t w;
+                memcpy(&w, src + 4 * i, sizeof w);
+                *dst++ = w & 0x3ff;
+                *dst++ = (w >> 10) & 0x3ff;
+                *dst++ = (w >> 20) & 0x3ff;
+        }
+}
+
+static void pack_v210(unsigned char *dst, const uint16_t *src, int linesize)
+{
+        for (int i = 0; i < linesize / 4; ++i) {
+                uint32_t w = src[0] | src[1] << 10 | (uint32_t) src[2] << 20;
+                memcpy(dst + 4 * i, &w, sizeof w);
+                src += 3;
+        }
+}
+
+static void push_line(struct yadif *s, unsigned char *dst, const unsigned char *src)
+{
+        if (s->codec == v210) {
+                unpack_v210((uint16_t *) dst, src, s->linesize);
+        } else {
+                memcpy(dst, src, s->linesize);
+        }
+}
+
+static void output_line(struct yadif_stripe *st, unsigned char *dst, const unsigned char *line)
+{
+        if (st->s->codec == v210) {
+                pack_v210(dst, (const uint16_t *) line, st->s->linesize);
+        } else {
+                memcpy(dst, line, st->s->linesize);
+        }
+}
+
+template<typename T>
+static void filter_stripe(struct yadif_stripe *st)
+{
+        struct yadif *s = st->s;
+        int h = s->height;
+        int n = s->samples;
+        auto frame = [s](int i) {
+                return (const T *) s->frames[max(i, 0) % HISTORY].get();
+        };
+        // output lags one frame behind
+        int cur_idx = max(s->pushed - 2, 0);
+        const T *prev = frame(cur_idx - 1);
+        const T *cur = frame(cur_idx);
+        const T *next = frame(s->pushed - 1);
+        // missing field of the first field time lies between previous and current frame
+        const T *prev2 = st->second_field ? cur : prev;
+        const T *next2 = st->second_field ? next : cur;
+        int kept_parity = st->second_field ? 1 : 0;
+
+        for (int y = st->y_start; y < st->y_end; ++y) {
+                unsigned char *dst = st->dst + (size_t) y * st->dst_pitch;
+                if ((y & 1) == kept_parity) {
+                        output_line(st, dst, (const unsigned char *) (cur + (size_t) y * n));
+                        continue;
+                }
+                size_t ym = y > 0 ? y - 1 : y + 1;
+                size_t yp = y + 1 < h ? y + 1 : y - 1;
+                size_t ymm = y >= 2 ? y - 2 : (y + 2 < h ? y + 2 : y);
+                size_t ypp = y + 2 < h ? y + 2 : (y >= 2 ? y - 2 : y);
+                yadif_line<T> l{
+                        cur + ym * n, cur + yp * n,
+                        prev + ym * n, prev + yp * n,
+                        next + ym * n, next + yp * n,
+                        prev2 + y * n, next2 + y * n,
+                        prev2 + ymm * n, next2 + ymm * n, prev2 + ypp * n, next2 + ypp * n,
+                };
+                if (s->codec == v210) {
+                        yadif_interpolate_line(l, (T *) st->line.get(), n, s->simd);
+                        output_line(st, dst, (const unsigned char *) st->line.get());
+                } else {
+                        yadif_interpolate_line(l, (T *) dst, n, s->simd);
+                }
+        }
+}
+
+static void *push_task(void *arg)
+{
+        auto st = (struct yadif_stripe *) arg;
+        struct yadif *s = st->s;
+        unsigned char *dst = s->frames[s->pushed % HISTORY].get();
+        size_t dst_linesize = s->frame_size / s->height;
+        for (int y = st->y_start; y < st->y_end; ++y) {
+                push_line(s, dst + y * dst_linesize, st->src + (size_t) y * s->linesize);
+        }
+        return NULL;
+}
+
+static void *filter_task(void *arg)
+{
+        auto st = (struct yadif_stripe *) arg;
+        if (st->s->codec == v210) {
+                filter_stripe<uint16_t>(st);
+        } else {
+                filter_stripe<uint8_t>(st);
+        }
+        return NULL;
+}
+
+static void run_stripes(struct yadif *s, runnable_t task)
+{
+        task_run_parallel(task, s->stripes.size(), s->stripes.data(), sizeof s->stripes[0], NULL);
+}
+
+bool yadif_supports(codec_t codec)
+{
+        return codec == UYVY || codec == v210;
+}
+
+struct yadif *yadif_create(struct video_desc desc)
+{
+        if (!yadif_supports(desc.color_spec) || desc.tile_count != 1 || desc.height < 2) {
+                return NULL;
+        }
+
+        auto s = new yadif();
+        s->codec = desc.color_spec;
+        s->simd = true;
+        s->height = desc.height;
+        s->linesize = vc_get_linesize(desc.width, desc.color_spec);
+        s->samples = desc.color_spec == v210 ? s->linesize / 4 * 3 : s->linesize;
+        size_t sample_size = desc.color_spec == v210 ? sizeof(uint16_t) : sizeof(uint8_t);
+        s->frame_size = sample_size * s->samples * s->height;
+        for (int i = 0; i < HISTORY; ++i) {
+                s->frames[i] = unique_ptr<unsigned char []>(new unsigned char[s->frame_size]);
+        }
+
+        int count = max<int>(1, min<int>(thread::hardware_concurrency(), s->height / MIN_STRIPE_LINES));
+        s->stripes.resize(count);
+        int stripe_height = s->height / count / 2 * 2;
+        for (int i = 0; i < count; ++i) {
+                s->stripes[i].s = s;
+                s->stripes[i].y_start = i * stripe_height;
+                s->stripes[i].y_end = i == count - 1 ? s->height : (i + 1) * stripe_height;
+                if (desc.color_spec == v210) {
+                        s->stripes[i].line = unique_ptr<uint16_t []>(new uint16_t[s->samples]);
+                }
+        }
+
+        return s;
+}
+
+void yadif_push(struct yadif *s, const unsigned char *src)
+{
+        for (auto &st : s->stripes) {
+                st.src = src;
+        }
+        run_stripes(s, push_task);
+        s->pushed += 1;
+}
+
+void yadif_filter(struct yadif *s, unsigned char *dst, int dst_pitch, bool second_field)
+{
+        assert(s->pushed > 0);
+        for (auto &st : s->stripes) {
+                st.dst = dst;
+                st.dst_pitch = dst_pitch;
+                st.second_field = second_field;
+        }
+        run_stripes(s, filter_task);
+}
+
+void yadif_set_simd(struct yadif *s, bool enable)
+{
+        s->simd = enable;
+}
+
+void yadif_destroy(struct yadif *s)
+{
+        delete s;
+}
+
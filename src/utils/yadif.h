@@ -0,0 +1,90 @@
+/**
+ * @file   utils/yadif.h
+ * @brief  Motion-adaptive deinterlacer (yadif algorithm)
+ *
+ * Missing lines of a field are interpolated spatially (edge-directed) and
+ * the result is limited by temporal prediction from the adjacent frames, so
+ * that static areas keep full vertical resolution. Works natively on UYVY
+ * and v210, frame is processed in horizontal stripes by multiple threads.
+ *
+ * Top field first is assumed. Output lags one frame behind the input since
+ * the following frame is needed for the temporal prediction.
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_YADIF_H_
+#define UTILS_YADIF_H_
+
+#include <stdbool.h>
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct yadif;
+
+bool yadif_supports(codec_t codec);
+/**
+ * @returns state or NULL if desc is not supported
+ */
+struct yadif *yadif_create(struct video_desc desc);
+/**
+ * Stores a frame to the deinterlacer history.
+ *
+ * @param src frame with lines vc_get_linesize() bytes apart
+ */
+void yadif_push(struct yadif *s, const unsigned char *src);
+/**
+ * Writes deinterlaced frame preceding the last pushed one (or the only one
+ * if just one was pushed).
+ *
+ * @param second_field false - keeps top field and interpolates bottom one,
+ *                     true - vice versa (time of the second field)
+ */
+void yadif_filter(struct yadif *s, unsigned char *dst, int dst_pitch, bool second_field);
+/**
+ * Enables or disables SIMD kernels (enabled by default), the output must
+ * be identical in both cases. Intended for testing.
+ */
+void yadif_set_simd(struct yadif *s, bool enable);
+void yadif_destroy(struct yadif *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_YADIF_H_
+
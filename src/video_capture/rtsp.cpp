@@ -204,6 +204,7 @@ struct video_rtsp_state {
 
     unsigned int h264_offset_len;
     unsigned char *h264_offset_buffer;
+    struct rtpdec_h264_state *h264_dec;
 };
 
 struct audio_rtsp_state {
@@ -345,6 +346,7 @@ vidcap_rtsp_thread(void *arg) {
                             struct decode_data_h264 d;
                             d.frame = s->vrtsp_state->frame;
                             d.offset_len = s->vrtsp_state->h264_offset_len;
+                            d.state = s->vrtsp_state->h264_dec;
                             if (pbuf_decode(s->vrtsp_state->cp->playout_buffer, curr_time_hr,
                                 decode_frame_by_pt, &d))
                             {
@@ -598,7 +600,8 @@ vidcap_rtsp_init(const struct vidcap_params *params, void **state) {
         s->vrtsp_state->h264_offset_len = len;
     }
 
-    s->vrtsp_state->tile->data = (char *) malloc(4 * s->vrtsp_state->tile->width * s->vrtsp_state->tile->height);
+    // tile data are set by decode_frame_h264() to point to its own buffer
+    s->vrtsp_state->h264_dec = rtpdec_h264_init();
     s->vrtsp_state->tile->data_len = 0;
 
     s->vrtsp_state->frame->frame_type = BFRAME;
@@ -608,8 +611,6 @@ vidcap_rtsp_init(const struct vidcap_params *params, void **state) {
     s->vrtsp_state->fps = 30;
     s->vrtsp_state->frame->interlacing = PROGRESSIVE;
 
-    s->vrtsp_state->frame->tiles[0].data = (char *) calloc(1, s->vrtsp_state->tile->width * s->vrtsp_state->tile->height);
-
     s->should_exit = FALSE;
 
     s->vrtsp_state->device = rtp_init_if("::1", s->vrtsp_state->mcast_if, s->vrtsp_state->port, 0, s->vrtsp_state->ttl, s->vrtsp_state->rtcp_bw,
@@ -1096,7 +1097,7 @@ vidcap_rtsp_done(void *state) {
 
     rtp_done(s->vrtsp_state->device);
 
-    free(s->vrtsp_state->tile->data);
+    rtpdec_h264_done(s->vrtsp_state->h264_dec);
     if(s->vrtsp_state->h264_offset_buffer!=NULL) free(s->vrtsp_state->h264_offset_buffer);
     if(s->vrtsp_state->frame!=NULL) free(s->vrtsp_state->frame);
     if(s->vrtsp_state!=NULL) free(s->vrtsp_state);
@@ -51,6 +51,7 @@
 
 #include "audio/audio.h"
 
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <strings.h>
@@ -59,10 +60,19 @@
 #ifdef HAVE_XFIXES
 #include <X11/extensions/Xfixes.h>
 #endif // HAVE_XFIXES
+#ifdef HAVE_XDAMAGE
+#include <X11/extensions/Xdamage.h>
+#endif // HAVE_XDAMAGE
+#ifdef HAVE_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif // HAVE_XSHM
 #include <X11/Xutil.h>
 #include "x11_common.h"
 
 #define QUEUE_SIZE_MAX 3
+#define MOD_NAME "[screen capture] "
 
 /* prototypes of functions defined in this module */
 static void show_help(void);
@@ -72,8 +82,9 @@ static void show_help()
 {
         printf("Screen capture\n");
         printf("Usage\n");
-        printf("\t-t screen[:fps=<fps>]\n");
+        printf("\t-t screen[:fps=<fps>][:noshm]\n");
         printf("\t\t<fps> - preferred grabbing fps (otherwise unlimited)\n");
+        printf("\t\tnoshm - do not use shared memory (XShm) even if available\n");
 }
 
 struct grabbed_data;
@@ -109,8 +120,390 @@ struct vidcap_screen_x11_state {
         double fps;
 
         bool initialized;
+
+        bool use_shm;
+#ifdef HAVE_XSHM
+        /**
+         * Shared memory image (XShm). If used, the screen is grabbed directly
+         * in vidcap_screen_x11_grab() to one of double-buffered output frames,
+         * only areas reported by XDamage are copied (if available) and frame
+         * is returned again if nothing has changed.
+         */
+        XShmSegmentInfo shminfo;
+        XImage *shm_image;
+        struct video_frame *buffers[2];
+        int buffer_refs[2];           ///< references held by frame consumers
+        int last_buffer;              ///< index of last returned buffer, -1 if none
+        struct timeval last_grab_time; ///< when the last frame was returned
+        pthread_cond_t buffer_released_cv;
+#ifdef HAVE_XFIXES
+        XRectangle cursor_rect[2];    ///< where cursor was drawn in the buffer
+        unsigned long cursor_serial;
+        int cursor_x, cursor_y;
+#endif // HAVE_XFIXES
+#endif // HAVE_XSHM
+#ifdef HAVE_XDAMAGE
+        Damage damage;                ///< 0 if XDamage is not used
+        int damage_event_base;
+        XserverRegion damaged;
+        XserverRegion pending[2];     ///< areas of respective buffers that are out of date
+#endif // HAVE_XDAMAGE
+
+        int unchanged_frames;         ///< statistics
+        long long bytes_copied;
 };
 
+#ifdef HAVE_XSHM
+static void buffer_dispose(struct video_frame *frame)
+{
+        struct vidcap_screen_x11_state *s = (struct vidcap_screen_x11_state *) frame->dispose_udata;
+
+        pthread_mutex_lock(&s->lock);
+        s->buffer_refs[frame == s->buffers[0] ? 0 : 1] -= 1;
+        pthread_cond_signal(&s->buffer_released_cv);
+        pthread_mutex_unlock(&s->lock);
+}
+
+static Display *shm_attach_dpy;
+static bool shm_attach_failed;
+static int (*shm_attach_old_handler)(Display *, XErrorEvent *);
+
+/**
+ * XShmAttach fails asynchronously (eg. with a remote X server that cannot
+ * access our segment), catch the error instead of letting the default
+ * handler exit the program.
+ */
+static int shm_attach_error_handler(Display *d, XErrorEvent *e)
+{
+        if (d == shm_attach_dpy) {
+                shm_attach_failed = true;
+                return 0;
+        }
+        return shm_attach_old_handler ? shm_attach_old_handler(d, e) : 0;
+}
+
+static bool shm_attach(struct vidcap_screen_x11_state *s)
+{
+        // the handler is process-wide, x11_lock() keeps other users of the shared display out
+        x11_lock();
+        shm_attach_dpy = s->dpy;
+        shm_attach_failed = false;
+        shm_attach_old_handler = XSetErrorHandler(shm_attach_error_handler);
+        Status ret = XShmAttach(s->dpy, &s->shminfo);
+        XSync(s->dpy, False); // process a possible error
+        XSetErrorHandler(shm_attach_old_handler);
+        shm_attach_dpy = NULL;
+        x11_unlock();
+
+        if (!ret || shm_attach_failed) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "XShmAttach failed, falling back to XGetImage.\n");
+                return false;
+        }
+        return true;
+}
+
+static bool initialize_shm(struct vidcap_screen_x11_state *s)
+{
+        if (!XShmQueryExtension(s->dpy)) {
+                return false;
+        }
+
+        int screen = DefaultScreen(s->dpy);
+        s->shm_image = XShmCreateImage(s->dpy, DefaultVisual(s->dpy, screen),
+                        DefaultDepth(s->dpy, screen), ZPixmap, NULL, &s->shminfo,
+                        s->tile->width, s->tile->height);
+        if (!s->shm_image) {
+                return false;
+        }
+        if (s->shm_image->bits_per_pixel != 32) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Unsupported XShm image depth %d bpp.\n",
+                                s->shm_image->bits_per_pixel);
+                XDestroyImage(s->shm_image);
+                s->shm_image = NULL;
+                return false;
+        }
+        s->shminfo.shmid = shmget(IPC_PRIVATE, s->shm_image->bytes_per_line * s->shm_image->height,
+                        IPC_CREAT | 0600);
+        if (s->shminfo.shmid == -1) {
+                perror(MOD_NAME "shmget");
+                XDestroyImage(s->shm_image);
+                s->shm_image = NULL;
+                return false;
+        }
+        s->shminfo.shmaddr = s->shm_image->data = shmat(s->shminfo.shmid, NULL, 0);
+        s->shminfo.readOnly = False;
+        if (s->shminfo.shmaddr == (char *) -1 || !shm_attach(s)) {
+                if (s->shminfo.shmaddr != (char *) -1) {
+                        shmdt(s->shminfo.shmaddr);
+                }
+                shmctl(s->shminfo.shmid, IPC_RMID, NULL);
+                s->shm_image->data = NULL;
+                XDestroyImage(s->shm_image);
+                s->shm_image = NULL;
+                return false;
+        }
+        // segment is destroyed when both X server and we detach
+        shmctl(s->shminfo.shmid, IPC_RMID, NULL);
+
+        pthread_cond_init(&s->buffer_released_cv, NULL);
+        for (int i = 0; i < 2; ++i) {
+                s->buffers[i] = vf_alloc_desc_data(video_desc_from_frame(s->frame));
+                s->buffers[i]->dispose = buffer_dispose;
+                s->buffers[i]->dispose_udata = s;
+                s->buffer_refs[i] = 0;
+        }
+        s->last_buffer = -1;
+
+#ifdef HAVE_XDAMAGE
+        int error_base;
+        if (XDamageQueryExtension(s->dpy, &s->damage_event_base, &error_base)) {
+                s->damage = XDamageCreate(s->dpy, s->root, XDamageReportNonEmpty);
+                s->damaged = XFixesCreateRegion(s->dpy, NULL, 0);
+                XRectangle whole = { 0, 0, s->tile->width, s->tile->height };
+                for (int i = 0; i < 2; ++i) {
+                        s->pending[i] = XFixesCreateRegion(s->dpy, &whole, 1);
+                }
+        } else {
+                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "XDamage not available, every frame will be copied.\n");
+        }
+#endif // HAVE_XDAMAGE
+
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "Using XShm%s.\n",
+#ifdef HAVE_XDAMAGE
+                        s->damage ? " with XDamage" : ""
+#else
+                        ""
+#endif
+                        );
+
+        return true;
+}
+
+static void destroy_shm(struct vidcap_screen_x11_state *s)
+{
+        pthread_mutex_lock(&s->lock);
+        while (s->buffer_refs[0] > 0 || s->buffer_refs[1] > 0) {
+                pthread_cond_wait(&s->buffer_released_cv, &s->lock);
+        }
+        pthread_mutex_unlock(&s->lock);
+
+#ifdef HAVE_XDAMAGE
+        if (s->damage) {
+                XDamageDestroy(s->dpy, s->damage);
+                XFixesDestroyRegion(s->dpy, s->damaged);
+                XFixesDestroyRegion(s->dpy, s->pending[0]);
+                XFixesDestroyRegion(s->dpy, s->pending[1]);
+        }
+#endif // HAVE_XDAMAGE
+        XShmDetach(s->dpy, &s->shminfo);
+        XDestroyImage(s->shm_image);
+        shmdt(s->shminfo.shmaddr);
+        for (int i = 0; i < 2; ++i) {
+                s->buffers[i]->dispose = NULL;
+                vf_free(s->buffers[i]);
+        }
+        pthread_cond_destroy(&s->buffer_released_cv);
+}
+
+/**
+ * Converts area of the shared image to RGB frame.
+ */
+static void copy_rect(struct vidcap_screen_x11_state *s, struct video_frame *frame, int x, int y, int w, int h)
+{
+        int dst_linesize = vc_get_linesize(frame->tiles[0].width, RGB);
+        for (int i = y; i < y + h; ++i) {
+                vc_copylineABGRtoRGB((unsigned char *) frame->tiles[0].data + i * dst_linesize + x * 3,
+                                (unsigned char *) s->shm_image->data + i * s->shm_image->bytes_per_line + x * 4,
+                                w * 3, 0, 8, 16);
+        }
+        s->bytes_copied += (long long) w * h * 3;
+}
+
+#ifdef HAVE_XFIXES
+static void draw_cursor(struct vidcap_screen_x11_state *s, struct video_frame *frame, XFixesCursorImage *cursor,
+                XRectangle *drawn)
+{
+        int linesize = vc_get_linesize(frame->tiles[0].width, RGB);
+        int x0 = cursor->x - cursor->xhot;
+        int y0 = cursor->y - cursor->yhot;
+        int x_start = x0 < 0 ? 0 : x0;
+        int y_start = y0 < 0 ? 0 : y0;
+        int x_end = x0 + cursor->width > (int) s->tile->width ? (int) s->tile->width : x0 + cursor->width;
+        int y_end = y0 + cursor->height > (int) s->tile->height ? (int) s->tile->height : y0 + cursor->height;
+
+        drawn->x = x_start;
+        drawn->y = y_start;
+        drawn->width = x_end > x_start ? x_end - x_start : 0;
+        drawn->height = y_end > y_start ? y_end - y_start : 0;
+
+        for (int y = y_start; y < y_end; ++y) {
+                unsigned char *line = (unsigned char *) frame->tiles[0].data + y * linesize;
+                for (int x = x_start; x < x_end; ++x) {
+                        uint_fast32_t cursor_pix = cursor->pixels[(x - x0) + (y - y0) * cursor->width];
+                        int alpha = cursor_pix >> 24 & 0xff;
+                        unsigned char *pix = line + x * 3;
+                        pix[0] = ((cursor_pix >> 16 & 0xff) * alpha + pix[0] * (255 - alpha)) / 255;
+                        pix[1] = ((cursor_pix >> 8 & 0xff) * alpha + pix[1] * (255 - alpha)) / 255;
+                        pix[2] = ((cursor_pix >> 0 & 0xff) * alpha + pix[2] * (255 - alpha)) / 255;
+                }
+        }
+}
+#endif // HAVE_XFIXES
+
+#ifdef HAVE_XDAMAGE
+/**
+ * Blocks until XDamage reports a change or until a frame interval since the
+ * last grabbed frame elapses, so that static screen isn't polled in a busy
+ * loop (cursor movement doesn't generate damage, it is checked at least
+ * once per frame interval).
+ *
+ * @retval true  damage was reported
+ */
+static bool wait_for_damage(struct vidcap_screen_x11_state *s)
+{
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        double remaining_us = 1000000.0 / s->frame->fps - tv_diff_usec(now, s->last_grab_time);
+
+        while (remaining_us > 0.0) {
+                if (XEventsQueued(s->dpy, QueuedAfterReading) > 0) {
+                        XEvent ev;
+                        if (XCheckTypedEvent(s->dpy, s->damage_event_base + XDamageNotify, &ev)) {
+                                return true;
+                        }
+                }
+                struct pollfd pfd = { .fd = ConnectionNumber(s->dpy), .events = POLLIN, .revents = 0 };
+                poll(&pfd, 1, (int) (remaining_us / 1000.0) + 1);
+                gettimeofday(&now, NULL);
+                remaining_us = 1000000.0 / s->frame->fps - tv_diff_usec(now, s->last_grab_time);
+        }
+        return false;
+}
+#endif // HAVE_XDAMAGE
+
+static struct video_frame *grab_shm(struct vidcap_screen_x11_state *s)
+{
+        bool damaged = true;
+        bool cursor_changed = false;
+#ifdef HAVE_XFIXES
+        XFixesCursorImage *cursor = NULL;
+#endif // HAVE_XFIXES
+
+        while (true) {
+#ifdef HAVE_XDAMAGE
+                if (s->damage) {
+                        XEvent ev;
+                        while (XCheckTypedEvent(s->dpy, s->damage_event_base + XDamageNotify, &ev)) {
+                        }
+                        XDamageSubtract(s->dpy, s->damage, None, s->damaged);
+                        int nrects = 0;
+                        XRectangle *rects = XFixesFetchRegion(s->dpy, s->damaged, &nrects);
+                        if (rects) {
+                                XFree(rects);
+                        }
+                        damaged = nrects > 0;
+                }
+#endif // HAVE_XDAMAGE
+
+#ifdef HAVE_XFIXES
+                cursor = XFixesGetCursorImage(s->dpy);
+                if (cursor) {
+                        cursor_changed = cursor->cursor_serial != s->cursor_serial ||
+                                cursor->x != s->cursor_x || cursor->y != s->cursor_y;
+                }
+#endif // HAVE_XFIXES
+
+                if (damaged || cursor_changed || s->last_buffer == -1) {
+                        break;
+                }
+#ifdef HAVE_XDAMAGE
+                // wait for a change, unchanged frame is passed once per frame interval
+                if (wait_for_damage(s)) {
+#ifdef HAVE_XFIXES
+                        if (cursor) {
+                                XFree(cursor);
+                        }
+#endif // HAVE_XFIXES
+                        continue;
+                }
+#endif // HAVE_XDAMAGE
+
+                // nothing has changed, pass the last frame once more
+                pthread_mutex_lock(&s->lock);
+                s->buffer_refs[s->last_buffer] += 1;
+                pthread_mutex_unlock(&s->lock);
+                s->unchanged_frames += 1;
+#ifdef HAVE_XFIXES
+                if (cursor) {
+                        XFree(cursor);
+                }
+#endif // HAVE_XFIXES
+                gettimeofday(&s->last_grab_time, NULL);
+                return s->buffers[s->last_buffer];
+        }
+
+        pthread_mutex_lock(&s->lock);
+        int target = s->last_buffer == 0 ? 1 : 0;
+        while (s->buffer_refs[target] > 0) {
+                pthread_cond_wait(&s->buffer_released_cv, &s->lock);
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        struct video_frame *frame = s->buffers[target];
+        XShmGetImage(s->dpy, s->root, s->shm_image, 0, 0, AllPlanes);
+
+#ifdef HAVE_XDAMAGE
+        if (s->damage) {
+                for (int i = 0; i < 2; ++i) {
+                        XFixesUnionRegion(s->dpy, s->pending[i], s->pending[i], s->damaged);
+                }
+#ifdef HAVE_XFIXES
+                // restore area under previously drawn cursor
+                XserverRegion cursor_region = XFixesCreateRegion(s->dpy, &s->cursor_rect[target], 1);
+                XFixesUnionRegion(s->dpy, s->pending[target], s->pending[target], cursor_region);
+                XFixesDestroyRegion(s->dpy, cursor_region);
+#endif // HAVE_XFIXES
+                int nrects = 0;
+                XRectangle *rects = XFixesFetchRegion(s->dpy, s->pending[target], &nrects);
+                for (int i = 0; i < nrects; ++i) {
+                        copy_rect(s, frame, rects[i].x, rects[i].y, rects[i].width, rects[i].height);
+                }
+                if (rects) {
+                        XFree(rects);
+                }
+                XFixesSetRegion(s->dpy, s->pending[target], NULL, 0);
+        } else
+#endif // HAVE_XDAMAGE
+        {
+                copy_rect(s, frame, 0, 0, s->tile->width, s->tile->height);
+        }
+
+#ifdef HAVE_XFIXES
+        if (cursor) {
+                draw_cursor(s, frame, cursor, &s->cursor_rect[target]);
+                s->cursor_serial = cursor->cursor_serial;
+                s->cursor_x = cursor->x;
+                s->cursor_y = cursor->y;
+                XFree(cursor);
+        }
+#endif // HAVE_XFIXES
+
+        pthread_mutex_lock(&s->lock);
+        s->buffer_refs[target] += 1;
+        s->last_buffer = target;
+        pthread_mutex_unlock(&s->lock);
+        gettimeofday(&s->last_grab_time, NULL);
+
+        return frame;
+}
+#else
+static bool initialize_shm(struct vidcap_screen_x11_state *s)
+{
+        UNUSED(s);
+        return false;
+}
+#endif // HAVE_XSHM
+
 static bool initialize(struct vidcap_screen_x11_state *s) {
         s->frame = vf_alloc(1);
         s->tile = vf_get_tile(s->frame, 0);
@@ -158,7 +551,14 @@ static bool initialize(struct vidcap_screen_x11_state *s) {
 
         s->tile->data = (char *) malloc(s->tile->data_len);
 
-        pthread_create(&s->worker_id, NULL, grab_thread, s);
+        if (s->use_shm) {
+                s->use_shm = initialize_shm(s);
+        }
+        if (!s->use_shm) {
+                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Not using shared memory, "
+                                "whole screen is transferred for every frame.\n");
+                pthread_create(&s->worker_id, NULL, grab_thread, s);
+        }
 
         return true;
 }
@@ -267,12 +667,13 @@ static int vidcap_screen_x11_init(const struct vidcap_params *params, void **sta
                 return VIDCAP_INIT_AUDIO_NOT_SUPPOTED;
         }
 
-        s = (struct vidcap_screen_x11_state *) malloc(sizeof(struct vidcap_screen_x11_state));
+        s = (struct vidcap_screen_x11_state *) calloc(1, sizeof(struct vidcap_screen_x11_state));
         if(s == NULL) {
                 printf("Unable to allocate screen capture state\n");
                 return VIDCAP_INIT_FAIL;
         }
         s->initialized = false;
+        s->use_shm = true;
 
         gettimeofday(&s->t0, NULL);
 
@@ -292,13 +693,27 @@ static int vidcap_screen_x11_init(const struct vidcap_params *params, void **sta
         s->frames = 0;
 
         if(vidcap_params_get_fmt(params)) {
-                if (strcmp(vidcap_params_get_fmt(params), "help") == 0) {
-                        show_help();
-                        free(s);
-                        return VIDCAP_INIT_NOERR;
-                } else if (strncasecmp(vidcap_params_get_fmt(params), "fps=", strlen("fps=")) == 0) {
-                        s->fps = atoi(vidcap_params_get_fmt(params) + strlen("fps="));
+                char *fmt = strdup(vidcap_params_get_fmt(params));
+                char *item, *save_ptr = NULL, *tmp = fmt;
+                while ((item = strtok_r(tmp, ":", &save_ptr))) {
+                        tmp = NULL;
+                        if (strcmp(item, "help") == 0) {
+                                show_help();
+                                free(fmt);
+                                free(s);
+                                return VIDCAP_INIT_NOERR;
+                        } else if (strncasecmp(item, "fps=", strlen("fps=")) == 0) {
+                                s->fps = atoi(item + strlen("fps="));
+                        } else if (strcasecmp(item, "noshm") == 0) {
+                                s->use_shm = false;
+                        } else {
+                                fprintf(stderr, "[Screen capture] Unknown option: %s\n", item);
+                                free(fmt);
+                                free(s);
+                                return VIDCAP_INIT_FAIL;
+                        }
                 }
+                free(fmt);
         }
 
         *state = s;
@@ -347,6 +762,12 @@ static void vidcap_screen_x11_done(void *state)
         }
         pthread_mutex_unlock(&s->lock);
 
+#ifdef HAVE_XSHM
+        if (s->initialized && s->use_shm) {
+                destroy_shm(s);
+        }
+#endif // HAVE_XSHM
+
         if(s->tile)
                 free(s->tile->data);
 
@@ -354,20 +775,11 @@ static void vidcap_screen_x11_done(void *state)
         free(s);
 }
 
-static struct video_frame * vidcap_screen_x11_grab(void *state, struct audio_frame **audio)
+/**
+ * Returns frame grabbed by grab_thread (using XGetImage).
+ */
+static struct video_frame *grab_queued(struct vidcap_screen_x11_state *s)
 {
-        struct vidcap_screen_x11_state *s = (struct vidcap_screen_x11_state *) state;
-
-        if (!s->initialized) {
-                s->initialized = initialize(s);
-                if (!s->initialized) {
-                        fprintf(stderr, "Cannot capture screen - unable to initialize!\n");
-                        return NULL;
-                }
-        }
-
-        *audio = NULL;
-
         struct grabbed_data *item = NULL;
 
         pthread_mutex_lock(&s->lock);
@@ -399,6 +811,34 @@ static struct video_frame * vidcap_screen_x11_grab(void *state, struct audio_fra
 
         XDestroyImage(item->data);
         free(item);
+        s->bytes_copied += s->tile->data_len;
+
+        return s->frame;
+}
+
+static struct video_frame * vidcap_screen_x11_grab(void *state, struct audio_frame **audio)
+{
+        struct vidcap_screen_x11_state *s = (struct vidcap_screen_x11_state *) state;
+
+        if (!s->initialized) {
+                s->initialized = initialize(s);
+                if (!s->initialized) {
+                        fprintf(stderr, "Cannot capture screen - unable to initialize!\n");
+                        return NULL;
+                }
+        }
+
+        *audio = NULL;
+
+        struct video_frame *ret;
+#ifdef HAVE_XSHM
+        if (s->use_shm) {
+                ret = grab_shm(s);
+        } else
+#endif // HAVE_XSHM
+        {
+                ret = grab_queued(s);
+        }
 
         if(s->fps > 0.0) {
                 struct timeval cur_time;
@@ -414,14 +854,18 @@ static struct video_frame * vidcap_screen_x11_grab(void *state, struct audio_fra
         double seconds = tv_diff(s->t, s->t0);        
         if (seconds >= 5) {
                 float fps  = s->frames / seconds;
-                log_msg(LOG_LEVEL_INFO, "[screen capture] %d frames in %g seconds = %g FPS\n", s->frames, seconds, fps);
+                log_msg(LOG_LEVEL_INFO, "[screen capture] %d frames in %g seconds = %g FPS "
+                                "(%d unchanged, %.1f MB/s copied)\n", s->frames, seconds, fps,
+                                s->unchanged_frames, s->bytes_copied / seconds / 1000000.0);
                 s->t0 = s->t;
                 s->frames = 0;
+                s->unchanged_frames = 0;
+                s->bytes_copied = 0;
         }
 
         s->frames++;
 
-        return s->frame;
+        return ret;
 }
 
 static const struct video_capture_info vidcap_screen_x11_info = {
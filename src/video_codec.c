@@ -65,7 +65,7 @@
 #include "utils/misc.h" // to_fourcc
 
 #ifdef __SSSE3__
-#include "tmmintrin.h"
+#include <tmmintrin.h>
 // compat with older Clang compiler
 #ifndef _mm_bslli_si128
 #define _mm_bslli_si128 _mm_slli_si128
@@ -1115,6 +1115,76 @@ static void vc_copylineToUYVY709(unsigned char *dst, const unsigned char *src, i
         register int y1, y2, u ,v;
         register uint32_t *d = (uint32_t *)(void *) dst;
 
+#ifdef __SSSE3__
+        // 8 pixels per iteration, bit-exact with the scalar code below
+        if (dst_len >= 16) {
+                // Shuffle masks gathering R|G<<16 and B of even/odd pixels to 32-bit lanes.
+                // Pixels are read from two (possibly overlapping) 16B loads at 0 and hi_off.
+                const int hi_off = 8 * pix_size - 16;
+                __m128i rg_lo[2], rg_hi[2], b_lo[2], b_hi[2];
+                for (int odd = 0; odd < 2; ++odd) {
+                        uint8_t masks[4][16];
+                        memset(masks, 0x80, sizeof masks);
+                        for (int i = 0; i < 4; ++i) {
+                                const int shift[3] = { rshift, gshift, bshift };
+                                const int lane_pos[3] = { 0, 2, 0 };
+                                for (int c = 0; c < 3; ++c) {
+                                        int idx = (2 * i + odd) * pix_size + shift[c];
+                                        int m = c == 2 ? 2 : 0;
+                                        if (idx < 16) {
+                                                masks[m][4 * i + lane_pos[c]] = idx;
+                                        } else {
+                                                masks[m + 1][4 * i + lane_pos[c]] = idx - hi_off;
+                                        }
+                                }
+                        }
+                        rg_lo[odd] = _mm_loadu_si128((__m128i const *)(const void *) masks[0]);
+                        rg_hi[odd] = _mm_loadu_si128((__m128i const *)(const void *) masks[1]);
+                        b_lo[odd] = _mm_loadu_si128((__m128i const *)(const void *) masks[2]);
+                        b_hi[odd] = _mm_loadu_si128((__m128i const *)(const void *) masks[3]);
+                }
+                // 16-bit coefficient pairs for R|G lanes, 40239 = 65536 - 25297 (G<<16 added separately)
+                const __m128i y_rg = _mm_setr_epi16(11993, -25297, 11993, -25297, 11993, -25297, 11993, -25297);
+                const __m128i u_rg = _mm_setr_epi16(-6619, -22151, -6619, -22151, -6619, -22151, -6619, -22151);
+                const __m128i v_rg = _mm_setr_epi16(28770, -26149, 28770, -26149, 28770, -26149, 28770, -26149);
+                const __m128i y_b = _mm_setr_epi16(4063, 0, 4063, 0, 4063, 0, 4063, 0);
+                const __m128i u_b = _mm_setr_epi16(28770, 0, 28770, 0, 28770, 0, 28770, 0);
+                const __m128i v_b = _mm_setr_epi16(-2621, 0, -2621, 0, -2621, 0, -2621, 0);
+                const __m128i g_mask = _mm_set1_epi32(0xffff0000);
+                const __m128i y_off = _mm_set1_epi32(1<<20);
+                const __m128i uv_off = _mm_set1_epi32(1<<23);
+                const __m128i out_shuffle = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+
+                while (dst_len >= 16) {
+                        __m128i in_lo = _mm_loadu_si128((__m128i const *)(const void *) src);
+                        __m128i in_hi = _mm_loadu_si128((__m128i const *)(const void *) (src + hi_off));
+                        __m128i rg[2], b[2], y[2];
+                        for (int odd = 0; odd < 2; ++odd) {
+                                rg[odd] = _mm_or_si128(_mm_shuffle_epi8(in_lo, rg_lo[odd]), _mm_shuffle_epi8(in_hi, rg_hi[odd]));
+                                b[odd] = _mm_or_si128(_mm_shuffle_epi8(in_lo, b_lo[odd]), _mm_shuffle_epi8(in_hi, b_hi[odd]));
+                                y[odd] = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rg[odd], y_rg), _mm_and_si128(rg[odd], g_mask)),
+                                                _mm_add_epi32(_mm_madd_epi16(b[odd], y_b), y_off));
+                        }
+                        // chroma of a pixel pair is computed from the sum of both pixels
+                        __m128i rg_sum = _mm_add_epi16(rg[0], rg[1]);
+                        __m128i b_sum = _mm_add_epi16(b[0], b[1]);
+                        __m128i u = _mm_add_epi32(_mm_madd_epi16(rg_sum, u_rg), _mm_madd_epi16(b_sum, u_b));
+                        __m128i v = _mm_add_epi32(_mm_madd_epi16(rg_sum, v_rg), _mm_madd_epi16(b_sum, v_b));
+                        // x / 2 rounding towards zero as in C
+                        u = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(u, _mm_srli_epi32(u, 31)), 1), uv_off);
+                        v = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(v, _mm_srli_epi32(v, 31)), 1), uv_off);
+                        // saturating packs clamp the same way as min(max(x, 0), (1<<24)-1) >> 16
+                        __m128i u_y1 = _mm_packs_epi32(_mm_srai_epi32(u, 16), _mm_srai_epi32(y[0], 16));
+                        __m128i v_y2 = _mm_packs_epi32(_mm_srai_epi32(v, 16), _mm_srai_epi32(y[1], 16));
+                        _mm_storeu_si128((__m128i *)(void *) d, _mm_shuffle_epi8(_mm_packus_epi16(u_y1, v_y2), out_shuffle));
+
+                        src += 8 * pix_size;
+                        d += 4;
+                        dst_len -= 16;
+                }
+        }
+#endif
+
         while (dst_len >= 4) {
                 r = *(src + rshift);
                 g = *(src + gshift);
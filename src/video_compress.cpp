@@ -43,7 +43,12 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <stdio.h>
 #include <string>
 #include <string.h>
@@ -51,8 +56,11 @@
 #include <vector>
 
 #include "compat/platform_time.h"
+#include "debug.h"
+#include "host.h"
 #include "messaging.h"
 #include "module.h"
+#include "utils/pipeline_stats.h"
 #include "utils/synchronized_queue.h"
 #include "utils/vf_split.h"
 #include "utils/worker.h"
@@ -62,7 +70,13 @@
 
 using namespace std;
 
+#define MOD_NAME "[compress] "
+
+/// Default maximal number of frames compressed concurrently by intra-only compressions
+static constexpr unsigned DEFAULT_FRAME_PARALLEL_MAX = 4;
+
 struct compress_state;
+struct compress_pipeline_task;
 
 namespace {
 /**
@@ -73,6 +87,8 @@ private:
         compress_state_real(struct module *parent, const char *config_string);
         void          start(struct compress_state *proxy);
         void          async_consumer(struct compress_state *s);
+        void          pipeline_emitter(struct compress_state *s);
+        vector<struct module *> *pipeline_get_state(struct module *parent);
         thread        asynch_consumer_thread;
 public:
         static compress_state_real *create(struct module *parent, const char *config_string,
@@ -82,10 +98,27 @@ public:
                 return s;
         }
         ~compress_state_real();
+        void          pipeline_push(shared_ptr<video_frame> frame, uint64_t t0, struct module *parent);
+        void          pipeline_release_state(vector<struct module *> *task_state);
+
         const video_compress_info    *funcs;            ///< handle for the driver
         vector<struct module *> state;                  ///< driver internal states
         string              compress_options; ///< compress options (for reconfiguration)
         volatile bool       discard_frames;   ///< this class is no longer active
+
+        /**
+         * @name Frame-parallel pipeline
+         * Used for intra-only Frame and Tile API compressions. Every frame is compressed
+         * by its own driver instance in worker pool, frames are emitted in capture order.
+         * @{ */
+        unsigned            max_in_flight;    ///< max frames not yet emitted, 0 if pipeline is disabled
+        list<vector<struct module *>> extra_state;      ///< driver states of additional instances
+        vector<vector<struct module *> *> free_state;   ///< instances not currently compressing
+        deque<compress_pipeline_task *> in_flight;      ///< compressed or compressing frames, nullptr = poison
+        mutex               pipeline_lock;
+        condition_variable  pipeline_cv;
+        thread              pipeline_emitter_thread;
+        /// @}
 };
 }
 
@@ -108,9 +141,14 @@ struct compress_state {
 struct module compress_init_noerr;
 
 static shared_ptr<video_frame> compress_frame_tiles(struct compress_state_real *s,
-                shared_ptr<video_frame> frame, struct module *parent);
+                vector<struct module *> &state, shared_ptr<video_frame> frame, struct module *parent);
 static void compress_done(struct module *mod);
 
+ADD_TO_PARAM(compress_frame_parallel, "compress-frame-parallel",
+                "* compress-frame-parallel=<n>\n"
+                "  Maximal number of frames compressed concurrently by intra-only compressions\n"
+                "  (libavcodec MJPEG, libjpeg, cpudxt), 1 disables frame parallelism.\n");
+
 /// @brief Displays list of available compressions.
 void show_compress_help()
 {
@@ -133,14 +171,21 @@ static void compress_process_message(struct compress_state *proxy, struct msg_ch
         /* In this case we are only changing some parameter of compression.
          * This means that we pass the parameter to compress driver. */
         if(data->what == CHANGE_PARAMS) {
-                for(unsigned int i = 0; i < proxy->ptr->state.size(); ++i) {
+                vector<struct module *> receivers = proxy->ptr->state;
+                {
+                        unique_lock<mutex> lk(proxy->ptr->pipeline_lock);
+                        for (auto const & instance : proxy->ptr->extra_state) {
+                                receivers.insert(receivers.end(), instance.begin(), instance.end());
+                        }
+                }
+                for (auto receiver : receivers) {
                         struct msg_change_compress_data *tmp_data =
                                 (struct msg_change_compress_data *)
                                 new_message(sizeof(struct msg_change_compress_data));
                         tmp_data->what = data->what;
                         strncpy(tmp_data->config_string, data->config_string,
                                         sizeof(tmp_data->config_string) - 1);
-                        struct response *resp = send_message_to_receiver(proxy->ptr->state[i],
+                        struct response *resp = send_message_to_receiver(receiver,
                                         (struct message *) tmp_data);
                         /// @todo
                         /// Handle responses more inteligently (eg. aggregate).
@@ -166,6 +211,10 @@ static void compress_process_message(struct compress_state *proxy, struct msg_ch
                         // let the async processing finish
                         old->discard_frames = true;
                         old->funcs->compress_frame_async_push_func(old->state[0], {}); // poison
+                } else if (old->max_in_flight > 0) {
+                        // frames already in pipeline are still emitted, only the poison is discarded
+                        old->discard_frames = true;
+                        old->pipeline_push({}, 0, nullptr);
                 }
                 delete old;
                 proxy->ptr = new_state;
@@ -216,7 +265,7 @@ int compress_init(struct module *parent, const char *config_string, struct compr
  * @retval     1            finished successfully, no state created (eg. displayed help)
  */
 compress_state_real::compress_state_real(struct module *parent, const char *config_string) :
-        funcs(nullptr), discard_frames(false)
+        funcs(nullptr), discard_frames(false), max_in_flight(0)
 {
         string compress_name;
 
@@ -265,6 +314,22 @@ void compress_state_real::start(struct compress_state *proxy)
 {
         if (funcs->compress_frame_async_push_func) {
                 asynch_consumer_thread = thread(&compress_state_real::async_consumer, this, proxy);
+                return;
+        }
+
+        if (funcs->is_intra_only && funcs->is_intra_only(state[0])) {
+                max_in_flight = min(max(thread::hardware_concurrency(), 1u), DEFAULT_FRAME_PARALLEL_MAX);
+                if (get_commandline_param("compress-frame-parallel")) {
+                        max_in_flight = max(atoi(get_commandline_param("compress-frame-parallel")), 1);
+                }
+                if (max_in_flight == 1) {
+                        max_in_flight = 0;
+                        return;
+                }
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Compressing up to %u frames concurrently.\n",
+                                max_in_flight);
+                free_state.push_back(&state);
+                pipeline_emitter_thread = thread(&compress_state_real::pipeline_emitter, this, proxy);
         }
 }
 
@@ -303,7 +368,9 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
 
         struct compress_state_real *s = proxy->ptr;
 
-        if (s->funcs->compress_frame_async_push_func) {
+        if (s->max_in_flight > 0) {
+                s->pipeline_push(move(frame), t0, &proxy->mod);
+        } else if (s->funcs->compress_frame_async_push_func) {
                 assert(s->funcs->compress_frame_async_pop_func);
                 if (frame) {
                         frame->compress_start = t0;
@@ -316,13 +383,15 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
                 }
 
                 shared_ptr<video_frame> sync_api_frame;
+                uint64_t cpu_start = pipeline_stats_begin();
                 if (s->funcs->compress_frame_func) {
                         sync_api_frame = s->funcs->compress_frame_func(s->state[0], frame);
                 } else if(s->funcs->compress_tile_func) {
-                        sync_api_frame = compress_frame_tiles(s, frame, &proxy->mod);
+                        sync_api_frame = compress_frame_tiles(s, s->state, frame, &proxy->mod);
                 } else {
                         assert(!"No egliable compress API found");
                 }
+                pipeline_stats_end(PIPELINE_STAGE_COMPRESS, cpu_start);
 
                 // empty return value here represents error, but we don't want to pass it to queue, since it would
                 // be interpreted as poisoned pill
@@ -370,19 +439,20 @@ static void *compress_tile_callback(void *arg) {
  * Compresses video frame with tiles API
  *
  * @param[in]     s             compress state
+ * @param[in]     state         driver states (one per tile) to be used
  * @param[in]     frame         uncompressed frame
  * @param         parent        parent module (for the case when there is a need to reconfigure)
  * @return                      compressed video frame, may be NULL if compression failed
  */
 static shared_ptr<video_frame> compress_frame_tiles(struct compress_state_real *s,
-                shared_ptr<video_frame> frame, struct module *parent)
+                vector<struct module *> &state, shared_ptr<video_frame> frame, struct module *parent)
 {
-        if(frame->tile_count != s->state.size()) {
-                size_t old_size = s->state.size();
-                s->state.resize(frame->tile_count);
-                for (unsigned int i = old_size; i < s->state.size(); ++i) {
-                        s->state[i] = s->funcs->init_func(parent, s->compress_options.c_str());
-                        if(!s->state[i]) {
+        if(frame->tile_count != state.size()) {
+                size_t old_size = state.size();
+                state.resize(frame->tile_count);
+                for (unsigned int i = old_size; i < state.size(); ++i) {
+                        state[i] = s->funcs->init_func(parent, s->compress_options.c_str());
+                        if(!state[i]) {
                                 fprintf(stderr, "Compression initialization failed\n");
                                 return NULL;
                         }
@@ -393,24 +463,21 @@ static shared_ptr<video_frame> compress_frame_tiles(struct compress_state_real *
         // frame pointer may no longer be valid
         frame = NULL;
 
-        vector<task_result_handle_t> task_handle(separate_tiles.size());
-
         vector <compress_worker_data> data_tile(separate_tiles.size());
         for(unsigned int i = 0; i < separate_tiles.size(); ++i) {
                 struct compress_worker_data *data = &data_tile[i];
-                data->state = s->state[i];
+                data->state = state[i];
                 data->frame = separate_tiles[i];
                 data->callback = s->funcs->compress_tile_func;
-
-                task_handle[i] = task_run_async(compress_tile_callback, data);
         }
 
+        task_run_parallel(compress_tile_callback, data_tile.size(), data_tile.data(), sizeof data_tile[0], NULL);
+
         vector<shared_ptr<video_frame>> compressed_tiles(separate_tiles.size(), nullptr);
 
         bool failed = false;
         for(unsigned int i = 0; i < separate_tiles.size(); ++i) {
-                struct compress_worker_data *data = (struct compress_worker_data *)
-                        wait_task(task_handle[i]);
+                struct compress_worker_data *data = &data_tile[i];
 
                 if(!data->ret) {
                         failed = true;
@@ -429,6 +496,152 @@ static shared_ptr<video_frame> compress_frame_tiles(struct compress_state_real *
  * @}
  */
 
+/**
+ * @name Frame-parallel Pipeline Routines
+ * Intra-only compressions may compress more frames at once, each with separate
+ * driver instance. Capture thread only dispatches the frame to worker pool (it
+ * blocks only if there are already max_in_flight frames in the pipeline) and
+ * pipeline_emitter() passes compressed frames to compress_pop() in order.
+ * @{
+ */
+/**
+ * @brief Frame in the pipeline, passed to the worker thread.
+ */
+struct compress_pipeline_task {
+        struct compress_state_real *s;
+        vector<struct module *> *state; ///< driver instance used for this frame
+        struct module *parent;
+        shared_ptr<video_frame> frame;  ///< uncompressed frame
+        uint64_t compress_start;
+
+        shared_ptr<video_frame> ret;    ///< OUT - compressed frame, NULL if failed
+        task_result_handle_t handle;
+};
+
+static void *compress_pipeline_callback(void *arg) {
+        auto *t = (struct compress_pipeline_task *) arg;
+
+        if (!t->frame->dispose) {
+                // Frame data are owned by the capture which waits until the frame is released
+                // and overwrites them with the next grab. Compress a copy to let capture continue.
+                // Copying here rather than in pipeline_push keeps it off the capture thread.
+                struct video_frame *copy = vf_get_copy(t->frame.get());
+                copy->dispose = vf_free;
+                t->frame = shared_ptr<video_frame>(copy, vf_free);
+        }
+
+        uint64_t cpu_start = pipeline_stats_begin();
+        if (t->s->funcs->compress_frame_func) {
+                t->ret = t->s->funcs->compress_frame_func((*t->state)[0], move(t->frame));
+        } else {
+                t->ret = compress_frame_tiles(t->s, *t->state, move(t->frame), t->parent);
+        }
+        pipeline_stats_end(PIPELINE_STAGE_COMPRESS, cpu_start);
+        t->frame = nullptr; // release the uncompressed frame as soon as possible
+        if (t->ret) {
+                t->ret->compress_start = t->compress_start;
+                t->ret->compress_end = time_since_epoch_in_ms();
+        }
+        t->s->pipeline_release_state(t->state);
+
+        return t;
+}
+
+namespace {
+/**
+ * Returns driver instance not currently used by any task, creating a new one if
+ * needed. Must be called with pipeline_lock held.
+ */
+vector<struct module *> *compress_state_real::pipeline_get_state(struct module *parent)
+{
+        if (free_state.empty() && 1 + extra_state.size() < max_in_flight) {
+                struct module *mod = funcs->init_func(parent, compress_options.c_str());
+                if (mod && mod != &compress_init_noerr) {
+                        extra_state.push_back({mod});
+                        return &extra_state.back();
+                }
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot create another compress instance, "
+                                "limiting concurrency to %u frames.\n", (unsigned) (1 + extra_state.size()));
+                max_in_flight = 1 + extra_state.size();
+        }
+        if (free_state.empty()) {
+                return nullptr;
+        }
+        auto ret = free_state.back();
+        free_state.pop_back();
+        return ret;
+}
+
+void compress_state_real::pipeline_release_state(vector<struct module *> *task_state)
+{
+        unique_lock<mutex> lk(pipeline_lock);
+        free_state.push_back(task_state);
+        lk.unlock();
+        pipeline_cv.notify_all();
+}
+
+/**
+ * Dispatches the frame to the worker pool (or passes poison pill if frame is empty).
+ */
+void compress_state_real::pipeline_push(shared_ptr<video_frame> frame, uint64_t t0, struct module *parent)
+{
+        unique_lock<mutex> lk(pipeline_lock);
+        if (!frame) {
+                in_flight.push_back(nullptr);
+                lk.unlock();
+                pipeline_cv.notify_all();
+                return;
+        }
+
+        vector<struct module *> *task_state = nullptr;
+        pipeline_cv.wait(lk, [&]{ return in_flight.size() < max_in_flight &&
+                        (task_state = pipeline_get_state(parent)) != nullptr; });
+        lk.unlock();
+
+        auto *t = new compress_pipeline_task{this, task_state, parent, move(frame), t0, {}, {}};
+        t->handle = task_run_async(compress_pipeline_callback, t);
+
+        lk.lock();
+        in_flight.push_back(t);
+        lk.unlock();
+        pipeline_cv.notify_all();
+}
+
+void compress_state_real::pipeline_emitter(struct compress_state *s)
+{
+        while (true) {
+                unique_lock<mutex> lk(pipeline_lock);
+                pipeline_cv.wait(lk, [this]{ return !in_flight.empty(); });
+                struct compress_pipeline_task *t = in_flight.front();
+                lk.unlock();
+
+                if (t) {
+                        wait_task(t->handle);
+                }
+
+                lk.lock();
+                in_flight.pop_front();
+                lk.unlock();
+                pipeline_cv.notify_all();
+
+                if (!t) {
+                        if (!discard_frames) {
+                                s->queue.push(shared_ptr<video_frame>());
+                        }
+                        return;
+                }
+                // empty frame means that compression failed, do not pass it as a poison
+                if (t->ret) {
+                        s->queue.push(move(t->ret));
+                }
+                delete t;
+        }
+}
+} // end of anonymous namespace
+/**
+ * @}
+ */
+
 /**
  * @brief Video compression cleanup function.
  * @param mod video compress module
@@ -450,10 +663,18 @@ compress_state_real::~compress_state_real()
         if (funcs->compress_frame_async_push_func) {
                 asynch_consumer_thread.join();
         }
+        if (pipeline_emitter_thread.joinable()) {
+                pipeline_emitter_thread.join();
+        }
 
         for(unsigned int i = 0; i < state.size(); ++i) {
                 module_done(state[i]);
         }
+        for (auto const & instance : extra_state) {
+                for (auto mod : instance) {
+                        module_done(mod);
+                }
+        }
 }
 
 namespace {
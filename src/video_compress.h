@@ -46,7 +46,7 @@
 
 #include "types.h"
 
-#define VIDEO_COMPRESS_ABI_VERSION 6
+#define VIDEO_COMPRESS_ABI_VERSION 7
 
 #ifdef __cplusplus
 extern "C" {
@@ -121,6 +121,19 @@ typedef void (*compress_frame_async_push_t)(struct module *state, std::shared_pt
  */
 typedef  std::shared_ptr<video_frame> (*compress_frame_async_pop_t)(struct module *state);
 
+/**
+ * @brief Tells whether every frame is compressed independently of others
+ *
+ * If so, several frames may be compressed concurrently, each by a separate
+ * driver instance created with compress_init_t (Frame and Tile API only).
+ * GPU-backed drivers should not provide this because each instance holds
+ * its own GL/CUDA context.
+ *
+ * @param[in]     state         driver internal state
+ * @retval        true          compressed stream doesn't have any inter-frame dependencies
+ */
+typedef  bool (*compress_is_intra_only_t)(struct module *state);
+
 void compress_frame(struct compress_state *, std::shared_ptr<video_frame>);
 
 struct compress_preset {
@@ -154,6 +167,7 @@ struct video_compress_info {
         compress_frame_async_push_t compress_frame_async_push_func; ///< Async API
         compress_frame_async_pop_t compress_frame_async_pop_func; ///< Async API
         std::list<compress_preset> (*get_presets)();    ///< list of available presets
+        compress_is_intra_only_t is_intra_only;         ///< optional, enables frame-parallel compression
 };
 
 std::shared_ptr<video_frame> compress_pop(struct compress_state *);
@@ -0,0 +1,226 @@
+/**
+ * @file   video_compress/cpudxt.cpp
+ * @brief  CPU DXT1 and YCoCg-DXT5 compression (RTDXT compatible)
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <memory>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "host.h"
+#include "lib_common.h"
+#include "module.h"
+#include "utils/dxt_cpu.h"
+#include "utils/video_frame_pool.h"
+#include "video.h"
+#include "video_compress.h"
+
+#define MOD_NAME "[CPU DXT] "
+
+using namespace std;
+
+namespace {
+
+struct state_video_compress_cpudxt {
+        struct module module_data;
+
+        codec_t color_spec;              ///< DXT1 or DXT5
+        enum dxt_cpu_type type;
+
+        struct video_desc saved_desc;
+        codec_t enc_codec;               ///< codec passed to the encoder
+        decoder_t decoder;               ///< conversion to enc_codec, NULL if not needed
+        bool interlaced_input;
+        unique_ptr<unsigned char []> converted; ///< used if decoder or interlaced_input
+
+        video_frame_pool<default_data_allocator> pool;
+};
+
+static void cpudxt_compress_done(struct module *mod);
+
+struct module *cpudxt_compress_init(struct module *parent, const char *opts)
+{
+        if (opts && strcmp(opts, "help") == 0) {
+                printf("CPU DXT compression usage:\n");
+                printf("\t-c cpudxt[:DXT1|:DXT5]\n");
+                printf("\t\tcompress with DXT1 (default) or DXT5 YCoCg, output is compatible with RTDXT\n");
+                return &compress_init_noerr;
+        }
+
+        auto s = new state_video_compress_cpudxt();
+
+        if (opts == NULL || opts[0] == '\0' || strcasecmp(opts, "DXT1") == 0) {
+                s->color_spec = DXT1;
+                s->type = DXT_CPU_DXT1;
+        } else if (strcasecmp(opts, "DXT5") == 0) {
+                s->color_spec = DXT5;
+                s->type = DXT_CPU_DXT5_YCOCG;
+        } else {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown compression: %s\n", opts);
+                delete s;
+                return NULL;
+        }
+
+        module_init_default(&s->module_data);
+        s->module_data.cls = MODULE_CLASS_DATA;
+        s->module_data.priv_data = s;
+        s->module_data.deleter = cpudxt_compress_done;
+        module_register(&s->module_data, parent);
+
+        return &s->module_data;
+}
+
+static bool configure_with(struct state_video_compress_cpudxt *s, struct video_desc desc)
+{
+        s->decoder = NULL;
+        s->converted = nullptr;
+
+        if (dxt_cpu_encoder_supports(desc.color_spec)) {
+                s->enc_codec = desc.color_spec;
+        } else {
+                codec_t candidates[] = { UYVY, RGBA };
+                if (codec_is_a_rgb(desc.color_spec)) {
+                        swap(candidates[0], candidates[1]);
+                }
+                for (auto c : candidates) {
+                        if ((s->decoder = get_decoder_from_to(desc.color_spec, c, false)) != NULL) {
+                                s->enc_codec = c;
+                                break;
+                        }
+                }
+                if (!s->decoder) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unsupported codec: %s\n",
+                                        get_codec_name(desc.color_spec));
+                        return false;
+                }
+                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Converting %s to %s prior to compression.\n",
+                                get_codec_name(desc.color_spec), get_codec_name(s->enc_codec));
+        }
+
+        struct video_desc compressed_desc = desc;
+        compressed_desc.color_spec = s->color_spec;
+        compressed_desc.tile_count = 1;
+        /* We will deinterlace the output frame */
+        s->interlaced_input = desc.interlacing == INTERLACED_MERGED;
+        if (s->interlaced_input) {
+                compressed_desc.interlacing = PROGRESSIVE;
+                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Enabling automatic deinterlacing.\n");
+        }
+        if (s->decoder || s->interlaced_input) {
+                s->converted = unique_ptr<unsigned char []>(new unsigned char[
+                                (size_t) vc_get_linesize(desc.width, s->enc_codec) * desc.height]);
+        }
+        s->pool.reconfigure(compressed_desc, dxt_cpu_get_size(desc.width, desc.height, s->type));
+
+        s->saved_desc = desc;
+
+        return true;
+}
+
+shared_ptr<video_frame> cpudxt_compress_tile(struct module *mod, shared_ptr<video_frame> tx)
+{
+        auto s = static_cast<struct state_video_compress_cpudxt *>(mod->priv_data);
+
+        struct video_desc desc = video_desc_from_frame(tx.get());
+        if (!video_desc_eq_excl_param(desc, s->saved_desc, PARAM_TILE_COUNT)) {
+                if (!configure_with(s, desc)) {
+                        return {};
+                }
+        }
+
+        unsigned char *src = (unsigned char *) tx->tiles[0].data;
+        int pitch = vc_get_linesize(tx->tiles[0].width, tx->color_spec);
+        if (s->converted) {
+                int dst_linesize = vc_get_linesize(tx->tiles[0].width, s->enc_codec);
+                for (unsigned int y = 0; y < tx->tiles[0].height; ++y) {
+                        unsigned char *dst = s->converted.get() + (size_t) y * dst_linesize;
+                        if (s->decoder) {
+                                s->decoder(dst, src + (size_t) y * pitch, dst_linesize, 0, 8, 16);
+                        } else {
+                                memcpy(dst, src + (size_t) y * pitch, dst_linesize);
+                        }
+                }
+                if (s->interlaced_input) {
+                        vc_deinterlace(s->converted.get(), dst_linesize, tx->tiles[0].height);
+                }
+                src = s->converted.get();
+                pitch = dst_linesize;
+        }
+
+        shared_ptr<video_frame> out = s->pool.get_frame();
+        dxt_cpu_encode(s->type, src, tx->tiles[0].width, tx->tiles[0].height, pitch, s->enc_codec,
+                        (unsigned char *) out->tiles[0].data);
+
+        return out;
+}
+
+static void cpudxt_compress_done(struct module *mod)
+{
+        auto s = static_cast<struct state_video_compress_cpudxt *>(mod->priv_data);
+
+        delete s;
+}
+
+const struct video_compress_info cpudxt_info = {
+        "cpudxt",
+        cpudxt_compress_init,
+        NULL,
+        cpudxt_compress_tile,
+        NULL,
+        NULL,
+        [] {
+                return list<compress_preset>{
+                        { "DXT1", 35, [](const struct video_desc *d){return (long)(d->width * d->height * d->fps * 4.0);},
+                                {10, 0.6, 0}, {10, 0.4, 0} },
+                        { "DXT5", 50, [](const struct video_desc *d){return (long)(d->width * d->height * d->fps * 8.0);},
+                                {12, 0.8, 0}, {12, 0.6, 0} },
+                };
+        },
+        [](struct module *) {
+                return true;
+        },
+};
+
+REGISTER_MODULE(cpudxt, &cpudxt_info, LIBRARY_CLASS_VIDEO_COMPRESS, VIDEO_COMPRESS_ABI_VERSION);
+
+} // end of anonymous namespace
+
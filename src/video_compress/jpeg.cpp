@@ -563,7 +563,8 @@ const struct video_compress_info jpeg_info = {
                         { "90", 80, [](const struct video_desc *d){return (long)(d->width * d->height * d->fps * 1.54);},
                                 {15, 0.6, 100}, {20, 0.6, 150} },
                 } : list<compress_preset>{};
-        }
+        },
+        NULL,
 };
 
 REGISTER_MODULE(jpeg, &jpeg_info, LIBRARY_CLASS_VIDEO_COMPRESS, VIDEO_COMPRESS_ABI_VERSION);
@@ -85,6 +85,9 @@ extern "C"
 #define _mm_bsrli_si128 _mm_srli_si128
 #endif
 #endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
 
 using namespace std;
 
@@ -92,6 +95,9 @@ static constexpr const codec_t DEFAULT_CODEC = MJPG;
 static constexpr double DEFAULT_X264_X265_CRF = 22.0;
 static constexpr const int DEFAULT_GOP_SIZE = 20;
 static constexpr const char *DEFAULT_THREAD_MODE = "slice";
+/// Number of lines converted at once from input codec to UYVY and then to
+/// the selected pixfmt. The intermediate buffer stays in cache.
+static constexpr const int CONVERT_CHUNK_LINES = 16;
 
 namespace {
 
@@ -190,12 +196,16 @@ struct state_video_compress_libav {
         struct video_desc   saved_desc;
 
         AVFrame            *in_frame;
+        int                 frame_seq; ///< pts of the next frame
         // for every core - parts of the above
         AVFrame           **in_frame_part;
+        // for every core - currently converted chunk of in_frame_part
+        AVFrame           **in_frame_chunk;
         AVCodecContext     *codec_ctx;
 
         unsigned char      *decoded; ///< intermediate representation for codecs
-                                     ///< that are not directly supported
+                                     ///< that are not directly supported,
+                                     ///< CONVERT_CHUNK_LINES lines for every core
         codec_t             decoded_codec;
         decoder_t           decoder;
 
@@ -457,8 +467,10 @@ struct module * libavcodec_compress_init(struct module *parent, const char *opts
                 s->params.cpu_count = 1;
         }
         s->in_frame_part = (AVFrame **) calloc(s->params.cpu_count, sizeof(AVFrame *));
+        s->in_frame_chunk = (AVFrame **) calloc(s->params.cpu_count, sizeof(AVFrame *));
         for(int i = 0; i < s->params.cpu_count; i++) {
                 s->in_frame_part[i] = av_frame_alloc();
+                s->in_frame_chunk[i] = av_frame_alloc();
         }
 
         s->decoded = NULL;
@@ -922,7 +934,10 @@ static bool configure_with(struct state_video_compress_libav *s, struct video_de
                         return false;
         }
 
-        s->decoded = (unsigned char *) malloc(vc_get_linesize(desc.width, s->decoded_codec) * desc.height);
+        if ((void *) s->decoder != (void *) memcpy) {
+                s->decoded = (unsigned char *) malloc(desc.width * 2 /* UYVY */ * CONVERT_CHUNK_LINES *
+                                s->params.cpu_count);
+        }
 
         s->in_frame = av_frame_alloc();
         if (!s->in_frame) {
@@ -985,7 +1000,37 @@ static void to_yuv420p(AVFrame *out_frame, unsigned char *in_data, int width, in
                 unsigned char *dst_y2 = out_frame->data[0] + out_frame->linesize[0] * (y + 1);
                 unsigned char *dst_cb = out_frame->data[1] + out_frame->linesize[1] * y / 2;
                 unsigned char *dst_cr = out_frame->data[2] + out_frame->linesize[2] * y / 2;
-                for(int x = 0; x < width / 2; ++x) {
+
+                int x = 0;
+#ifdef __SSSE3__
+                // Y0-7 | U0-3 | V0-3 from 8 UYVY pixels
+                __m128i split = _mm_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15, 0, 4, 8, 12, 2, 6, 10, 14);
+                __m128i one = _mm_set1_epi8(1);
+
+                for (; x < width - 15; x += 16) {
+                        __m128i a = _mm_shuffle_epi8(_mm_lddqu_si128((__m128i const*) src), split);
+                        __m128i b = _mm_shuffle_epi8(_mm_lddqu_si128((__m128i const*) (src + 16)), split);
+                        __m128i a2 = _mm_shuffle_epi8(_mm_lddqu_si128((__m128i const*) src2), split);
+                        __m128i b2 = _mm_shuffle_epi8(_mm_lddqu_si128((__m128i const*) (src2 + 16)), split);
+                        src += 32;
+                        src2 += 32;
+
+                        _mm_storeu_si128((__m128i *) dst_y, _mm_unpacklo_epi64(a, b));
+                        _mm_storeu_si128((__m128i *) dst_y2, _mm_unpacklo_epi64(a2, b2));
+                        dst_y += 16;
+                        dst_y2 += 16;
+
+                        // U0-7 | V0-7, averaged with truncation as the scalar code
+                        __m128i uv = _mm_unpackhi_epi32(a, b);
+                        __m128i uv2 = _mm_unpackhi_epi32(a2, b2);
+                        uv = _mm_sub_epi8(_mm_avg_epu8(uv, uv2), _mm_and_si128(_mm_xor_si128(uv, uv2), one));
+                        _mm_storel_epi64((__m128i *) dst_cb, uv);
+                        _mm_storel_epi64((__m128i *) dst_cr, _mm_bsrli_si128(uv, 8));
+                        dst_cb += 8;
+                        dst_cr += 8;
+                }
+#endif
+                for(; x < width - 1; x += 2) {
                         *dst_cb++ = (*src++ + *src2++) / 2;
                         *dst_y++ = *src++;
                         *dst_y2++ = *src2++;
@@ -1002,7 +1047,27 @@ static void to_yuv422p(AVFrame *out_frame, unsigned char *src, int width, int he
                 unsigned char *dst_y = out_frame->data[0] + out_frame->linesize[0] * y;
                 unsigned char *dst_cb = out_frame->data[1] + out_frame->linesize[1] * y;
                 unsigned char *dst_cr = out_frame->data[2] + out_frame->linesize[2] * y;
-                for(int x = 0; x < width; x += 2) {
+
+                int x = 0;
+#ifdef __SSSE3__
+                // Y0-7 | U0-3 | V0-3 from 8 UYVY pixels
+                __m128i split = _mm_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15, 0, 4, 8, 12, 2, 6, 10, 14);
+
+                for (; x < width - 15; x += 16) {
+                        __m128i a = _mm_shuffle_epi8(_mm_lddqu_si128((__m128i const*) src), split);
+                        __m128i b = _mm_shuffle_epi8(_mm_lddqu_si128((__m128i const*) (src + 16)), split);
+                        src += 32;
+
+                        _mm_storeu_si128((__m128i *) dst_y, _mm_unpacklo_epi64(a, b));
+                        dst_y += 16;
+                        __m128i uv = _mm_unpackhi_epi32(a, b); // U0-7 | V0-7
+                        _mm_storel_epi64((__m128i *) dst_cb, uv);
+                        _mm_storel_epi64((__m128i *) dst_cr, _mm_bsrli_si128(uv, 8));
+                        dst_cb += 8;
+                        dst_cr += 8;
+                }
+#endif
+                for(; x < width; x += 2) {
                         *dst_cb++ = *src++;
                         *dst_y++ = *src++;
                         *dst_cr++ = *src++;
@@ -1273,26 +1338,53 @@ static pixfmt_callback_t select_pixfmt_callback(AVPixelFormat fmt, codec_t src)
 
 struct my_task_data {
         void (*callback)(AVFrame *out_frame, unsigned char *in_data, int width, int height);
+        decoder_t decoder;      ///< conversion to UYVY, NULL if in_data can be passed to callback directly
         AVFrame *out_frame;
+        AVFrame *out_chunk;     ///< used as a view of out_frame when decoding
+        int chroma_shift;       ///< log2 of vertical chroma subsampling of out_frame
         unsigned char *in_data;
+        int in_linesize;
+        unsigned char *decoded; ///< buffer for CONVERT_CHUNK_LINES lines of UYVY
         int width;
         int height;
 };
 
 void *my_task(void *arg);
 
+/**
+ * Converts a stripe of input frame to the selected pixfmt. If input needs to
+ * be decoded to UYVY first, it is done in chunks of CONVERT_CHUNK_LINES
+ * lines so that the intermediate data are still in cache when converted.
+ */
 void *my_task(void *arg) {
         struct my_task_data *data = (struct my_task_data *) arg;
-        data->callback(data->out_frame, data->in_data, data->width, data->height);
+        if (data->decoder == NULL) {
+                data->callback(data->out_frame, data->in_data, data->width, data->height);
+                return NULL;
+        }
+
+        int decoded_linesize = data->width * 2; /* UYVY */
+        for (int y = 0; y < data->height; y += CONVERT_CHUNK_LINES) {
+                int lines = min(CONVERT_CHUNK_LINES, data->height - y);
+                for (int i = 0; i < lines; ++i) {
+                        data->decoder(data->decoded + i * decoded_linesize,
+                                        data->in_data + (y + i) * data->in_linesize,
+                                        decoded_linesize, 0, 8, 16);
+                }
+                for (int p = 0; p < AV_NUM_DATA_POINTERS && data->out_frame->data[p]; ++p) {
+                        int plane_line = p == 1 || p == 2 ? y >> data->chroma_shift : y;
+                        data->out_chunk->data[p] = data->out_frame->data[p] + data->out_frame->linesize[p] * plane_line;
+                        data->out_chunk->linesize[p] = data->out_frame->linesize[p];
+                }
+                data->callback(data->out_chunk, data->decoded, data->width, lines);
+        }
         return NULL;
 }
 
 static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shared_ptr<video_frame> tx)
 {
         struct state_video_compress_libav *s = (struct state_video_compress_libav *) mod->priv_data;
-        static int frame_seq = 0;
         int ret;
-        unsigned char *decoded;
         shared_ptr<video_frame> out{};
 
         libavcodec_check_messages(s);
@@ -1330,30 +1422,18 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
                         s->compressed_desc.height * 4);
 #endif // LIBAVCODEC_VERSION_MAJOR >= 54
 
-        s->in_frame->pts = frame_seq++;
-
-        if((void *) s->decoder != (void *) memcpy) {
-                unsigned char *line1 = (unsigned char *) tx->tiles[0].data;
-                unsigned char *line2 = (unsigned char *) s->decoded;
-                int src_linesize = vc_get_linesize(tx->tiles[0].width, tx->color_spec);
-                int dst_linesize = tx->tiles[0].width * 2; /* UYVY */
-                for (int i = 0; i < (int) tx->tiles[0].height; ++i) {
-                        s->decoder(line2, line1, dst_linesize,
-                                        0, 8, 16);
-                        line1 += src_linesize;
-                        line2 += dst_linesize;
-                }
-                decoded = s->decoded;
-        } else {
-                decoded = (unsigned char *) tx->tiles[0].data;
-        }
+        s->in_frame->pts = s->frame_seq++;
 
         {
-                task_result_handle_t handle[s->params.cpu_count];
+                bool decode = (void *) s->decoder != (void *) memcpy;
+                int in_linesize = vc_get_linesize(tx->tiles[0].width, tx->color_spec);
                 struct my_task_data data[s->params.cpu_count];
                 for(int i = 0; i < s->params.cpu_count; ++i) {
                         data[i].callback = select_pixfmt_callback(s->selected_pixfmt, s->decoded_codec);
+                        data[i].decoder = decode ? s->decoder : NULL;
                         data[i].out_frame = s->in_frame_part[i];
+                        data[i].out_chunk = s->in_frame_chunk[i];
+                        data[i].chroma_shift = av_pix_fmt_desc_get(s->selected_pixfmt)->log2_chroma_h;
 
                         size_t height = tx->tiles[0].height / s->params.cpu_count;
                         // height needs to be even
@@ -1365,16 +1445,12 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
                                         height * (s->params.cpu_count - 1);
                         }
                         data[i].width = tx->tiles[0].width;
-                        data[i].in_data = decoded + i * height *
-                                vc_get_linesize(tx->tiles[0].width, s->decoded_codec);
-
-                        // run !
-                        handle[i] = task_run_async(my_task, (void *) &data[i]);
+                        data[i].in_data = (unsigned char *) tx->tiles[0].data + i * height * in_linesize;
+                        data[i].in_linesize = in_linesize;
+                        data[i].decoded = decode ? s->decoded + i * tx->tiles[0].width * 2 * CONVERT_CHUNK_LINES : NULL;
                 }
 
-                for(int i = 0; i < s->params.cpu_count; ++i) {
-                        wait_task(handle[i]);
-                }
+                task_run_parallel(my_task, s->params.cpu_count, data, sizeof data[0], NULL);
         }
 
         AVFrame *frame = s->in_frame;
@@ -1417,7 +1493,7 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
         }
 
         if (got_output) {
-                //printf("Write frame %3d (size=%5d)\n", frame_seq, s->pkt[buffer_idx].size);
+                //printf("Write frame %3d (size=%5d)\n", s->frame_seq, s->pkt[buffer_idx].size);
                 out->tiles[0].data = (char *) pkt->data;
                 out->tiles[0].data_len = pkt->size;
         } else {
@@ -1433,7 +1509,7 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
         }
 
         if (ret) {
-                //printf("Write frame %3d (size=%5d)\n", frame_seq, s->pkt[buffer_idx].size);
+                //printf("Write frame %3d (size=%5d)\n", s->frame_seq, s->pkt[buffer_idx].size);
                 out->tiles[0].data_len = ret;
         } else {
                 return {};
@@ -1495,8 +1571,10 @@ static void libavcodec_compress_done(struct module *mod)
         rm_release_shared_lock(LAVCD_LOCK_NAME);
         for(int i = 0; i < s->params.cpu_count; i++) {
                 av_free(s->in_frame_part[i]);
+                av_free(s->in_frame_chunk[i]);
         }
         free(s->in_frame_part);
+        free(s->in_frame_chunk);
         delete s;
 }
 
@@ -1646,6 +1724,33 @@ static void setparam_vp8_vp9(AVCodecContext *codec_ctx, struct setparam_param *p
         }
 }
 
+/**
+ * Changes bitrate of the opened encoder without reinitialization. FFmpeg
+ * reconfigures libx264 (if opened with a bitrate, ie. with VBV) and NVENC
+ * when rate control members of the codec context change between frames.
+ *
+ * @retval false encoder doesn't support it, it needs to be reinitialized
+ */
+static bool change_bitrate_on_the_fly(struct state_video_compress_libav *s, long long bitrate)
+{
+        static const regex nvenc(".*nvenc.*"); // called per frame by rate control
+        if (s->codec_ctx == nullptr || s->saved_desc.fps <= 0.0 || s->codec_ctx->bit_rate <= 0 || bitrate <= 0 ||
+                        (strcmp(s->codec_ctx->codec->name, "libx264") != 0 &&
+                         !regex_match(s->codec_ctx->codec->name, nvenc))) {
+                return false;
+        }
+
+        s->requested_bitrate = bitrate;
+        if (s->codec_ctx->rc_max_rate > 0) { // keep the VBV buffer duration
+                s->codec_ctx->rc_buffer_size = (long long) s->codec_ctx->rc_buffer_size * bitrate / s->codec_ctx->rc_max_rate;
+                s->codec_ctx->rc_max_rate = bitrate;
+        }
+        s->codec_ctx->bit_rate = bitrate;
+        s->codec_ctx->bit_rate_tolerance = bitrate / s->saved_desc.fps * 6;
+        log_msg(LOG_LEVEL_VERBOSE, "[lavc] Bitrate changed to %lld bps.\n", bitrate);
+        return true;
+}
+
 static void libavcodec_check_messages(struct state_video_compress_libav *s)
 {
         struct message *msg;
@@ -1653,6 +1758,14 @@ static void libavcodec_check_messages(struct state_video_compress_libav *s)
                 struct msg_change_compress_data *data =
                         (struct msg_change_compress_data *) msg;
                 struct response *r;
+                // only bitrate changed (eg. by rate control of the sender)
+                if (data->what == CHANGE_PARAMS &&
+                                strncasecmp(data->config_string, "bitrate=", strlen("bitrate=")) == 0 &&
+                                strchr(data->config_string, ':') == NULL &&
+                                change_bitrate_on_the_fly(s, unit_evaluate(data->config_string + strlen("bitrate=")))) {
+                        free_message(msg, new_response(RESPONSE_OK, NULL));
+                        continue;
+                }
                 if (parse_fmt(s, data->config_string) == 0) {
                         log_msg(LOG_LEVEL_NOTICE, "[Libavcodec] Compression successfully changed.\n");
                         r = new_response(RESPONSE_OK, NULL);
@@ -1666,6 +1779,32 @@ static void libavcodec_check_messages(struct state_video_compress_libav *s)
 
 }
 
+/**
+ * Frames may be compressed in parallel by separate encoder instances only if
+ * the selected codec has no inter-frame dependencies (MJPEG, JPEG 2000).
+ */
+static bool libavcodec_is_intra_only(struct module *mod)
+{
+        auto s = static_cast<struct state_video_compress_libav *>(mod->priv_data);
+        enum AVCodecID id = AV_CODEC_ID_NONE;
+
+        if (!s->backend.empty()) {
+                AVCodec *codec = avcodec_find_encoder_by_name(s->backend.c_str());
+                if (codec) {
+                        id = codec->id;
+                }
+        } else {
+                codec_t ug_codec = s->requested_codec_id == VIDEO_CODEC_NONE ?
+                        DEFAULT_CODEC : s->requested_codec_id;
+                if (codec_params.find(ug_codec) != codec_params.end()) {
+                        id = codec_params.at(ug_codec).av_codec;
+                }
+        }
+
+        const AVCodecDescriptor *desc = avcodec_descriptor_get(id);
+        return desc && (desc->props & AV_CODEC_PROP_INTRA_ONLY);
+}
+
 const struct video_compress_info libavcodec_info = {
         "libavcodec",
         libavcodec_compress_init,
@@ -1674,6 +1813,7 @@ const struct video_compress_info libavcodec_info = {
         NULL,
         NULL,
         get_libavcodec_presets,
+        libavcodec_is_intra_only,
 };
 
 REGISTER_MODULE(libavcodec, &libavcodec_info, LIBRARY_CLASS_VIDEO_COMPRESS, VIDEO_COMPRESS_ABI_VERSION);
@@ -0,0 +1,261 @@
+/**
+ * @file   video_compress/libjpeg.cpp
+ * @brief  CPU JPEG compression (libjpeg-turbo)
+ *
+ * Stream produced by this module is compatible with GPUJPEG (@ref jpeg.cpp)
+ * so that either side may be replaced with CPU implementation.
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <memory>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "host.h"
+#include "lib_common.h"
+#include "module.h"
+#include "utils/jpeg_slices.h"
+#include "utils/video_frame_pool.h"
+#include "video.h"
+#include "video_compress.h"
+
+#define MOD_NAME "[libjpeg] "
+
+using namespace std;
+
+namespace {
+
+struct state_video_compress_libjpeg {
+        struct module module_data;
+
+        int quality;
+        int restart_interval;
+
+        struct jpeg_slices_encoder *encoder;
+        struct video_desc saved_desc;
+        codec_t enc_codec;               ///< codec passed to the encoder
+        decoder_t decoder;               ///< conversion to enc_codec, NULL if not needed
+        unique_ptr<unsigned char []> converted;
+        size_t max_compressed_len;
+
+        video_frame_pool<default_data_allocator> pool;
+};
+
+static void libjpeg_compress_done(struct module *mod);
+
+static bool parse_fmt(struct state_video_compress_libjpeg *s, char *fmt)
+{
+        char *tok, *save_ptr = NULL;
+        tok = strtok_r(fmt, ":", &save_ptr);
+        s->quality = atoi(tok);
+        if (s->quality <= 0 || s->quality > 100) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Error: Quality should be in interval [1-100]!\n");
+                return false;
+        }
+
+        tok = strtok_r(NULL, ":", &save_ptr);
+        if (tok) {
+                s->restart_interval = atoi(tok);
+                if (s->restart_interval < 0) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Error: Restart interval should be non-negative!\n");
+                        return false;
+                }
+        }
+        tok = strtok_r(NULL, ":", &save_ptr);
+        if (tok) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "WARNING: Trailing configuration parameters.\n");
+        }
+
+        return true;
+}
+
+struct module *libjpeg_compress_init(struct module *parent, const char *opts)
+{
+        if (opts && strcmp(opts, "help") == 0) {
+                printf("CPU JPEG (libjpeg) compression usage:\n");
+                printf("\t-c libjpeg[:<quality>[:<restart_interval>]]\n");
+                printf("\t\t<quality> - JPEG quality [1-100] (default %d)\n", JPEG_SLICES_DEFAULT_QUALITY);
+                printf("\t\t<restart_interval> - restart interval in MCUs, 0 to disable; frame is\n"
+                                "\t\t\tencoded by multiple threads along restart markers (default as GPUJPEG)\n");
+                return &compress_init_noerr;
+        }
+
+        auto s = new state_video_compress_libjpeg();
+        s->quality = JPEG_SLICES_DEFAULT_QUALITY;
+        s->restart_interval = -1;
+
+        if (opts && opts[0] != '\0') {
+                char *fmt = strdup(opts);
+                bool ret = parse_fmt(s, fmt);
+                free(fmt);
+                if (!ret) {
+                        delete s;
+                        return NULL;
+                }
+        }
+
+        s->encoder = jpeg_slices_encoder_create(s->quality, s->restart_interval, 0);
+        if (!s->encoder) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to create encoder!\n");
+                delete s;
+                return NULL;
+        }
+
+        module_init_default(&s->module_data);
+        s->module_data.cls = MODULE_CLASS_DATA;
+        s->module_data.priv_data = s;
+        s->module_data.deleter = libjpeg_compress_done;
+        module_register(&s->module_data, parent);
+
+        return &s->module_data;
+}
+
+static bool configure_with(struct state_video_compress_libjpeg *s, struct video_desc desc)
+{
+        s->decoder = NULL;
+        s->converted = nullptr;
+
+        if (jpeg_slices_encoder_supports(desc.color_spec)) {
+                s->enc_codec = desc.color_spec;
+        } else {
+                codec_t candidates[] = { UYVY, RGB };
+                if (codec_is_a_rgb(desc.color_spec)) {
+                        swap(candidates[0], candidates[1]);
+                }
+                for (auto c : candidates) {
+                        if ((s->decoder = get_decoder_from_to(desc.color_spec, c, false)) != NULL) {
+                                s->enc_codec = c;
+                                break;
+                        }
+                }
+                if (!s->decoder) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unsupported codec: %s\n",
+                                        get_codec_name(desc.color_spec));
+                        return false;
+                }
+                s->converted = unique_ptr<unsigned char []>(new unsigned char[
+                                (size_t) vc_get_linesize(desc.width, s->enc_codec) * desc.height]);
+                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Converting %s to %s prior to compression.\n",
+                                get_codec_name(desc.color_spec), get_codec_name(s->enc_codec));
+        }
+
+        struct video_desc compressed_desc = desc;
+        compressed_desc.color_spec = JPEG;
+        compressed_desc.tile_count = 1;
+        // JPEG of a sane quality never exceeds size of 24-bit uncompressed frame
+        s->max_compressed_len = (size_t) desc.width * desc.height * 3 + 4096;
+        s->pool.reconfigure(compressed_desc, s->max_compressed_len);
+
+        s->saved_desc = desc;
+
+        return true;
+}
+
+shared_ptr<video_frame> libjpeg_compress_tile(struct module *mod, shared_ptr<video_frame> tx)
+{
+        auto s = static_cast<struct state_video_compress_libjpeg *>(mod->priv_data);
+
+        struct video_desc desc = video_desc_from_frame(tx.get());
+        if (!video_desc_eq_excl_param(desc, s->saved_desc, PARAM_TILE_COUNT)) {
+                if (!configure_with(s, desc)) {
+                        return {};
+                }
+        }
+
+        unsigned char *src = (unsigned char *) tx->tiles[0].data;
+        int pitch = vc_get_linesize(tx->tiles[0].width, tx->color_spec);
+        if (s->decoder) {
+                int dst_linesize = vc_get_linesize(tx->tiles[0].width, s->enc_codec);
+                for (unsigned int y = 0; y < tx->tiles[0].height; ++y) {
+                        s->decoder(s->converted.get() + (size_t) y * dst_linesize,
+                                        src + (size_t) y * pitch, dst_linesize,
+                                        0, 8, 16);
+                }
+                src = s->converted.get();
+                pitch = dst_linesize;
+        }
+
+        shared_ptr<video_frame> out = s->pool.get_frame();
+        size_t len = jpeg_slices_encode(s->encoder, src, tx->tiles[0].width, tx->tiles[0].height,
+                        pitch, s->enc_codec, (unsigned char *) out->tiles[0].data,
+                        s->max_compressed_len);
+        if (len == 0) {
+                return {};
+        }
+        out->tiles[0].data_len = len;
+
+        return out;
+}
+
+static void libjpeg_compress_done(struct module *mod)
+{
+        auto s = static_cast<struct state_video_compress_libjpeg *>(mod->priv_data);
+
+        jpeg_slices_encoder_destroy(s->encoder);
+        delete s;
+}
+
+const struct video_compress_info libjpeg_info = {
+        "libjpeg",
+        libjpeg_compress_init,
+        NULL,
+        libjpeg_compress_tile,
+        NULL,
+        NULL,
+        [] {
+                return list<compress_preset>{
+                        { "60", 60, [](const struct video_desc *d){return (long)(d->width * d->height * d->fps * 0.68);},
+                                {10, 2.0, 0}, {10, 1.5, 0} },
+                        { "80", 70, [](const struct video_desc *d){return (long)(d->width * d->height * d->fps * 0.87);},
+                                {12, 2.5, 0}, {15, 2.0, 0} },
+                        { "90", 80, [](const struct video_desc *d){return (long)(d->width * d->height * d->fps * 1.54);},
+                                {15, 3.0, 0}, {20, 2.5, 0} },
+                };
+        },
+        [](struct module *) {
+                return true;
+        },
+};
+
+REGISTER_MODULE(libjpeg, &libjpeg_info, LIBRARY_CLASS_VIDEO_COMPRESS, VIDEO_COMPRESS_ABI_VERSION);
+
+} // end of anonymous namespace
+
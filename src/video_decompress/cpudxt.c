@@ -0,0 +1,176 @@
+/**
+ * @file   video_decompress/cpudxt.c
+ * @brief  CPU DXT1 and YCoCg-DXT5 decompression
+ *
+ * Decodes streams produced by RTDXT and CPU DXT compression. Has lower
+ * priority than the GLSL decoder (which is thus preferred when available).
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "lib_common.h"
+#include "utils/dxt_cpu.h"
+#include "video.h"
+#include "video_decompress.h"
+
+#define MOD_NAME "[CPU DXT dec.] "
+
+struct state_decompress_cpudxt {
+        struct video_desc desc;
+        enum dxt_cpu_type type;
+        int rshift, gshift, bshift;
+        int pitch;
+        codec_t out_codec;
+
+        unsigned char *tmp;   ///< used if output needs to be post-processed
+};
+
+static void *cpudxt_decompress_init(void)
+{
+        return calloc(1, sizeof(struct state_decompress_cpudxt));
+}
+
+static int cpudxt_decompress_reconfigure(void *state, struct video_desc desc,
+                int rshift, int gshift, int bshift, int pitch, codec_t out_codec)
+{
+        struct state_decompress_cpudxt *s = (struct state_decompress_cpudxt *) state;
+
+        assert(desc.color_spec == DXT1 || desc.color_spec == DXT5);
+        assert(out_codec == RGBA || out_codec == UYVY);
+
+        s->desc = desc;
+        s->type = desc.color_spec == DXT1 ? DXT_CPU_DXT1 : DXT_CPU_DXT5_YCOCG;
+        s->out_codec = out_codec;
+        s->pitch = pitch;
+        s->rshift = rshift;
+        s->gshift = gshift;
+        s->bshift = bshift;
+
+        free(s->tmp);
+        s->tmp = NULL;
+        if (out_codec == RGBA && (rshift != 0 || gshift != 8 || bshift != 16)) {
+                s->tmp = malloc((size_t) vc_get_linesize(desc.width, RGBA) * desc.height);
+                if (!s->tmp) {
+                        return FALSE;
+                }
+        }
+
+        return TRUE;
+}
+
+static int cpudxt_decompress(void *state, unsigned char *dst, unsigned char *buffer,
+                unsigned int src_len, int frame_seq)
+{
+        UNUSED(frame_seq);
+        struct state_decompress_cpudxt *s = (struct state_decompress_cpudxt *) state;
+
+        if (src_len < dxt_cpu_get_size(s->desc.width, s->desc.height, s->type)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Frame too short (%u B)!\n", src_len);
+                return FALSE;
+        }
+
+        if (!s->tmp) {
+                dxt_cpu_decode(s->type, buffer, s->desc.width, s->desc.height, dst, s->pitch, s->out_codec);
+                return TRUE;
+        }
+
+        int linesize = vc_get_linesize(s->desc.width, RGBA);
+        dxt_cpu_decode(s->type, buffer, s->desc.width, s->desc.height, s->tmp, linesize, RGBA);
+        for (unsigned int i = 0; i < s->desc.height; i++) {
+                vc_copylineRGBA(dst + (size_t) i * s->pitch, s->tmp + (size_t) i * linesize,
+                                linesize, s->rshift, s->gshift, s->bshift);
+        }
+
+        return TRUE;
+}
+
+static int cpudxt_decompress_get_property(void *state, int property, void *val, size_t *len)
+{
+        UNUSED(state);
+        int ret = FALSE;
+
+        switch(property) {
+                case DECOMPRESS_PROPERTY_ACCEPTS_CORRUPTED_FRAME:
+                        if(*len >= sizeof(int)) {
+                                *(int *) val = TRUE;
+                                *len = sizeof(int);
+                                ret = TRUE;
+                        }
+                        break;
+                default:
+                        ret = FALSE;
+        }
+
+        return ret;
+}
+
+static void cpudxt_decompress_done(void *state)
+{
+        struct state_decompress_cpudxt *s = (struct state_decompress_cpudxt *) state;
+
+        free(s->tmp);
+        free(s);
+}
+
+static const struct decode_from_to *cpudxt_decompress_get_decoders(void) {
+        static const struct decode_from_to ret[] = {
+		{ DXT1, RGBA, 600 },
+		{ DXT5, RGBA, 600 },
+		{ DXT1, UYVY, 600 },
+		{ DXT5, UYVY, 600 },
+		{ VIDEO_CODEC_NONE, VIDEO_CODEC_NONE, 0 },
+        };
+        return ret;
+}
+
+static const struct video_decompress_info cpudxt_info = {
+        cpudxt_decompress_init,
+        cpudxt_decompress_reconfigure,
+        cpudxt_decompress,
+        cpudxt_decompress_get_property,
+        cpudxt_decompress_done,
+        cpudxt_decompress_get_decoders,
+};
+
+REGISTER_MODULE(cpudxt, &cpudxt_info, LIBRARY_CLASS_VIDEO_DECOMPRESS, VIDEO_DECOMPRESS_ABI_VERSION);
+
@@ -48,8 +48,10 @@
 #include "lib_common.h"
 #include "tv.h"
 #include "utils/resource_manager.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_decompress.h"
+#include "video_decompress/libavcodec_conv.h"
 
 #ifdef USE_HWACC
 #include <libavutil/hwcontext.h>
@@ -60,6 +62,9 @@
 #define DEFAULT_SURFACES 20
 #endif
 
+#include <libavutil/cpu.h>
+#include <libavutil/pixdesc.h>
+
 #ifdef __cplusplus
 #include <algorithm>
 using std::max;
@@ -73,17 +78,6 @@ using std::min;
 
 #define MOD_NAME "[lavd] "
 
-#ifdef __SSE3__
-#include "pmmintrin.h"
-// compat with older Clang compiler
-#ifndef _mm_bslli_si128
-#define _mm_bslli_si128 _mm_slli_si128
-#endif
-#ifndef _mm_bsrli_si128
-#define _mm_bsrli_si128 _mm_srli_si128
-#endif
-#endif
-
 #ifdef USE_HWACC
 struct hw_accel_state {
         enum {
@@ -121,13 +115,17 @@ struct state_libavcodec_decompress {
         unsigned int     broken_h264_mt_decoding_workaroud_warning_displayed;
         bool             broken_h264_mt_decoding_workaroud_active;
 
+        bool             convert_simd;    ///< use SIMD pixel format conversions where available
+        int              convert_threads; ///< number of stripes the conversion is split to
+        AVFrame        **convert_part;    ///< stripes of the decoded frame (only data pointers are set)
+
 #ifdef USE_HWACC
         struct hw_accel_state hwaccel;
 #endif
 };
 
-static int change_pixfmt(AVFrame *frame, unsigned char *dst, int av_codec,
-                codec_t out_codec, int width, int height, int pitch);
+static int change_pixfmt(struct state_libavcodec_decompress *s, AVFrame *frame, unsigned char *dst,
+                int av_codec, codec_t out_codec, int width, int height, int pitch);
 static void error_callback(void *, int, const char *, va_list);
 static enum AVPixelFormat get_format_callback(struct AVCodecContext *s, const enum AVPixelFormat *fmt);
 
@@ -375,6 +373,9 @@ static bool configure_with(struct state_libavcodec_decompress *s,
         return true;
 }
 
+ADD_TO_PARAM(lavd_convert, "lavd-convert", "* lavd-convert=[scalar][:threads=<n>]\n"
+                "  Pixel format conversion of decoded frames: scalar disables SIMD code, threads sets\n"
+                "  number of stripes converted in parallel (default: CPU count).\n");
 static void * libavcodec_decompress_init(void)
 {
         struct state_libavcodec_decompress *s;
@@ -404,6 +405,32 @@ static void * libavcodec_decompress_init(void)
         hwaccel_state_init(&s->hwaccel);
 #endif
 
+        s->convert_simd = av_get_cpu_flags() & AV_CPU_FLAG_SSE4;
+        s->convert_threads = av_cpu_count();
+        if (get_commandline_param("lavd-convert")) {
+                const char *param = get_commandline_param("lavd-convert");
+                char *val = alloca(strlen(param) + 1);
+                strcpy(val, param);
+                char *item, *save_ptr;
+                while ((item = strtok_r(val, ":", &save_ptr))) {
+                        val = NULL;
+                        if (strcmp(item, "scalar") == 0) {
+                                s->convert_simd = false;
+                        } else if (strncmp(item, "threads=", strlen("threads=")) == 0) {
+                                s->convert_threads = atoi(item + strlen("threads="));
+                        } else {
+                                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Unknown lavd-convert option: %s\n", item);
+                        }
+                }
+        }
+        s->convert_threads = max(s->convert_threads, 1);
+        s->convert_part = (AVFrame **) calloc(s->convert_threads, sizeof(AVFrame *));
+        for (int i = 0; i < s->convert_threads; ++i) {
+                s->convert_part[i] = av_frame_alloc();
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Using %s pixel format conversions in %d thread(s).\n",
+                        s->convert_simd ? "SIMD" : "scalar", s->convert_threads);
+
         return s;
 }
 
@@ -429,734 +456,6 @@ static int libavcodec_decompress_reconfigure(void *state, struct video_desc desc
         return configure_with(s, desc);
 }
 
-static void nv12_to_yuv422(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        for(int y = 0; y < (int) height; ++y) {
-                char *src_y = (char *) in_frame->data[0] + in_frame->linesize[0] * y;
-                char *src_cbcr = (char *) in_frame->data[1] + in_frame->linesize[1] * (y / 2);
-                char *dst = dst_buffer + pitch * y;
-                for(int x = 0; x < width / 2; ++x) {
-                        *dst++ = *src_cbcr++;
-                        *dst++ = *src_y++;
-                        *dst++ = *src_cbcr++;
-                        *dst++ = *src_y++;
-                }
-        }
-}
-
-static void rgb24_to_uyvy(char *dst_buffer, AVFrame *frame,
-                int width, int height, int pitch)
-{
-        for (int y = 0; y < height; ++y) {
-                vc_copylineRGBtoUYVY((unsigned char *) dst_buffer + y * pitch, frame->data[0] + y * frame->linesize[0], vc_get_linesize(width, UYVY));
-        }
-}
-
-static void rgb24_to_rgb(char *dst_buffer, AVFrame *frame,
-                int width, int height, int pitch)
-{
-        for (int y = 0; y < height; ++y) {
-                memcpy(dst_buffer + y * pitch, frame->data[0] + y * frame->linesize[0],
-                                vc_get_linesize(width, RGB));
-        }
-}
-
-static void yuv420p_to_yuv422(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        for(int y = 0; y < (int) height / 2; ++y) {
-                char *src_y1 = (char *) in_frame->data[0] + in_frame->linesize[0] * y * 2;
-                char *src_y2 = (char *) in_frame->data[0] + in_frame->linesize[0] * (y * 2 + 1);
-                char *src_cb = (char *) in_frame->data[1] + in_frame->linesize[1] * y;
-                char *src_cr = (char *) in_frame->data[2] + in_frame->linesize[2] * y;
-                char *dst1 = dst_buffer + (y * 2) * pitch;
-                char *dst2 = dst_buffer + (y * 2 + 1) * pitch;
-
-                int x = 0;
-
-#ifdef __SSE3__
-                __m128i y1;
-                __m128i y2;
-                __m128i u1;
-                __m128i u2;
-                __m128i v1;
-                __m128i v2;
-                __m128i out1l;
-                __m128i out1h;
-                __m128i out2l;
-                __m128i out2h;
-                __m128i zero = _mm_set1_epi32(0);
-
-                for (; x < width - 15; x += 16){
-                        y1 = _mm_lddqu_si128((__m128i const*) src_y1);
-                        y2 = _mm_lddqu_si128((__m128i const*) src_y2);
-                        src_y1 += 16;
-                        src_y2 += 16;
-
-                        out1l = _mm_unpacklo_epi8(zero, y1);
-                        out1h = _mm_unpackhi_epi8(zero, y1);
-                        out2l = _mm_unpacklo_epi8(zero, y2);
-                        out2h = _mm_unpackhi_epi8(zero, y2);
-
-                        u1 = _mm_lddqu_si128((__m128i const*) src_cb);
-                        v1 = _mm_lddqu_si128((__m128i const*) src_cr);
-                        src_cb += 8;
-                        src_cr += 8;
-
-                        u1 = _mm_unpacklo_epi8(u1, zero);
-                        v1 = _mm_unpacklo_epi8(v1, zero);
-                        u2 = _mm_unpackhi_epi8(u1, zero);
-                        v2 = _mm_unpackhi_epi8(v1, zero);
-                        u1 = _mm_unpacklo_epi8(u1, zero);
-                        v1 = _mm_unpacklo_epi8(v1, zero);
-
-                        v1 = _mm_bslli_si128(v1, 2);
-                        v2 = _mm_bslli_si128(v2, 2);
-
-                        u1 = _mm_or_si128(u1, v1);
-                        u2 = _mm_or_si128(u2, v2);
-
-                        out1l = _mm_or_si128(out1l, u1);
-                        out1h = _mm_or_si128(out1h, u2);
-                        out2l = _mm_or_si128(out2l, u1);
-                        out2h = _mm_or_si128(out2h, u2);
-
-                        _mm_storeu_si128((__m128i *) dst1, out1l);
-                        dst1 += 16;
-                        _mm_storeu_si128((__m128i *) dst1, out1h);
-                        dst1 += 16;
-                        _mm_storeu_si128((__m128i *) dst2, out2l);
-                        dst2 += 16;
-                        _mm_storeu_si128((__m128i *) dst2, out2h);
-                        dst2 += 16;
-                }
-#endif
-
-                for(; x < width - 1; x += 2) {
-                        *dst1++ = *src_cb;
-                        *dst1++ = *src_y1++;
-                        *dst1++ = *src_cr;
-                        *dst1++ = *src_y1++;
-
-                        *dst2++ = *src_cb++;
-                        *dst2++ = *src_y2++;
-                        *dst2++ = *src_cr++;
-                        *dst2++ = *src_y2++;
-                }
-        }
-}
-
-static void yuv420p_to_v210(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        for(int y = 0; y < (int) height / 2; ++y) {
-                uint8_t *src_y1 = (in_frame->data[0] + in_frame->linesize[0] * y * 2);
-                uint8_t *src_y2 = (in_frame->data[0] + in_frame->linesize[0] * (y * 2 + 1));
-                uint8_t *src_cb = (in_frame->data[1] + in_frame->linesize[1] * y);
-                uint8_t *src_cr = (in_frame->data[2] + in_frame->linesize[2] * y);
-                uint32_t *dst1 = (uint32_t *)(void *)(dst_buffer + (y * 2) * pitch);
-                uint32_t *dst2 = (uint32_t *)(void *)(dst_buffer + (y * 2 + 1) * pitch);
-
-                for(int x = 0; x < width / 6; ++x) {
-                        uint32_t w0_0, w0_1, w0_2, w0_3;
-                        uint32_t w1_0, w1_1, w1_2, w1_3;
-
-                        w0_0 = *src_cb << 2;
-                        w1_0 = *src_cb << 2;
-                        src_cb++;
-                        w0_0 = w0_0 | (*src_y1++ << 2) << 10;
-                        w1_0 = w1_0 | (*src_y2++ << 2) << 10;
-                        w0_0 = w0_0 | (*src_cr << 2) << 20;
-                        w1_0 = w1_0 | (*src_cr << 2) << 20;
-                        src_cr++;
-
-                        w0_1 = *src_y1++ << 2;
-                        w1_1 = *src_y2++ << 2;
-                        w0_1 = w0_1 | (*src_cb << 2) << 10;
-                        w1_1 = w1_1 | (*src_cb << 2) << 10;
-                        src_cb++;
-                        w0_1 = w0_1 | (*src_y1++ << 2) << 20;
-                        w1_1 = w1_1 | (*src_y2++ << 2) << 20;
-
-                        w0_2 = *src_cr << 2;
-                        w1_2 = *src_cr << 2;
-                        src_cr++;
-                        w0_2 = w0_2 | (*src_y1++ << 2) << 10;
-                        w1_2 = w1_2 | (*src_y2++ << 2) << 10;
-                        w0_2 = w0_2 | (*src_cb << 2) << 20;
-                        w1_2 = w1_2 | (*src_cb << 2) << 20;
-                        src_cb++;
-
-                        w0_3 = *src_y1++;
-                        w1_3 = *src_y2++;
-                        w0_3 = w0_3 | (*src_cr << 2) << 10;
-                        w1_3 = w1_3 | (*src_cr << 2) << 10;
-                        src_cr++;
-                        w0_3 = w0_3 | (*src_y1++ << 2) << 20;
-                        w1_3 = w1_3 | (*src_y2++ << 2) << 20;
-
-                        *dst1++ = w0_0;
-                        *dst1++ = w0_1;
-                        *dst1++ = w0_2;
-                        *dst1++ = w0_3;
-
-                        *dst2++ = w1_0;
-                        *dst2++ = w1_1;
-                        *dst2++ = w1_2;
-                        *dst2++ = w1_3;
-                }
-        }
-}
-
-static void yuv422p_to_yuv422(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        for(int y = 0; y < (int) height; ++y) {
-                char *src_y = (char *) in_frame->data[0] + in_frame->linesize[0] * y;
-                char *src_cb = (char *) in_frame->data[1] + in_frame->linesize[1] * y;
-                char *src_cr = (char *) in_frame->data[2] + in_frame->linesize[2] * y;
-                char *dst = dst_buffer + pitch * y;
-                for(int x = 0; x < width / 2; ++x) {
-                        *dst++ = *src_cb++;
-                        *dst++ = *src_y++;
-                        *dst++ = *src_cr++;
-                        *dst++ = *src_y++;
-                }
-        }
-}
-
-static void yuv422p_to_v210(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        for(int y = 0; y < (int) height; ++y) {
-                uint8_t *src_y = (in_frame->data[0] + in_frame->linesize[0] * y);
-                uint8_t *src_cb = (in_frame->data[1] + in_frame->linesize[1] * y);
-                uint8_t *src_cr = (in_frame->data[2] + in_frame->linesize[2] * y);
-                uint32_t *dst = (uint32_t *)(void *)(dst_buffer + y * pitch);
-
-                for(int x = 0; x < width / 6; ++x) {
-                        uint32_t w0_0, w0_1, w0_2, w0_3;
-
-                        w0_0 = *src_cb++ << 2;
-                        w0_0 = w0_0 | (*src_y++ << 2) << 10;
-                        w0_0 = w0_0 | (*src_cr++ << 2) << 20;
-
-                        w0_1 = *src_y++ << 2;
-                        w0_1 = w0_1 | (*src_cb++ << 2) << 10;
-                        w0_1 = w0_1 | (*src_y++ << 2) << 20;
-
-                        w0_2 = *src_cr++ << 2;
-                        w0_2 = w0_2 | (*src_y++ << 2) << 10;
-                        w0_2 = w0_2 | (*src_cb++ << 2) << 20;
-
-                        w0_3 = *src_y++ << 2;
-                        w0_3 = w0_3 | (*src_cr++ << 2) << 10;
-                        w0_3 = w0_3 | (*src_y++ << 2) << 20;
-
-                        *dst++ = w0_0;
-                        *dst++ = w0_1;
-                        *dst++ = w0_2;
-                        *dst++ = w0_3;
-                }
-        }
-}
-
-
-static void yuv444p_to_yuv422(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        for(int y = 0; y < (int) height; ++y) {
-                char *src_y = (char *) in_frame->data[0] + in_frame->linesize[0] * y;
-                unsigned char *src_cb = (unsigned char *) in_frame->data[1] + in_frame->linesize[1] * y;
-                unsigned char *src_cr = (unsigned char *) in_frame->data[2] + in_frame->linesize[2] * y;
-                char *dst = dst_buffer + pitch * y;
-                for(int x = 0; x < width / 2; ++x) {
-                        *dst++ = (*src_cb + *(src_cb + 1)) / 2;
-                        src_cb += 2;
-                        *dst++ = *src_y++;
-                        *dst++ = (*src_cr + *(src_cr + 1)) / 2;
-                        src_cr += 2;
-                        *dst++ = *src_y++;
-                }
-        }
-}
-
-static void yuv444p_to_v210(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        for(int y = 0; y < (int) height; ++y) {
-                uint8_t *src_y = (in_frame->data[0] + in_frame->linesize[0] * y);
-                uint8_t *src_cb = (in_frame->data[1] + in_frame->linesize[1] * y);
-                uint8_t *src_cr = (in_frame->data[2] + in_frame->linesize[2] * y);
-                uint32_t *dst = (uint32_t *)(void *)(dst_buffer + y * pitch);
-
-                for(int x = 0; x < width / 6; ++x) {
-                        uint32_t w0_0, w0_1, w0_2, w0_3;
-
-                        w0_0 = ((src_cb[0] << 2) + (src_cb[1] << 2)) / 2;
-                        w0_0 = w0_0 | (*src_y++ << 2) << 10;
-                        w0_0 = w0_0 | ((src_cr[0] << 2) + (src_cr[1] << 2)) / 2 << 20;
-                        src_cb += 2;
-                        src_cr += 2;
-
-                        w0_1 = *src_y++ << 2;
-                        w0_1 = w0_1 | ((src_cb[0] << 2) + (src_cb[1] << 2)) / 2 << 10;
-                        w0_1 = w0_1 | (*src_y++ << 2) << 20;
-                        src_cb += 2;
-
-                        w0_2 = ((src_cr[0] << 2) + (src_cr[1] << 2)) / 2;
-                        w0_2 = w0_2 | (*src_y++ << 2) << 10;
-                        w0_2 = w0_2 | ((src_cb[0] << 2) + (src_cb[1] << 2)) / 2 << 20;
-                        src_cr += 2;
-                        src_cb += 2;
-
-                        w0_3 = *src_y++ << 2;
-                        w0_3 = w0_3 | ((src_cr[0] << 2) + (src_cr[1] << 2)) / 2 << 10;
-                        w0_3 = w0_3 | (*src_y++ << 2) << 20;
-                        src_cr += 2;
-
-                        *dst++ = w0_0;
-                        *dst++ = w0_1;
-                        *dst++ = w0_2;
-                        *dst++ = w0_3;
-                }
-        }
-}
-
-
-/**
- * Changes pixel format from planar YUV 422 to packed RGB.
- * Color space is assumed ITU-T Rec. 609. YUV is expected to be full scale (aka in JPEG).
- */
-static void nv12_to_rgb24(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        for(int y = 0; y < (int) height; ++y) {
-                unsigned char *src_y = (unsigned char *) in_frame->data[0] + in_frame->linesize[0] * y;
-                unsigned char *src_cbcr = (unsigned char *) in_frame->data[1] + in_frame->linesize[1] * (y / 2);
-                unsigned char *dst = (unsigned char *) dst_buffer + pitch * y;
-                for(int x = 0; x < width / 2; ++x) {
-                        int cb = *src_cbcr++ - 128;
-                        int cr = *src_cbcr++ - 128;
-                        int y = *src_y++ << 16;
-                        int r = 75700 * cr;
-                        int g = -26864 * cb - 38050 * cr;
-                        int b = 133176 * cb;
-                        *dst++ = min(max(r + y, 0), (1<<24) - 1) >> 16;
-                        *dst++ = min(max(g + y, 0), (1<<24) - 1) >> 16;
-                        *dst++ = min(max(b + y, 0), (1<<24) - 1) >> 16;
-                        y = *src_y++ << 16;
-                        *dst++ = min(max(r + y, 0), (1<<24) - 1) >> 16;
-                        *dst++ = min(max(g + y, 0), (1<<24) - 1) >> 16;
-                        *dst++ = min(max(b + y, 0), (1<<24) - 1) >> 16;
-                }
-        }
-}
-
-/**
- * Changes pixel format from planar YUV 422 to packed RGB.
- * Color space is assumed ITU-T Rec. 609. YUV is expected to be full scale (aka in JPEG).
- */
-static void yuv422p_to_rgb24(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        for(int y = 0; y < (int) height; ++y) {
-                unsigned char *src_y = (unsigned char *) in_frame->data[0] + in_frame->linesize[0] * y;
-                unsigned char *src_cb = (unsigned char *) in_frame->data[1] + in_frame->linesize[1] * y;
-                unsigned char *src_cr = (unsigned char *) in_frame->data[2] + in_frame->linesize[2] * y;
-                unsigned char *dst = (unsigned char *) dst_buffer + pitch * y;
-                for(int x = 0; x < width / 2; ++x) {
-                        int cb = *src_cb++ - 128;
-                        int cr = *src_cr++ - 128;
-                        int y = *src_y++ << 16;
-                        int r = 75700 * cr;
-                        int g = -26864 * cb - 38050 * cr;
-                        int b = 133176 * cb;
-                        *dst++ = min(max(r + y, 0), (1<<24) - 1) >> 16;
-                        *dst++ = min(max(g + y, 0), (1<<24) - 1) >> 16;
-                        *dst++ = min(max(b + y, 0), (1<<24) - 1) >> 16;
-                        y = *src_y++ << 16;
-                        *dst++ = min(max(r + y, 0), (1<<24) - 1) >> 16;
-                        *dst++ = min(max(g + y, 0), (1<<24) - 1) >> 16;
-                        *dst++ = min(max(b + y, 0), (1<<24) - 1) >> 16;
-                }
-        }
-}
-
-/**
- * Changes pixel format from planar YUV 422 to packed RGB.
- * Color space is assumed ITU-T Rec. 609. YUV is expected to be full scale (aka in JPEG).
- */
-static void yuv420p_to_rgb24(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        for(int y = 0; y < (int) height / 2; ++y) {
-                unsigned char *src_y1 = (unsigned char *) in_frame->data[0] + in_frame->linesize[0] * y * 2;
-                unsigned char *src_y2 = (unsigned char *) in_frame->data[0] + in_frame->linesize[0] * (y * 2 + 1);
-                unsigned char *src_cb = (unsigned char *) in_frame->data[1] + in_frame->linesize[1] * y;
-                unsigned char *src_cr = (unsigned char *) in_frame->data[2] + in_frame->linesize[2] * y;
-                unsigned char *dst1 = (unsigned char *) dst_buffer + pitch * (y * 2);
-                unsigned char *dst2 = (unsigned char *) dst_buffer + pitch * (y * 2 + 1);
-                for(int x = 0; x < width / 2; ++x) {
-                        int cb = *src_cb++ - 128;
-                        int cr = *src_cr++ - 128;
-                        int y = *src_y1++ << 16;
-                        int r = 75700 * cr;
-                        int g = -26864 * cb - 38050 * cr;
-                        int b = 133176 * cb;
-                        *dst1++ = min(max(r + y, 0), (1<<24) - 1) >> 16;
-                        *dst1++ = min(max(g + y, 0), (1<<24) - 1) >> 16;
-                        *dst1++ = min(max(b + y, 0), (1<<24) - 1) >> 16;
-                        y = *src_y1++ << 16;
-                        *dst1++ = min(max(r + y, 0), (1<<24) - 1) >> 16;
-                        *dst1++ = min(max(g + y, 0), (1<<24) - 1) >> 16;
-                        *dst1++ = min(max(b + y, 0), (1<<24) - 1) >> 16;
-                        y = *src_y2++ << 16;
-                        *dst2++ = min(max(r + y, 0), (1<<24) - 1) >> 16;
-                        *dst2++ = min(max(g + y, 0), (1<<24) - 1) >> 16;
-                        *dst2++ = min(max(b + y, 0), (1<<24) - 1) >> 16;
-                        y = *src_y2++ << 16;
-                        *dst2++ = min(max(r + y, 0), (1<<24) - 1) >> 16;
-                        *dst2++ = min(max(g + y, 0), (1<<24) - 1) >> 16;
-                        *dst2++ = min(max(b + y, 0), (1<<24) - 1) >> 16;
-                }
-        }
-}
-
-/**
- * Changes pixel format from planar YUV 444 to packed RGB.
- * Color space is assumed ITU-T Rec. 609. YUV is expected to be full scale (aka in JPEG).
- */
-static void yuv444p_to_rgb24(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        for(int y = 0; y < (int) height; ++y) {
-                unsigned char *src_y = (unsigned char *) in_frame->data[0] + in_frame->linesize[0] * y;
-                unsigned char *src_cb = (unsigned char *) in_frame->data[1] + in_frame->linesize[1] * y;
-                unsigned char *src_cr = (unsigned char *) in_frame->data[2] + in_frame->linesize[2] * y;
-                unsigned char *dst = (unsigned char *) dst_buffer + pitch * y;
-                for(int x = 0; x < width; ++x) {
-                        int cb = *src_cb++ - 128;
-                        int cr = *src_cr++ - 128;
-                        int y = *src_y++ << 16;
-                        int r = 75700 * cr;
-                        int g = -26864 * cb - 38050 * cr;
-                        int b = 133176 * cb;
-                        *dst++ = min(max(r + y, 0), (1<<24) - 1) >> 16;
-                        *dst++ = min(max(g + y, 0), (1<<24) - 1) >> 16;
-                        *dst++ = min(max(b + y, 0), (1<<24) - 1) >> 16;
-                }
-        }
-}
-
-static void yuv420p10le_to_v210(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        for(int y = 0; y < (int) height / 2; ++y) {
-                uint16_t *src_y1 = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * y * 2);
-                uint16_t *src_y2 = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * (y * 2 + 1));
-                uint16_t *src_cb = (uint16_t *)(void *)(in_frame->data[1] + in_frame->linesize[1] * y);
-                uint16_t *src_cr = (uint16_t *)(void *)(in_frame->data[2] + in_frame->linesize[2] * y);
-                uint32_t *dst1 = (uint32_t *)(void *)(dst_buffer + (y * 2) * pitch);
-                uint32_t *dst2 = (uint32_t *)(void *)(dst_buffer + (y * 2 + 1) * pitch);
-
-                for(int x = 0; x < width / 6; ++x) {
-                        uint32_t w0_0, w0_1, w0_2, w0_3;
-                        uint32_t w1_0, w1_1, w1_2, w1_3;
-
-                        w0_0 = *src_cb;
-                        w1_0 = *src_cb;
-                        src_cb++;
-                        w0_0 = w0_0 | (*src_y1++) << 10;
-                        w1_0 = w1_0 | (*src_y2++) << 10;
-                        w0_0 = w0_0 | (*src_cr) << 20;
-                        w1_0 = w1_0 | (*src_cr) << 20;
-                        src_cr++;
-
-                        w0_1 = *src_y1++;
-                        w1_1 = *src_y2++;
-                        w0_1 = w0_1 | (*src_cb) << 10;
-                        w1_1 = w1_1 | (*src_cb) << 10;
-                        src_cb++;
-                        w0_1 = w0_1 | (*src_y1++) << 20;
-                        w1_1 = w1_1 | (*src_y2++) << 20;
-
-                        w0_2 = *src_cr;
-                        w1_2 = *src_cr;
-                        src_cr++;
-                        w0_2 = w0_2 | (*src_y1++) << 10;
-                        w1_2 = w1_2 | (*src_y2++) << 10;
-                        w0_2 = w0_2 | (*src_cb) << 20;
-                        w1_2 = w1_2 | (*src_cb) << 20;
-                        src_cb++;
-
-                        w0_3 = *src_y1++;
-                        w1_3 = *src_y2++;
-                        w0_3 = w0_3 | (*src_cr) << 10;
-                        w1_3 = w1_3 | (*src_cr) << 10;
-                        src_cr++;
-                        w0_3 = w0_3 | (*src_y1++) << 20;
-                        w1_3 = w1_3 | (*src_y2++) << 20;
-
-                        *dst1++ = w0_0;
-                        *dst1++ = w0_1;
-                        *dst1++ = w0_2;
-                        *dst1++ = w0_3;
-
-                        *dst2++ = w1_0;
-                        *dst2++ = w1_1;
-                        *dst2++ = w1_2;
-                        *dst2++ = w1_3;
-                }
-        }
-}
-
-static void yuv422p10le_to_v210(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        for(int y = 0; y < (int) height; ++y) {
-                uint16_t *src_y = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * y);
-                uint16_t *src_cb = (uint16_t *)(void *)(in_frame->data[1] + in_frame->linesize[1] * y);
-                uint16_t *src_cr = (uint16_t *)(void *)(in_frame->data[2] + in_frame->linesize[2] * y);
-                uint32_t *dst = (uint32_t *)(void *)(dst_buffer + y * pitch);
-
-                for(int x = 0; x < width / 6; ++x) {
-                        uint32_t w0_0, w0_1, w0_2, w0_3;
-
-                        w0_0 = *src_cb++;
-                        w0_0 = w0_0 | (*src_y++) << 10;
-                        w0_0 = w0_0 | (*src_cr++) << 20;
-
-                        w0_1 = *src_y++;
-                        w0_1 = w0_1 | (*src_cb++) << 10;
-                        w0_1 = w0_1 | (*src_y++) << 20;
-
-                        w0_2 = *src_cr++;
-                        w0_2 = w0_2 | (*src_y++) << 10;
-                        w0_2 = w0_2 | (*src_cb++) << 20;
-
-                        w0_3 = *src_y++;
-                        w0_3 = w0_3 | (*src_cr++) << 10;
-                        w0_3 = w0_3 | (*src_y++) << 20;
-
-                        *dst++ = w0_0;
-                        *dst++ = w0_1;
-                        *dst++ = w0_2;
-                        *dst++ = w0_3;
-                }
-        }
-}
-
-static void yuv444p10le_to_v210(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        for(int y = 0; y < (int) height; ++y) {
-                uint16_t *src_y = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * y);
-                uint16_t *src_cb = (uint16_t *)(void *)(in_frame->data[1] + in_frame->linesize[1] * y);
-                uint16_t *src_cr = (uint16_t *)(void *)(in_frame->data[2] + in_frame->linesize[2] * y);
-                uint32_t *dst = (uint32_t *)(void *)(dst_buffer + y * pitch);
-
-                for(int x = 0; x < width / 6; ++x) {
-                        uint32_t w0_0, w0_1, w0_2, w0_3;
-
-                        w0_0 = (src_cb[0] + src_cb[1]) / 2;
-                        w0_0 = w0_0 | (*src_y++) << 10;
-                        w0_0 = w0_0 | (src_cr[0] + src_cr[1]) / 2 << 20;
-                        src_cb += 2;
-                        src_cr += 2;
-
-                        w0_1 = *src_y++;
-                        w0_1 = w0_1 | (src_cb[0] + src_cb[1]) / 2 << 10;
-                        w0_1 = w0_1 | (*src_y++) << 20;
-                        src_cb += 2;
-
-                        w0_2 = (src_cr[0] + src_cr[1]) / 2;
-                        w0_2 = w0_2 | (*src_y++) << 10;
-                        w0_2 = w0_2 | (src_cb[0] + src_cb[1]) / 2 << 20;
-                        src_cr += 2;
-                        src_cb += 2;
-
-                        w0_3 = *src_y++;
-                        w0_3 = w0_3 | (src_cr[0] + src_cr[1]) / 2 << 10;
-                        w0_3 = w0_3 | (*src_y++) << 20;
-                        src_cr += 2;
-
-                        *dst++ = w0_0;
-                        *dst++ = w0_1;
-                        *dst++ = w0_2;
-                        *dst++ = w0_3;
-                }
-        }
-}
-
-static void yuv420p10le_to_uyvy(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        for(int y = 0; y < (int) height / 2; ++y) {
-                uint16_t *src_y1 = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * y * 2);
-                uint16_t *src_y2 = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * (y * 2 + 1));
-                uint16_t *src_cb = (uint16_t *)(void *)(in_frame->data[1] + in_frame->linesize[1] * y);
-                uint16_t *src_cr = (uint16_t *)(void *)(in_frame->data[2] + in_frame->linesize[2] * y);
-                uint8_t *dst1 = (uint8_t *)(void *)(dst_buffer + (y * 2) * pitch);
-                uint8_t *dst2 = (uint8_t *)(void *)(dst_buffer + (y * 2 + 1) * pitch);
-
-                for(int x = 0; x < width / 2; ++x) {
-                        uint8_t tmp;
-                        // U
-                        tmp = *src_cb++ >> 2;
-                        *dst1++ = tmp;
-                        *dst2++ = tmp;
-                        // Y
-                        *dst1++ = *src_y1++ >> 2;
-                        *dst2++ = *src_y2++ >> 2;
-                        // V
-                        tmp = *src_cr++ >> 2;
-                        *dst1++ = tmp;
-                        *dst2++ = tmp;
-                        // Y
-                        *dst1++ = *src_y1++ >> 2;
-                        *dst2++ = *src_y2++ >> 2;
-                }
-        }
-}
-
-static void yuv422p10le_to_uyvy(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        for(int y = 0; y < (int) height; ++y) {
-                uint16_t *src_y = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * y);
-                uint16_t *src_cb = (uint16_t *)(void *)(in_frame->data[1] + in_frame->linesize[1] * y);
-                uint16_t *src_cr = (uint16_t *)(void *)(in_frame->data[2] + in_frame->linesize[2] * y);
-                uint8_t *dst = (uint8_t *)(void *)(dst_buffer + y * pitch);
-
-                for(int x = 0; x < width / 2; ++x) {
-                        *dst++ = *src_cb++ >> 2;
-                        *dst++ = *src_y++ >> 2;
-                        *dst++ = *src_cr++ >> 2;
-                        *dst++ = *src_y++ >> 2;
-                }
-        }
-}
-
-static void yuv444p10le_to_uyvy(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        for(int y = 0; y < (int) height; ++y) {
-                uint16_t *src_y = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * y);
-                uint16_t *src_cb = (uint16_t *)(void *)(in_frame->data[1] + in_frame->linesize[1] * y);
-                uint16_t *src_cr = (uint16_t *)(void *)(in_frame->data[2] + in_frame->linesize[2] * y);
-                uint8_t *dst = (uint8_t *)(void *)(dst_buffer + y * pitch);
-
-                for(int x = 0; x < width / 2; ++x) {
-                        *dst++ = (src_cb[0] + src_cb[0]) / 2 >> 2;
-                        *dst++ = *src_y++ >> 2;
-                        *dst++ = (src_cr[0] + src_cr[1]) / 2 >> 2;
-                        *dst++ = *src_y++ >> 2;
-                        src_cb += 2;
-                        src_cr += 2;
-                }
-        }
-}
-
-static void yuv420p10le_to_rgb24(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        char *tmp = malloc(vc_get_linesize(UYVY, width) * height);
-        char *uyvy = tmp;
-        yuv420p10le_to_uyvy(uyvy, in_frame, width, height, vc_get_linesize(UYVY, width));
-        for (int i = 0; i < height; i++) {
-                vc_copylineUYVYtoRGB((unsigned char *) dst_buffer, (unsigned char *) uyvy, vc_get_linesize(RGB, width));
-                uyvy += vc_get_linesize(UYVY, width);
-                dst_buffer += pitch;
-        }
-        free(tmp);
-}
-
-static void yuv422p10le_to_rgb24(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        char *tmp = malloc(vc_get_linesize(UYVY, width) * height);
-        char *uyvy = tmp;
-        yuv422p10le_to_uyvy(uyvy, in_frame, width, height, vc_get_linesize(UYVY, width));
-        for (int i = 0; i < height; i++) {
-                vc_copylineUYVYtoRGB((unsigned char *) dst_buffer, (unsigned char *) uyvy, vc_get_linesize(RGB, width));
-                uyvy += vc_get_linesize(UYVY, width);
-                dst_buffer += pitch;
-        }
-        free(tmp);
-}
-
-static void yuv444p10le_to_rgb24(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        char *tmp = malloc(vc_get_linesize(UYVY, width) * height);
-        char *uyvy = tmp;
-        yuv444p10le_to_uyvy(uyvy, in_frame, width, height, vc_get_linesize(UYVY, width));
-        for (int i = 0; i < height; i++) {
-                vc_copylineUYVYtoRGB((unsigned char *) dst_buffer, (unsigned char *) uyvy, vc_get_linesize(RGB, width));
-                uyvy += vc_get_linesize(UYVY, width);
-                dst_buffer += pitch;
-        }
-        free(tmp);
-}
-
-static void not_implemented_conv(char *dst_buffer, AVFrame *in_frame,
-                int width, int height, int pitch)
-{
-        UNUSED(dst_buffer);
-        UNUSED(in_frame);
-        UNUSED(width);
-        UNUSED(height);
-        UNUSED(pitch);
-        log_msg(LOG_LEVEL_ERROR, "Selected conversion is not implemented!\n");
-}
-
-
-static const struct {
-        int av_codec;
-        codec_t uv_codec;
-        void (*convert)(char *dst_buffer, AVFrame *in_frame, int width, int height, int pitch);
-} convert_funcs[] = {
-        // 10-bit YUV
-        {AV_PIX_FMT_YUV420P10LE, v210, yuv420p10le_to_v210},
-        {AV_PIX_FMT_YUV420P10LE, UYVY, yuv420p10le_to_uyvy},
-        {AV_PIX_FMT_YUV420P10LE, RGB, yuv420p10le_to_rgb24},
-        {AV_PIX_FMT_YUV422P10LE, v210, yuv422p10le_to_v210},
-        {AV_PIX_FMT_YUV422P10LE, UYVY, yuv422p10le_to_uyvy},
-        {AV_PIX_FMT_YUV422P10LE, RGB, yuv422p10le_to_rgb24},
-        {AV_PIX_FMT_YUV444P10LE, v210, yuv444p10le_to_v210},
-        {AV_PIX_FMT_YUV444P10LE, UYVY, yuv444p10le_to_uyvy},
-        {AV_PIX_FMT_YUV444P10LE, RGB, yuv444p10le_to_rgb24},
-        // 8-bit YUV
-        {AV_PIX_FMT_YUV420P, v210, yuv420p_to_v210},
-        {AV_PIX_FMT_YUV420P, UYVY, yuv420p_to_yuv422},
-        {AV_PIX_FMT_YUV420P, RGB, yuv420p_to_rgb24},
-        {AV_PIX_FMT_YUV422P, v210, yuv422p_to_v210},
-        {AV_PIX_FMT_YUV422P, UYVY, yuv422p_to_yuv422},
-        {AV_PIX_FMT_YUV422P, RGB, yuv422p_to_rgb24},
-        {AV_PIX_FMT_YUV444P, v210, yuv444p_to_v210},
-        {AV_PIX_FMT_YUV444P, UYVY, yuv444p_to_yuv422},
-        {AV_PIX_FMT_YUV444P, RGB, yuv444p_to_rgb24},
-        // 8-bit YUV (JPEG color range)
-        {AV_PIX_FMT_YUVJ420P, v210, yuv420p_to_v210},
-        {AV_PIX_FMT_YUVJ420P, UYVY, yuv420p_to_yuv422},
-        {AV_PIX_FMT_YUVJ420P, RGB, yuv420p_to_rgb24},
-        {AV_PIX_FMT_YUVJ422P, v210, yuv422p_to_v210},
-        {AV_PIX_FMT_YUVJ422P, UYVY, yuv422p_to_yuv422},
-        {AV_PIX_FMT_YUVJ422P, RGB, yuv422p_to_rgb24},
-        {AV_PIX_FMT_YUVJ444P, v210, yuv444p_to_v210},
-        {AV_PIX_FMT_YUVJ444P, UYVY, yuv444p_to_yuv422},
-        {AV_PIX_FMT_YUVJ444P, RGB, yuv444p_to_rgb24},
-        // 8-bit YUV (NV12)
-        {AV_PIX_FMT_NV12, v210, not_implemented_conv},
-        {AV_PIX_FMT_NV12, UYVY, nv12_to_yuv422},
-        {AV_PIX_FMT_NV12, RGB, nv12_to_rgb24},
-        // RGB
-        {AV_PIX_FMT_RGB24, v210, not_implemented_conv},
-        {AV_PIX_FMT_RGB24, UYVY, rgb24_to_uyvy},
-        {AV_PIX_FMT_RGB24, RGB, rgb24_to_rgb},
-};
 
 #ifdef USE_HWACC
 static int create_hw_device_ctx(enum AVHWDeviceType type, AVBufferRef **device_ref){
@@ -1533,6 +832,67 @@ static enum AVPixelFormat get_format_callback(struct AVCodecContext *s __attribu
 }
 
 
+struct convert_task_data {
+        av_to_uv_convert_t *convert;
+        char *dst_buffer;
+        AVFrame *in_frame;
+        int width;
+        int height;
+        int pitch;
+};
+
+static void *convert_task(void *arg) {
+        struct convert_task_data *data = (struct convert_task_data *) arg;
+        data->convert(data->dst_buffer, data->in_frame, data->width, data->height, data->pitch);
+        return NULL;
+}
+
+/**
+ * Runs the conversion in horizontal stripes in parallel. Stripe height is
+ * kept even so that the 4:2:0 conversions (processing line pairs) see the
+ * same data as if the whole frame was converted at once. The calling thread
+ * converts stripes as well.
+ *
+ * @param parts  preallocated frames used as stripe views of frame, at least threads items
+ */
+static void convert_parallel(av_to_uv_convert_t *convert,
+                char *dst_buffer, AVFrame *frame, int width, int height, int pitch,
+                AVFrame **parts, int threads)
+{
+        int stripe_height = height / threads / 2 * 2;
+        if (threads <= 1 || stripe_height == 0) {
+                convert(dst_buffer, frame, width, height, pitch);
+                return;
+        }
+
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+        int chroma_shift = desc ? desc->log2_chroma_h : 0;
+        struct convert_task_data data[threads];
+
+        for (int i = 0; i < threads; ++i) {
+                int first_line = i * stripe_height;
+                for (int p = 0; p < AV_NUM_DATA_POINTERS; ++p) {
+                        if (frame->data[p] == NULL) {
+                                parts[i]->data[p] = NULL;
+                                continue;
+                        }
+                        int plane_line = p == 1 || p == 2 ? first_line >> chroma_shift : first_line;
+                        parts[i]->data[p] = frame->data[p] + frame->linesize[p] * plane_line;
+                        parts[i]->linesize[p] = frame->linesize[p];
+                }
+                parts[i]->format = frame->format;
+
+                data[i].convert = convert;
+                data[i].dst_buffer = dst_buffer + first_line * pitch;
+                data[i].in_frame = parts[i];
+                data[i].width = width;
+                data[i].height = i < threads - 1 ? stripe_height : height - first_line;
+                data[i].pitch = pitch;
+        }
+
+        task_run_parallel(convert_task, threads, data, sizeof data[0], NULL);
+}
+
 /**
  * Changes pixel format from frame to native (currently UYVY).
  *
@@ -1549,20 +909,15 @@ static enum AVPixelFormat get_format_callback(struct AVCodecContext *s __attribu
  * @see    yuvj422p_to_yuv422
  * @see    yuv420p_to_yuv422
  */
-static int change_pixfmt(AVFrame *frame, unsigned char *dst, int av_codec,
-                codec_t out_codec, int width, int height, int pitch) {
+static int change_pixfmt(struct state_libavcodec_decompress *s, AVFrame *frame, unsigned char *dst,
+                int av_codec, codec_t out_codec, int width, int height, int pitch) {
         assert(out_codec == UYVY || out_codec == RGB || out_codec == v210);
 
-        void (*convert)(char *dst_buffer, AVFrame *in_frame, int width, int height, int pitch) = NULL;
-        for (unsigned int i = 0; i < sizeof convert_funcs / sizeof convert_funcs[0]; ++i) {
-                if (convert_funcs[i].av_codec == av_codec &&
-                                convert_funcs[i].uv_codec == out_codec) {
-                        convert = convert_funcs[i].convert;
-                }
-        }
+        av_to_uv_convert_t *convert = get_av_to_uv_conversion(av_codec, out_codec, s->convert_simd);
 
         if (convert) {
-                convert((char *) dst, frame, width, height, pitch);
+                convert_parallel(convert, (char *) dst, frame, width, height, pitch,
+                                s->convert_part, s->convert_threads);
         } else {
                 log_msg(LOG_LEVEL_ERROR, "Unsupported pixel "
                                 "format: %s (id %d)\n",
@@ -1663,7 +1018,7 @@ static int libavcodec_decompress(void *state, unsigned char *dst, unsigned char
                                         transfer_frame(&s->hwaccel, s->frame);
                                 }
 #endif
-                                res = change_pixfmt(s->frame, dst, s->frame->format,
+                                res = change_pixfmt(s, s->frame, dst, s->frame->format,
                                                 s->out_codec, s->width, s->height, s->pitch);
                                 if(res == TRUE) {
                                         s->last_frame_seq_initialized = true;
@@ -1728,6 +1083,11 @@ static void libavcodec_decompress_done(void *state)
 
         deconfigure(s);
 
+        for (int i = 0; i < s->convert_threads; ++i) {
+                av_frame_free(&s->convert_part[i]);
+        }
+        free(s->convert_part);
+
         rm_release_shared_lock(LAVCD_LOCK_NAME);
 
         free(s);
@@ -0,0 +1,1107 @@
+/**
+ * @file   video_decompress/libavcodec_conv.c
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ */
+/*
+ * Copyright (c) 2013-2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include "libavcodec_common.h"
+#include "video.h"
+#include "video_decompress/libavcodec_conv.h"
+
+#ifdef __SSE3__
+#include "pmmintrin.h"
+// compat with older Clang compiler
+#ifndef _mm_bslli_si128
+#define _mm_bslli_si128 _mm_slli_si128
+#endif
+#ifndef _mm_bsrli_si128
+#define _mm_bsrli_si128 _mm_srli_si128
+#endif
+#endif
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+
+#undef max
+#undef min
+#define max(a, b)      (((a) > (b))? (a): (b))
+#define min(a, b)      (((a) < (b))? (a): (b))
+
+static void nv12_to_yuv422(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        for(int y = 0; y < (int) height; ++y) {
+                char *src_y = (char *) in_frame->data[0] + in_frame->linesize[0] * y;
+                char *src_cbcr = (char *) in_frame->data[1] + in_frame->linesize[1] * (y / 2);
+                char *dst = dst_buffer + pitch * y;
+                for(int x = 0; x < width / 2; ++x) {
+                        *dst++ = *src_cbcr++;
+                        *dst++ = *src_y++;
+                        *dst++ = *src_cbcr++;
+                        *dst++ = *src_y++;
+                }
+        }
+}
+
+static void rgb24_to_uyvy(char *dst_buffer, AVFrame *frame,
+                int width, int height, int pitch)
+{
+        for (int y = 0; y < height; ++y) {
+                vc_copylineRGBtoUYVY((unsigned char *) dst_buffer + y * pitch, frame->data[0] + y * frame->linesize[0], vc_get_linesize(width, UYVY));
+        }
+}
+
+static void rgb24_to_rgb(char *dst_buffer, AVFrame *frame,
+                int width, int height, int pitch)
+{
+        for (int y = 0; y < height; ++y) {
+                memcpy(dst_buffer + y * pitch, frame->data[0] + y * frame->linesize[0],
+                                vc_get_linesize(width, RGB));
+        }
+}
+
+static void yuv420p_to_yuv422(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        for(int y = 0; y < (int) height / 2; ++y) {
+                char *src_y1 = (char *) in_frame->data[0] + in_frame->linesize[0] * y * 2;
+                char *src_y2 = (char *) in_frame->data[0] + in_frame->linesize[0] * (y * 2 + 1);
+                char *src_cb = (char *) in_frame->data[1] + in_frame->linesize[1] * y;
+                char *src_cr = (char *) in_frame->data[2] + in_frame->linesize[2] * y;
+                char *dst1 = dst_buffer + (y * 2) * pitch;
+                char *dst2 = dst_buffer + (y * 2 + 1) * pitch;
+
+                int x = 0;
+
+#ifdef __SSE3__
+                __m128i y1;
+                __m128i y2;
+                __m128i u1;
+                __m128i u2;
+                __m128i v1;
+                __m128i v2;
+                __m128i out1l;
+                __m128i out1h;
+                __m128i out2l;
+                __m128i out2h;
+                __m128i zero = _mm_set1_epi32(0);
+
+                for (; x < width - 15; x += 16){
+                        y1 = _mm_lddqu_si128((__m128i const*) src_y1);
+                        y2 = _mm_lddqu_si128((__m128i const*) src_y2);
+                        src_y1 += 16;
+                        src_y2 += 16;
+
+                        out1l = _mm_unpacklo_epi8(zero, y1);
+                        out1h = _mm_unpackhi_epi8(zero, y1);
+                        out2l = _mm_unpacklo_epi8(zero, y2);
+                        out2h = _mm_unpackhi_epi8(zero, y2);
+
+                        u1 = _mm_lddqu_si128((__m128i const*) src_cb);
+                        v1 = _mm_lddqu_si128((__m128i const*) src_cr);
+                        src_cb += 8;
+                        src_cr += 8;
+
+                        u1 = _mm_unpacklo_epi8(u1, zero);
+                        v1 = _mm_unpacklo_epi8(v1, zero);
+                        u2 = _mm_unpackhi_epi8(u1, zero);
+                        v2 = _mm_unpackhi_epi8(v1, zero);
+                        u1 = _mm_unpacklo_epi8(u1, zero);
+                        v1 = _mm_unpacklo_epi8(v1, zero);
+
+                        v1 = _mm_bslli_si128(v1, 2);
+                        v2 = _mm_bslli_si128(v2, 2);
+
+                        u1 = _mm_or_si128(u1, v1);
+                        u2 = _mm_or_si128(u2, v2);
+
+                        out1l = _mm_or_si128(out1l, u1);
+                        out1h = _mm_or_si128(out1h, u2);
+                        out2l = _mm_or_si128(out2l, u1);
+                        out2h = _mm_or_si128(out2h, u2);
+
+                        _mm_storeu_si128((__m128i *) dst1, out1l);
+                        dst1 += 16;
+                        _mm_storeu_si128((__m128i *) dst1, out1h);
+                        dst1 += 16;
+                        _mm_storeu_si128((__m128i *) dst2, out2l);
+                        dst2 += 16;
+                        _mm_storeu_si128((__m128i *) dst2, out2h);
+                        dst2 += 16;
+                }
+#endif
+
+                for(; x < width - 1; x += 2) {
+                        *dst1++ = *src_cb;
+                        *dst1++ = *src_y1++;
+                        *dst1++ = *src_cr;
+                        *dst1++ = *src_y1++;
+
+                        *dst2++ = *src_cb++;
+                        *dst2++ = *src_y2++;
+                        *dst2++ = *src_cr++;
+                        *dst2++ = *src_y2++;
+                }
+        }
+}
+
+static void yuv420p_to_v210(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        for(int y = 0; y < (int) height / 2; ++y) {
+                uint8_t *src_y1 = (in_frame->data[0] + in_frame->linesize[0] * y * 2);
+                uint8_t *src_y2 = (in_frame->data[0] + in_frame->linesize[0] * (y * 2 + 1));
+                uint8_t *src_cb = (in_frame->data[1] + in_frame->linesize[1] * y);
+                uint8_t *src_cr = (in_frame->data[2] + in_frame->linesize[2] * y);
+                uint32_t *dst1 = (uint32_t *)(void *)(dst_buffer + (y * 2) * pitch);
+                uint32_t *dst2 = (uint32_t *)(void *)(dst_buffer + (y * 2 + 1) * pitch);
+
+                for(int x = 0; x < width / 6; ++x) {
+                        uint32_t w0_0, w0_1, w0_2, w0_3;
+                        uint32_t w1_0, w1_1, w1_2, w1_3;
+
+                        w0_0 = *src_cb << 2;
+                        w1_0 = *src_cb << 2;
+                        src_cb++;
+                        w0_0 = w0_0 | (*src_y1++ << 2) << 10;
+                        w1_0 = w1_0 | (*src_y2++ << 2) << 10;
+                        w0_0 = w0_0 | (*src_cr << 2) << 20;
+                        w1_0 = w1_0 | (*src_cr << 2) << 20;
+                        src_cr++;
+
+                        w0_1 = *src_y1++ << 2;
+                        w1_1 = *src_y2++ << 2;
+                        w0_1 = w0_1 | (*src_cb << 2) << 10;
+                        w1_1 = w1_1 | (*src_cb << 2) << 10;
+                        src_cb++;
+                        w0_1 = w0_1 | (*src_y1++ << 2) << 20;
+                        w1_1 = w1_1 | (*src_y2++ << 2) << 20;
+
+                        w0_2 = *src_cr << 2;
+                        w1_2 = *src_cr << 2;
+                        src_cr++;
+                        w0_2 = w0_2 | (*src_y1++ << 2) << 10;
+                        w1_2 = w1_2 | (*src_y2++ << 2) << 10;
+                        w0_2 = w0_2 | (*src_cb << 2) << 20;
+                        w1_2 = w1_2 | (*src_cb << 2) << 20;
+                        src_cb++;
+
+                        w0_3 = *src_y1++ << 2;
+                        w1_3 = *src_y2++ << 2;
+                        w0_3 = w0_3 | (*src_cr << 2) << 10;
+                        w1_3 = w1_3 | (*src_cr << 2) << 10;
+                        src_cr++;
+                        w0_3 = w0_3 | (*src_y1++ << 2) << 20;
+                        w1_3 = w1_3 | (*src_y2++ << 2) << 20;
+
+                        *dst1++ = w0_0;
+                        *dst1++ = w0_1;
+                        *dst1++ = w0_2;
+                        *dst1++ = w0_3;
+
+                        *dst2++ = w1_0;
+                        *dst2++ = w1_1;
+                        *dst2++ = w1_2;
+                        *dst2++ = w1_3;
+                }
+        }
+}
+
+static void yuv422p_to_yuv422(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        for(int y = 0; y < (int) height; ++y) {
+                char *src_y = (char *) in_frame->data[0] + in_frame->linesize[0] * y;
+                char *src_cb = (char *) in_frame->data[1] + in_frame->linesize[1] * y;
+                char *src_cr = (char *) in_frame->data[2] + in_frame->linesize[2] * y;
+                char *dst = dst_buffer + pitch * y;
+                for(int x = 0; x < width / 2; ++x) {
+                        *dst++ = *src_cb++;
+                        *dst++ = *src_y++;
+                        *dst++ = *src_cr++;
+                        *dst++ = *src_y++;
+                }
+        }
+}
+
+static void yuv422p_to_v210(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        for(int y = 0; y < (int) height; ++y) {
+                uint8_t *src_y = (in_frame->data[0] + in_frame->linesize[0] * y);
+                uint8_t *src_cb = (in_frame->data[1] + in_frame->linesize[1] * y);
+                uint8_t *src_cr = (in_frame->data[2] + in_frame->linesize[2] * y);
+                uint32_t *dst = (uint32_t *)(void *)(dst_buffer + y * pitch);
+
+                for(int x = 0; x < width / 6; ++x) {
+                        uint32_t w0_0, w0_1, w0_2, w0_3;
+
+                        w0_0 = *src_cb++ << 2;
+                        w0_0 = w0_0 | (*src_y++ << 2) << 10;
+                        w0_0 = w0_0 | (*src_cr++ << 2) << 20;
+
+                        w0_1 = *src_y++ << 2;
+                        w0_1 = w0_1 | (*src_cb++ << 2) << 10;
+                        w0_1 = w0_1 | (*src_y++ << 2) << 20;
+
+                        w0_2 = *src_cr++ << 2;
+                        w0_2 = w0_2 | (*src_y++ << 2) << 10;
+                        w0_2 = w0_2 | (*src_cb++ << 2) << 20;
+
+                        w0_3 = *src_y++ << 2;
+                        w0_3 = w0_3 | (*src_cr++ << 2) << 10;
+                        w0_3 = w0_3 | (*src_y++ << 2) << 20;
+
+                        *dst++ = w0_0;
+                        *dst++ = w0_1;
+                        *dst++ = w0_2;
+                        *dst++ = w0_3;
+                }
+        }
+}
+
+
+static void yuv444p_to_yuv422(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        for(int y = 0; y < (int) height; ++y) {
+                char *src_y = (char *) in_frame->data[0] + in_frame->linesize[0] * y;
+                unsigned char *src_cb = (unsigned char *) in_frame->data[1] + in_frame->linesize[1] * y;
+                unsigned char *src_cr = (unsigned char *) in_frame->data[2] + in_frame->linesize[2] * y;
+                char *dst = dst_buffer + pitch * y;
+                for(int x = 0; x < width / 2; ++x) {
+                        *dst++ = (*src_cb + *(src_cb + 1)) / 2;
+                        src_cb += 2;
+                        *dst++ = *src_y++;
+                        *dst++ = (*src_cr + *(src_cr + 1)) / 2;
+                        src_cr += 2;
+                        *dst++ = *src_y++;
+                }
+        }
+}
+
+static void yuv444p_to_v210(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        for(int y = 0; y < (int) height; ++y) {
+                uint8_t *src_y = (in_frame->data[0] + in_frame->linesize[0] * y);
+                uint8_t *src_cb = (in_frame->data[1] + in_frame->linesize[1] * y);
+                uint8_t *src_cr = (in_frame->data[2] + in_frame->linesize[2] * y);
+                uint32_t *dst = (uint32_t *)(void *)(dst_buffer + y * pitch);
+
+                for(int x = 0; x < width / 6; ++x) {
+                        uint32_t w0_0, w0_1, w0_2, w0_3;
+
+                        w0_0 = ((src_cb[0] << 2) + (src_cb[1] << 2)) / 2;
+                        w0_0 = w0_0 | (*src_y++ << 2) << 10;
+                        w0_0 = w0_0 | ((src_cr[0] << 2) + (src_cr[1] << 2)) / 2 << 20;
+                        src_cb += 2;
+                        src_cr += 2;
+
+                        w0_1 = *src_y++ << 2;
+                        w0_1 = w0_1 | ((src_cb[0] << 2) + (src_cb[1] << 2)) / 2 << 10;
+                        w0_1 = w0_1 | (*src_y++ << 2) << 20;
+                        src_cb += 2;
+
+                        w0_2 = ((src_cr[0] << 2) + (src_cr[1] << 2)) / 2;
+                        w0_2 = w0_2 | (*src_y++ << 2) << 10;
+                        w0_2 = w0_2 | ((src_cb[0] << 2) + (src_cb[1] << 2)) / 2 << 20;
+                        src_cr += 2;
+                        src_cb += 2;
+
+                        w0_3 = *src_y++ << 2;
+                        w0_3 = w0_3 | ((src_cr[0] << 2) + (src_cr[1] << 2)) / 2 << 10;
+                        w0_3 = w0_3 | (*src_y++ << 2) << 20;
+                        src_cr += 2;
+
+                        *dst++ = w0_0;
+                        *dst++ = w0_1;
+                        *dst++ = w0_2;
+                        *dst++ = w0_3;
+                }
+        }
+}
+
+
+/**
+ * Changes pixel format from planar YUV 422 to packed RGB.
+ * Color space is assumed ITU-T Rec. 609. YUV is expected to be full scale (aka in JPEG).
+ */
+static void nv12_to_rgb24(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        for(int y = 0; y < (int) height; ++y) {
+                unsigned char *src_y = (unsigned char *) in_frame->data[0] + in_frame->linesize[0] * y;
+                unsigned char *src_cbcr = (unsigned char *) in_frame->data[1] + in_frame->linesize[1] * (y / 2);
+                unsigned char *dst = (unsigned char *) dst_buffer + pitch * y;
+                for(int x = 0; x < width / 2; ++x) {
+                        int cb = *src_cbcr++ - 128;
+                        int cr = *src_cbcr++ - 128;
+                        int y = *src_y++ << 16;
+                        int r = 75700 * cr;
+                        int g = -26864 * cb - 38050 * cr;
+                        int b = 133176 * cb;
+                        *dst++ = min(max(r + y, 0), (1<<24) - 1) >> 16;
+                        *dst++ = min(max(g + y, 0), (1<<24) - 1) >> 16;
+                        *dst++ = min(max(b + y, 0), (1<<24) - 1) >> 16;
+                        y = *src_y++ << 16;
+                        *dst++ = min(max(r + y, 0), (1<<24) - 1) >> 16;
+                        *dst++ = min(max(g + y, 0), (1<<24) - 1) >> 16;
+                        *dst++ = min(max(b + y, 0), (1<<24) - 1) >> 16;
+                }
+        }
+}
+
+/**
+ * Changes pixel format from planar YUV 422 to packed RGB.
+ * Color space is assumed ITU-T Rec. 609. YUV is expected to be full scale (aka in JPEG).
+ */
+static void yuv422p_to_rgb24(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        for(int y = 0; y < (int) height; ++y) {
+                unsigned char *src_y = (unsigned char *) in_frame->data[0] + in_frame->linesize[0] * y;
+                unsigned char *src_cb = (unsigned char *) in_frame->data[1] + in_frame->linesize[1] * y;
+                unsigned char *src_cr = (unsigned char *) in_frame->data[2] + in_frame->linesize[2] * y;
+                unsigned char *dst = (unsigned char *) dst_buffer + pitch * y;
+                for(int x = 0; x < width / 2; ++x) {
+                        int cb = *src_cb++ - 128;
+                        int cr = *src_cr++ - 128;
+                        int y = *src_y++ << 16;
+                        int r = 75700 * cr;
+                        int g = -26864 * cb - 38050 * cr;
+                        int b = 133176 * cb;
+                        *dst++ = min(max(r + y, 0), (1<<24) - 1) >> 16;
+                        *dst++ = min(max(g + y, 0), (1<<24) - 1) >> 16;
+                        *dst++ = min(max(b + y, 0), (1<<24) - 1) >> 16;
+                        y = *src_y++ << 16;
+                        *dst++ = min(max(r + y, 0), (1<<24) - 1) >> 16;
+                        *dst++ = min(max(g + y, 0), (1<<24) - 1) >> 16;
+                        *dst++ = min(max(b + y, 0), (1<<24) - 1) >> 16;
+                }
+        }
+}
+
+/**
+ * Changes pixel format from planar YUV 422 to packed RGB.
+ * Color space is assumed ITU-T Rec. 609. YUV is expected to be full scale (aka in JPEG).
+ */
+static void yuv420p_to_rgb24(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        for(int y = 0; y < (int) height / 2; ++y) {
+                unsigned char *src_y1 = (unsigned char *) in_frame->data[0] + in_frame->linesize[0] * y * 2;
+                unsigned char *src_y2 = (unsigned char *) in_frame->data[0] + in_frame->linesize[0] * (y * 2 + 1);
+                unsigned char *src_cb = (unsigned char *) in_frame->data[1] + in_frame->linesize[1] * y;
+                unsigned char *src_cr = (unsigned char *) in_frame->data[2] + in_frame->linesize[2] * y;
+                unsigned char *dst1 = (unsigned char *) dst_buffer + pitch * (y * 2);
+                unsigned char *dst2 = (unsigned char *) dst_buffer + pitch * (y * 2 + 1);
+                for(int x = 0; x < width / 2; ++x) {
+                        int cb = *src_cb++ - 128;
+                        int cr = *src_cr++ - 128;
+                        int y = *src_y1++ << 16;
+                        int r = 75700 * cr;
+                        int g = -26864 * cb - 38050 * cr;
+                        int b = 133176 * cb;
+                        *dst1++ = min(max(r + y, 0), (1<<24) - 1) >> 16;
+                        *dst1++ = min(max(g + y, 0), (1<<24) - 1) >> 16;
+                        *dst1++ = min(max(b + y, 0), (1<<24) - 1) >> 16;
+                        y = *src_y1++ << 16;
+                        *dst1++ = min(max(r + y, 0), (1<<24) - 1) >> 16;
+                        *dst1++ = min(max(g + y, 0), (1<<24) - 1) >> 16;
+                        *dst1++ = min(max(b + y, 0), (1<<24) - 1) >> 16;
+                        y = *src_y2++ << 16;
+                        *dst2++ = min(max(r + y, 0), (1<<24) - 1) >> 16;
+                        *dst2++ = min(max(g + y, 0), (1<<24) - 1) >> 16;
+                        *dst2++ = min(max(b + y, 0), (1<<24) - 1) >> 16;
+                        y = *src_y2++ << 16;
+                        *dst2++ = min(max(r + y, 0), (1<<24) - 1) >> 16;
+                        *dst2++ = min(max(g + y, 0), (1<<24) - 1) >> 16;
+                        *dst2++ = min(max(b + y, 0), (1<<24) - 1) >> 16;
+                }
+        }
+}
+
+/**
+ * Changes pixel format from planar YUV 444 to packed RGB.
+ * Color space is assumed ITU-T Rec. 609. YUV is expected to be full scale (aka in JPEG).
+ */
+static void yuv444p_to_rgb24(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        for(int y = 0; y < (int) height; ++y) {
+                unsigned char *src_y = (unsigned char *) in_frame->data[0] + in_frame->linesize[0] * y;
+                unsigned char *src_cb = (unsigned char *) in_frame->data[1] + in_frame->linesize[1] * y;
+                unsigned char *src_cr = (unsigned char *) in_frame->data[2] + in_frame->linesize[2] * y;
+                unsigned char *dst = (unsigned char *) dst_buffer + pitch * y;
+                for(int x = 0; x < width; ++x) {
+                        int cb = *src_cb++ - 128;
+                        int cr = *src_cr++ - 128;
+                        int y = *src_y++ << 16;
+                        int r = 75700 * cr;
+                        int g = -26864 * cb - 38050 * cr;
+                        int b = 133176 * cb;
+                        *dst++ = min(max(r + y, 0), (1<<24) - 1) >> 16;
+                        *dst++ = min(max(g + y, 0), (1<<24) - 1) >> 16;
+                        *dst++ = min(max(b + y, 0), (1<<24) - 1) >> 16;
+                }
+        }
+}
+
+static void yuv420p10le_to_v210(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        for(int y = 0; y < (int) height / 2; ++y) {
+                uint16_t *src_y1 = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * y * 2);
+                uint16_t *src_y2 = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * (y * 2 + 1));
+                uint16_t *src_cb = (uint16_t *)(void *)(in_frame->data[1] + in_frame->linesize[1] * y);
+                uint16_t *src_cr = (uint16_t *)(void *)(in_frame->data[2] + in_frame->linesize[2] * y);
+                uint32_t *dst1 = (uint32_t *)(void *)(dst_buffer + (y * 2) * pitch);
+                uint32_t *dst2 = (uint32_t *)(void *)(dst_buffer + (y * 2 + 1) * pitch);
+
+                for(int x = 0; x < width / 6; ++x) {
+                        uint32_t w0_0, w0_1, w0_2, w0_3;
+                        uint32_t w1_0, w1_1, w1_2, w1_3;
+
+                        w0_0 = *src_cb;
+                        w1_0 = *src_cb;
+                        src_cb++;
+                        w0_0 = w0_0 | (*src_y1++) << 10;
+                        w1_0 = w1_0 | (*src_y2++) << 10;
+                        w0_0 = w0_0 | (*src_cr) << 20;
+                        w1_0 = w1_0 | (*src_cr) << 20;
+                        src_cr++;
+
+                        w0_1 = *src_y1++;
+                        w1_1 = *src_y2++;
+                        w0_1 = w0_1 | (*src_cb) << 10;
+                        w1_1 = w1_1 | (*src_cb) << 10;
+                        src_cb++;
+                        w0_1 = w0_1 | (*src_y1++) << 20;
+                        w1_1 = w1_1 | (*src_y2++) << 20;
+
+                        w0_2 = *src_cr;
+                        w1_2 = *src_cr;
+                        src_cr++;
+                        w0_2 = w0_2 | (*src_y1++) << 10;
+                        w1_2 = w1_2 | (*src_y2++) << 10;
+                        w0_2 = w0_2 | (*src_cb) << 20;
+                        w1_2 = w1_2 | (*src_cb) << 20;
+                        src_cb++;
+
+                        w0_3 = *src_y1++;
+                        w1_3 = *src_y2++;
+                        w0_3 = w0_3 | (*src_cr) << 10;
+                        w1_3 = w1_3 | (*src_cr) << 10;
+                        src_cr++;
+                        w0_3 = w0_3 | (*src_y1++) << 20;
+                        w1_3 = w1_3 | (*src_y2++) << 20;
+
+                        *dst1++ = w0_0;
+                        *dst1++ = w0_1;
+                        *dst1++ = w0_2;
+                        *dst1++ = w0_3;
+
+                        *dst2++ = w1_0;
+                        *dst2++ = w1_1;
+                        *dst2++ = w1_2;
+                        *dst2++ = w1_3;
+                }
+        }
+}
+
+static void yuv422p10le_to_v210(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        for(int y = 0; y < (int) height; ++y) {
+                uint16_t *src_y = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * y);
+                uint16_t *src_cb = (uint16_t *)(void *)(in_frame->data[1] + in_frame->linesize[1] * y);
+                uint16_t *src_cr = (uint16_t *)(void *)(in_frame->data[2] + in_frame->linesize[2] * y);
+                uint32_t *dst = (uint32_t *)(void *)(dst_buffer + y * pitch);
+
+                for(int x = 0; x < width / 6; ++x) {
+                        uint32_t w0_0, w0_1, w0_2, w0_3;
+
+                        w0_0 = *src_cb++;
+                        w0_0 = w0_0 | (*src_y++) << 10;
+                        w0_0 = w0_0 | (*src_cr++) << 20;
+
+                        w0_1 = *src_y++;
+                        w0_1 = w0_1 | (*src_cb++) << 10;
+                        w0_1 = w0_1 | (*src_y++) << 20;
+
+                        w0_2 = *src_cr++;
+                        w0_2 = w0_2 | (*src_y++) << 10;
+                        w0_2 = w0_2 | (*src_cb++) << 20;
+
+                        w0_3 = *src_y++;
+                        w0_3 = w0_3 | (*src_cr++) << 10;
+                        w0_3 = w0_3 | (*src_y++) << 20;
+
+                        *dst++ = w0_0;
+                        *dst++ = w0_1;
+                        *dst++ = w0_2;
+                        *dst++ = w0_3;
+                }
+        }
+}
+
+static void yuv444p10le_to_v210(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        for(int y = 0; y < (int) height; ++y) {
+                uint16_t *src_y = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * y);
+                uint16_t *src_cb = (uint16_t *)(void *)(in_frame->data[1] + in_frame->linesize[1] * y);
+                uint16_t *src_cr = (uint16_t *)(void *)(in_frame->data[2] + in_frame->linesize[2] * y);
+                uint32_t *dst = (uint32_t *)(void *)(dst_buffer + y * pitch);
+
+                for(int x = 0; x < width / 6; ++x) {
+                        uint32_t w0_0, w0_1, w0_2, w0_3;
+
+                        w0_0 = (src_cb[0] + src_cb[1]) / 2;
+                        w0_0 = w0_0 | (*src_y++) << 10;
+                        w0_0 = w0_0 | (src_cr[0] + src_cr[1]) / 2 << 20;
+                        src_cb += 2;
+                        src_cr += 2;
+
+                        w0_1 = *src_y++;
+                        w0_1 = w0_1 | (src_cb[0] + src_cb[1]) / 2 << 10;
+                        w0_1 = w0_1 | (*src_y++) << 20;
+                        src_cb += 2;
+
+                        w0_2 = (src_cr[0] + src_cr[1]) / 2;
+                        w0_2 = w0_2 | (*src_y++) << 10;
+                        w0_2 = w0_2 | (src_cb[0] + src_cb[1]) / 2 << 20;
+                        src_cr += 2;
+                        src_cb += 2;
+
+                        w0_3 = *src_y++;
+                        w0_3 = w0_3 | (src_cr[0] + src_cr[1]) / 2 << 10;
+                        w0_3 = w0_3 | (*src_y++) << 20;
+                        src_cr += 2;
+
+                        *dst++ = w0_0;
+                        *dst++ = w0_1;
+                        *dst++ = w0_2;
+                        *dst++ = w0_3;
+                }
+        }
+}
+
+static void yuv420p10le_to_uyvy(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        for(int y = 0; y < (int) height / 2; ++y) {
+                uint16_t *src_y1 = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * y * 2);
+                uint16_t *src_y2 = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * (y * 2 + 1));
+                uint16_t *src_cb = (uint16_t *)(void *)(in_frame->data[1] + in_frame->linesize[1] * y);
+                uint16_t *src_cr = (uint16_t *)(void *)(in_frame->data[2] + in_frame->linesize[2] * y);
+                uint8_t *dst1 = (uint8_t *)(void *)(dst_buffer + (y * 2) * pitch);
+                uint8_t *dst2 = (uint8_t *)(void *)(dst_buffer + (y * 2 + 1) * pitch);
+
+                for(int x = 0; x < width / 2; ++x) {
+                        uint8_t tmp;
+                        // U
+                        tmp = *src_cb++ >> 2;
+                        *dst1++ = tmp;
+                        *dst2++ = tmp;
+                        // Y
+                        *dst1++ = *src_y1++ >> 2;
+                        *dst2++ = *src_y2++ >> 2;
+                        // V
+                        tmp = *src_cr++ >> 2;
+                        *dst1++ = tmp;
+                        *dst2++ = tmp;
+                        // Y
+                        *dst1++ = *src_y1++ >> 2;
+                        *dst2++ = *src_y2++ >> 2;
+                }
+        }
+}
+
+static void yuv422p10le_to_uyvy(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        for(int y = 0; y < (int) height; ++y) {
+                uint16_t *src_y = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * y);
+                uint16_t *src_cb = (uint16_t *)(void *)(in_frame->data[1] + in_frame->linesize[1] * y);
+                uint16_t *src_cr = (uint16_t *)(void *)(in_frame->data[2] + in_frame->linesize[2] * y);
+                uint8_t *dst = (uint8_t *)(void *)(dst_buffer + y * pitch);
+
+                for(int x = 0; x < width / 2; ++x) {
+                        *dst++ = *src_cb++ >> 2;
+                        *dst++ = *src_y++ >> 2;
+                        *dst++ = *src_cr++ >> 2;
+                        *dst++ = *src_y++ >> 2;
+                }
+        }
+}
+
+static void yuv444p10le_to_uyvy(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        for(int y = 0; y < (int) height; ++y) {
+                uint16_t *src_y = (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * y);
+                uint16_t *src_cb = (uint16_t *)(void *)(in_frame->data[1] + in_frame->linesize[1] * y);
+                uint16_t *src_cr = (uint16_t *)(void *)(in_frame->data[2] + in_frame->linesize[2] * y);
+                uint8_t *dst = (uint8_t *)(void *)(dst_buffer + y * pitch);
+
+                for(int x = 0; x < width / 2; ++x) {
+                        *dst++ = (src_cb[0] + src_cb[0]) / 2 >> 2;
+                        *dst++ = *src_y++ >> 2;
+                        *dst++ = (src_cr[0] + src_cr[1]) / 2 >> 2;
+                        *dst++ = *src_y++ >> 2;
+                        src_cb += 2;
+                        src_cr += 2;
+                }
+        }
+}
+
+static void yuv420p10le_to_rgb24(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        char *tmp = malloc(vc_get_linesize(width, UYVY) * height);
+        char *uyvy = tmp;
+        yuv420p10le_to_uyvy(uyvy, in_frame, width, height, vc_get_linesize(width, UYVY));
+        for (int i = 0; i < height; i++) {
+                vc_copylineUYVYtoRGB((unsigned char *) dst_buffer, (unsigned char *) uyvy, vc_get_linesize(width, RGB));
+                uyvy += vc_get_linesize(width, UYVY);
+                dst_buffer += pitch;
+        }
+        free(tmp);
+}
+
+static void yuv422p10le_to_rgb24(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        char *tmp = malloc(vc_get_linesize(width, UYVY) * height);
+        char *uyvy = tmp;
+        yuv422p10le_to_uyvy(uyvy, in_frame, width, height, vc_get_linesize(width, UYVY));
+        for (int i = 0; i < height; i++) {
+                vc_copylineUYVYtoRGB((unsigned char *) dst_buffer, (unsigned char *) uyvy, vc_get_linesize(width, RGB));
+                uyvy += vc_get_linesize(width, UYVY);
+                dst_buffer += pitch;
+        }
+        free(tmp);
+}
+
+static void yuv444p10le_to_rgb24(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        char *tmp = malloc(vc_get_linesize(width, UYVY) * height);
+        char *uyvy = tmp;
+        yuv444p10le_to_uyvy(uyvy, in_frame, width, height, vc_get_linesize(width, UYVY));
+        for (int i = 0; i < height; i++) {
+                vc_copylineUYVYtoRGB((unsigned char *) dst_buffer, (unsigned char *) uyvy, vc_get_linesize(width, RGB));
+                uyvy += vc_get_linesize(width, UYVY);
+                dst_buffer += pitch;
+        }
+        free(tmp);
+}
+
+#ifdef __SSE4_1__
+/*
+ * SSE4.1 versions of the most used conversions. They must produce output
+ * bit-exact with the scalar functions above (checked by unit tests).
+ * Planar formats are processed in chunks of 16 luma samples, the remainder
+ * of the line is handled by scalar code.
+ */
+
+/// packs three vectors of 10-bit values to v210 words
+#define V210_PACK(a, b, c) _mm_or_si128(_mm_or_si128(a, _mm_slli_epi32(b, 10)), _mm_slli_epi32(c, 20))
+
+static void yuv8_line_to_v210_sse4(uint32_t *dst, const uint8_t *src_y, const uint8_t *src_cb,
+                const uint8_t *src_cr, int width)
+{
+        const __m128i a0_y = _mm_setr_epi8(-128, -128, -128, -128, 1, -128, -128, -128, -128, -128, -128, -128, 4, -128, -128, -128);
+        const __m128i a0_uv = _mm_setr_epi8(0, -128, -128, -128, -128, -128, -128, -128, 9, -128, -128, -128, -128, -128, -128, -128);
+        const __m128i b0_y = _mm_setr_epi8(0, -128, -128, -128, -128, -128, -128, -128, 3, -128, -128, -128, -128, -128, -128, -128);
+        const __m128i b0_uv = _mm_setr_epi8(-128, -128, -128, -128, 1, -128, -128, -128, -128, -128, -128, -128, 10, -128, -128, -128);
+        const __m128i c0_y = _mm_setr_epi8(-128, -128, -128, -128, 2, -128, -128, -128, -128, -128, -128, -128, 5, -128, -128, -128);
+        const __m128i c0_uv = _mm_setr_epi8(8, -128, -128, -128, -128, -128, -128, -128, 2, -128, -128, -128, -128, -128, -128, -128);
+        const __m128i a1_y = _mm_setr_epi8(-128, -128, -128, -128, 7, -128, -128, -128, -128, -128, -128, -128, 10, -128, -128, -128);
+        const __m128i a1_uv = _mm_setr_epi8(3, -128, -128, -128, -128, -128, -128, -128, 12, -128, -128, -128, -128, -128, -128, -128);
+        const __m128i b1_y = _mm_setr_epi8(6, -128, -128, -128, -128, -128, -128, -128, 9, -128, -128, -128, -128, -128, -128, -128);
+        const __m128i b1_uv = _mm_setr_epi8(-128, -128, -128, -128, 4, -128, -128, -128, -128, -128, -128, -128, 13, -128, -128, -128);
+        const __m128i c1_y = _mm_setr_epi8(-128, -128, -128, -128, 8, -128, -128, -128, -128, -128, -128, -128, 11, -128, -128, -128);
+        const __m128i c1_uv = _mm_setr_epi8(11, -128, -128, -128, -128, -128, -128, -128, 5, -128, -128, -128, -128, -128, -128, -128);
+
+        int x = 0;
+        // 12 pixels (2 v210 blocks) per iteration, 16 luma samples read
+        for (; x + 16 <= width; x += 12) {
+                __m128i y = _mm_loadu_si128((__m128i const *)(const void *) src_y);
+                __m128i uv = _mm_unpacklo_epi64(_mm_loadl_epi64((__m128i const *)(const void *) src_cb),
+                                _mm_loadl_epi64((__m128i const *)(const void *) src_cr));
+                src_y += 12;
+                src_cb += 6;
+                src_cr += 6;
+
+                __m128i a = _mm_or_si128(_mm_shuffle_epi8(y, a0_y), _mm_shuffle_epi8(uv, a0_uv));
+                __m128i b = _mm_or_si128(_mm_shuffle_epi8(y, b0_y), _mm_shuffle_epi8(uv, b0_uv));
+                __m128i c = _mm_or_si128(_mm_shuffle_epi8(y, c0_y), _mm_shuffle_epi8(uv, c0_uv));
+                _mm_storeu_si128((__m128i *)(void *) dst, _mm_slli_epi32(V210_PACK(a, b, c), 2));
+
+                a = _mm_or_si128(_mm_shuffle_epi8(y, a1_y), _mm_shuffle_epi8(uv, a1_uv));
+                b = _mm_or_si128(_mm_shuffle_epi8(y, b1_y), _mm_shuffle_epi8(uv, b1_uv));
+                c = _mm_or_si128(_mm_shuffle_epi8(y, c1_y), _mm_shuffle_epi8(uv, c1_uv));
+                _mm_storeu_si128((__m128i *)(void *) (dst + 4), _mm_slli_epi32(V210_PACK(a, b, c), 2));
+                dst += 8;
+        }
+
+        for (; x + 6 <= width; x += 6) {
+                *dst++ = src_cb[0] << 2 | src_y[0] << 12 | src_cr[0] << 22;
+                *dst++ = src_y[1] << 2 | src_cb[1] << 12 | src_y[2] << 22;
+                *dst++ = src_cr[1] << 2 | src_y[3] << 12 | src_cb[2] << 22;
+                *dst++ = src_y[4] << 2 | src_cr[2] << 12 | src_y[5] << 22;
+                src_y += 6;
+                src_cb += 3;
+                src_cr += 3;
+        }
+}
+
+static void yuv10_line_to_v210_sse4(uint32_t *dst, const uint16_t *src_y, const uint16_t *src_cb,
+                const uint16_t *src_cr, int width)
+{
+        const __m128i a0_y0 = _mm_setr_epi8(-128, -128, -128, -128, 2, 3, -128, -128, -128, -128, -128, -128, 8, 9, -128, -128);
+        const __m128i a0_cb = _mm_setr_epi8(0, 1, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+        const __m128i a0_cr = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, 2, 3, -128, -128, -128, -128, -128, -128);
+        const __m128i b0_y0 = _mm_setr_epi8(0, 1, -128, -128, -128, -128, -128, -128, 6, 7, -128, -128, -128, -128, -128, -128);
+        const __m128i b0_cb = _mm_setr_epi8(-128, -128, -128, -128, 2, 3, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+        const __m128i b0_cr = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 4, 5, -128, -128);
+        const __m128i c0_y0 = _mm_setr_epi8(-128, -128, -128, -128, 4, 5, -128, -128, -128, -128, -128, -128, 10, 11, -128, -128);
+        const __m128i c0_cb = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, 4, 5, -128, -128, -128, -128, -128, -128);
+        const __m128i c0_cr = _mm_setr_epi8(0, 1, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+        const __m128i a1_y0 = _mm_setr_epi8(-128, -128, -128, -128, 14, 15, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+        const __m128i a1_y1 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 4, 5, -128, -128);
+        const __m128i a1_cb = _mm_setr_epi8(6, 7, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+        const __m128i a1_cr = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, 8, 9, -128, -128, -128, -128, -128, -128);
+        const __m128i b1_y0 = _mm_setr_epi8(12, 13, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+        const __m128i b1_y1 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, 2, 3, -128, -128, -128, -128, -128, -128);
+        const __m128i b1_cb = _mm_setr_epi8(-128, -128, -128, -128, 8, 9, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+        const __m128i b1_cr = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 10, 11, -128, -128);
+        const __m128i c1_y1 = _mm_setr_epi8(-128, -128, -128, -128, 0, 1, -128, -128, -128, -128, -128, -128, 6, 7, -128, -128);
+        const __m128i c1_cb = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, 10, 11, -128, -128, -128, -128, -128, -128);
+        const __m128i c1_cr = _mm_setr_epi8(6, 7, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+
+        int x = 0;
+        for (; x + 16 <= width; x += 12) {
+                __m128i y0 = _mm_loadu_si128((__m128i const *)(const void *) src_y);
+                __m128i y1 = _mm_loadu_si128((__m128i const *)(const void *) (src_y + 8));
+                __m128i cb = _mm_loadu_si128((__m128i const *)(const void *) src_cb);
+                __m128i cr = _mm_loadu_si128((__m128i const *)(const void *) src_cr);
+                src_y += 12;
+                src_cb += 6;
+                src_cr += 6;
+
+                __m128i a = _mm_or_si128(_mm_shuffle_epi8(y0, a0_y0),
+                                _mm_or_si128(_mm_shuffle_epi8(cb, a0_cb), _mm_shuffle_epi8(cr, a0_cr)));
+                __m128i b = _mm_or_si128(_mm_shuffle_epi8(y0, b0_y0),
+                                _mm_or_si128(_mm_shuffle_epi8(cb, b0_cb), _mm_shuffle_epi8(cr, b0_cr)));
+                __m128i c = _mm_or_si128(_mm_shuffle_epi8(y0, c0_y0),
+                                _mm_or_si128(_mm_shuffle_epi8(cb, c0_cb), _mm_shuffle_epi8(cr, c0_cr)));
+                _mm_storeu_si128((__m128i *)(void *) dst, V210_PACK(a, b, c));
+
+                a = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(y0, a1_y0), _mm_shuffle_epi8(y1, a1_y1)),
+                                _mm_or_si128(_mm_shuffle_epi8(cb, a1_cb), _mm_shuffle_epi8(cr, a1_cr)));
+                b = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(y0, b1_y0), _mm_shuffle_epi8(y1, b1_y1)),
+                                _mm_or_si128(_mm_shuffle_epi8(cb, b1_cb), _mm_shuffle_epi8(cr, b1_cr)));
+                c = _mm_or_si128(_mm_shuffle_epi8(y1, c1_y1),
+                                _mm_or_si128(_mm_shuffle_epi8(cb, c1_cb), _mm_shuffle_epi8(cr, c1_cr)));
+                _mm_storeu_si128((__m128i *)(void *) (dst + 4), V210_PACK(a, b, c));
+                dst += 8;
+        }
+
+        for (; x + 6 <= width; x += 6) {
+                *dst++ = src_cb[0] | src_y[0] << 10 | src_cr[0] << 20;
+                *dst++ = src_y[1] | src_cb[1] << 10 | src_y[2] << 20;
+                *dst++ = src_cr[1] | src_y[3] << 10 | src_cb[2] << 20;
+                *dst++ = src_y[4] | src_cr[2] << 10 | src_y[5] << 20;
+                src_y += 6;
+                src_cb += 3;
+                src_cr += 3;
+        }
+}
+
+/**
+ * Converts 4 pixels to RGB using the same fixed-point arithmetic as
+ * yuv420p_to_rgb24(). Saturating packs yield the same result as clamping
+ * to [0, 2^24) before the shift.
+ */
+static inline __m128i yuv_to_rgb_sse4(__m128i y, __m128i cb, __m128i cr, __m128i *g_out, __m128i *b_out)
+{
+        y = _mm_slli_epi32(y, 16);
+        __m128i r = _mm_add_epi32(y, _mm_mullo_epi32(cr, _mm_set1_epi32(75700)));
+        __m128i g = _mm_add_epi32(y, _mm_add_epi32(_mm_mullo_epi32(cb, _mm_set1_epi32(-26864)),
+                                _mm_mullo_epi32(cr, _mm_set1_epi32(-38050))));
+        __m128i b = _mm_add_epi32(y, _mm_mullo_epi32(cb, _mm_set1_epi32(133176)));
+        *g_out = _mm_srai_epi32(g, 16);
+        *b_out = _mm_srai_epi32(b, 16);
+        return _mm_srai_epi32(r, 16);
+}
+
+/**
+ * @param cbcr_interleaved chroma is NV12-like interleaved CbCr plane (src_cr is ignored)
+ */
+static void yuv8_line_to_rgb24_sse4(uint8_t *dst, const uint8_t *src_y, const uint8_t *src_cb,
+                const uint8_t *src_cr, int width, bool cbcr_interleaved)
+{
+        const __m128i deinterleave = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+        const __m128i r0 = _mm_setr_epi8(0, -128, -128, 1, -128, -128, 2, -128, -128, 3, -128, -128, 4, -128, -128, 5);
+        const __m128i g0 = _mm_setr_epi8(-128, 0, -128, -128, 1, -128, -128, 2, -128, -128, 3, -128, -128, 4, -128, -128);
+        const __m128i b0 = _mm_setr_epi8(-128, -128, 0, -128, -128, 1, -128, -128, 2, -128, -128, 3, -128, -128, 4, -128);
+        const __m128i r1 = _mm_setr_epi8(-128, -128, 6, -128, -128, 7, -128, -128, 8, -128, -128, 9, -128, -128, 10, -128);
+        const __m128i g1 = _mm_setr_epi8(5, -128, -128, 6, -128, -128, 7, -128, -128, 8, -128, -128, 9, -128, -128, 10);
+        const __m128i b1 = _mm_setr_epi8(-128, 5, -128, -128, 6, -128, -128, 7, -128, -128, 8, -128, -128, 9, -128, -128);
+        const __m128i r2 = _mm_setr_epi8(-128, 11, -128, -128, 12, -128, -128, 13, -128, -128, 14, -128, -128, 15, -128, -128);
+        const __m128i g2 = _mm_setr_epi8(-128, -128, 11, -128, -128, 12, -128, -128, 13, -128, -128, 14, -128, -128, 15, -128);
+        const __m128i b2 = _mm_setr_epi8(10, -128, -128, 11, -128, -128, 12, -128, -128, 13, -128, -128, 14, -128, -128, 15);
+        const __m128i bias = _mm_set1_epi32(128);
+
+        int x = 0;
+        for (; x + 16 <= width; x += 16) {
+                __m128i y = _mm_loadu_si128((__m128i const *)(const void *) src_y);
+                __m128i cb, cr;
+                if (cbcr_interleaved) {
+                        __m128i cbcr = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *)(const void *) src_cb), deinterleave);
+                        cb = cbcr;
+                        cr = _mm_srli_si128(cbcr, 8);
+                        src_cb += 16;
+                } else {
+                        cb = _mm_loadl_epi64((__m128i const *)(const void *) src_cb);
+                        cr = _mm_loadl_epi64((__m128i const *)(const void *) src_cr);
+                        src_cb += 8;
+                        src_cr += 8;
+                }
+                src_y += 16;
+                // duplicate chroma samples for both pixels of a pair
+                cb = _mm_unpacklo_epi8(cb, cb);
+                cr = _mm_unpacklo_epi8(cr, cr);
+
+                __m128i r16[2], g16[2], b16[2];
+                for (int i = 0; i < 2; ++i) {
+                        __m128i r_lo, g_lo, b_lo, r_hi, g_hi, b_hi;
+                        r_lo = yuv_to_rgb_sse4(_mm_cvtepu8_epi32(y),
+                                        _mm_sub_epi32(_mm_cvtepu8_epi32(cb), bias),
+                                        _mm_sub_epi32(_mm_cvtepu8_epi32(cr), bias), &g_lo, &b_lo);
+                        r_hi = yuv_to_rgb_sse4(_mm_cvtepu8_epi32(_mm_srli_si128(y, 4)),
+                                        _mm_sub_epi32(_mm_cvtepu8_epi32(_mm_srli_si128(cb, 4)), bias),
+                                        _mm_sub_epi32(_mm_cvtepu8_epi32(_mm_srli_si128(cr, 4)), bias), &g_hi, &b_hi);
+                        r16[i] = _mm_packs_epi32(r_lo, r_hi);
+                        g16[i] = _mm_packs_epi32(g_lo, g_hi);
+                        b16[i] = _mm_packs_epi32(b_lo, b_hi);
+                        y = _mm_srli_si128(y, 8);
+                        cb = _mm_srli_si128(cb, 8);
+                        cr = _mm_srli_si128(cr, 8);
+                }
+                __m128i r = _mm_packus_epi16(r16[0], r16[1]);
+                __m128i g = _mm_packus_epi16(g16[0], g16[1]);
+                __m128i b = _mm_packus_epi16(b16[0], b16[1]);
+
+                _mm_storeu_si128((__m128i *)(void *) dst, _mm_or_si128(_mm_shuffle_epi8(r, r0),
+                                        _mm_or_si128(_mm_shuffle_epi8(g, g0), _mm_shuffle_epi8(b, b0))));
+                _mm_storeu_si128((__m128i *)(void *) (dst + 16), _mm_or_si128(_mm_shuffle_epi8(r, r1),
+                                        _mm_or_si128(_mm_shuffle_epi8(g, g1), _mm_shuffle_epi8(b, b1))));
+                _mm_storeu_si128((__m128i *)(void *) (dst + 32), _mm_or_si128(_mm_shuffle_epi8(r, r2),
+                                        _mm_or_si128(_mm_shuffle_epi8(g, g2), _mm_shuffle_epi8(b, b2))));
+                dst += 48;
+        }
+
+        for (; x + 2 <= width; x += 2) {
+                int cb = *src_cb++ - 128;
+                int cr;
+                if (cbcr_interleaved) {
+                        cr = *src_cb++ - 128;
+                } else {
+                        cr = *src_cr++ - 128;
+                }
+                int r = 75700 * cr;
+                int g = -26864 * cb - 38050 * cr;
+                int b = 133176 * cb;
+                for (int i = 0; i < 2; ++i) {
+                        int y = *src_y++ << 16;
+                        *dst++ = min(max(r + y, 0), (1<<24) - 1) >> 16;
+                        *dst++ = min(max(g + y, 0), (1<<24) - 1) >> 16;
+                        *dst++ = min(max(b + y, 0), (1<<24) - 1) >> 16;
+                }
+        }
+}
+
+/// @param chroma_shift vertical chroma subsampling (log2)
+static void yuv8_to_v210_sse4(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch, int chroma_shift)
+{
+        for (int y = 0; y < height; ++y) {
+                yuv8_line_to_v210_sse4((uint32_t *)(void *)(dst_buffer + y * pitch),
+                                in_frame->data[0] + in_frame->linesize[0] * y,
+                                in_frame->data[1] + in_frame->linesize[1] * (y >> chroma_shift),
+                                in_frame->data[2] + in_frame->linesize[2] * (y >> chroma_shift),
+                                width);
+        }
+}
+
+static void yuv10_to_v210_sse4(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch, int chroma_shift)
+{
+        for (int y = 0; y < height; ++y) {
+                yuv10_line_to_v210_sse4((uint32_t *)(void *)(dst_buffer + y * pitch),
+                                (uint16_t *)(void *)(in_frame->data[0] + in_frame->linesize[0] * y),
+                                (uint16_t *)(void *)(in_frame->data[1] + in_frame->linesize[1] * (y >> chroma_shift)),
+                                (uint16_t *)(void *)(in_frame->data[2] + in_frame->linesize[2] * (y >> chroma_shift)),
+                                width);
+        }
+}
+
+static void yuv8_to_rgb24_sse4(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch, int chroma_shift, bool nv12)
+{
+        for (int y = 0; y < height; ++y) {
+                yuv8_line_to_rgb24_sse4((uint8_t *) dst_buffer + y * pitch,
+                                in_frame->data[0] + in_frame->linesize[0] * y,
+                                in_frame->data[1] + in_frame->linesize[1] * (y >> chroma_shift),
+                                nv12 ? NULL : in_frame->data[2] + in_frame->linesize[2] * (y >> chroma_shift),
+                                width, nv12);
+        }
+}
+
+/*
+ * 4:2:0 scalar functions process lines in pairs and leave the last line of
+ * odd-height frames untouched, so do the SIMD variants.
+ */
+static void yuv420p_to_v210_sse4(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        yuv8_to_v210_sse4(dst_buffer, in_frame, width, height / 2 * 2, pitch, 1);
+}
+
+static void yuv422p_to_v210_sse4(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        yuv8_to_v210_sse4(dst_buffer, in_frame, width, height, pitch, 0);
+}
+
+static void yuv420p10le_to_v210_sse4(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        yuv10_to_v210_sse4(dst_buffer, in_frame, width, height / 2 * 2, pitch, 1);
+}
+
+static void yuv422p10le_to_v210_sse4(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        yuv10_to_v210_sse4(dst_buffer, in_frame, width, height, pitch, 0);
+}
+
+static void yuv420p_to_rgb24_sse4(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        yuv8_to_rgb24_sse4(dst_buffer, in_frame, width, height / 2 * 2, pitch, 1, false);
+}
+
+static void yuv422p_to_rgb24_sse4(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        yuv8_to_rgb24_sse4(dst_buffer, in_frame, width, height, pitch, 0, false);
+}
+
+static void nv12_to_rgb24_sse4(char *dst_buffer, AVFrame *in_frame,
+                int width, int height, int pitch)
+{
+        yuv8_to_rgb24_sse4(dst_buffer, in_frame, width, height, pitch, 1, true);
+}
+
+#define CONV_SSE4(func) func
+#else
+#define CONV_SSE4(func) NULL
+#endif // defined __SSE4_1__
+
+static const struct av_to_uv_conversion conversions[] = {
+        // 10-bit YUV
+        {AV_PIX_FMT_YUV420P10LE, v210, yuv420p10le_to_v210, CONV_SSE4(yuv420p10le_to_v210_sse4)},
+        {AV_PIX_FMT_YUV420P10LE, UYVY, yuv420p10le_to_uyvy, NULL},
+        {AV_PIX_FMT_YUV420P10LE, RGB, yuv420p10le_to_rgb24, NULL},
+        {AV_PIX_FMT_YUV422P10LE, v210, yuv422p10le_to_v210, CONV_SSE4(yuv422p10le_to_v210_sse4)},
+        {AV_PIX_FMT_YUV422P10LE, UYVY, yuv422p10le_to_uyvy, NULL},
+        {AV_PIX_FMT_YUV422P10LE, RGB, yuv422p10le_to_rgb24, NULL},
+        {AV_PIX_FMT_YUV444P10LE, v210, yuv444p10le_to_v210, NULL},
+        {AV_PIX_FMT_YUV444P10LE, UYVY, yuv444p10le_to_uyvy, NULL},
+        {AV_PIX_FMT_YUV444P10LE, RGB, yuv444p10le_to_rgb24, NULL},
+        // 8-bit YUV
+        {AV_PIX_FMT_YUV420P, v210, yuv420p_to_v210, CONV_SSE4(yuv420p_to_v210_sse4)},
+        {AV_PIX_FMT_YUV420P, UYVY, yuv420p_to_yuv422, NULL},
+        {AV_PIX_FMT_YUV420P, RGB, yuv420p_to_rgb24, CONV_SSE4(yuv420p_to_rgb24_sse4)},
+        {AV_PIX_FMT_YUV422P, v210, yuv422p_to_v210, CONV_SSE4(yuv422p_to_v210_sse4)},
+        {AV_PIX_FMT_YUV422P, UYVY, yuv422p_to_yuv422, NULL},
+        {AV_PIX_FMT_YUV422P, RGB, yuv422p_to_rgb24, CONV_SSE4(yuv422p_to_rgb24_sse4)},
+        {AV_PIX_FMT_YUV444P, v210, yuv444p_to_v210, NULL},
+        {AV_PIX_FMT_YUV444P, UYVY, yuv444p_to_yuv422, NULL},
+        {AV_PIX_FMT_YUV444P, RGB, yuv444p_to_rgb24, NULL},
+        // 8-bit YUV (JPEG color range)
+        {AV_PIX_FMT_YUVJ420P, v210, yuv420p_to_v210, CONV_SSE4(yuv420p_to_v210_sse4)},
+        {AV_PIX_FMT_YUVJ420P, UYVY, yuv420p_to_yuv422, NULL},
+        {AV_PIX_FMT_YUVJ420P, RGB, yuv420p_to_rgb24, CONV_SSE4(yuv420p_to_rgb24_sse4)},
+        {AV_PIX_FMT_YUVJ422P, v210, yuv422p_to_v210, CONV_SSE4(yuv422p_to_v210_sse4)},
+        {AV_PIX_FMT_YUVJ422P, UYVY, yuv422p_to_yuv422, NULL},
+        {AV_PIX_FMT_YUVJ422P, RGB, yuv422p_to_rgb24, CONV_SSE4(yuv422p_to_rgb24_sse4)},
+        {AV_PIX_FMT_YUVJ444P, v210, yuv444p_to_v210, NULL},
+        {AV_PIX_FMT_YUVJ444P, UYVY, yuv444p_to_yuv422, NULL},
+        {AV_PIX_FMT_YUVJ444P, RGB, yuv444p_to_rgb24, NULL},
+        // 8-bit YUV (NV12)
+        {AV_PIX_FMT_NV12, UYVY, nv12_to_yuv422, NULL},
+        {AV_PIX_FMT_NV12, RGB, nv12_to_rgb24, CONV_SSE4(nv12_to_rgb24_sse4)},
+        // RGB
+        {AV_PIX_FMT_RGB24, UYVY, rgb24_to_uyvy, NULL},
+        {AV_PIX_FMT_RGB24, RGB, rgb24_to_rgb, NULL},
+        {AV_PIX_FMT_NONE, VIDEO_CODEC_NONE, NULL, NULL},
+};
+
+const struct av_to_uv_conversion *get_av_to_uv_conversions(void)
+{
+        return conversions;
+}
+
+av_to_uv_convert_t *get_av_to_uv_conversion(int av_codec, codec_t uv_codec, bool simd)
+{
+        for (const struct av_to_uv_conversion *c = conversions; c->convert != NULL; ++c) {
+                if (c->av_codec == av_codec && c->uv_codec == uv_codec) {
+                        return simd && c->convert_simd ? c->convert_simd : c->convert;
+                }
+        }
+        return NULL;
+}
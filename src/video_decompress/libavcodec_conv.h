@@ -0,0 +1,77 @@
+/**
+ * @file   video_decompress/libavcodec_conv.h
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ *
+ * Conversions of frames decoded by libavcodec to UltraGrid pixel formats.
+ */
+/*
+ * Copyright (c) 2013-2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBAVCODEC_CONV_H_
+#define LIBAVCODEC_CONV_H_
+
+#include <stdbool.h>
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct AVFrame;
+
+typedef void av_to_uv_convert_t(char *dst_buffer, struct AVFrame *in_frame, int width, int height, int pitch);
+
+struct av_to_uv_conversion {
+        int av_codec;
+        codec_t uv_codec;
+        av_to_uv_convert_t *convert;
+        /// optional SIMD variant, must be bit-exact with convert
+        av_to_uv_convert_t *convert_simd;
+};
+
+/**
+ * @returns all conversions, the list is terminated by an item with convert == NULL
+ */
+const struct av_to_uv_conversion *get_av_to_uv_conversions(void);
+/**
+ * @param simd  prefer SIMD variant if there is one
+ * @returns     conversion or NULL if not supported
+ */
+av_to_uv_convert_t *get_av_to_uv_conversion(int av_codec, codec_t uv_codec, bool simd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBAVCODEC_CONV_H_
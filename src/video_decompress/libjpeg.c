@@ -0,0 +1,191 @@
+/**
+ * @file   video_decompress/libjpeg.c
+ * @brief  CPU JPEG decompression (libjpeg-turbo)
+ *
+ * Decodes streams produced both by GPUJPEG and by CPU libjpeg compression.
+ * Has lower priority than GPUJPEG decoder (which is thus preferred when
+ * available) but higher than libavcodec.
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "lib_common.h"
+#include "utils/jpeg_slices.h"
+#include "video.h"
+#include "video_decompress.h"
+
+#define MOD_NAME "[libjpeg dec.] "
+
+struct state_decompress_libjpeg {
+        struct jpeg_slices_decoder *decoder;
+
+        struct video_desc desc;
+        int rshift, gshift, bshift;
+        int pitch;
+        codec_t out_codec;
+
+        unsigned char *tmp;   ///< used if output needs to be post-processed
+};
+
+static void *libjpeg_decompress_init(void)
+{
+        struct state_decompress_libjpeg *s = calloc(1, sizeof(struct state_decompress_libjpeg));
+
+        s->decoder = jpeg_slices_decoder_create(0);
+        if (!s->decoder) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to create decoder!\n");
+                free(s);
+                return NULL;
+        }
+
+        return s;
+}
+
+static int libjpeg_decompress_reconfigure(void *state, struct video_desc desc,
+                int rshift, int gshift, int bshift, int pitch, codec_t out_codec)
+{
+        struct state_decompress_libjpeg *s = (struct state_decompress_libjpeg *) state;
+
+        assert(out_codec == RGB || out_codec == UYVY);
+
+        s->desc = desc;
+        s->out_codec = out_codec;
+        s->pitch = pitch;
+        s->rshift = rshift;
+        s->gshift = gshift;
+        s->bshift = bshift;
+
+        free(s->tmp);
+        s->tmp = NULL;
+        if (out_codec == RGB && (rshift != 0 || gshift != 8 || bshift != 16)) {
+                s->tmp = malloc((size_t) vc_get_linesize(desc.width, RGB) * desc.height);
+                if (!s->tmp) {
+                        return FALSE;
+                }
+        }
+
+        return TRUE;
+}
+
+static int libjpeg_decompress(void *state, unsigned char *dst, unsigned char *buffer,
+                unsigned int src_len, int frame_seq)
+{
+        UNUSED(frame_seq);
+        struct state_decompress_libjpeg *s = (struct state_decompress_libjpeg *) state;
+        int width, height;
+
+        if (!jpeg_slices_get_dimensions(buffer, src_len, &width, &height)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Unable to parse JPEG header!\n");
+                return FALSE;
+        }
+        if ((unsigned int) width != s->desc.width || (unsigned int) height != s->desc.height) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Stream dimensions %dx%d do not match "
+                                "expected %ux%u!\n", width, height, s->desc.width, s->desc.height);
+                return FALSE;
+        }
+
+        if (!s->tmp) {
+                return jpeg_slices_decode(s->decoder, buffer, src_len, dst, s->pitch, s->out_codec);
+        }
+
+        int linesize = vc_get_linesize(s->desc.width, RGB);
+        if (!jpeg_slices_decode(s->decoder, buffer, src_len, s->tmp, linesize, RGB)) {
+                return FALSE;
+        }
+        for (unsigned int i = 0; i < s->desc.height; i++) {
+                vc_copylineRGB(dst + (size_t) i * s->pitch, s->tmp + (size_t) i * linesize,
+                                linesize, s->rshift, s->gshift, s->bshift);
+        }
+
+        return TRUE;
+}
+
+static int libjpeg_decompress_get_property(void *state, int property, void *val, size_t *len)
+{
+        UNUSED(state);
+        int ret = FALSE;
+
+        switch(property) {
+                case DECOMPRESS_PROPERTY_ACCEPTS_CORRUPTED_FRAME:
+                        if(*len >= sizeof(int)) {
+                                *(int *) val = FALSE;
+                                *len = sizeof(int);
+                                ret = TRUE;
+                        }
+                        break;
+                default:
+                        ret = FALSE;
+        }
+
+        return ret;
+}
+
+static void libjpeg_decompress_done(void *state)
+{
+        struct state_decompress_libjpeg *s = (struct state_decompress_libjpeg *) state;
+
+        jpeg_slices_decoder_destroy(s->decoder);
+        free(s->tmp);
+        free(s);
+}
+
+static const struct decode_from_to *libjpeg_decompress_get_decoders(void) {
+        static const struct decode_from_to ret[] = {
+		{ JPEG, RGB, 550 },
+		{ JPEG, UYVY, 550 },
+		{ VIDEO_CODEC_NONE, VIDEO_CODEC_NONE, 0 },
+        };
+        return ret;
+}
+
+static const struct video_decompress_info libjpeg_info = {
+        libjpeg_decompress_init,
+        libjpeg_decompress_reconfigure,
+        libjpeg_decompress,
+        libjpeg_decompress_get_property,
+        libjpeg_decompress_done,
+        libjpeg_decompress_get_decoders,
+};
+
+REGISTER_MODULE(libjpeg, &libjpeg_info, LIBRARY_CLASS_VIDEO_DECOMPRESS, VIDEO_DECOMPRESS_ABI_VERSION);
+
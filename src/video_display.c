@@ -80,7 +80,7 @@ struct display {
         void *state;       ///< state of the created video capture driver
 
         struct vo_postprocess_state *postprocess;
-        int pp_output_frames_count, display_pitch;
+        int display_pitch;
         struct video_desc saved_desc;
         enum video_mode saved_mode;
 };
@@ -256,8 +256,9 @@ struct video_frame *display_get_frame(struct display *d)
  * @param frame    frame that has been obtained from display_get_frame() and has not yet been put.
  *                 Should not be NULL unless we want to quit display mainloop.
  * @param flags specifies blocking behavior (@ref display_put_frame_flags)
- * @retval      0  if displayed succesfully
- * @retval      1  if not displayed
+ * @retval      0  if displayed succesfully (or passed to postprocessing)
+ * @retval      1  if not displayed (with postprocessing, refers to a previously
+ *                 put frame, see vo_postprocess_put())
  */
 int display_put_frame(struct display *d, struct video_frame *frame, int flags)
 {
@@ -265,31 +266,30 @@ int display_put_frame(struct display *d, struct video_frame *frame, int flags)
         assert(d->magic == DISPLAY_MAGIC);
 
         if (!frame) {
+                // let the postprocessors output all frames before the poisoned pill
+                vo_postprocess_flush(d->postprocess);
                 return d->funcs->putf(d->state, frame, flags);
         }
 
         if (d->postprocess) {
-                int display_ret = 0;
-		for (int i = 0; i < d->pp_output_frames_count; ++i) {
-			struct video_frame *display_frame = d->funcs->getf(d->state);
-			int ret = vo_postprocess(d->postprocess,
-					frame,
-					display_frame,
-					d->display_pitch);
-                        frame = NULL;
-			if (!ret) {
-				d->funcs->putf(d->state, display_frame, PUTF_DISCARD);
-				return 1;
-			}
-
-			display_ret = d->funcs->putf(d->state, display_frame, flags);
-		}
-                return display_ret;
+                return vo_postprocess_put(d->postprocess, frame, flags);
         } else {
                 return d->funcs->putf(d->state, frame, flags);
         }
 }
 
+static struct video_frame *display_pp_getf(void *udata)
+{
+        struct display *d = (struct display *) udata;
+        return d->funcs->getf(d->state);
+}
+
+static int display_pp_putf(void *udata, struct video_frame *frame, int flags)
+{
+        struct display *d = (struct display *) udata;
+        return d->funcs->putf(d->state, frame, flags);
+}
+
 /**
  * @brief Reconfigure display to new video format.
  *
@@ -333,7 +333,8 @@ int display_reconfigure(struct display *d, struct video_desc desc, enum video_mo
                 }
 		struct video_desc display_desc;
                 int render_mode; // WTF ?
-		vo_postprocess_get_out_desc(d->postprocess, &display_desc, &render_mode, &d->pp_output_frames_count);
+		int pp_output_frames_count;
+		vo_postprocess_get_out_desc(d->postprocess, &display_desc, &render_mode, &pp_output_frames_count);
 		int rc = d->funcs->reconfigure_video(d->state, display_desc);
                 len = sizeof d->display_pitch;
                 d->display_pitch = PITCH_DEFAULT;
@@ -342,6 +343,8 @@ int display_reconfigure(struct display *d, struct video_desc desc, enum video_mo
                 if (d->display_pitch == PITCH_DEFAULT) {
 			d->display_pitch = vc_get_linesize(display_desc.width, display_desc.color_spec);
 		}
+                vo_postprocess_set_output(d->postprocess, display_pp_getf, display_pp_putf, d,
+                                d->display_pitch);
 
                 return rc;
         } else {
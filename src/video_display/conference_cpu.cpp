@@ -0,0 +1,661 @@
+/**
+ * @file   video_display/conference_cpu.cpp
+ * @brief  Conference (MCU-like) display composing participants on CPU
+ *
+ * Counterpart of the conference display for machines without a GPU. Frames
+ * of each participant (UYVY or v210) are scaled directly to UYVY with a
+ * bilinear scaler (vertical pass vectorized), placed in a grid, one-big or
+ * custom layout and the composite is passed to the real display. Only the
+ * participants that sent a new frame since the last composition are scaled
+ * again, each in its own task of the worker pool.
+ */
+/*
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "debug.h"
+#include "lib_common.h"
+#include "utils/mpmc_queue.h"
+#include "utils/worker.h"
+#include "video.h"
+#include "video_codec.h"
+#include "video_display.h"
+
+#define MOD_NAME "[conference CPU] "
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr milliseconds SOURCE_TIMEOUT(500);
+constexpr unsigned int IN_QUEUE_MAX_BUFFER_LEN = 5;
+constexpr double DEFAULT_FPS = 30.0;
+
+enum class layout_type {
+        GRID,    ///< every participant covers equal space
+        ONE_BIG, ///< the first participant takes upper 2/3 of space
+        CUSTOM,  ///< user-given rectangles
+};
+
+struct rect {
+        int x, y, width, height;
+};
+
+struct participant {
+        uint32_t ssrc;
+        struct video_frame *frame; ///< last received frame (owned), NULL until the first one
+        steady_clock::time_point last_seen;
+        struct rect pos;           ///< placement in the composite
+        bool dirty;                ///< needs to be scaled to the composite again
+};
+
+/// bilinear source sample of an output sample, weight is of idx1 in 1/256
+struct sample_pos {
+        int idx0, idx1, weight;
+};
+
+vector<sample_pos> compute_positions(int src_len, int dst_len)
+{
+        vector<sample_pos> ret(dst_len);
+        for (int i = 0; i < dst_len; ++i) {
+                double x = (i + 0.5) * src_len / dst_len - 0.5;
+                x = max(0.0, min<double>(x, src_len - 1));
+                int idx = x;
+                ret[i] = { idx, min(idx + 1, src_len - 1), (int) ((x - idx) * 256.0 + 0.5) };
+        }
+        return ret;
+}
+
+/// dst = a * (1 - weight / 256) + b * weight / 256, bytewise
+void blend_lines(const unsigned char *a, const unsigned char *b, int weight, unsigned char *dst, int len)
+{
+        int i = 0;
+#ifdef __SSE2__
+        const __m128i wa = _mm_set1_epi16(256 - weight);
+        const __m128i wb = _mm_set1_epi16(weight);
+        const __m128i round = _mm_set1_epi16(128);
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= len; i += 16) {
+                __m128i va = _mm_loadu_si128((const __m128i *)(const void *)(a + i));
+                __m128i vb = _mm_loadu_si128((const __m128i *)(const void *)(b + i));
+                // at most 255 * 256 + 128, fits unsigned 16 bits
+                __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+                                        _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb)), round);
+                __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+                                        _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb)), round);
+                _mm_storeu_si128((__m128i *)(void *)(dst + i),
+                                _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+        }
+#endif
+        for (; i < len; ++i) {
+                dst[i] = (a[i] * (256 - weight) + b[i] * weight + 128) >> 8;
+        }
+}
+
+/// scales an UYVY line horizontally, luma and chroma are sampled separately
+void scale_line(const unsigned char *src, unsigned char *dst, const vector<sample_pos> &luma,
+                const vector<sample_pos> &chroma)
+{
+        for (size_t j = 0; j < chroma.size(); ++j) {
+                const sample_pos &c = chroma[j];
+                const unsigned char *c0 = src + c.idx0 * 4;
+                const unsigned char *c1 = src + c.idx1 * 4;
+                dst[4 * j] = (c0[0] * (256 - c.weight) + c1[0] * c.weight + 128) >> 8;
+                dst[4 * j + 2] = (c0[2] * (256 - c.weight) + c1[2] * c.weight + 128) >> 8;
+                for (int k = 0; k < 2; ++k) {
+                        const sample_pos &l = luma[2 * j + k];
+                        dst[4 * j + 1 + 2 * k] = (src[l.idx0 * 2 + 1] * (256 - l.weight) +
+                                        src[l.idx1 * 2 + 1] * l.weight + 128) >> 8;
+                }
+        }
+}
+
+struct scale_task {
+        const struct video_frame *frame;
+        unsigned char *dst;  ///< upper left corner in the composite
+        int dst_pitch;
+        int dst_width;       ///< even
+        int dst_height;
+};
+
+/**
+ * Scales one participant to its place in the composite. Vertical pass is
+ * done first (on whole source lines, vectorized), so that the scalar
+ * horizontal pass runs only once per output line.
+ */
+void *scale_participant(void *arg)
+{
+        auto t = static_cast<struct scale_task *>(arg);
+        const struct tile *src = &t->frame->tiles[0];
+        codec_t codec = t->frame->color_spec;
+        int src_pitch = vc_get_linesize(src->width, codec);
+        int line_len = vc_get_linesize(src->width, UYVY);
+
+        vector<sample_pos> luma = compute_positions(src->width, t->dst_width);
+        vector<sample_pos> chroma = compute_positions(max<int>(1, src->width / 2), t->dst_width / 2);
+        vector<sample_pos> lines = compute_positions(src->height, t->dst_height);
+
+        // UYVY lines converted from v210, indexed by source line
+        unique_ptr<unsigned char []> converted[2];
+        int converted_idx[2] = { -1, -1 };
+        if (codec == v210) {
+                converted[0] = unique_ptr<unsigned char []>(new unsigned char[line_len]);
+                converted[1] = unique_ptr<unsigned char []>(new unsigned char[line_len]);
+        }
+        auto get_line = [&](int y) -> const unsigned char * {
+                const unsigned char *line = (const unsigned char *) src->data + (size_t) y * src_pitch;
+                if (codec != v210) {
+                        return line;
+                }
+                for (int i = 0; i < 2; ++i) {
+                        if (converted_idx[i] == y) {
+                                return converted[i].get();
+                        }
+                }
+                // replace the line that won't be needed anymore (lines are accessed in ascending order)
+                int i = converted_idx[0] < converted_idx[1] ? 0 : 1;
+                vc_copylinev210(converted[i].get(), line, line_len);
+                converted_idx[i] = y;
+                return converted[i].get();
+        };
+
+        unique_ptr<unsigned char []> blended(new unsigned char[line_len]);
+        for (int y = 0; y < t->dst_height; ++y) {
+                const sample_pos &l = lines[y];
+                const unsigned char *line = get_line(l.idx0);
+                if (l.weight != 0) {
+                        const unsigned char *line0 = line; // get_line() may reuse the other buffer
+                        const unsigned char *line1 = get_line(l.idx1);
+                        blend_lines(line0, line1, l.weight, blended.get(), line_len);
+                        line = blended.get();
+                }
+                scale_line(line, t->dst + (size_t) y * t->dst_pitch, luma, chroma);
+        }
+
+        return t;
+}
+
+struct state_conference_cpu_common {
+        ~state_conference_cpu_common() {
+                display_done(real_display);
+                for (auto &p : participants) {
+                        vf_free(p.frame);
+                }
+        }
+
+        struct display *real_display = nullptr;
+        struct video_desc display_desc = {};
+
+        int width = 0;
+        int height = 0;
+        double fps = 0.0;
+        bool autofps = false;
+        layout_type layout = layout_type::GRID;
+        vector<struct rect> custom_layout;
+
+        mpmc_queue<struct video_frame *, IN_QUEUE_MAX_BUFFER_LEN> incoming_queue;
+        vector<struct participant> participants; ///< in order of joining
+        unique_ptr<unsigned char []> composite;  ///< UYVY
+        steady_clock::time_point next_frame;
+
+        pthread_t thread_id = {};
+
+        struct module *parent = nullptr;
+};
+
+struct state_conference_cpu {
+        shared_ptr<struct state_conference_cpu_common> common;
+        struct video_desc desc;
+};
+
+/// black UYVY
+void clear_composite(struct state_conference_cpu_common *s)
+{
+        uint32_t black;
+        memcpy(&black, "\x80\x10\x80\x10", sizeof black);
+        uint32_t *p = (uint32_t *)(void *) s->composite.get();
+        fill(p, p + (size_t) s->width * s->height / 2, black);
+}
+
+/// fits participant frame to the area keeping aspect ratio, centered
+struct rect fit_to(const struct video_frame *frame, struct rect area)
+{
+        double scale = min((double) area.width / frame->tiles[0].width,
+                        (double) area.height / frame->tiles[0].height);
+        int width = max(2, (int) (frame->tiles[0].width * scale) & ~1);
+        int height = max(1, (int) (frame->tiles[0].height * scale));
+        return { (area.x + (area.width - width) / 2) & ~1, area.y + (area.height - height) / 2,
+                width, height };
+}
+
+void compute_layout(struct state_conference_cpu_common *s)
+{
+        int count = s->participants.size();
+        int small_h = s->height / 3;
+        int big_h = small_h * 2;
+        int cols = s->layout == layout_type::ONE_BIG ? max(1, count - 1) : (int) ceil(sqrt(count));
+
+        for (int i = 0; i < count; ++i) {
+                struct participant &p = s->participants[i];
+                struct rect area;
+                if (count == 1 && s->layout != layout_type::CUSTOM) {
+                        area = { 0, 0, s->width, s->height };
+                } else if (s->layout == layout_type::ONE_BIG) {
+                        area = i == 0 ? rect{ 0, 0, s->width, big_h } :
+                                rect{ (i - 1) * (s->width / cols), big_h, s->width / cols, small_h };
+                } else if (s->layout == layout_type::CUSTOM) {
+                        area = i < (int) s->custom_layout.size() ? s->custom_layout[i] : rect{ 0, 0, 0, 0 };
+                } else {
+                        area = { (i % cols) * (s->width / cols), (i / cols) * (s->height / cols),
+                                s->width / cols, s->height / cols };
+                }
+                p.pos = p.frame && area.width >= 2 && area.height >= 1 ? fit_to(p.frame, area) : rect{ 0, 0, 0, 0 };
+                p.dirty = true;
+        }
+
+        clear_composite(s);
+}
+
+void compose(struct state_conference_cpu_common *s)
+{
+        vector<struct scale_task> tasks;
+        int pitch = vc_get_linesize(s->width, UYVY);
+        for (auto &p : s->participants) {
+                if (!p.dirty || !p.frame || p.pos.width == 0) {
+                        continue;
+                }
+                tasks.push_back({ p.frame, s->composite.get() + (size_t) p.pos.y * pitch + p.pos.x * 2,
+                                pitch, p.pos.width, p.pos.height });
+                p.dirty = false;
+        }
+        if (!tasks.empty()) {
+                task_run_parallel(scale_participant, tasks.size(), tasks.data(), sizeof tasks[0], NULL);
+        }
+}
+
+struct display *display_conference_cpu_fork(void *state)
+{
+        shared_ptr<struct state_conference_cpu_common> s = ((struct state_conference_cpu *)state)->common;
+        struct display *out;
+        char fmt[2 + sizeof(void *) * 2 + 1] = "";
+        snprintf(fmt, sizeof fmt, "%p", state);
+
+        int rc = initialize_video_display(s->parent,
+                        "conference_cpu", fmt, 0, NULL, &out);
+        return rc == 0 ? out : NULL;
+}
+
+void show_help()
+{
+        printf("Conference display composing on CPU\n");
+        printf("Usage:\n");
+        printf("\t-d conference_cpu:<display_config>#<width>:<height>[:<fps>][#<layout>]\n");
+        printf("\t\t<layout> - grid (default), big (first participant enlarged) or custom\n"
+                        "\t\t\tplacement <x>,<y>,<w>,<h>[/<x>,<y>,<w>,<h>...] in pixels,\n"
+                        "\t\t\tassigned to participants in order of joining\n");
+}
+
+bool parse_layout(struct state_conference_cpu_common *s, const char *cfg)
+{
+        if (strcmp(cfg, "grid") == 0) {
+                s->layout = layout_type::GRID;
+                return true;
+        }
+        if (strcmp(cfg, "big") == 0) {
+                s->layout = layout_type::ONE_BIG;
+                return true;
+        }
+        s->layout = layout_type::CUSTOM;
+        string spec = cfg;
+        size_t start = 0;
+        while (start < spec.size()) {
+                size_t end = spec.find('/', start);
+                string item = spec.substr(start, end == string::npos ? string::npos : end - start);
+                struct rect r;
+                if (sscanf(item.c_str(), "%d,%d,%d,%d", &r.x, &r.y, &r.width, &r.height) != 4 ||
+                                r.x < 0 || r.y < 0 || r.width <= 0 || r.height <= 0 ||
+                                r.x + r.width > s->width || r.y + r.height > s->height) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong layout item: %s\n", item.c_str());
+                        return false;
+                }
+                s->custom_layout.push_back(r);
+                start = end == string::npos ? spec.size() : end + 1;
+        }
+        return !s->custom_layout.empty();
+}
+
+static void *display_run_thread(void *arg)
+{
+        display_run((struct display *) arg);
+        return NULL;
+}
+
+void *display_conference_cpu_init(struct module *parent, const char *fmt, unsigned int flags)
+{
+        if (fmt && isdigit(fmt[0])) { // fork
+                struct state_conference_cpu *orig;
+                sscanf(fmt, "%p", &orig);
+                auto s = new state_conference_cpu();
+                s->common = orig->common;
+                return s;
+        }
+        if (!fmt || strchr(fmt, '#') == NULL || strcmp(fmt, "help") == 0) {
+                show_help();
+                return &display_init_noerr;
+        }
+
+        auto common = make_shared<state_conference_cpu_common>();
+        string display_cfg(fmt, strchr(fmt, '#'));
+        const char *mosaic_cfg = strchr(fmt, '#') + 1;
+        double fps = 0.0;
+        if (sscanf(mosaic_cfg, "%d:%d:%lf", &common->width, &common->height, &fps) < 2 ||
+                        common->width <= 0 || common->height <= 0) {
+                show_help();
+                return NULL;
+        }
+        common->width &= ~1;
+        common->fps = fps;
+        common->autofps = fps <= 0.0;
+        if (strchr(mosaic_cfg, '#') && !parse_layout(common.get(), strchr(mosaic_cfg, '#') + 1)) {
+                return NULL;
+        }
+
+        string requested_display = display_cfg.substr(0, display_cfg.find(':'));
+        const char *cfg = display_cfg.find(':') == string::npos ? NULL :
+                display_cfg.c_str() + display_cfg.find(':') + 1;
+        if (initialize_video_display(parent, requested_display.c_str(), cfg, flags, NULL,
+                                &common->real_display) != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to initialize display %s!\n",
+                                requested_display.c_str());
+                return NULL;
+        }
+        common->composite = unique_ptr<unsigned char []>(new unsigned char[
+                        (size_t) vc_get_linesize(common->width, UYVY) * common->height]);
+        clear_composite(common.get());
+
+        int ret = pthread_create(&common->thread_id, NULL, display_run_thread,
+                        common->real_display);
+        assert (ret == 0);
+
+        common->parent = parent;
+
+        auto s = new state_conference_cpu();
+        s->common = common;
+        return s;
+}
+
+void check_reconf(struct state_conference_cpu_common *s)
+{
+        struct video_desc desc{};
+        desc.width = s->width;
+        desc.height = s->height;
+        desc.fps = s->fps;
+        desc.color_spec = UYVY;
+        desc.interlacing = PROGRESSIVE;
+        desc.tile_count = 1;
+
+        if (!video_desc_eq(desc, s->display_desc)) {
+                s->display_desc = desc;
+                ostringstream oss;
+                oss << desc;
+                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Output reconfigured to %s\n", oss.str().c_str());
+                display_reconfigure(s->real_display, s->display_desc, VIDEO_NORMAL);
+        }
+}
+
+/// @returns true if layout needs to be recomputed
+bool process_frame(struct state_conference_cpu_common *s, struct video_frame *frame,
+                steady_clock::time_point now)
+{
+        auto it = find_if(s->participants.begin(), s->participants.end(),
+                        [frame](const struct participant &p) { return p.ssrc == frame->ssrc; });
+        bool relayout = false;
+        if (it == s->participants.end()) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "New source 0x%08x.\n", frame->ssrc);
+                if (s->participants.empty()) {
+                        s->next_frame = now;
+                }
+                s->participants.push_back({ frame->ssrc, NULL, now, {}, true });
+                it = s->participants.end() - 1;
+                relayout = true;
+        } else if (it->frame && (it->frame->tiles[0].width != frame->tiles[0].width ||
+                                it->frame->tiles[0].height != frame->tiles[0].height)) {
+                relayout = true;
+        }
+        if (s->autofps && frame->fps > s->fps) {
+                s->fps = frame->fps;
+        }
+        relayout = relayout || it->frame == NULL;
+        vf_free(it->frame);
+        it->frame = frame;
+        it->last_seen = now;
+        it->dirty = true;
+
+        return relayout;
+}
+
+void display_conference_cpu_run(void *state)
+{
+        shared_ptr<struct state_conference_cpu_common> s = ((struct state_conference_cpu *)state)->common;
+        uint32_t last_ssrc = 0;
+
+        while (1) {
+                struct video_frame *frame = NULL;
+                bool received;
+                if (s->participants.empty()) {
+                        frame = s->incoming_queue.pop();
+                        received = true;
+                } else {
+                        received = s->incoming_queue.timed_pop(frame, s->next_frame - steady_clock::now());
+                }
+                if (received && !frame) {
+                        display_put_frame(s->real_display, NULL, PUTF_BLOCKING);
+                        break;
+                }
+
+                steady_clock::time_point now = steady_clock::now();
+                bool relayout = false;
+                if (frame) {
+                        if (frame->color_spec != UYVY && frame->color_spec != v210) {
+                                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Unsupported codec %s!\n",
+                                                get_codec_name(frame->color_spec));
+                                vf_free(frame);
+                        } else {
+                                last_ssrc = frame->ssrc;
+                                relayout = process_frame(s.get(), frame, now);
+                        }
+                }
+
+                for (auto it = s->participants.begin(); it != s->participants.end(); ) {
+                        if (now - it->last_seen > SOURCE_TIMEOUT) {
+                                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Source 0x%08x timeout. Deleting from "
+                                                "conference display.\n", it->ssrc);
+                                vf_free(it->frame);
+                                it = s->participants.erase(it);
+                                relayout = true;
+                        } else {
+                                ++it;
+                        }
+                }
+                if (relayout) {
+                        compute_layout(s.get());
+                }
+
+                if (s->participants.empty() || now < s->next_frame) {
+                        continue;
+                }
+
+                compose(s.get());
+                check_reconf(s.get());
+                struct video_frame *out = display_get_frame(s->real_display);
+                memcpy(out->tiles[0].data, s->composite.get(), out->tiles[0].data_len);
+                out->ssrc = last_ssrc;
+                display_put_frame(s->real_display, out, PUTF_BLOCKING);
+
+                auto period = duration_cast<steady_clock::duration>(
+                                duration<double>(1.0 / (s->fps > 0.0 ? s->fps : DEFAULT_FPS)));
+                s->next_frame += period;
+                if (s->next_frame < now) { // do not try to catch up after a stall
+                        s->next_frame = now + period;
+                }
+        }
+
+        pthread_join(s->thread_id, NULL);
+}
+
+void display_conference_cpu_done(void *state)
+{
+        delete (struct state_conference_cpu *) state;
+}
+
+struct video_frame *display_conference_cpu_getf(void *state)
+{
+        struct state_conference_cpu *s = (struct state_conference_cpu *) state;
+
+        return vf_alloc_desc_data(s->desc);
+}
+
+int display_conference_cpu_putf(void *state, struct video_frame *frame, int flags)
+{
+        shared_ptr<struct state_conference_cpu_common> s = ((struct state_conference_cpu *)state)->common;
+
+        if (flags == PUTF_DISCARD) {
+                vf_free(frame);
+        } else {
+                if (s->incoming_queue.try_push(move(frame))) {
+                        return 0;
+                }
+                if (flags == PUTF_NONBLOCK) {
+                        return 1;
+                }
+                s->incoming_queue.push(frame);
+        }
+
+        return 0;
+}
+
+int display_conference_cpu_get_property(void *state, int property, void *val, size_t *len)
+{
+        shared_ptr<struct state_conference_cpu_common> s = ((struct state_conference_cpu *)state)->common;
+        codec_t codecs[] = { UYVY, v210 };
+
+        switch (property) {
+        case DISPLAY_PROPERTY_SUPPORTS_MULTI_SOURCES:
+                ((struct multi_sources_supp_info *) val)->val = true;
+                ((struct multi_sources_supp_info *) val)->fork_display = display_conference_cpu_fork;
+                ((struct multi_sources_supp_info *) val)->state = state;
+                *len = sizeof(struct multi_sources_supp_info);
+                return TRUE;
+        case DISPLAY_PROPERTY_CODECS:
+                if (*len < sizeof codecs) {
+                        return FALSE;
+                }
+                memcpy(val, codecs, sizeof codecs);
+                *len = sizeof codecs;
+                return TRUE;
+        case DISPLAY_PROPERTY_BUF_PITCH:
+                *(int *) val = PITCH_DEFAULT;
+                *len = sizeof(int);
+                return TRUE;
+        case DISPLAY_PROPERTY_VIDEO_MODE:
+                *(int *) val = DISPLAY_PROPERTY_VIDEO_MERGED;
+                *len = sizeof(int);
+                return TRUE;
+        default:
+                return display_get_property(s->real_display, property, val, len);
+        }
+}
+
+int display_conference_cpu_reconfigure(void *state, struct video_desc desc)
+{
+        struct state_conference_cpu *s = (struct state_conference_cpu *) state;
+
+        s->desc = desc;
+
+        return 1;
+}
+
+void display_conference_cpu_put_audio_frame(void *state, struct audio_frame *frame)
+{
+        UNUSED(state);
+        UNUSED(frame);
+}
+
+int display_conference_cpu_reconfigure_audio(void *state, int quant_samples, int channels,
+                int sample_rate)
+{
+        UNUSED(state);
+        UNUSED(quant_samples);
+        UNUSED(channels);
+        UNUSED(sample_rate);
+
+        return FALSE;
+}
+
+const struct video_display_info display_conference_cpu_info = {
+        [](struct device_info **available_cards, int *count) {
+                *available_cards = nullptr;
+                *count = 0;
+        },
+        display_conference_cpu_init,
+        display_conference_cpu_run,
+        display_conference_cpu_done,
+        display_conference_cpu_getf,
+        display_conference_cpu_putf,
+        display_conference_cpu_reconfigure,
+        display_conference_cpu_get_property,
+        display_conference_cpu_put_audio_frame,
+        display_conference_cpu_reconfigure_audio,
+};
+
+REGISTER_MODULE(conference_cpu, &display_conference_cpu_info, LIBRARY_CLASS_VIDEO_DISPLAY, VIDEO_DISPLAY_ABI_VERSION);
+
+} // end of anonymous namespace
+
@@ -44,16 +44,14 @@
 #include "config_win32.h"
 #include "debug.h"
 #include "lib_common.h"
+#include "utils/mpmc_queue.h"
 #include "video.h"
 #include "video_display.h"
 
-#include <condition_variable>
 #include <chrono>
 #include <list>
 #include <map>
 #include <memory>
-#include <mutex>
-#include <queue>
 #include <unordered_map>
 
 using namespace std;
@@ -82,16 +80,12 @@ struct state_proxy_common {
 
         int transition;
 
-        queue<struct video_frame *> incoming_queue;
-        condition_variable in_queue_decremented_cv;
+        mpmc_queue<struct video_frame *, IN_QUEUE_MAX_BUFFER_LEN> incoming_queue;
         map<uint32_t, list<struct video_frame *> > frames;
         unordered_map<uint32_t, chrono::system_clock::time_point> disabled_ssrc;
 
         pthread_t thread_id;
 
-        mutex lock;
-        condition_variable cv;
-
         struct module *parent;
 };
 
@@ -168,14 +162,7 @@ static void display_proxy_run(void *state)
         int skipped = 0;
 
         while (1) {
-                struct video_frame *frame;
-                {
-                        unique_lock<mutex> lg(s->lock);
-                        s->cv.wait(lg, [s]{return s->incoming_queue.size() > 0;});
-                        frame = s->incoming_queue.front();
-                        s->incoming_queue.pop();
-                        s->in_queue_decremented_cv.notify_one();
-                }
+                struct video_frame *frame = s->incoming_queue.pop();
 
                 if (!frame) {
                         display_put_frame(s->real_display, NULL, PUTF_BLOCKING);
@@ -340,17 +327,14 @@ static int display_proxy_putf(void *state, struct video_frame *frame, int flags)
         if (flags == PUTF_DISCARD) {
                 vf_free(frame);
         } else {
-                unique_lock<mutex> lg(s->lock);
-                if (s->incoming_queue.size() >= IN_QUEUE_MAX_BUFFER_LEN) {
-                        fprintf(stderr, "Proxy: queue full!\n");
+                if (s->incoming_queue.try_push(move(frame))) {
+                        return 0;
                 }
-                if (flags == PUTF_NONBLOCK && s->incoming_queue.size() >= IN_QUEUE_MAX_BUFFER_LEN) {
+                fprintf(stderr, "Proxy: queue full!\n");
+                if (flags == PUTF_NONBLOCK) {
                         return 1;
                 }
-                s->in_queue_decremented_cv.wait(lg, [s]{return s->incoming_queue.size() < IN_QUEUE_MAX_BUFFER_LEN;});
                 s->incoming_queue.push(frame);
-                lg.unlock();
-                s->cv.notify_one();
         }
 
         return 0;
@@ -46,9 +46,11 @@
 
 #include "debug.h"
 
+#include <algorithm>
 #include <sstream>
 #include <string>
 #include <stdexcept>
+#include <vector>
 
 #include "host.h"
 #include "ihdtv.h"
@@ -71,8 +73,74 @@
 #include "video_display.h"
 #include "video_rxtx.h"
 
+#define DEFAULT_RTX_WINDOW_MS 50
+#define DEFAULT_RTX_RING_SIZE 8192
+
 using namespace std;
 
+ADD_TO_PARAM(rtx, "rtx",
+                "* rtx[=<window_ms>]\n"
+                "  Request retransmission of lost video packets with RTCP NACKs (must be set on both sides).\n"
+                "  Receiver extends the playout delay by window_ms (default 50),\n"
+                "  sender does not resend older packets.\n");
+ADD_TO_PARAM(rtx_ring, "rtx-ring",
+                "* rtx-ring=<packets>\n"
+                "  Number of last sent packets kept by the sender for retransmission (default 8192)\n");
+ADD_TO_PARAM(stripe, "stripe",
+                "* stripe[=<paths>]\n"
+                "  Spread packets of the video stream over multiple paths (must be set on both sides with\n"
+                "  the same count of paths) instead of splitting the frame among comma-separated receivers.\n"
+                "  Path n is sent to n-th receiver address (or the last one) and uses ports following the\n"
+                "  base ones (skipping audio ports), eg. 5004, 5008, 5010...\n");
+ADD_TO_PARAM(rate_control, "rate-control",
+                "* rate-control[=<max_bitrate>[:<min_bitrate>]]\n"
+                "  Adapt bitrate of libavcodec encoder to packet loss reported by the receiver (must be set\n"
+                "  on both sides, receiver ignores the values). max_bitrate should match the bitrate set\n"
+                "  to the encoder (eg. -c libavcodec:encoder=libx264:bitrate=20M), min_bitrate is 1/10 of\n"
+                "  it by default.\n");
+
+/**
+ * Adds paths 1..path_count-1 for striping to the session.
+ */
+static bool add_stripe_paths(struct rtp *session, const char *addrs, int path_count,
+                int recv_port_base, int send_port_base, int ttl, bool use_ipv6, const char *mcast_if)
+{
+        vector<string> addr_list;
+        istringstream iss(addrs);
+        string addr;
+        while (getline(iss, addr, ',')) {
+                addr_list.push_back(addr);
+        }
+
+        int recv_port = recv_port_base;
+        int send_port = send_port_base;
+        for (int i = 1; i < path_count; ++i) {
+                /* port + 2 is reserved for audio, port 0 means any */
+                if (recv_port != 0) {
+                        recv_port += recv_port == recv_port_base ? 4 : 2;
+                }
+                if (send_port != 0) {
+                        send_port += send_port == send_port_base ? 4 : 2;
+                }
+                addr = addr_list[min<size_t>(i, addr_list.size() - 1)];
+                if (!rtp_add_path(session, addr.c_str(), mcast_if, recv_port, send_port, ttl, use_ipv6)) {
+                        log_msg(LOG_LEVEL_ERROR, "Unable to create path %d to %s.\n", i, addr.c_str());
+                        return false;
+                }
+        }
+        log_msg(LOG_LEVEL_NOTICE, "Striping video over %d paths.\n", path_count);
+        return true;
+}
+
+int rtp_video_rxtx::get_rtx_window_ms()
+{
+        const char *window = get_commandline_param("rtx");
+        if (window == nullptr) {
+                return 0;
+        }
+        return atoi(window) > 0 ? atoi(window) : DEFAULT_RTX_WINDOW_MS;
+}
+
 struct response *rtp_video_rxtx::process_sender_message(struct msg_sender *msg, int *status)
 {
         *status = 0;
@@ -312,6 +380,13 @@ struct rtp **rtp_video_rxtx::initialize_network(const char *addrs, int recv_port
         free(tmp);
         tmp = strdup(addrs);
 
+        // when striping, one session is created and all receivers are its paths
+        int path_count = 1;
+        if (get_commandline_param("stripe") != NULL) {
+                path_count = max(required_connections, atoi(get_commandline_param("stripe")));
+                required_connections = 1;
+        }
+
         devices = (struct rtp **)
                 malloc((required_connections + 1) * sizeof(struct rtp *));
 
@@ -329,6 +404,11 @@ struct rtp **rtp_video_rxtx::initialize_network(const char *addrs, int recv_port
                                 send_port, ttl, rtcp_bw, FALSE,
                                 rtp_recv_callback, (uint8_t *)participants,
                                 use_ipv6, true);
+                if (devices[index] != NULL && path_count > 1 && !add_stripe_paths(devices[index],
+                                        addrs, path_count, recv_port, send_port, ttl, use_ipv6, mcast_if)) {
+                        rtp_done(devices[index]);
+                        devices[index] = NULL;
+                }
                 if (devices[index] != NULL) {
                         rtp_set_option(devices[index], RTP_OPT_WEAK_VALIDATION,
                                 TRUE);
@@ -346,6 +426,19 @@ struct rtp **rtp_video_rxtx::initialize_network(const char *addrs, int recv_port
 
                         rtp_set_send_buf(devices[index], INITIAL_VIDEO_SEND_BUFFER_SIZE);
 
+                        if (get_rtx_window_ms() > 0) {
+                                const char *ring = get_commandline_param("rtx-ring");
+                                int ring_size = ring && atoi(ring) > 0 ? atoi(ring) : DEFAULT_RTX_RING_SIZE;
+                                if (!rtp_enable_retransmission(devices[index], ring_size, get_rtx_window_ms())) {
+                                        log_msg(LOG_LEVEL_WARNING, "Unable to allocate retransmission buffer.\n");
+                                }
+                        }
+
+                        if (get_commandline_param("rate-control") != NULL &&
+                                        !rtp_enable_loss_reports(devices[index])) {
+                                log_msg(LOG_LEVEL_WARNING, "Unable to enable loss reports.\n");
+                        }
+
                         pdb_add(participants, rtp_my_ssrc(devices[index]));
                 }
                 else {
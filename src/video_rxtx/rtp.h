@@ -66,6 +66,8 @@ public:
                         const char *mcast_if);
         void destroy_rtp_devices(struct rtp ** network_devices);
         static void display_buf_increase_warning(int size);
+        /// @returns retransmission window requested with "--param rtx" in ms or 0 if disabled
+        static int get_rtx_window_ms();
 
 protected:
         int m_connections_count;
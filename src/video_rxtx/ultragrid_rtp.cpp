@@ -61,9 +61,12 @@
 #include "rtp/rtp_callback.h"
 #include "rtp/video_decoders.h"
 #include "rtp/pbuf.h"
+#include "rtp/rate_control.h"
 #include "tfrc.h"
 #include "transmit.h"
 #include "tv.h"
+#include "utils/misc.h"
+#include "utils/pipeline_stats.h"
 #include "utils/vf_split.h"
 #include "video.h"
 #include "video_compress.h"
@@ -74,9 +77,13 @@
 #include "utils/worker.h"
 
 #include <chrono>
+#include <climits>
 #include <sstream>
 #include <utility>
 
+#define MAX_NACKS_PER_ITERATION 256
+#define MAX_RTCP_PER_FRAME 16
+
 using namespace std;
 
 ultragrid_rtp_video_rxtx::ultragrid_rtp_video_rxtx(const map<string, param_u> &params) :
@@ -88,6 +95,26 @@ ultragrid_rtp_video_rxtx::ultragrid_rtp_video_rxtx(const map<string, param_u> &p
         m_async_sending = false;
 
         m_control = (struct control_state *) get_module(get_root_module(static_cast<struct module *>(params.at("parent").ptr)), "control");
+
+        const char *rate_cfg = get_commandline_param("rate-control");
+        if (rate_cfg != nullptr && strlen(rate_cfg) > 0 && (m_rxtx_mode & MODE_SENDER) != 0) {
+                if (strncasecmp(static_cast<const char *>(params.at("compression").ptr), "libavcodec", strlen("libavcodec")) != 0) {
+                        log_msg(LOG_LEVEL_WARNING, "[rate control] Supported only with libavcodec compression, disabled.\n");
+                } else {
+                        string max_str = rate_cfg;
+                        string min_str;
+                        if (max_str.find(':') != string::npos) {
+                                min_str = max_str.substr(max_str.find(':') + 1);
+                                max_str = max_str.substr(0, max_str.find(':'));
+                        }
+                        long long max_bitrate = unit_evaluate(max_str.c_str());
+                        long long min_bitrate = min_str.empty() ? max_bitrate / 10 : unit_evaluate(min_str.c_str());
+                        if (max_bitrate <= 0 || min_bitrate <= 0) {
+                                throw string("Wrong rate-control bitrate!");
+                        }
+                        m_rate_control = unique_ptr<rate_control>(new rate_control(max_bitrate, min_bitrate));
+                }
+        }
 }
 
 ultragrid_rtp_video_rxtx::~ultragrid_rtp_video_rxtx()
@@ -116,7 +143,9 @@ void *(*ultragrid_rtp_video_rxtx::get_receiver_thread())(void *arg) {
 void ultragrid_rtp_video_rxtx::send_frame(shared_ptr<video_frame> tx_frame)
 {
         if (m_fec_state) {
+                uint64_t cpu_start = pipeline_stats_begin();
                 tx_frame = m_fec_state->encode(tx_frame);
+                pipeline_stats_end(PIPELINE_STAGE_SEND, cpu_start);
         }
 
         auto data = new pair<ultragrid_rtp_video_rxtx *, shared_ptr<video_frame>>(this, tx_frame);
@@ -145,6 +174,8 @@ void ultragrid_rtp_video_rxtx::send_frame_async(shared_ptr<video_frame> tx_frame
 
         int buffer_id = tx_get_buffer_id(m_tx);
 
+        uint64_t cpu_start = pipeline_stats_begin();
+
         if (m_paused) {
                 goto after_send;
         }
@@ -165,6 +196,8 @@ void ultragrid_rtp_video_rxtx::send_frame_async(shared_ptr<video_frame> tx_frame
 
                 vf_free(split_frames);
         }
+        pipeline_stats_end(PIPELINE_STAGE_SEND, cpu_start);
+        pipeline_stats_frame(PIPELINE_STAGE_SEND);
 
         if ((m_rxtx_mode & MODE_RECEIVER) == 0) { // otherwise receiver thread does the stuff...
                 struct timeval curr_time;
@@ -174,13 +207,26 @@ void ultragrid_rtp_video_rxtx::send_frame_async(shared_ptr<video_frame> tx_frame
                 rtp_update(m_network_devices[0], curr_time);
                 rtp_send_ctrl(m_network_devices[0], ts, 0, curr_time);
 
-                // receive RTCP
-                struct timeval timeout;
-                timeout.tv_sec = 0;
-                timeout.tv_usec = 0;
-                rtp_recv_r(m_network_devices[0], &timeout, ts);
+                // receive RTCP - loss (UGLR) and stripe (UGSP) reports must be
+                // drained completely, otherwise feedback lags behind the stream
+                int max_rtcp = 1;
+                if (m_rate_control || get_commandline_param("stripe") != NULL) {
+                        max_rtcp = INT_MAX;
+                } else if (get_rtx_window_ms() > 0) {
+                        max_rtcp = MAX_RTCP_PER_FRAME;
+                }
+                for (int i = 0; i < max_rtcp; ++i) {
+                        struct timeval timeout;
+                        timeout.tv_sec = 0;
+                        timeout.tv_usec = 0;
+                        if (!rtp_recv_r(m_network_devices[0], &timeout, ts)) {
+                                break;
+                        }
+                }
         }
 
+        adjust_bitrate();
+
 after_send:
         m_async_sending_lock.lock();
         m_async_sending = false;
@@ -222,6 +268,30 @@ after_send:
         }
 }
 
+/**
+ * Passes the bitrate computed by the rate control from the last loss report
+ * to the compression.
+ */
+void ultragrid_rtp_video_rxtx::adjust_bitrate()
+{
+        double loss;
+        if (!m_rate_control || !rtp_get_loss(m_network_devices[0], &loss)) {
+                return;
+        }
+        long long bitrate = m_rate_control->update(loss, std::chrono::steady_clock::now());
+        if (bitrate == 0) {
+                return;
+        }
+        log_msg(LOG_LEVEL_INFO, "[rate control] Loss %.1f %%, setting bitrate to %.2f Mbps.\n",
+                        loss * 100.0, bitrate / 1000000.0);
+
+        struct msg_change_compress_data *msg = (struct msg_change_compress_data *)
+                new_message(sizeof(struct msg_change_compress_data));
+        msg->what = CHANGE_PARAMS;
+        snprintf(msg->config_string, sizeof msg->config_string, "bitrate=%lld", bitrate);
+        free_response(send_message(&m_sender_mod, "compress", (struct message *) msg));
+}
+
 void ultragrid_rtp_video_rxtx::receiver_process_messages()
 {
         struct msg_receiver *msg;
@@ -347,6 +417,7 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
         fr = 1;
 
         auto last_not_timeout = std::chrono::steady_clock::time_point::min();
+        const auto rtx_window = std::chrono::milliseconds(get_rtx_window_ms());
 
         while (!should_exit) {
                 struct timeval timeout;
@@ -375,7 +446,11 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                 } else {
                         timeout.tv_usec = 1000;
                 }
+                uint64_t cpu_start = pipeline_stats_begin();
                 ret = rtp_recv_r(m_network_devices[0], &timeout, ts);
+                pipeline_stats_end(PIPELINE_STAGE_RECEIVE, cpu_start);
+                rtp_send_path_report(m_network_devices[0]);
+                rtp_send_loss_report(m_network_devices[0]);
 
                 // timeout
                 if (ret == FALSE) {
@@ -431,6 +506,16 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                                         break;
                                 }
 #endif // SHARED_DECODER
+                                pbuf_set_nack_window(cp->playout_buffer, rtx_window);
+                        }
+
+                        if (rtx_window.count() > 0 && cp->decoder_state != NULL) {
+                                uint16_t seqs[MAX_NACKS_PER_ITERATION];
+                                int count = pbuf_get_nacks(cp->playout_buffer, curr_time_hr,
+                                                seqs, MAX_NACKS_PER_ITERATION);
+                                if (count > 0) {
+                                        rtp_send_nack(m_network_devices[0], cp->ssrc, seqs, count);
+                                }
                         }
 
                         struct vcodec_state *vdecoder_state = (struct vcodec_state *) cp->decoder_state;
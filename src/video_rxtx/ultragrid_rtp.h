@@ -44,10 +44,12 @@
 #include <condition_variable>
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 
 struct control_state;
+struct rate_control;
 
 class ultragrid_rtp_video_rxtx : public rtp_video_rxtx {
 public:
@@ -67,6 +69,7 @@ private:
         virtual void *(*get_receiver_thread())(void *arg);
 
         void receiver_process_messages();
+        void adjust_bitrate();
         void remove_display_from_decoders();
         struct vcodec_state *new_video_decoder(struct display *d);
         static void destroy_video_decoder(void *state);
@@ -93,6 +96,8 @@ private:
         long long int m_nano_per_frame_actual_cumul = 0;
         long long int m_nano_per_frame_expected_cumul = 0;
         long long int m_compress_millis_cumul = 0;
+
+        std::unique_ptr<rate_control> m_rate_control; ///< NULL if not enabled
 };
 
 #endif // VIDEO_RXTX_ULTRAGRID_RTP_H_
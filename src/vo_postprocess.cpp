@@ -0,0 +1,504 @@
+/*
+ * FILE:    vo_postprocess.cpp
+ * AUTHORS: Martin Benes     <martinbenesh@gmail.com>
+ *          Lukas Hejtmanek  <xhejtman@ics.muni.cz>
+ *          Petr Holub       <hopet@ics.muni.cz>
+ *          Milos Liska      <xliska@fi.muni.cz>
+ *          Jiri Matela      <matela@ics.muni.cz>
+ *          Dalibor Matura   <255899@mail.muni.cz>
+ *          Ian Wesley-Smith <iwsmith@cct.lsu.edu>
+ *
+ * Copyright (c) 2005-2010 CESNET z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ * 
+ *      This product includes software developed by CESNET z.s.p.o.
+ * 
+ * 4. Neither the name of the CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * @file
+ * Postprocessors can be chained (eg. "deinterlace,border"). Every postprocessor
+ * of the chain runs in its own thread (pipeline stage) and postprocessed frames
+ * are passed to the output (display) by the last stage, so that the caller
+ * (decoder) only hands the frame over.
+ *
+ * Input buffers of a stage are taken from a pool if the postprocessor accepts
+ * arbitrary input frame (@ref VO_PP_PROPERTY_ACCEPTS_ANY_FRAME), otherwise its
+ * own buffer returned by getf() is used and the previous stage waits until it
+ * is released. Postprocessors capable of processing in place
+ * (@ref VO_PP_PROPERTY_IN_PLACE) just pass the input frame on.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "debug.h"
+#include "lib_common.h"
+#include "utils/synchronized_queue.h"
+#include "utils/video_frame_pool.h"
+#include "video.h"
+#include "video_display.h"
+#include "vo_postprocess.h"
+
+#define MOD_NAME "[vo_pp] "
+/// number of pooled input frames of a stage, also the maximal length of its queue
+#define PP_POOL_FRAMES 3
+
+using namespace std;
+
+namespace {
+enum pp_item_type {
+        PP_ITEM_FRAME,
+        PP_ITEM_RECONFIGURE,
+        PP_ITEM_QUIT,
+};
+
+struct pp_item {
+        enum pp_item_type type;
+        shared_ptr<video_frame> frame;
+        int flags;
+        struct video_desc desc; ///< for PP_ITEM_RECONFIGURE
+};
+
+struct vo_postprocess_stage {
+        vo_postprocess_stage(const struct vo_postprocess_info *f, void *st, bool any_frame, bool in_place) :
+                funcs(f), state(st), accepts_any_frame(any_frame), in_place(in_place),
+                out_desc(), out_frames_count(1), pool(PP_POOL_FRAMES), input_busy(false) {}
+
+        shared_ptr<video_frame> get_input();
+
+        const struct vo_postprocess_info *funcs;
+        void *state;
+        bool accepts_any_frame;
+        bool in_place;
+
+        struct video_desc out_desc;
+        int out_frames_count;
+
+        video_frame_pool<default_data_allocator> pool; ///< used if accepts_any_frame
+
+        /// protects module's own input buffer (if not accepts_any_frame)
+        mutex input_lock;
+        condition_variable input_cv;
+        bool input_busy;
+
+        synchronized_queue<pp_item, PP_POOL_FRAMES> queue; ///< bounded so that a slow stage throttles the previous ones
+        thread worker;
+};
+} // end of anonymous namespace
+
+struct vo_postprocess_state {
+        vector<vo_postprocess_stage *> stages;
+
+        vo_postprocess_output_getf_t out_getf;
+        vo_postprocess_output_putf_t out_putf;
+        void *out_udata;
+        int out_pitch;
+
+        shared_ptr<video_frame> acquired; ///< frame returned by vo_postprocess_getf()
+
+        mutex lock;
+        condition_variable cv;
+        int in_flight;       ///< number of frame items in stage queues or being processed
+        int out_dropped;     ///< frames refused by output putf, not yet reported by vo_postprocess_put()
+        bool reconfigured;   ///< signalized by last stage after reconfiguration
+        bool reconfigure_ret;
+};
+
+static void stage_run(struct vo_postprocess_state *s, size_t idx);
+
+void show_vo_postprocess_help()
+{
+        printf("Possible postprocess modules (may be chained with comma):\n");
+        list_modules(LIBRARY_CLASS_VIDEO_POSTPROCESS, VO_PP_ABI_VERSION);
+}
+
+static bool get_bool_property(const struct vo_postprocess_info *funcs, void *state, int property)
+{
+        bool val = false;
+        size_t len = sizeof val;
+        if (funcs->get_property(state, property, &val, &len) && len == sizeof val) {
+                return val;
+        }
+        return false;
+}
+
+static vo_postprocess_stage *stage_init(const char *config_string)
+{
+        char *lib_name = strdup(config_string);
+        if (strchr(lib_name, ':')) {
+                *strchr(lib_name, ':') = '\0';
+        }
+
+        const struct vo_postprocess_info *funcs = (const struct vo_postprocess_info *)
+                load_library(lib_name, LIBRARY_CLASS_VIDEO_POSTPROCESS, VO_PP_ABI_VERSION);
+        if (!funcs) {
+                fprintf(stderr, "Unknown postprocess module: %s\n", lib_name);
+                free(lib_name);
+                return NULL;
+        }
+        free(lib_name);
+
+        const char *vo_postprocess_options = NULL;
+        if (strchr(config_string, ':'))
+                vo_postprocess_options = strchr(config_string, ':') + 1;
+        void *state = funcs->init(vo_postprocess_options);
+        if(!state) {
+                fprintf(stderr, "Postprocessing initialization failed: %s\n", config_string);
+                return NULL;
+        }
+
+        return new vo_postprocess_stage(funcs, state,
+                        get_bool_property(funcs, state, VO_PP_PROPERTY_ACCEPTS_ANY_FRAME),
+                        get_bool_property(funcs, state, VO_PP_PROPERTY_IN_PLACE));
+}
+
+struct vo_postprocess_state *vo_postprocess_init(const char *config_string)
+{
+        if(!config_string) 
+                return NULL;
+
+        if(strcmp(config_string, "help") == 0)
+        {
+                show_vo_postprocess_help();
+                return NULL;
+        }
+
+        auto s = new vo_postprocess_state();
+        s->in_flight = 0;
+        s->out_dropped = 0;
+        s->reconfigured = false;
+        s->reconfigure_ret = false;
+
+        char *tmp = strdup(config_string);
+        char *item, *save_ptr = NULL;
+        char *config = tmp;
+        while ((item = strtok_r(config, ",", &save_ptr))) {
+                vo_postprocess_stage *stage = stage_init(item);
+                if (!stage) {
+                        free(tmp);
+                        vo_postprocess_done(s);
+                        return NULL;
+                }
+                s->stages.push_back(stage);
+                config = NULL;
+        }
+        free(tmp);
+
+        if (s->stages.empty()) {
+                delete s;
+                return NULL;
+        }
+
+        for (size_t i = 0; i < s->stages.size(); ++i) {
+                s->stages[i]->worker = thread(stage_run, s, i);
+        }
+
+        return s;
+}
+
+static void pool_reconfigure(vo_postprocess_stage *stage, struct video_desc desc)
+{
+        if (stage->accepts_any_frame) {
+                stage->pool.reconfigure(desc, (size_t) vc_get_linesize(desc.width, desc.color_spec) * desc.height);
+        }
+}
+
+shared_ptr<video_frame> vo_postprocess_stage::get_input()
+{
+        if (accepts_any_frame) {
+                return pool.get_frame();
+        }
+
+        unique_lock<mutex> lk(input_lock);
+        input_cv.wait(lk, [this]{ return !input_busy; });
+        input_busy = true;
+        lk.unlock();
+
+        return shared_ptr<video_frame>(funcs->getf(state), [this](struct video_frame *) {
+                        unique_lock<mutex> lk(input_lock);
+                        input_busy = false;
+                        lk.unlock();
+                        input_cv.notify_one();
+                        });
+}
+
+static void item_done(struct vo_postprocess_state *s)
+{
+        unique_lock<mutex> lk(s->lock);
+        s->in_flight -= 1;
+        lk.unlock();
+        s->cv.notify_all();
+}
+
+static void push_frame(struct vo_postprocess_state *s, vo_postprocess_stage *stage, shared_ptr<video_frame> frame, int flags)
+{
+        unique_lock<mutex> lk(s->lock);
+        s->in_flight += 1;
+        lk.unlock();
+        stage->queue.push(pp_item{PP_ITEM_FRAME, move(frame), flags, {}});
+}
+
+static void process_frame(struct vo_postprocess_state *s, vo_postprocess_stage *stage,
+                vo_postprocess_stage *next, shared_ptr<video_frame> in, int flags)
+{
+        int pitch = next ? vc_get_linesize(stage->out_desc.width, stage->out_desc.color_spec) : s->out_pitch;
+
+        if (next && next->accepts_any_frame && stage->in_place && stage->out_frames_count == 1 &&
+                        video_desc_eq(stage->out_desc, video_desc_from_frame(in.get()))) {
+                if (stage->funcs->vo_postprocess(stage->state, in.get(), in.get(), pitch)) {
+                        push_frame(s, next, move(in), flags);
+                }
+                return;
+        }
+
+        for (int i = 0; i < stage->out_frames_count; ++i) {
+                if (next) {
+                        shared_ptr<video_frame> out = next->get_input();
+                        if (!stage->funcs->vo_postprocess(stage->state, i == 0 ? in.get() : NULL, out.get(), pitch)) {
+                                return;
+                        }
+                        push_frame(s, next, move(out), flags);
+                } else {
+                        struct video_frame *out = s->out_getf(s->out_udata);
+                        if (!stage->funcs->vo_postprocess(stage->state, i == 0 ? in.get() : NULL, out, pitch)) {
+                                s->out_putf(s->out_udata, out, PUTF_DISCARD);
+                                return;
+                        }
+                        if (s->out_putf(s->out_udata, out, flags) != 0) {
+                                lock_guard<mutex> lk(s->lock);
+                                s->out_dropped += 1;
+                        }
+                }
+        }
+}
+
+static void stage_run(struct vo_postprocess_state *s, size_t idx)
+{
+        vo_postprocess_stage *stage = s->stages[idx];
+        vo_postprocess_stage *next = idx + 1 < s->stages.size() ? s->stages[idx + 1] : NULL;
+
+        while (true) {
+                pp_item item = stage->queue.pop();
+                switch (item.type) {
+                case PP_ITEM_QUIT:
+                        return;
+                case PP_ITEM_FRAME:
+                        process_frame(s, stage, next, move(item.frame), item.flags);
+                        item_done(s);
+                        break;
+                case PP_ITEM_RECONFIGURE:
+                {
+                        bool ret = stage->funcs->reconfigure(stage->state, item.desc);
+                        if (ret) {
+                                int display_mode;
+                                stage->funcs->get_out_desc(stage->state, &stage->out_desc, &display_mode,
+                                                &stage->out_frames_count);
+                        }
+                        if (ret && next) {
+                                // frames for the next stage are already of the new format
+                                pool_reconfigure(next, stage->out_desc);
+                                next->queue.push(pp_item{PP_ITEM_RECONFIGURE, {}, 0, stage->out_desc});
+                        } else {
+                                unique_lock<mutex> lk(s->lock);
+                                s->reconfigured = true;
+                                s->reconfigure_ret = ret;
+                                lk.unlock();
+                                s->cv.notify_all();
+                        }
+                        break;
+                }
+                }
+        }
+}
+
+/**
+ * Reconfigures the whole chain. Frames already passed to the chain are
+ * postprocessed (and output) prior to the reconfiguration.
+ */
+int vo_postprocess_reconfigure(struct vo_postprocess_state *s,
+                struct video_desc desc)
+{
+        if (!s) {
+                return FALSE;
+        }
+
+        s->acquired = nullptr;
+        pool_reconfigure(s->stages[0], desc);
+
+        unique_lock<mutex> lk(s->lock);
+        s->reconfigured = false;
+        lk.unlock();
+        s->stages[0]->queue.push(pp_item{PP_ITEM_RECONFIGURE, {}, 0, desc});
+
+        lk.lock();
+        s->cv.wait(lk, [s]{ return s->reconfigured; });
+
+        return s->reconfigure_ret;
+}
+
+struct video_frame * vo_postprocess_getf(struct vo_postprocess_state *s)
+{
+        if(s) {
+                s->acquired = s->stages[0]->get_input();
+                return s->acquired.get();
+        } else {
+                return NULL;
+        }
+}
+
+void vo_postprocess_set_output(struct vo_postprocess_state *s, vo_postprocess_output_getf_t getf,
+                vo_postprocess_output_putf_t putf, void *udata, int pitch)
+{
+        s->out_getf = getf;
+        s->out_putf = putf;
+        s->out_udata = udata;
+        s->out_pitch = pitch;
+}
+
+int vo_postprocess_put(struct vo_postprocess_state *s, struct video_frame *frame, int flags)
+{
+        assert(frame == s->acquired.get());
+        if (flags == PUTF_DISCARD) {
+                s->acquired = nullptr;
+                return 0;
+        }
+        push_frame(s, s->stages[0], move(s->acquired), flags);
+
+        lock_guard<mutex> lk(s->lock);
+        if (s->out_dropped > 0) {
+                s->out_dropped -= 1;
+                return 1;
+        }
+        return 0;
+}
+
+void vo_postprocess_flush(struct vo_postprocess_state *s)
+{
+        if (!s) {
+                return;
+        }
+        unique_lock<mutex> lk(s->lock);
+        s->cv.wait(lk, [s]{ return s->in_flight == 0; });
+}
+
+void vo_postprocess_done(struct vo_postprocess_state *s)
+{
+        if (!s) {
+                return;
+        }
+
+        vo_postprocess_flush(s);
+        s->acquired = nullptr;
+        // stop the stages in order so that no stage feeds an already finished one
+        for (auto stage : s->stages) {
+                if (stage->worker.joinable()) {
+                        stage->queue.push(pp_item{PP_ITEM_QUIT, {}, 0, {}});
+                        stage->worker.join();
+                }
+        }
+        for (auto stage : s->stages) {
+                stage->funcs->done(stage->state);
+                delete stage;
+        }
+        delete s;
+}
+
+void vo_postprocess_get_out_desc(struct vo_postprocess_state *s, struct video_desc *out, int *display_mode, int *out_frames_count)
+{
+        if (!s) {
+                return;
+        }
+        s->stages.back()->funcs->get_out_desc(s->stages.back()->state, out, display_mode, out_frames_count);
+}
+
+/**
+ * Properties are those of the first postprocessor except of the list of
+ * codecs, which is intersection of codecs supported by all postprocessors.
+ */
+bool vo_postprocess_get_property(struct vo_postprocess_state *s, int property, void *val, size_t *len)
+{
+        if (!s) {
+                return false;
+        }
+        if (property != VO_PP_PROPERTY_CODECS || s->stages.size() == 1) {
+                return s->stages[0]->funcs->get_property(s->stages[0]->state, property, val, len);
+        }
+
+        vector<codec_t> codecs;
+        bool restricted = false;
+        for (auto stage : s->stages) {
+                codec_t stage_codecs[VIDEO_CODEC_COUNT];
+                size_t stage_len = sizeof stage_codecs;
+                if (!stage->funcs->get_property(stage->state, VO_PP_PROPERTY_CODECS, stage_codecs, &stage_len)) {
+                        continue; // all uncompressed supported
+                }
+                vector<codec_t> current(stage_codecs, stage_codecs + stage_len / sizeof(codec_t));
+                if (restricted) {
+                        vector<codec_t> intersection;
+                        for (auto c : codecs) {
+                                if (find(current.begin(), current.end(), c) != current.end()) {
+                                        intersection.push_back(c);
+                                }
+                        }
+                        current = intersection;
+                }
+                codecs = current;
+                restricted = true;
+        }
+        if (!restricted) {
+                return false;
+        }
+        if (codecs.size() * sizeof(codec_t) > *len) {
+                *len = 0;
+                return true;
+        }
+        memcpy(val, codecs.data(), codecs.size() * sizeof(codec_t));
+        *len = codecs.size() * sizeof(codec_t);
+        return true;
+}
+
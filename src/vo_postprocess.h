@@ -57,6 +57,8 @@ extern "C" {
 /*          property                               type                   default          */
 #define VO_PP_PROPERTY_CODECS                0 /*  codec_t[]          all uncompressed     */
 #define VO_PP_DOES_CHANGE_TILING_MODE        1 /*  bool                    false           */
+#define VO_PP_PROPERTY_ACCEPTS_ANY_FRAME     2 /*  bool                    false           */
+#define VO_PP_PROPERTY_IN_PLACE              3 /*  bool                    false           */
 
 #define VO_PP_ABI_VERSION 5
 
@@ -111,6 +113,10 @@ typedef bool (*vo_postprocess_get_property_t)(void *state, int property, void *v
  * @param state postprocessor state
  * @param input frame
  *
+ * Input frame is obtained by getf unless the postprocessor reports
+ * VO_PP_PROPERTY_ACCEPTS_ANY_FRAME. If it reports VO_PP_PROPERTY_IN_PLACE,
+ * in and out may point to the same frame.
+ *
  * @return flag If output video frame is filled with valid data.
  *
  */
@@ -133,7 +139,9 @@ struct vo_postprocess_info {
 };
 
 /**
- * Semantic and parameters of following functions is same as their typedef counterparts
+ * Semantic and parameters of following functions is same as their typedef counterparts.
+ * vo_postprocess_init() accepts also comma-separated list of postprocessors, each
+ * of them is then run by its own thread.
  */
 struct vo_postprocess_state *vo_postprocess_init(const char *config_string);
 
@@ -142,9 +150,35 @@ struct video_frame * vo_postprocess_getf(struct vo_postprocess_state *);
 void vo_postprocess_get_out_desc(struct vo_postprocess_state *, struct video_desc *out, int *display_mode, int *out_frames_count);
 bool vo_postprocess_get_property(struct vo_postprocess_state *, int property, void *val, size_t *len);
 
-bool vo_postprocess(struct vo_postprocess_state *, struct video_frame*, struct video_frame*, int req_pitch);
 void vo_postprocess_done(struct vo_postprocess_state *s);
 
+typedef struct video_frame *(*vo_postprocess_output_getf_t)(void *udata);
+typedef int (*vo_postprocess_output_putf_t)(void *udata, struct video_frame *frame, int flags);
+/**
+ * Sets output of the postprocessing chain. Called from postprocessing
+ * threads, it must be set prior to first vo_postprocess_put() and after
+ * every reconfiguration.
+ *
+ * @param pitch requested pitch of output frames
+ */
+void vo_postprocess_set_output(struct vo_postprocess_state *, vo_postprocess_output_getf_t getf,
+                vo_postprocess_output_putf_t putf, void *udata, int pitch);
+/**
+ * Passes frame obtained by vo_postprocess_getf() to the postprocessing chain.
+ * Does not wait for the frame to be processed, so frames refused by the output
+ * putf (eg. dropped with PUTF_NONBLOCK) are reported by subsequent calls, one
+ * per call.
+ *
+ * @param flags flags passed to output putf (@ref display_put_frame_flags)
+ * @retval 0 no frame was dropped since the last report
+ * @retval 1 a previously put frame was not displayed
+ */
+int vo_postprocess_put(struct vo_postprocess_state *, struct video_frame *frame, int flags);
+/**
+ * Waits until all frames passed to the chain have been output.
+ */
+void vo_postprocess_flush(struct vo_postprocess_state *);
+
 void show_vo_postprocess_help(void);
 
 #ifdef __cplusplus
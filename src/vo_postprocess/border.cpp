@@ -55,9 +55,20 @@ struct state_border {
         struct video_frame *in = nullptr;
 };
 
-static bool border_get_property(void * /* state */, int /* property */, void * /* val */, size_t * /* len */)
+static bool border_get_property(void * /* state */, int property, void *val, size_t *len)
 {
-        return false;
+        switch (property) {
+        case VO_PP_PROPERTY_ACCEPTS_ANY_FRAME:
+        case VO_PP_PROPERTY_IN_PLACE:
+                if (*len < sizeof(bool)) {
+                        return false;
+                }
+                *(bool *) val = true;
+                *len = sizeof(bool);
+                return true;
+        default:
+                return false;
+        }
 }
 
 static void * border_init(const char *config) {
@@ -139,7 +150,9 @@ static bool border_postprocess(void *state, struct video_frame *in, struct video
 
         struct state_border *s = (struct state_border *) state;
 
-        memcpy(out->tiles[0].data + s->width * req_pitch, in->tiles[0].data + s->width * req_pitch, in->tiles[0].data_len - 2 * s->width * req_pitch);
+        if (out != in) {
+                memcpy(out->tiles[0].data + s->width * req_pitch, in->tiles[0].data + s->width * req_pitch, in->tiles[0].data_len - 2 * s->width * req_pitch);
+        }
 
         if (in->color_spec == UYVY) {
                 uint32_t rgba[2]{};
@@ -45,18 +45,24 @@
 #include <pthread.h>
 #include <stdlib.h>
 #include "lib_common.h"
+#include "utils/yadif.h"
 #include "video.h"
 #include "video_display.h"
 #include "vo_postprocess.h"
 
 struct state_deinterlace {
         struct video_frame *out;
+        bool yadif;           ///< motion-adaptive deinterlacing requested
+        struct yadif *yadif_state; ///< NULL if blending is used
 };
 
 static void usage()
 {
         printf("Deinterlaces output video frames.\nUsage:\n");
-        printf("\t-p deinterlace\n");
+        printf("\t-p deinterlace[:yadif]\n");
+        printf("\t\tyadif - motion-adaptive deinterlacing (UYVY and v210 only, one frame latency),\n"
+                        "\t\t\tdefault is linear blend\n");
+        printf("\tFor field rate output use \"-p double_framerate:yadif\".\n");
 }
 
 static void * deinterlace_init(const char *config) {
@@ -66,13 +72,46 @@ static void * deinterlace_init(const char *config) {
         }
 
         struct state_deinterlace *s = new state_deinterlace();
+        if (config && strcmp(config, "yadif") == 0) {
+                s->yadif = true;
+        } else if (config && strlen(config) > 0) {
+                fprintf(stderr, "[deinterlace] Unknown option: %s\n", config);
+                delete s;
+                return NULL;
+        }
 
         return s;
 }
 
-static bool deinterlace_get_property(void *, int, void *, size_t *)
+static bool deinterlace_get_property(void *state, int property, void *val, size_t *len)
 {
-        return false;
+        struct state_deinterlace *s = (struct state_deinterlace *) state;
+
+        switch (property) {
+        case VO_PP_PROPERTY_CODECS:
+                if (!s->yadif) {
+                        return false;
+                }
+                if (*len < 2 * sizeof(codec_t)) {
+                        *len = 0;
+                        return true;
+                }
+                ((codec_t *) val)[0] = UYVY;
+                ((codec_t *) val)[1] = v210;
+                *len = 2 * sizeof(codec_t);
+                return true;
+        case VO_PP_PROPERTY_ACCEPTS_ANY_FRAME:
+        case VO_PP_PROPERTY_IN_PLACE:
+                // yadif_push() copies the input to its own history
+                if (*len < sizeof(bool)) {
+                        return false;
+                }
+                *(bool *) val = true;
+                *len = sizeof(bool);
+                return true;
+        default:
+                return false;
+        }
 }
 
 static int deinterlace_reconfigure(void *state, struct video_desc desc)
@@ -83,6 +122,16 @@ static int deinterlace_reconfigure(void *state, struct video_desc desc)
         assert(desc.tile_count == 1);
         s->out = vf_alloc_desc_data(desc);
 
+        yadif_destroy(s->yadif_state);
+        s->yadif_state = NULL;
+        if (s->yadif) {
+                s->yadif_state = yadif_create(desc);
+                if (!s->yadif_state) {
+                        log_msg(LOG_LEVEL_WARNING, "[deinterlace] Codec %s not supported by yadif, "
+                                        "using linear blend.\n", get_codec_name(desc.color_spec));
+                }
+        }
+
         return TRUE;
 }
 
@@ -95,7 +144,14 @@ static struct video_frame * deinterlace_getf(void *state)
 
 static bool deinterlace_postprocess(void *state, struct video_frame *in, struct video_frame *out, int req_pitch)
 {
-        UNUSED(state);
+        struct state_deinterlace *s = (struct state_deinterlace *) state;
+
+        if (s->yadif_state) {
+                yadif_push(s->yadif_state, (unsigned char *) in->tiles[0].data);
+                yadif_filter(s->yadif_state, (unsigned char *) out->tiles[0].data, req_pitch, false);
+                return true;
+        }
+
         assert (req_pitch == vc_get_linesize(in->tiles[0].width, in->color_spec));
         assert (video_desc_eq(video_desc_from_frame(out), video_desc_from_frame(in)));
         assert (in->tiles[0].data_len <= vc_get_linesize(in->tiles[0].width, in->color_spec) * in->tiles[0].height);
@@ -103,7 +159,9 @@ static bool deinterlace_postprocess(void *state, struct video_frame *in, struct
 
         vc_deinterlace((unsigned char *) in->tiles[0].data, vc_get_linesize(in->tiles[0].width,
                                 in->color_spec), in->tiles[0].height);
-        memcpy(out->tiles[0].data, in->tiles[0].data, in->tiles[0].data_len);
+        if (out != in) {
+                memcpy(out->tiles[0].data, in->tiles[0].data, in->tiles[0].data_len);
+        }
 
         return true;
 }
@@ -113,6 +171,7 @@ static void deinterlace_done(void *state)
         struct state_deinterlace *s = (struct state_deinterlace *) state;
         
         vf_free(s->out);
+        yadif_destroy(s->yadif_state);
         delete s;
 }
 
@@ -56,6 +56,7 @@
 
 #include "debug.h"
 #include "lib_common.h"
+#include "utils/yadif.h"
 #include "video.h"
 #include "video_display.h"
 #include "vo_postprocess.h"
@@ -64,11 +65,17 @@ struct state_df {
         struct video_frame *in;
         char *buffers[2];
         int buffer_current;
+
+        bool yadif;
+        struct yadif *yadif_state; ///< used instead of weaving fields if not NULL
 };
 
 static void usage()
 {
-        printf("-p double_framerate\n");
+        printf("-p double_framerate[:yadif]\n");
+        printf("\tyadif - interpolate missing field of each output frame with motion-adaptive\n"
+                        "\t\tdeinterlacer (UYVY and v210 only) instead of weaving it from adjacent\n"
+                        "\t\tframe, output is delayed by one frame\n");
 }
 
 static void * df_init(const char *config) {
@@ -86,18 +93,37 @@ static void * df_init(const char *config) {
         s->in = vf_alloc(1);
         s->buffers[0] = s->buffers[1] = NULL;
         s->buffer_current = 0;
+        s->yadif = false;
+        s->yadif_state = NULL;
+
+        if (config && strcmp(config, "yadif") == 0) {
+                s->yadif = true;
+        } else if (config && strlen(config) > 0) {
+                fprintf(stderr, "[Double Framerate] Unknown option: %s\n", config);
+                vf_free(s->in);
+                free(s);
+                return NULL;
+        }
         
         return s;
 }
 
 static bool df_get_property(void *state, int property, void *val, size_t *len)
 {
-        UNUSED(state);
-        UNUSED(property);
-        UNUSED(val);
-        UNUSED(len);
+        struct state_df *s = (struct state_df *) state;
+
+        if (property != VO_PP_PROPERTY_CODECS || !s->yadif) {
+                return false;
+        }
+        if (*len < 2 * sizeof(codec_t)) {
+                *len = 0;
+                return true;
+        }
+        ((codec_t *) val)[0] = UYVY;
+        ((codec_t *) val)[1] = v210;
+        *len = 2 * sizeof(codec_t);
 
-        return false;
+        return true;
 }
 
 static int df_postprocess_reconfigure(void *state, struct video_desc desc)
@@ -126,6 +152,16 @@ static int df_postprocess_reconfigure(void *state, struct video_desc desc)
         s->buffers[0] = malloc(in_tile->data_len);
         s->buffers[1] = malloc(in_tile->data_len);
         in_tile->data = s->buffers[s->buffer_current];
+
+        yadif_destroy(s->yadif_state);
+        s->yadif_state = NULL;
+        if (s->yadif) {
+                s->yadif_state = yadif_create(desc);
+                if (!s->yadif_state) {
+                        log_msg(LOG_LEVEL_WARNING, "[Double Framerate] Codec %s not supported by yadif, "
+                                        "weaving fields.\n", get_codec_name(desc.color_spec));
+                }
+        }
         
         return TRUE;
 }
@@ -145,6 +181,15 @@ static bool df_postprocess(void *state, struct video_frame *in, struct video_fra
         struct state_df *s = (struct state_df *) state;
         unsigned int y;
 
+        if (s->yadif_state) {
+                // first call outputs top field time, second call (in == NULL) the bottom one
+                if (in != NULL) {
+                        yadif_push(s->yadif_state, (unsigned char *) in->tiles[0].data);
+                }
+                yadif_filter(s->yadif_state, (unsigned char *) out->tiles[0].data, req_pitch, in == NULL);
+                return true;
+        }
+
         if(in != NULL) {
                 char *src = s->buffers[(s->buffer_current + 1) % 2] + vc_get_linesize(s->in->tiles[0].width, s->in->color_spec);
                 char *dst = out->tiles[0].data + req_pitch;
@@ -179,6 +224,7 @@ static void df_done(void *state)
         
         free(s->buffers[0]);
         free(s->buffers[1]);
+        yadif_destroy(s->yadif_state);
         vf_free(s->in);
         free(state);
 }
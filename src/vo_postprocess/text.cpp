@@ -79,11 +79,19 @@ struct state_text {
 static bool text_get_property(void *state, int property, void *val, size_t *len)
 {
         UNUSED(state);
-        UNUSED(property);
-        UNUSED(val);
-        UNUSED(len);
 
-        return false;
+        switch (property) {
+        case VO_PP_PROPERTY_ACCEPTS_ANY_FRAME:
+        case VO_PP_PROPERTY_IN_PLACE:
+                if (*len < sizeof(bool)) {
+                        return false;
+                }
+                *(bool *) val = true;
+                *len = sizeof(bool);
+                return true;
+        default:
+                return false;
+        }
 }
 
 #define TEXT_H 36
@@ -253,7 +261,9 @@ static bool text_postprocess(void *state, struct video_frame *in, struct video_f
                 return false;
         }
 
-        memcpy(out->tiles[0].data, in->tiles[0].data, in->tiles[0].data_len);
+        if (out != in) {
+                memcpy(out->tiles[0].data, in->tiles[0].data, in->tiles[0].data_len);
+        }
 
         if ((int) data_len == s->height * dstlinesize) {
                 for (int y = 0; y < s->height; y++) {
@@ -58,6 +58,7 @@
 #include "test_tv.h"
 #include "test_net_udp.h"
 #include "test_rtp.h"
+#include "test_rate_control.h"
 #include "test_video_capture.h"
 #include "test_video_display.h"
 
@@ -107,6 +108,8 @@ int main()
                 return 1;
         if (test_rtp() != 0)
                 return 1;
+        if (test_rate_control() != 0)
+                return 1;
 
 #ifdef TEST_AV_HW
         if (test_audio_hw() != 0)
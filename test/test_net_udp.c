@@ -42,6 +42,14 @@
 #include "test_net_udp.h"
 
 #define BUFSIZE 1024
+#define PACED_PACKETS 100
+#define PACED_INTERVAL_US 200
+
+#if defined HAVE_LINUX && defined SO_TXTIME
+#include <dlfcn.h>
+#include <linux/net_tstamp.h>
+#define TEST_TXTIME 1
+#endif
 
 static void randomize(char buf[], int buflen)
 {
@@ -52,6 +60,188 @@ static void randomize(char buf[], int buflen)
         }
 }
 
+#ifdef TEST_TXTIME
+static int sendmmsg_calls;
+static int sendmmsg_packets;
+static uint64_t txtime[2 * PACED_PACKETS];
+
+/*
+ * Interposes libc sendmmsg() to record how the paced packets are passed to
+ * the kernel and which departure times they carry. This doesn't depend on
+ * the qdisc, which may silently ignore the timestamps.
+ */
+int sendmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+        static int (*real_sendmmsg)(int, struct mmsghdr *, unsigned int, int);
+        unsigned int i;
+
+        if (real_sendmmsg == NULL) {
+                real_sendmmsg = (int (*)(int, struct mmsghdr *, unsigned int, int))
+                        dlsym(RTLD_NEXT, "sendmmsg");
+        }
+        sendmmsg_calls += 1;
+        for (i = 0; i < vlen; i++) {
+                struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msgvec[i].msg_hdr);
+                uint64_t t = 0;
+                if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET &&
+                    cmsg->cmsg_type == SCM_TXTIME) {
+                        memcpy(&t, CMSG_DATA(cmsg), sizeof t);
+                }
+                if (sendmmsg_packets < 2 * PACED_PACKETS) {
+                        txtime[sendmmsg_packets++] = t;
+                }
+        }
+        return real_sendmmsg(fd, msgvec, vlen, flags);
+}
+
+static uint64_t monotonic_ns(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ * Passes a bulk of packets to udp_sendv(), nothing may leave before
+ * udp_async_wait() (checked if the receive queue was empty before).
+ */
+static int send_paced_bulk(socket_udp *s, char *buf, int check_queue)
+{
+        struct timeval timeout;
+        struct iovec iov;
+        int i;
+
+        if (!udp_async_start_paced(s, PACED_PACKETS, PACED_INTERVAL_US * 1000)) {
+                return -1;
+        }
+        iov.iov_base = buf;
+        iov.iov_len = BUFSIZE;
+        for (i = 0; i < PACED_PACKETS; i++) {
+                if (udp_sendv(s, &iov, 1, NULL) < 0) {
+                        printf("FAIL\n");
+                        perror("  Cannot send packet");
+                        return 0;
+                }
+        }
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 0;
+        udp_fd_zero();
+        udp_fd_set(s);
+        if (check_queue && udp_select(&timeout) != 0) {
+                printf("FAIL\n");
+                printf("  Packets sent before udp_async_wait()\n");
+                return 0;
+        }
+        udp_async_wait(s);
+        return 1;
+}
+
+/*
+ * Sends two bulks of packets with SO_TXTIME departure times. Checks that each
+ * bulk is passed to the kernel with a single sendmmsg() call, that the
+ * timestamps are spaced by the requested interval and that the second bulk
+ * doesn't overlap the schedule of the first one. Gaps between arrivals are only
+ * reported - loopback has no qdisc by default, so the packets are actually
+ * paced only if fq is set up (tc qdisc add dev lo root fq).
+ */
+static void test_net_udp_paced(void)
+{
+        struct timeval timeout;
+        socket_udp *s1;
+        char buf1[BUFSIZE], buf2[BUFSIZE];
+        double arrival[2 * PACED_PACKETS];
+        double min_gap = 1e9, sum_gap = 0.0;
+        uint64_t start;
+        int i, ret, received = 0;
+
+        printf
+            ("Testing UDP/IP networking (IPv4 loopback, SO_TXTIME pacing) .............. ");
+        fflush(stdout);
+        s1 = udp_init("127.0.0.1", 5004, 5004, 1, false, false);
+        if (s1 == NULL) {
+                printf("FAIL\n");
+                printf("  Cannot initialize socket\n");
+                return;
+        }
+        udp_set_recv_buf(s1, 2 * PACED_PACKETS * BUFSIZE * 4);
+        randomize(buf1, BUFSIZE);
+        sendmmsg_calls = sendmmsg_packets = 0;
+        start = monotonic_ns();
+        for (i = 0; i < 2; i++) {
+                ret = send_paced_bulk(s1, buf1, i == 0);
+                if (ret == -1) {
+                        printf("Skipped\n");
+                        printf("  SO_TXTIME not supported\n");
+                        goto abort_paced;
+                }
+                if (ret == 0) {
+                        goto abort_paced;
+                }
+        }
+
+        if (sendmmsg_calls != 2 || sendmmsg_packets != 2 * PACED_PACKETS) {
+                printf("FAIL\n");
+                printf("  %d packets passed in %d sendmmsg calls, expected %d in 2\n",
+                       sendmmsg_packets, sendmmsg_calls, 2 * PACED_PACKETS);
+                goto abort_paced;
+        }
+        if (txtime[0] < start || txtime[0] > monotonic_ns()) {
+                printf("FAIL\n");
+                printf("  First departure time out of range\n");
+                goto abort_paced;
+        }
+        for (i = 1; i < 2 * PACED_PACKETS; i++) {
+                /* the second bulk may start later if the first one has already departed */
+                uint64_t gap = txtime[i] - txtime[i - 1];
+                if (gap != PACED_INTERVAL_US * 1000 &&
+                    (i != PACED_PACKETS || gap < PACED_INTERVAL_US * 1000)) {
+                        printf("FAIL\n");
+                        printf("  Departure time of packet %d is %lld ns after the previous one\n",
+                               i, (long long) gap);
+                        goto abort_paced;
+                }
+        }
+
+        for (received = 0; received < 2 * PACED_PACKETS; received++) {
+                struct timespec ts;
+                timeout.tv_sec = 1;
+                timeout.tv_usec = 0;
+                udp_fd_zero();
+                udp_fd_set(s1);
+                if (udp_select(&timeout) <= 0) {
+                        break;
+                }
+                if (udp_recv(s1, buf2, BUFSIZE) != BUFSIZE || memcmp(buf1, buf2, BUFSIZE) != 0) {
+                        break;
+                }
+                clock_gettime(CLOCK_MONOTONIC, &ts);
+                arrival[received] = ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+        }
+        if (received != 2 * PACED_PACKETS) {
+                printf("FAIL\n");
+                printf("  Received only %d of %d packets\n", received, 2 * PACED_PACKETS);
+                goto abort_paced;
+        }
+        for (i = 1; i < 2 * PACED_PACKETS; i++) {
+                double gap = arrival[i] - arrival[i - 1];
+                sum_gap += gap;
+                if (gap < min_gap) {
+                        min_gap = gap;
+                }
+        }
+        printf("Ok\n");
+        if (sum_gap / (2 * PACED_PACKETS - 1) < PACED_INTERVAL_US / 2) {
+                printf("  Packets not paced by the qdisc (mean gap %.1f us), is fq set on lo?\n",
+                       sum_gap / (2 * PACED_PACKETS - 1));
+        } else {
+                printf("  Inter-packet gap: mean %.1f us, min %.1f us (requested %d us)\n",
+                       sum_gap / (2 * PACED_PACKETS - 1), min_gap, PACED_INTERVAL_US);
+        }
+ abort_paced:
+        udp_exit(s1);
+}
+#endif // defined TEST_TXTIME
+
 int test_net_udp(void)
 {
         struct timeval timeout;
@@ -533,5 +723,9 @@ int test_net_udp(void)
         udp_exit(s1);
 #endif                          /* WIN32 */
 
+#ifdef TEST_TXTIME
+        test_net_udp_paced();
+#endif
+
         return 0;
 }
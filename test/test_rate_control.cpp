@@ -0,0 +1,166 @@
+/*
+ * FILE:    test_rate_control.cpp
+ *
+ * Copyright (c) 2017 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#include "debug.h"
+#include "host.h"
+#include "rtp/rtp.h"
+#include "rtp/rate_control.h"
+#include "test_rate_control.h"
+
+#include <chrono>
+
+#define LINK_RATE 20000000LL   ///< rate limit of the emulated path
+#define MAX_BITRATE 50000000LL
+#define MIN_BITRATE 5000000LL
+#define PAYLOAD 1200
+#define RUN_SECONDS 6
+#define SETTLE_SECONDS 1       ///< time allowed for the initial decrease
+#define TICK_US 5000
+
+#define RX_PORT 5106           ///< receiver's RTP port, only this port is impaired
+#define TX_PORT 5108
+
+using namespace std::chrono;
+
+static void callback(struct rtp *session, rtp_event *e)
+{
+        UNUSED(session);
+        if (e->type == RX_RTP) {
+                free(e->data);
+        }
+}
+
+static void drain(struct rtp *session)
+{
+        struct timeval timeout;
+
+        do {
+                timeout.tv_sec = 0;
+                timeout.tv_usec = 0;
+        } while (rtp_recv_r(session, &timeout, 0));
+}
+
+/*
+ * Sends RTP over loopback through a rate limited net_impair path while the
+ * sending bitrate is driven by rate_control from the receiver's loss reports.
+ * After the initial decrease the bitrate must stay below the link rate, but
+ * mustn't collapse to the minimum.
+ */
+int test_rate_control(void)
+{
+        struct rtp *tx, *rx;
+        char payload[PAYLOAD] = { 0 };
+        long long bitrate = MAX_BITRATE, max_settled = 0, min_settled = MAX_BITRATE;
+        double credit = 0.0;
+        int ret = 0;
+
+        printf
+            ("Testing rate control (loopback, rate limited path) ....................... ");
+        fflush(stdout);
+
+        commandline_params["udp-impair"] = "rate=" + std::to_string(LINK_RATE) + ":port=" + std::to_string(RX_PORT);
+        tx = rtp_init("127.0.0.1", TX_PORT, RX_PORT, 1, 1000, FALSE, callback, NULL, false, false);
+        rx = rtp_init("127.0.0.1", RX_PORT, TX_PORT, 1, 1000, FALSE, callback, NULL, false, false);
+        commandline_params.erase("udp-impair");
+        if (tx == NULL || rx == NULL || !rtp_enable_loss_reports(tx) || !rtp_enable_loss_reports(rx)) {
+                printf("FAIL\n");
+                printf("  Cannot initialize RTP sessions\n");
+                ret = 1;
+                goto out;
+        }
+        rtp_set_option(rx, RTP_OPT_WEAK_VALIDATION, TRUE);
+        rtp_set_option(rx, RTP_OPT_PROMISC, TRUE);
+
+        {
+                rate_control rc(MAX_BITRATE, MIN_BITRATE);
+                auto start = steady_clock::now();
+                auto last = start;
+                uint32_t ts = 0;
+
+                for (auto now = start; now - start < seconds(RUN_SECONDS); now = steady_clock::now()) {
+                        credit += bitrate * duration_cast<duration<double>>(now - last).count() / 8;
+                        last = now;
+                        for ( ; credit >= PAYLOAD; credit -= PAYLOAD) {
+                                rtp_send_data(tx, ts, 96, 0, 0, NULL, payload, PAYLOAD, NULL, 0, 0);
+                        }
+                        ts += 90 * TICK_US / 1000;
+
+                        drain(rx);
+                        rtp_send_loss_report(rx);
+                        drain(tx);
+
+                        double loss;
+                        if (rtp_get_loss(tx, &loss)) {
+                                long long new_bitrate = rc.update(loss, now);
+                                if (new_bitrate != 0) {
+                                        bitrate = new_bitrate;
+                                }
+                        }
+                        if (now - start >= seconds(SETTLE_SECONDS)) {
+                                max_settled = std::max(max_settled, bitrate);
+                                min_settled = std::min(min_settled, bitrate);
+                        }
+                        usleep(TICK_US);
+                }
+        }
+
+        if (max_settled >= LINK_RATE) {
+                printf("FAIL\n");
+                printf("  Bitrate %lld above the link rate %lld\n", max_settled, LINK_RATE);
+                ret = 1;
+                goto out;
+        }
+        if (min_settled <= MIN_BITRATE) {
+                printf("FAIL\n");
+                printf("  Bitrate collapsed to the minimum\n");
+                ret = 1;
+                goto out;
+        }
+        printf("Ok\n");
+        printf("  Settled at %.1f - %.1f Mbps (link %.1f Mbps)\n", min_settled / 1e6,
+                        max_settled / 1e6, LINK_RATE / 1e6);
+
+out:
+        if (tx != NULL) {
+                rtp_done(tx);
+        }
+        if (rx != NULL) {
+                rtp_done(rx);
+        }
+        return ret;
+}
@@ -0,0 +1,146 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rtp/rtpenc_h264.h"
+
+#define ITERATIONS 50
+
+static double get_time(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/**
+ * Naive byte-wise scanner equivalent to the former parser
+ */
+static unsigned parse_bytewise(const uint8_t *buf, int size, unsigned *sizes, unsigned max_nals)
+{
+        unsigned count = 0;
+        int start = -1;
+
+        for (int i = 0; i + 2 < size; ++i) {
+                if (buf[i] == 0 && buf[i + 1] == 0 && buf[i + 2] == 1) {
+                        if (start >= 0) {
+                                int end = i;
+                                if (end > start && buf[end - 1] == 0) {
+                                        end--;
+                                }
+                                if (end > start && count < max_nals) {
+                                        sizes[count++] = end - start;
+                                }
+                        }
+                        start = i + 3;
+                        i += 2;
+                }
+        }
+        if (start >= 0 && start < size && count < max_nals) {
+                sizes[count++] = size - start;
+        }
+
+        return count;
+}
+
+/**
+ * Generates Annex-B stream with random (emulation-prevented) payload
+ */
+static uint8_t *generate(int size, int slice_size, int *out_len)
+{
+        uint8_t *buf = malloc(size + 1024);
+        int len = 0;
+        int nal = 0;
+
+        while (len < size) {
+                int nal_size = nal % 8 < 3 ? 4 + rand() % 30 : slice_size;
+                memcpy(buf + len, "\x00\x00\x00\x01", 4);
+                len += 4;
+                buf[len++] = nal % 8 < 3 ? 0x67 + nal % 8 : 0x65;
+                for (int i = 1; i < nal_size && len < size + 1000; ++i) {
+                        uint8_t b = rand() % 256;
+                        if (len >= 2 && buf[len - 1] == 0 && buf[len - 2] == 0 && b <= 3) {
+                                buf[len++] = 3;
+                        }
+                        buf[len++] = b;
+                }
+                if (buf[len - 1] == 0) { // NAL unit cannot end with zero
+                        buf[len++] = 0x80;
+                }
+                nal++;
+        }
+        *out_len = len;
+        return buf;
+}
+
+int main(int argc, char *argv[])
+{
+        uint8_t *buf;
+        int len;
+
+        if (argc == 2 && strcmp(argv[1], "-h") != 0) {
+                FILE *f = fopen(argv[1], "rb");
+                if (!f) {
+                        perror("fopen");
+                        return EXIT_FAILURE;
+                }
+                fseek(f, 0L, SEEK_END);
+                len = ftell(f);
+                fseek(f, 0L, SEEK_SET);
+                buf = malloc(len);
+                if (fread(buf, 1, len, f) != (size_t) len) {
+                        perror("fread");
+                        return EXIT_FAILURE;
+                }
+                fclose(f);
+        } else if (argc == 1) {
+                // roughly one 100 Mbps 25 fps intra frame with 4 slices
+                buf = generate(500000, 125000, &len);
+        } else {
+                fprintf(stderr, "Measures NAL unit boundary detection speed of the H.264 RTP packetizer\n\n");
+                fprintf(stderr, "Usage:\n");
+                fprintf(stderr, "\t%s [<annex_b_file.h264>]\n\n", argv[0]);
+                fprintf(stderr, "If no file is given, synthetic stream is used.\n");
+                return EXIT_FAILURE;
+        }
+
+        struct rtpenc_h264_state *state = rtpenc_h264_init_state();
+        unsigned max_nals = len / 3 + 1;
+        unsigned *sizes = malloc(max_nals * sizeof(unsigned));
+        unsigned count_ref = 0, count = 0;
+
+        double t0 = get_time();
+        for (int i = 0; i < ITERATIONS; ++i) {
+                count_ref = parse_bytewise(buf, len, sizes, max_nals);
+        }
+        double t1 = get_time();
+        for (int i = 0; i < ITERATIONS; ++i) {
+                count = rtpenc_h264_frame_parse(state, buf, len);
+        }
+        double t2 = get_time();
+
+        if (count != count_ref) {
+                fprintf(stderr, "NAL count mismatch: %u vs %u\n", count, count_ref);
+                return EXIT_FAILURE;
+        }
+        for (unsigned i = 0; i < count; ++i) {
+                if (state->nals[i].size != sizes[i]) {
+                        fprintf(stderr, "NAL %u size mismatch: %u vs %u\n", i, state->nals[i].size, sizes[i]);
+                        return EXIT_FAILURE;
+                }
+        }
+
+        double mb = (double) len * ITERATIONS / 1000000.0;
+        printf("%d bytes, %u NAL units\n", len, count);
+        printf("byte-wise scan:  %8.1f MB/s\n", mb / (t1 - t0));
+        printf("rtpenc_h264:     %8.1f MB/s\n", mb / (t2 - t1));
+
+        rtpenc_h264_destroy_state(state);
+        free(sizes);
+        free(buf);
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,131 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utils/jpeg_slices.h"
+
+#define ITERATIONS 20
+
+static double get_time(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/**
+ * Generates smooth gradients with some noise (roughly camera-like content)
+ */
+static unsigned char *generate(int width, int height, codec_t codec)
+{
+        int bpp = codec == UYVY ? 2 : 3;
+        unsigned char *buf = malloc((size_t) width * height * bpp);
+        unsigned char *p = buf;
+
+        for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width * bpp; ++x) {
+                        *p++ = (x / bpp * 255 / width + y * 255 / height + x % bpp * 60 + rand() % 16) & 0xFF;
+                }
+        }
+        if (codec == UYVY) { // keep in limited range
+                for (size_t i = 0; i < (size_t) width * height * 2; ++i) {
+                        buf[i] = 16 + buf[i] * 219 / 255;
+                }
+        }
+        return buf;
+}
+
+static bool run(int width, int height, codec_t codec, int slices)
+{
+        int bpp = codec == UYVY ? 2 : 3;
+        size_t out_len = (size_t) width * height * 3;
+        unsigned char *src = generate(width, height, codec);
+        unsigned char *ref = malloc(out_len);
+        unsigned char *out = malloc(out_len);
+        unsigned char *dec_ref = malloc((size_t) width * height * bpp);
+        unsigned char *dec = malloc((size_t) width * height * bpp);
+        bool ret = true;
+
+        struct jpeg_slices_encoder *enc1 = jpeg_slices_encoder_create(JPEG_SLICES_DEFAULT_QUALITY, -1, 1);
+        struct jpeg_slices_encoder *enc = jpeg_slices_encoder_create(JPEG_SLICES_DEFAULT_QUALITY, -1, slices);
+        struct jpeg_slices_decoder *dec1 = jpeg_slices_decoder_create(1);
+        struct jpeg_slices_decoder *decn = jpeg_slices_decoder_create(slices);
+
+        size_t ref_len = 0, len = 0;
+        double t0 = get_time();
+        for (int i = 0; i < ITERATIONS; ++i) {
+                ref_len = jpeg_slices_encode(enc1, src, width, height, width * bpp, codec, ref, out_len);
+        }
+        double t1 = get_time();
+        for (int i = 0; i < ITERATIONS; ++i) {
+                len = jpeg_slices_encode(enc, src, width, height, width * bpp, codec, out, out_len);
+        }
+        double t2 = get_time();
+        for (int i = 0; i < ITERATIONS; ++i) {
+                jpeg_slices_decode(dec1, ref, ref_len, dec_ref, width * bpp, codec);
+        }
+        double t3 = get_time();
+        for (int i = 0; i < ITERATIONS; ++i) {
+                jpeg_slices_decode(decn, out, len, dec, width * bpp, codec);
+        }
+        double t4 = get_time();
+
+        if (ref_len == 0 || len != ref_len || memcmp(ref, out, len) != 0) {
+                fprintf(stderr, "%dx%d %s: sliced bitstream differs from single-threaded one!\n",
+                                width, height, codec == UYVY ? "UYVY" : "RGB");
+                ret = false;
+        }
+        if (memcmp(dec_ref, dec, (size_t) width * height * bpp) != 0) {
+                fprintf(stderr, "%dx%d %s: sliced decoding differs from single-threaded one!\n",
+                                width, height, codec == UYVY ? "UYVY" : "RGB");
+                ret = false;
+        }
+
+        printf("%4dx%-4d %s %7zu B  encode: %6.1f fps (1 thread) %6.1f fps (%d slices)  "
+                        "decode: %6.1f fps (1 thread) %6.1f fps (%d slices)\n",
+                        width, height, codec == UYVY ? "UYVY" : "RGB ", len,
+                        ITERATIONS / (t1 - t0), ITERATIONS / (t2 - t1), slices,
+                        ITERATIONS / (t3 - t2), ITERATIONS / (t4 - t3), slices);
+
+        jpeg_slices_encoder_destroy(enc1);
+        jpeg_slices_encoder_destroy(enc);
+        jpeg_slices_decoder_destroy(dec1);
+        jpeg_slices_decoder_destroy(decn);
+        free(src);
+        free(ref);
+        free(out);
+        free(dec_ref);
+        free(dec);
+
+        return ret;
+}
+
+int main(int argc, char *argv[])
+{
+        int slices = 0;
+
+        if (argc > 2 || (argc == 2 && (slices = atoi(argv[1])) <= 0)) {
+                fprintf(stderr, "Measures CPU JPEG (libjpeg-turbo) encoding and decoding throughput\n"
+                                "and checks that sliced coding matches the single-threaded one.\n\n");
+                fprintf(stderr, "Usage:\n");
+                fprintf(stderr, "\t%s [<slices>]\n\n", argv[0]);
+                fprintf(stderr, "Default number of slices is number of CPU cores.\n");
+                return EXIT_FAILURE;
+        }
+        if (slices == 0) {
+                slices = sysconf(_SC_NPROCESSORS_ONLN);
+        }
+
+        bool ok = true;
+        ok = run(1920, 1080, UYVY, slices) && ok;
+        ok = run(1920, 1080, RGB, slices) && ok;
+        ok = run(3840, 2160, UYVY, slices) && ok;
+        ok = run(3840, 2160, RGB, slices) && ok;
+        ok = run(1366, 768, UYVY, slices) && ok;
+
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,98 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libavutil/cpu.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+
+#include "video_codec.h"
+#include "video_decompress/libavcodec_conv.h"
+
+#define ITERATIONS 20
+
+// video_codec.c uses UltraGrid logging
+void log_msg(int level, const char *format, ...);
+
+void log_msg(int level, const char *format, ...)
+{
+        (void) level;
+        va_list ap;
+        va_start(ap, format);
+        vfprintf(stderr, format, ap);
+        va_end(ap);
+}
+
+static double get_time(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static double measure(av_to_uv_convert_t *convert, char *dst, AVFrame *frame, int width, int height, int pitch)
+{
+        double t0 = get_time();
+        for (int i = 0; i < ITERATIONS; ++i) {
+                convert(dst, frame, width, height, pitch);
+        }
+        return (get_time() - t0) * 1000.0 / ITERATIONS;
+}
+
+int main(int argc, char *argv[])
+{
+        int width = 3840;
+        int height = 2160;
+
+        if (argc == 3) {
+                width = atoi(argv[1]);
+                height = atoi(argv[2]);
+        }
+        if (argc == 2 || argc > 3 || width <= 0 || height <= 0) {
+                fprintf(stderr, "Measures single-threaded scalar and SIMD conversions of frames\n"
+                                "decoded by libavcodec to UltraGrid pixel formats.\n\n");
+                fprintf(stderr, "Usage:\n");
+                fprintf(stderr, "\t%s [<width> <height>]\n\n", argv[0]);
+                fprintf(stderr, "Default size is 3840x2160.\n");
+                return EXIT_FAILURE;
+        }
+        if (!(av_get_cpu_flags() & AV_CPU_FLAG_SSE4)) {
+                printf("CPU doesn't support SSE4.1, SIMD conversions won't be used by the decoder.\n");
+        }
+
+        for (const struct av_to_uv_conversion *c = get_av_to_uv_conversions(); c->convert != NULL; ++c) {
+                AVFrame *frame = av_frame_alloc();
+                frame->format = c->av_codec;
+                frame->width = width;
+                frame->height = height;
+                if (av_frame_get_buffer(frame, 32) != 0) {
+                        fprintf(stderr, "Cannot allocate frame!\n");
+                        return EXIT_FAILURE;
+                }
+                // content doesn't matter, 0x0202 is valid sample also for 10-bit formats
+                const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(c->av_codec);
+                for (int p = 0; p < AV_NUM_DATA_POINTERS && frame->data[p]; ++p) {
+                        int plane_height = p == 1 || p == 2 ?
+                                (height + (1 << desc->log2_chroma_h) - 1) >> desc->log2_chroma_h : height;
+                        memset(frame->data[p], 0x02, frame->linesize[p] * plane_height);
+                }
+                int pitch = vc_get_linesize(width, c->uv_codec);
+                char *dst = malloc((size_t) pitch * height);
+
+                printf("%-12s -> %-4s  scalar: %7.2f ms", av_get_pix_fmt_name(c->av_codec),
+                                get_codec_name(c->uv_codec), measure(c->convert, dst, frame, width, height, pitch));
+                if (c->convert_simd) {
+                        printf("  SIMD: %7.2f ms", measure(c->convert_simd, dst, frame, width, height, pitch));
+                }
+                printf("\n");
+
+                free(dst);
+                av_frame_free(&frame);
+        }
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,100 @@
+#!/bin/sh
+#
+# Runs the whole UltraGrid send/receive pipeline (testcard -> compress -> FEC ->
+# encryption -> tx_send -> loopback UDP -> pbuf -> decode -> dummy display)
+# with --param pipeline-stats and prints the final frames/s, Gbit/s, per-stage
+# CPU usage and send-to-display latency percentiles.
+#
+# By default, sender and receiver run in a single process. With -2, two local
+# processes are used (the latency is then measured against wall-clock time).
+#
+# With -i, the sent packets pass through the in-process network impairment
+# (loss, reordering, jitter, rate limit), eg. to compare FEC configurations:
+#   loopback_bench.sh -f ldgm:25% -i ge=1/30:seed=7
+#
+# A rate-limited impairment also exercises the rate control of the encoder,
+# which should settle below the limit (its last decisions are printed), eg.:
+#   loopback_bench.sh -c libavcodec:encoder=libx264:bitrate=40M -i rate=20M \
+#           -x "--param rate-control=40M"
+#
+
+set -e
+
+UV=${UV:-$(dirname "$0")/../bin/uv}
+TESTCARD=testcard:1920:1080:30:UYVY
+COMPRESS=
+FEC=
+KEY=
+IMPAIR=
+DURATION=20
+TWO_PROC=
+EXTRA=
+
+usage() {
+        cat <<EOF
+Usage: $0 [-t <testcard_opts>] [-c <compress>] [-f <fec>] [-e <key>] [-i <impair>] [-d <sec>] [-2] [-x <uv_opts>]
+	-t  video capture (default: $TESTCARD)
+	-c  compression (default: none)
+	-f  FEC, eg. ldgm:20% or rs:200:220 (default: none)
+	-e  encryption key (default: none)
+	-i  network impairment of sent packets, see "--param udp-impair=help" (default: none)
+	-d  duration in seconds (default: $DURATION)
+	-2  run sender and receiver as separate processes
+	-x  additional options passed to both sender and receiver
+Environment:
+	UV  path to the uv binary (default: $UV)
+EOF
+}
+
+while getopts "t:c:f:e:i:d:2x:h" opt; do
+        case $opt in
+                t) TESTCARD=$OPTARG ;;
+                c) COMPRESS=$OPTARG ;;
+                f) FEC=$OPTARG ;;
+                e) KEY=$OPTARG ;;
+                i) IMPAIR=$OPTARG ;;
+                d) DURATION=$OPTARG ;;
+                2) TWO_PROC=1 ;;
+                x) EXTRA=$OPTARG ;;
+                h) usage; exit 0 ;;
+                *) usage; exit 1 ;;
+        esac
+done
+
+if [ ! -x "$UV" ]; then
+        echo "$UV not found, build UltraGrid first or set UV." >&2
+        exit 1
+fi
+
+COMMON="--param pipeline-stats $EXTRA"
+[ -n "$KEY" ] && COMMON="$COMMON --encryption $KEY"
+SENDER="-t $TESTCARD"
+[ -n "$COMPRESS" ] && SENDER="$SENDER -c $COMPRESS"
+[ -n "$FEC" ] && SENDER="$SENDER -f $FEC"
+[ -n "$IMPAIR" ] && SENDER="$SENDER --param udp-impair=$IMPAIR"
+
+LOG=$(mktemp)
+RX_LOG=$(mktemp)
+trap 'rm -f "$LOG" "$RX_LOG"' EXIT
+
+if [ -z "$TWO_PROC" ]; then
+        timeout -s INT "$DURATION" "$UV" $COMMON $SENDER -d dummy 127.0.0.1 > "$LOG" 2>&1 || true
+else
+        timeout -s INT "$((DURATION + 2))" "$UV" $COMMON -d dummy > "$RX_LOG" 2>&1 &
+        RX_PID=$!
+        sleep 1
+        timeout -s INT "$DURATION" "$UV" $COMMON $SENDER 127.0.0.1 > "$LOG" 2>&1 || true
+        wait $RX_PID || true
+fi
+
+echo "Pipeline: $TESTCARD, compress ${COMPRESS:-none}, FEC ${FEC:-none}, encryption $([ -n "$KEY" ] && echo on || echo off), impairment ${IMPAIR:-none}"
+if [ -z "$TWO_PROC" ]; then
+        grep '\[pipeline\] total' "$LOG" || { cat "$LOG"; exit 1; }
+        grep '\[rate control\]' "$LOG" | tail -3
+else
+        echo "Sender:"
+        grep '\[pipeline\] total' "$LOG" || { cat "$LOG"; exit 1; }
+        grep '\[rate control\]' "$LOG" | tail -3
+        echo "Receiver:"
+        grep '\[pipeline\] total' "$RX_LOG" || { cat "$RX_LOG"; exit 1; }
+fi
@@ -0,0 +1,90 @@
+/*
+ * Compares throughput and hand-off latency of synchronized_queue (mutex and
+ * condition variables) and mpmc_queue (lock-free with spin-then-block) under
+ * contention - P producers and C consumers pass timestamped items through
+ * a queue of length 1 (as between decoder threads) and 5 (proxy display).
+ *
+ * Usage: queue_bench [<items>] (default 200000 per configuration)
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "utils/mpmc_queue.h"
+#include "utils/synchronized_queue.h"
+
+using namespace std;
+
+static uint64_t now_ns()
+{
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// 0 is used as a quit message, so the timestamps are shifted by one
+template<typename queue_t>
+static void run(const char *name, int len, int producers, int consumers, int items)
+{
+        queue_t queue;
+        vector<vector<uint64_t>> latency(consumers);
+        vector<thread> threads;
+
+        uint64_t start = now_ns();
+        for (int i = 0; i < consumers; ++i) {
+                threads.emplace_back([&queue, &latency, i] {
+                        while (uint64_t sent = queue.pop()) {
+                                latency[i].push_back(now_ns() - (sent - 1));
+                        }
+                });
+        }
+        for (int i = 0; i < producers; ++i) {
+                threads.emplace_back([&queue, producers, items] {
+                        for (int j = 0; j < items / producers; ++j) {
+                                queue.push(now_ns() + 1);
+                        }
+                });
+        }
+        for (int i = 0; i < producers; ++i) {
+                threads[consumers + i].join();
+        }
+        for (int i = 0; i < consumers; ++i) {
+                queue.push(0);
+        }
+        for (int i = 0; i < consumers; ++i) {
+                threads[i].join();
+        }
+        double sec = (now_ns() - start) / 1e9;
+
+        vector<uint64_t> all;
+        for (auto const & l : latency) {
+                all.insert(all.end(), l.begin(), l.end());
+        }
+        sort(all.begin(), all.end());
+        printf("%-18s len %d %dP:%dC %10.0f items/s  latency p50 %8.2f us  p99 %9.2f us  max %9.2f us\n",
+                        name, len, producers, consumers, all.size() / sec,
+                        all[all.size() / 2] / 1000.0, all[all.size() * 99 / 100] / 1000.0,
+                        all.back() / 1000.0);
+}
+
+template<int len>
+static void run_len(int items)
+{
+        const int configs[][2] = { { 1, 1 }, { 2, 2 }, { 4, 4 } };
+        for (auto const & c : configs) {
+                run<synchronized_queue<uint64_t, len>>("synchronized_queue", len, c[0], c[1], items);
+                run<mpmc_queue<uint64_t, len>>("mpmc_queue", len, c[0], c[1], items);
+        }
+}
+
+int main(int argc, char *argv[])
+{
+        int items = argc > 1 ? atoi(argv[1]) : 200000;
+        printf("%u CPUs, %d items per configuration:\n", thread::hardware_concurrency(), items);
+        run_len<1>(items);
+        run_len<5>(items);
+}
+
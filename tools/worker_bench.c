@@ -0,0 +1,138 @@
+/*
+ * Measures task dispatch latency of the worker pool (utils/worker.cpp).
+ *
+ * Detached tasks are submitted at a fixed rate and each records the time
+ * between its submission and its start. Then, fork/join round-trip of a batch
+ * of empty tasks (as used for slices/tiles) is measured.
+ *
+ * Usage: worker_bench [<tasks_per_sec> ...] (default 10000 and 1000000)
+ *
+ * Build against another implementation to compare, eg.:
+ *   git show <rev>:src/utils/worker.cpp > /tmp/worker_old.cpp
+ *   make worker_bench WORKER=/tmp/worker_old.cpp
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utils/worker.h"
+
+#define DURATION_SEC 1
+#define FORK_JOIN_TASKS 8
+#define FORK_JOIN_ITERATIONS 10000
+
+struct sample {
+        uint64_t submitted;
+        uint64_t started;
+};
+
+static int finished;
+
+static uint64_t now_ns(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+        uint64_t x = *(const uint64_t *) a;
+        uint64_t y = *(const uint64_t *) b;
+        return x < y ? -1 : x > y;
+}
+
+static void print_percentiles(const char *label, uint64_t *ns, int count)
+{
+        qsort(ns, count, sizeof *ns, cmp_u64);
+        printf("%-28s p50 %8.2f us  p90 %8.2f us  p99 %8.2f us  max %9.2f us\n", label,
+                        ns[count / 2] / 1000.0, ns[count * 9 / 10] / 1000.0,
+                        ns[count * 99 / 100] / 1000.0, ns[count - 1] / 1000.0);
+}
+
+static void *record_start(void *arg)
+{
+        struct sample *s = (struct sample *) arg;
+        s->started = now_ns();
+        __atomic_add_fetch(&finished, 1, __ATOMIC_RELEASE);
+        return NULL;
+}
+
+static void run_rate(int rate)
+{
+        int count = rate * DURATION_SEC;
+        struct sample *samples = calloc(count, sizeof *samples);
+        uint64_t *latency = malloc(count * sizeof *latency);
+        uint64_t interval = 1000000000ull / rate;
+
+        __atomic_store_n(&finished, 0, __ATOMIC_RELEASE);
+        uint64_t start = now_ns();
+        for (int i = 0; i < count; ++i) {
+                uint64_t deadline = start + i * interval;
+                while (now_ns() < deadline) {
+                }
+                samples[i].submitted = now_ns();
+                task_run_async_detached(record_start, &samples[i]);
+        }
+        uint64_t submit_end = now_ns();
+        while (__atomic_load_n(&finished, __ATOMIC_ACQUIRE) < count) {
+                usleep(1000);
+        }
+
+        for (int i = 0; i < count; ++i) {
+                latency[i] = samples[i].started - samples[i].submitted;
+        }
+        char label[64];
+        snprintf(label, sizeof label, "%d tasks/s (%.0f achieved)", rate,
+                        count / ((submit_end - start) / 1e9));
+        print_percentiles(label, latency, count);
+        free(samples);
+        free(latency);
+}
+
+static void *empty_task(void *arg)
+{
+        return arg;
+}
+
+static void run_fork_join(void)
+{
+        uint64_t *round_trip = malloc(FORK_JOIN_ITERATIONS * sizeof *round_trip);
+        task_result_handle_t handles[FORK_JOIN_TASKS];
+
+        for (int i = 0; i < FORK_JOIN_ITERATIONS; ++i) {
+                uint64_t t0 = now_ns();
+                for (int j = 0; j < FORK_JOIN_TASKS; ++j) {
+                        handles[j] = task_run_async(empty_task, NULL);
+                }
+                for (int j = 0; j < FORK_JOIN_TASKS; ++j) {
+                        wait_task(handles[j]);
+                }
+                round_trip[i] = now_ns() - t0;
+        }
+        char label[64];
+        snprintf(label, sizeof label, "fork/join of %d tasks", FORK_JOIN_TASKS);
+        print_percentiles(label, round_trip, FORK_JOIN_ITERATIONS);
+        free(round_trip);
+}
+
+int main(int argc, char *argv[])
+{
+        printf("Dispatch latency (submission to task start), %ld CPUs:\n", sysconf(_SC_NPROCESSORS_ONLN));
+        if (argc > 1) { // custom rates
+                for (int i = 1; i < argc; ++i) {
+                        run_rate(atoi(argv[i]));
+                }
+                return 0;
+        }
+        run_rate(10000);
+        run_rate(1000000);
+        run_fork_join();
+
+        return 0;
+}
+
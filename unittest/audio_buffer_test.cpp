@@ -0,0 +1,90 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "audio_buffer_test.h"
+
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+#include "utils/audio_buffer.h"
+
+using namespace std;
+
+#define SAMPLE_RATE 48000
+#define BPS 2
+#define CHANNELS 2
+#define LATENCY_MS 50
+#define PKT_FRAMES 480         // 10 ms packets on both sides
+#define DURATION_S 180
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( audio_buffer_test );
+
+audio_buffer_test::audio_buffer_test()
+{
+}
+
+audio_buffer_test::~audio_buffer_test()
+{
+}
+
+void
+audio_buffer_test::setUp()
+{
+}
+
+
+void
+audio_buffer_test::tearDown()
+{
+}
+
+/**
+ * Simulates producer running (1 + skew) times faster than the consumer and
+ * checks that the resampling ratio converges to the skew and that the
+ * consumer gets full packets once the buffer settles.
+ */
+void
+audio_buffer_test::runSkew(double skew)
+{
+        const int frame_size = BPS * CHANNELS;
+        struct audio_buffer *buf = audio_buffer_init(SAMPLE_RATE, BPS, CHANNELS, LATENCY_MS);
+        vector<char> in(2 * PKT_FRAMES * frame_size);
+        vector<char> out(PKT_FRAMES * frame_size);
+        for (size_t i = 0; i < in.size() / 2; ++i) {
+                ((short *)(void *) in.data())[i] = (short) (10000 * sin(i * 0.05));
+        }
+
+        const int steps = DURATION_S * SAMPLE_RATE / PKT_FRAMES;
+        double pending = 0.0;
+        int short_reads = 0;
+        for (int i = 0; i < steps; ++i) {
+                pending += PKT_FRAMES * (1.0 + skew);
+                int frames = (int) pending;
+                pending -= frames;
+                audio_buffer_write(buf, in.data(), frames * frame_size);
+                int len = audio_buffer_read(buf, out.data(), out.size());
+                if (i > steps / 2 && len != (int) out.size()) {
+                        short_reads += 1;
+                }
+        }
+        double ratio = audio_buffer_get_ratio(buf);
+        audio_buffer_destroy(buf);
+
+        ostringstream oss;
+        oss << "skew " << skew << ", ratio " << ratio;
+        // ratio resolution is 100 ppm
+        CPPUNIT_ASSERT_DOUBLES_EQUAL_MESSAGE(oss.str(), 1.0 + skew, ratio, 0.0002);
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(oss.str(), 0, short_reads);
+}
+
+void
+audio_buffer_test::testFasterProducer()
+{
+        runSkew(0.002);
+}
+
+void
+audio_buffer_test::testSlowerProducer()
+{
+        runSkew(-0.0015);
+}
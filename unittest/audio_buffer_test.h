@@ -0,0 +1,25 @@
+#ifndef AUDIO_BUFFER_TEST_H
+#define AUDIO_BUFFER_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class audio_buffer_test : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( audio_buffer_test );
+  CPPUNIT_TEST( testFasterProducer );
+  CPPUNIT_TEST( testSlowerProducer );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  audio_buffer_test();
+  ~audio_buffer_test();
+  void setUp();
+  void tearDown();
+
+  void testFasterProducer();
+  void testSlowerProducer();
+private:
+  void runSkew(double skew);
+};
+
+#endif //  AUDIO_BUFFER_TEST_H
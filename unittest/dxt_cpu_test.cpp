@@ -0,0 +1,143 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "dxt_cpu_test.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+#include "utils/dxt_cpu.h"
+#include "video.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( dxt_cpu_test );
+
+dxt_cpu_test::dxt_cpu_test()
+{
+}
+
+dxt_cpu_test::~dxt_cpu_test()
+{
+}
+
+void
+dxt_cpu_test::setUp()
+{
+}
+
+
+void
+dxt_cpu_test::tearDown()
+{
+}
+
+struct round_trip_error {
+        double rmse;
+        int max;
+        int max_x, max_y;
+};
+
+/**
+ * Compresses and decompresses an RGBA image, returns the error of RGB
+ * channels.
+ */
+static round_trip_error round_trip(enum dxt_cpu_type type, const vector<unsigned char> &in,
+                int width, int height)
+{
+        vector<unsigned char> compressed(dxt_cpu_get_size(width, height, type));
+        vector<unsigned char> out(in.size());
+        dxt_cpu_encode(type, in.data(), width, height, width * 4, RGBA, compressed.data());
+        dxt_cpu_decode(type, compressed.data(), width, height, out.data(), width * 4, RGBA);
+
+        round_trip_error err{0.0, 0, 0, 0};
+        double sum = 0.0;
+        for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                        for (int c = 0; c < 3; ++c) {
+                                size_t i = ((size_t) y * width + x) * 4 + c;
+                                int d = abs(in[i] - out[i]);
+                                sum += d * d;
+                                if (d > err.max) {
+                                        err = { 0.0, d, x, y };
+                                }
+                        }
+                }
+        }
+        err.rmse = sqrt(sum / (3.0 * width * height));
+        return err;
+}
+
+static vector<unsigned char> gradient(int width, int height)
+{
+        vector<unsigned char> img((size_t) width * height * 4);
+        for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                        unsigned char *p = &img[((size_t) y * width + x) * 4];
+                        p[0] = x * 255 / (width - 1);
+                        p[1] = y * 255 / (height - 1);
+                        p[2] = 255 - (x + y) * 255 / (width + height - 2);
+                        p[3] = 255;
+                }
+        }
+        return img;
+}
+
+/**
+ * Each 4x4 block has a different flat color. Endpoints of such block round
+ * to the same 565 value, which must not be decoded in 3-color mode as black.
+ */
+void dxt_cpu_test::testFlatDXT1()
+{
+        const int width = 256;
+        const int blocks_per_line = width / 4;
+        vector<uint32_t> colors;
+        for (int r = 0; r < 256; r += 15) {
+                for (int g = 0; g < 256; g += 15) {
+                        for (int b = 0; b < 256; b += 15) {
+                                colors.push_back(r | g << 8 | b << 16);
+                        }
+                }
+        }
+        colors.push_back(5 | 0 << 8 | 250 << 16);
+        const int height = (colors.size() + blocks_per_line - 1) / blocks_per_line * 4;
+
+        vector<unsigned char> img((size_t) width * height * 4);
+        for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                        size_t block = (size_t) y / 4 * blocks_per_line + x / 4;
+                        uint32_t c = colors[block % colors.size()];
+                        unsigned char *p = &img[((size_t) y * width + x) * 4];
+                        p[0] = c & 0xff;
+                        p[1] = (c >> 8) & 0xff;
+                        p[2] = c >> 16;
+                        p[3] = 255;
+                }
+        }
+
+        round_trip_error err = round_trip(DXT_CPU_DXT1, img, width, height);
+        ostringstream oss;
+        oss << "max error " << err.max << " at " << err.max_x << "x" << err.max_y;
+        // 5 bits per channel lose at most 4 levels
+        CPPUNIT_ASSERT_MESSAGE(oss.str(), err.max <= 4);
+}
+
+void dxt_cpu_test::testGradientDXT1()
+{
+        const int width = 1920, height = 1080;
+        round_trip_error err = round_trip(DXT_CPU_DXT1, gradient(width, height), width, height);
+        ostringstream oss;
+        oss << "RMSE " << err.rmse << ", max error " << err.max << " at " << err.max_x << "x" << err.max_y;
+        CPPUNIT_ASSERT_MESSAGE(oss.str(), err.rmse < 3.0 && err.max <= 8);
+}
+
+void dxt_cpu_test::testGradientDXT5()
+{
+        const int width = 1920, height = 1080;
+        round_trip_error err = round_trip(DXT_CPU_DXT5_YCOCG, gradient(width, height), width, height);
+        ostringstream oss;
+        oss << "RMSE " << err.rmse << ", max error " << err.max << " at " << err.max_x << "x" << err.max_y;
+        CPPUNIT_ASSERT_MESSAGE(oss.str(), err.rmse < 3.0 && err.max <= 8);
+}
@@ -0,0 +1,25 @@
+#ifndef DXT_CPU_TEST_H
+#define DXT_CPU_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class dxt_cpu_test : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( dxt_cpu_test );
+  CPPUNIT_TEST( testFlatDXT1 );
+  CPPUNIT_TEST( testGradientDXT1 );
+  CPPUNIT_TEST( testGradientDXT5 );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  dxt_cpu_test();
+  ~dxt_cpu_test();
+  void setUp();
+  void tearDown();
+
+  void testFlatDXT1();
+  void testGradientDXT1();
+  void testGradientDXT5();
+};
+
+#endif //  DXT_CPU_TEST_H
@@ -0,0 +1,160 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// conversions are linked to the test only if not built as a module
+#if defined HAVE_LAVC && ! defined BUILD_LIBRARIES
+
+#include <cppunit/config/SourcePrefix.h>
+#include "libavcodec_test.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "libavcodec_common.h"
+#include "video.h"
+#include "video_decompress/libavcodec_conv.h"
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( libavcodec_test );
+
+static const struct {
+        int width;
+        int height;
+} sizes[] = {
+        { 1920, 1080 },
+        { 1366, 7 },   // odd sizes to exercise scalar tails
+        { 34, 2 },
+        { 18, 4 },
+};
+
+/**
+ * @returns frame of given format filled with pseudo-random data
+ */
+static AVFrame *get_test_frame(int av_codec, int width, int height)
+{
+        AVFrame *frame = av_frame_alloc();
+        frame->format = av_codec;
+        frame->width = width;
+        frame->height = height;
+        if (av_frame_get_buffer(frame, 32) != 0) {
+                av_frame_free(&frame);
+                return NULL;
+        }
+
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((enum AVPixelFormat) av_codec);
+        bool is_10bit = av_codec == AV_PIX_FMT_YUV420P10LE || av_codec == AV_PIX_FMT_YUV422P10LE ||
+                av_codec == AV_PIX_FMT_YUV444P10LE;
+        for (int p = 0; p < AV_NUM_DATA_POINTERS && frame->data[p]; ++p) {
+                int plane_height = p == 1 || p == 2 ?
+                        (height + (1 << desc->log2_chroma_h) - 1) >> desc->log2_chroma_h : height;
+                for (int k = 0; k < frame->linesize[p] * plane_height; ++k) {
+                        frame->data[p][k] = rand();
+                        if (is_10bit && k % 2 == 1) {
+                                frame->data[p][k] &= 0x3; // keep samples in 10-bit range
+                        }
+                }
+        }
+        return frame;
+}
+
+static string get_conversion_name(const struct av_to_uv_conversion *c, int width, int height)
+{
+        return string(av_get_pix_fmt_name((enum AVPixelFormat) c->av_codec)) + " -> " +
+                get_codec_name(c->uv_codec) + " " + to_string(width) + "x" + to_string(height);
+}
+
+libavcodec_test::libavcodec_test()
+{
+}
+
+libavcodec_test::~libavcodec_test()
+{
+}
+
+void
+libavcodec_test::setUp()
+{
+        srand(0);
+}
+
+
+void
+libavcodec_test::tearDown()
+{
+}
+
+/**
+ * SIMD conversions must be bit-exact with the scalar ones
+ */
+void
+libavcodec_test::testSimdConversions()
+{
+        for (const struct av_to_uv_conversion *c = get_av_to_uv_conversions(); c->convert != NULL; ++c) {
+                if (c->convert_simd == NULL) {
+                        continue;
+                }
+                for (const auto & size : sizes) {
+                        AVFrame *frame = get_test_frame(c->av_codec, size.width, size.height);
+                        CPPUNIT_ASSERT(frame != NULL);
+                        int pitch = vc_get_linesize(size.width, c->uv_codec);
+                        vector<char> ref(pitch * size.height);
+                        vector<char> out(pitch * size.height);
+
+                        c->convert(ref.data(), frame, size.width, size.height, pitch);
+                        c->convert_simd(out.data(), frame, size.width, size.height, pitch);
+                        av_frame_free(&frame);
+
+                        CPPUNIT_ASSERT_MESSAGE(get_conversion_name(c, size.width, size.height),
+                                        ref == out);
+                }
+        }
+}
+
+/**
+ * The decoder converts frames in stripes of even height in parallel - the
+ * result must be the same as if the whole frame was converted at once.
+ */
+void
+libavcodec_test::testStripedConversions()
+{
+        for (const struct av_to_uv_conversion *c = get_av_to_uv_conversions(); c->convert != NULL; ++c) {
+                const int width = 1366;
+                const int height = 14;
+                const int stripe_height = 6;
+                AVFrame *frame = get_test_frame(c->av_codec, width, height);
+                CPPUNIT_ASSERT(frame != NULL);
+                const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((enum AVPixelFormat) c->av_codec);
+                int pitch = vc_get_linesize(width, c->uv_codec);
+                vector<char> ref(pitch * height);
+                vector<char> out(pitch * height);
+
+                c->convert(ref.data(), frame, width, height, pitch);
+
+                AVFrame *part = av_frame_alloc();
+                for (int first_line = 0; first_line < height; first_line += stripe_height) {
+                        for (int p = 0; p < AV_NUM_DATA_POINTERS && frame->data[p]; ++p) {
+                                int plane_line = p == 1 || p == 2 ? first_line >> desc->log2_chroma_h : first_line;
+                                part->data[p] = frame->data[p] + frame->linesize[p] * plane_line;
+                                part->linesize[p] = frame->linesize[p];
+                        }
+                        part->format = frame->format;
+                        c->convert(out.data() + first_line * pitch, part, width,
+                                        min(stripe_height, height - first_line), pitch);
+                }
+                av_frame_free(&part);
+                av_frame_free(&frame);
+
+                CPPUNIT_ASSERT_MESSAGE(get_conversion_name(c, width, height), ref == out);
+        }
+}
+
+#endif // defined HAVE_LAVC && ! defined BUILD_LIBRARIES
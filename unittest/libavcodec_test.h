@@ -0,0 +1,23 @@
+#ifndef LIBAVCODEC_TEST_H
+#define LIBAVCODEC_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class libavcodec_test : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( libavcodec_test );
+  CPPUNIT_TEST( testSimdConversions );
+  CPPUNIT_TEST( testStripedConversions );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  libavcodec_test();
+  ~libavcodec_test();
+  void setUp();
+  void tearDown();
+
+  void testSimdConversions();
+  void testStripedConversions();
+};
+
+#endif //  LIBAVCODEC_TEST_H
@@ -0,0 +1,176 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "rate_control_test.h"
+
+#include <chrono>
+
+#include "rtp/rate_control.h"
+
+#define MAX_BITRATE 100000000LL
+#define MIN_BITRATE 1000000LL
+
+using namespace std;
+using namespace std::chrono;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( rate_control_test );
+
+rate_control_test::rate_control_test()
+{
+}
+
+rate_control_test::~rate_control_test()
+{
+}
+
+void
+rate_control_test::setUp()
+{
+}
+
+
+void
+rate_control_test::tearDown()
+{
+}
+
+/**
+ * Loss above the threshold lowers the bitrate below the delivered one, loss
+ * between the thresholds is tolerated unless it follows an increase.
+ */
+void
+rate_control_test::testDecrease()
+{
+        rate_control rc(MAX_BITRATE, MIN_BITRATE);
+        auto t = steady_clock::now();
+
+        CPPUNIT_ASSERT_EQUAL(0LL, rc.update(0.0, t));
+        CPPUNIT_ASSERT_EQUAL(0LL, rc.update(0.01, t));
+        // 100 Mbps * (1 - 0.1) * 0.9
+        CPPUNIT_ASSERT_EQUAL(81000000LL, rc.update(0.1, t));
+        t += seconds(1);
+        CPPUNIT_ASSERT_EQUAL(0LL, rc.update(0.015, t));
+        CPPUNIT_ASSERT_EQUAL(40500000LL, rc.update(0.444444444444, t));
+
+        // increase, loss slightly above LOSS_INCREASE is then attributed to it
+        t += seconds(3);
+        long long probed = 0;
+        while (probed == 0) {
+                probed = rc.update(0.0, t);
+                t += seconds(1);
+        }
+        CPPUNIT_ASSERT(probed > 40500000LL);
+        long long decreased = rc.update(0.01, t);
+        CPPUNIT_ASSERT(decreased > 0 && decreased < probed);
+
+        // never below the minimum
+        t += seconds(1);
+        CPPUNIT_ASSERT_EQUAL(MIN_BITRATE, rc.update(0.99, t));
+        t += seconds(1);
+        CPPUNIT_ASSERT_EQUAL(0LL, rc.update(0.99, t));
+}
+
+/**
+ * Reports shortly after a decrease are ignored, the bitrate is increased only
+ * after a longer hold and then at most once per interval.
+ */
+void
+rate_control_test::testHold()
+{
+        rate_control rc(MAX_BITRATE, MIN_BITRATE);
+        auto t0 = steady_clock::now();
+
+        CPPUNIT_ASSERT_EQUAL(45000000LL, rc.update(0.5, t0));
+        CPPUNIT_ASSERT_EQUAL(0LL, rc.update(0.5, t0 + milliseconds(400)));
+        CPPUNIT_ASSERT_EQUAL(20250000LL, rc.update(0.5, t0 + milliseconds(600)));
+
+        // increase hold (2 s) counts from the last decrease at 600 ms
+        auto t = t0 + milliseconds(600);
+        CPPUNIT_ASSERT_EQUAL(0LL, rc.update(0.0, t + milliseconds(1900)));
+        // 3 increases of 1 % needed to exceed MIN_CHANGE, one per second at most
+        int updates = 0;
+        long long bitrate = 0;
+        for (auto now = t + seconds(2); bitrate == 0; now += milliseconds(500)) {
+                bitrate = rc.update(0.0, now);
+                updates += 1;
+        }
+        CPPUNIT_ASSERT_EQUAL(5, updates);
+}
+
+/**
+ * Bitrate is probed by small steps up to 1.1 times the bitrate of the last
+ * decrease, by bigger ones above it, and never above the maximum.
+ */
+void
+rate_control_test::testProbeSteps()
+{
+        rate_control rc(MAX_BITRATE, MIN_BITRATE);
+        auto t = steady_clock::now();
+
+        rc.update(0.5, t);
+        t += seconds(1);
+        long long current = rc.update(0.5, t); // 20.25 Mbps, last decrease at 45 Mbps
+        t += seconds(2);
+
+        bool far_steps = false;
+        int updates_since_change = 0;
+        while (current < MAX_BITRATE) {
+                long long bitrate = rc.update(0.0, t);
+                t += seconds(1);
+                updates_since_change += 1;
+                CPPUNIT_ASSERT(updates_since_change <= 3);
+                if (bitrate == 0) {
+                        continue;
+                }
+                double ratio = (double) bitrate / current;
+                if (bitrate == MAX_BITRATE) {
+                        CPPUNIT_ASSERT(ratio <= 1.05 + 1e-6);
+                } else if (current < 45000000 * 1.1) {
+                        // three 1 % steps
+                        CPPUNIT_ASSERT_EQUAL(3, updates_since_change);
+                        CPPUNIT_ASSERT_DOUBLES_EQUAL(1.01 * 1.01 * 1.01, ratio, 1e-3);
+                } else {
+                        CPPUNIT_ASSERT_EQUAL(1, updates_since_change);
+                        CPPUNIT_ASSERT_DOUBLES_EQUAL(1.05, ratio, 1e-3);
+                        far_steps = true;
+                }
+                current = bitrate;
+                updates_since_change = 0;
+        }
+        CPPUNIT_ASSERT(far_steps);
+        CPPUNIT_ASSERT_EQUAL(MAX_BITRATE, current);
+        CPPUNIT_ASSERT_EQUAL(0LL, rc.update(0.0, t));
+}
+
+/**
+ * Changes smaller than MIN_CHANGE (3 %) are accumulated and not propagated to
+ * the encoder, except of reaching the maximum.
+ */
+void
+rate_control_test::testMinChange()
+{
+        rate_control rc(MAX_BITRATE, MIN_BITRATE);
+        auto t = steady_clock::now();
+
+        // 100 * 0.97 * 0.9 = 87.3 Mbps, then probed by 1 % steps
+        long long current = rc.update(0.03, t);
+        CPPUNIT_ASSERT_EQUAL(87300000LL, current);
+        t += seconds(2);
+        for (int i = 0; i < 2; ++i) {
+                CPPUNIT_ASSERT_EQUAL(0LL, rc.update(0.0, t));
+                t += seconds(1);
+        }
+        long long bitrate = rc.update(0.0, t);
+        CPPUNIT_ASSERT(bitrate >= current * 1.03);
+        t += seconds(1);
+
+        // last step to the maximum is propagated even if small
+        long long last = bitrate;
+        while ((bitrate = rc.update(0.0, t)) != MAX_BITRATE) {
+                if (bitrate != 0) {
+                        CPPUNIT_ASSERT(bitrate >= last * 1.03);
+                        last = bitrate;
+                }
+                t += seconds(1);
+        }
+        CPPUNIT_ASSERT(MAX_BITRATE < last * 1.03);
+}
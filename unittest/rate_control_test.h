@@ -0,0 +1,27 @@
+#ifndef RATE_CONTROL_TEST_H
+#define RATE_CONTROL_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class rate_control_test : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( rate_control_test );
+  CPPUNIT_TEST( testDecrease );
+  CPPUNIT_TEST( testHold );
+  CPPUNIT_TEST( testProbeSteps );
+  CPPUNIT_TEST( testMinChange );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  rate_control_test();
+  ~rate_control_test();
+  void setUp();
+  void tearDown();
+
+  void testDecrease();
+  void testHold();
+  void testProbeSteps();
+  void testMinChange();
+};
+
+#endif //  RATE_CONTROL_TEST_H
@@ -0,0 +1,166 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "ring_buffer_test.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "utils/ring_buffer.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( ring_buffer_test );
+
+ring_buffer_test::ring_buffer_test()
+{
+}
+
+ring_buffer_test::~ring_buffer_test()
+{
+}
+
+void
+ring_buffer_test::setUp()
+{
+}
+
+
+void
+ring_buffer_test::tearDown()
+{
+}
+
+/**
+ * Writes and reads chunks of size coprime with buffer length so that the
+ * indices wrap at all possible offsets.
+ */
+void
+ring_buffer_test::testWraparound()
+{
+        struct ring_buffer *ring = ring_buffer_init(100);
+        unsigned char counter_in = 0;
+        unsigned char counter_out = 0;
+
+        for (int i = 0; i < 300; ++i) {
+                unsigned char in[37];
+                for (auto & b : in) {
+                        b = counter_in++;
+                }
+                ring_buffer_write(ring, (char *) in, sizeof in);
+                CPPUNIT_ASSERT_EQUAL((int) sizeof in, ring_get_current_size(ring));
+
+                // read in two parts to exercise partial reads
+                unsigned char out[37];
+                CPPUNIT_ASSERT_EQUAL(20, ring_buffer_read(ring, (char *) out, 20));
+                CPPUNIT_ASSERT_EQUAL(17, ring_buffer_read(ring, (char *) out + 20, 100));
+                for (auto b : out) {
+                        CPPUNIT_ASSERT_EQUAL((int) counter_out++, (int) b);
+                }
+                CPPUNIT_ASSERT_EQUAL(0, ring_get_current_size(ring));
+        }
+
+        ring_buffer_destroy(ring);
+}
+
+/**
+ * Overflowing write keeps the most recent data, too long write is ignored.
+ */
+void
+ring_buffer_test::testOverflow()
+{
+        struct ring_buffer *ring = ring_buffer_init(10);
+        char out[11] = "";
+
+        ring_buffer_write(ring, "ABCDEF", 6);
+        ring_buffer_write(ring, "GHIJKL", 6);
+        CPPUNIT_ASSERT_EQUAL(10, ring_get_current_size(ring));
+        CPPUNIT_ASSERT_EQUAL(10, ring_buffer_read(ring, out, sizeof out));
+        CPPUNIT_ASSERT_EQUAL(string("CDEFGHIJKL"), string(out, 10));
+
+        ring_buffer_write(ring, "0123456789A", 11);
+        CPPUNIT_ASSERT_EQUAL(0, ring_get_current_size(ring));
+
+        // overflow while part of the data was already read
+        ring_buffer_write(ring, "abcdefgh", 8);
+        CPPUNIT_ASSERT_EQUAL(3, ring_buffer_read(ring, out, 3));
+        ring_buffer_write(ring, "ijklmnop", 8);
+        CPPUNIT_ASSERT_EQUAL(10, ring_buffer_read(ring, out, sizeof out));
+        CPPUNIT_ASSERT_EQUAL(string("ghijklmnop"), string(out, 10));
+
+        ring_buffer_destroy(ring);
+}
+
+void
+ring_buffer_test::testReserveCommit()
+{
+        struct ring_buffer *ring = ring_buffer_init(16);
+        void *ptr1, *ptr2;
+        int size1, size2;
+        char out[16];
+
+        ring_buffer_write(ring, "0123456789", 10);
+        CPPUNIT_ASSERT_EQUAL(10, ring_buffer_read(ring, out, sizeof out));
+
+        // write crossing the end of the buffer
+        CPPUNIT_ASSERT_EQUAL(12, ring_buffer_reserve_write(ring, 12, &ptr1, &size1, &ptr2, &size2));
+        CPPUNIT_ASSERT_EQUAL(6, size1);
+        CPPUNIT_ASSERT_EQUAL(6, size2);
+        CPPUNIT_ASSERT(ptr2 != NULL);
+        memcpy(ptr1, "abcdef", size1);
+        memcpy(ptr2, "ghijkl", size2);
+        CPPUNIT_ASSERT_EQUAL(0, ring_get_current_size(ring)); // not yet committed
+        ring_buffer_commit_write(ring, 12);
+        CPPUNIT_ASSERT_EQUAL(12, ring_get_current_size(ring));
+
+        // only free space may be reserved
+        CPPUNIT_ASSERT_EQUAL(4, ring_buffer_reserve_write(ring, 10, &ptr1, &size1, &ptr2, &size2));
+        CPPUNIT_ASSERT_EQUAL(4, size1);
+        CPPUNIT_ASSERT(ptr2 == NULL);
+
+        CPPUNIT_ASSERT_EQUAL(12, ring_buffer_reserve_read(ring, 16, &ptr1, &size1, &ptr2, &size2));
+        CPPUNIT_ASSERT_EQUAL(string("abcdef"), string((char *) ptr1, size1));
+        CPPUNIT_ASSERT_EQUAL(string("ghijkl"), string((char *) ptr2, size2));
+        ring_buffer_commit_read(ring, 8);
+        CPPUNIT_ASSERT_EQUAL(4, ring_get_current_size(ring));
+        CPPUNIT_ASSERT_EQUAL(4, ring_buffer_read(ring, out, sizeof out));
+        CPPUNIT_ASSERT_EQUAL(string("ijkl"), string(out, 4));
+
+        ring_buffer_destroy(ring);
+}
+
+/**
+ * Regions of mirrored buffer are contiguous even when crossing the end.
+ */
+void
+ring_buffer_test::testMirrored()
+{
+        struct ring_buffer *ring = ring_buffer_init_mirrored(1000);
+        int len = ring_get_size(ring);
+        CPPUNIT_ASSERT(len >= 1000);
+
+        vector<char> in(len);
+        for (int i = 0; i < len; ++i) {
+                in[i] = (char) (i * 7);
+        }
+        vector<char> out(len);
+        ring_buffer_write(ring, in.data(), len / 2 + 3);
+        CPPUNIT_ASSERT_EQUAL(len / 2 + 3, ring_buffer_read(ring, out.data(), len));
+
+        void *ptr1, *ptr2;
+        int size1, size2;
+        CPPUNIT_ASSERT_EQUAL(len, ring_buffer_reserve_write(ring, len, &ptr1, &size1, &ptr2, &size2));
+        CPPUNIT_ASSERT_EQUAL(len, size1);
+        CPPUNIT_ASSERT(ptr2 == NULL);
+        memcpy(ptr1, in.data(), len);
+        ring_buffer_commit_write(ring, len);
+
+        CPPUNIT_ASSERT_EQUAL(len, ring_buffer_reserve_read(ring, len, &ptr1, &size1, &ptr2, &size2));
+        CPPUNIT_ASSERT_EQUAL(len, size1);
+        CPPUNIT_ASSERT(ptr2 == NULL);
+        CPPUNIT_ASSERT(memcmp(ptr1, in.data(), len) == 0);
+        ring_buffer_commit_read(ring, len);
+        CPPUNIT_ASSERT_EQUAL(0, ring_get_current_size(ring));
+
+        ring_buffer_destroy(ring);
+}
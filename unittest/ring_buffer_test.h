@@ -0,0 +1,27 @@
+#ifndef RING_BUFFER_TEST_H
+#define RING_BUFFER_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class ring_buffer_test : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( ring_buffer_test );
+  CPPUNIT_TEST( testWraparound );
+  CPPUNIT_TEST( testOverflow );
+  CPPUNIT_TEST( testReserveCommit );
+  CPPUNIT_TEST( testMirrored );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  ring_buffer_test();
+  ~ring_buffer_test();
+  void setUp();
+  void tearDown();
+
+  void testWraparound();
+  void testOverflow();
+  void testReserveCommit();
+  void testMirrored();
+};
+
+#endif //  RING_BUFFER_TEST_H
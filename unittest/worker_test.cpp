@@ -0,0 +1,59 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "worker_test.h"
+
+#include <cstdint>
+
+#include "utils/worker.h"
+
+#define NESTING_DEPTH 400 ///< more than MAX_WORKERS
+#define CHAINS 4
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( worker_test );
+
+worker_test::worker_test()
+{
+}
+
+worker_test::~worker_test()
+{
+}
+
+void
+worker_test::setUp()
+{
+}
+
+
+void
+worker_test::tearDown()
+{
+}
+
+static void *nested_task(void *arg)
+{
+        intptr_t depth = (intptr_t) arg;
+        if (depth == 0) {
+                return (void *) 1;
+        }
+        task_result_handle_t h = task_run_async(nested_task, (void *) (depth - 1));
+        return (void *) ((intptr_t) wait_task(h) + 1);
+}
+
+/**
+ * Tasks waiting for their subtasks must not exhaust the pool - chains of
+ * nested waits deeper than the maximal number of workers must complete.
+ */
+void
+worker_test::testNestedWait()
+{
+        task_result_handle_t h[CHAINS];
+        for (int i = 0; i < CHAINS; ++i) {
+                h[i] = task_run_async(nested_task, (void *) NESTING_DEPTH);
+        }
+        for (int i = 0; i < CHAINS; ++i) {
+                CPPUNIT_ASSERT_EQUAL((intptr_t) NESTING_DEPTH + 1, (intptr_t) wait_task(h[i]));
+        }
+}
@@ -0,0 +1,21 @@
+#ifndef WORKER_TEST_H
+#define WORKER_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class worker_test : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( worker_test );
+  CPPUNIT_TEST( testNestedWait );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  worker_test();
+  ~worker_test();
+  void setUp();
+  void tearDown();
+
+  void testNestedWait();
+};
+
+#endif //  WORKER_TEST_H
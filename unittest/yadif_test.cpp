@@ -0,0 +1,219 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "yadif_test.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <vector>
+
+#include "utils/yadif.h"
+#include "video.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( yadif_test );
+
+yadif_test::yadif_test()
+{
+}
+
+yadif_test::~yadif_test()
+{
+}
+
+void
+yadif_test::setUp()
+{
+}
+
+
+void
+yadif_test::tearDown()
+{
+}
+
+/**
+ * Fills frame with pseudo-random samples - either full-range noise or a
+ * gradient with small noise, where the edge-directed predictions compete.
+ */
+static void fill_frame(vector<unsigned char> &frame, uint32_t &seed, bool smooth)
+{
+        for (size_t i = 0; i < frame.size(); ++i) {
+                seed = seed * 1103515245 + 12345;
+                unsigned char noise = seed >> 16;
+                frame[i] = smooth ? (unsigned char) (i / 7 + noise % 8) : noise;
+        }
+}
+
+/**
+ * Deinterlaces the same sequence with and without SIMD kernels and checks
+ * that the outputs are bit-exact. Widths are chosen so that both the vector
+ * loop and the scalar tail of every line are used.
+ */
+static void check_simd(codec_t codec)
+{
+        for (unsigned width : { 1366u, 1920u }) {
+                struct video_desc desc{width, 64, codec, 25, INTERLACED_MERGED, 1};
+                int linesize = vc_get_linesize(width, codec);
+                size_t frame_size = (size_t) linesize * desc.height;
+
+                struct yadif *state[2] = { yadif_create(desc), yadif_create(desc) };
+                CPPUNIT_ASSERT(state[0] != nullptr && state[1] != nullptr);
+                yadif_set_simd(state[1], false);
+
+                uint32_t seed = width;
+                vector<unsigned char> in(frame_size);
+                vector<unsigned char> out[2] = { vector<unsigned char>(frame_size), vector<unsigned char>(frame_size) };
+                for (int i = 0; i < 6; ++i) {
+                        fill_frame(in, seed, i >= 3);
+                        for (auto s : state) {
+                                yadif_push(s, in.data());
+                        }
+                        for (bool second_field : { false, true }) {
+                                for (int j = 0; j < 2; ++j) {
+                                        yadif_filter(state[j], out[j].data(), linesize, second_field);
+                                }
+                                ostringstream msg;
+                                msg << get_codec_name(codec) << " " << width << " frame " << i
+                                        << (second_field ? " second" : " first") << " field";
+                                CPPUNIT_ASSERT_MESSAGE(msg.str(), out[0] == out[1]);
+                        }
+                }
+
+                for (auto s : state) {
+                        yadif_destroy(s);
+                }
+        }
+}
+
+void
+yadif_test::testSimdUYVY()
+{
+        check_simd(UYVY);
+}
+
+void
+yadif_test::testSimdV210()
+{
+        check_simd(v210);
+}
+
+/**
+ * Fills frame with noise, v210 padding bits are left zero because they are
+ * not preserved.
+ */
+static void fill_noise(vector<unsigned char> &frame, uint32_t &seed, codec_t codec)
+{
+        fill_frame(frame, seed, false);
+        if (codec == v210) {
+                for (size_t i = 3; i < frame.size(); i += 4) {
+                        frame[i] &= 0x3f;
+                }
+        }
+}
+
+/**
+ * Fills frame with progressive content - a vertical gradient added to
+ * per-column noise.
+ */
+static void fill_progressive(vector<unsigned char> &frame, int linesize, uint32_t &seed, codec_t codec)
+{
+        int height = frame.size() / linesize;
+        if (codec == v210) {
+                for (int x = 0; x < linesize / 4; ++x) {
+                        uint32_t base[3];
+                        for (auto &b : base) {
+                                seed = seed * 1103515245 + 12345;
+                                b = 64 + (seed >> 16) % 640;
+                        }
+                        for (int y = 0; y < height; ++y) {
+                                uint32_t word = (base[0] + 4 * y) | (base[1] + 4 * y) << 10 | (base[2] + 4 * y) << 20;
+                                for (int i = 0; i < 4; ++i) {
+                                        frame[y * linesize + 4 * x + i] = word >> (8 * i);
+                                }
+                        }
+                }
+        } else {
+                for (int x = 0; x < linesize; ++x) {
+                        seed = seed * 1103515245 + 12345;
+                        int base = 16 + (seed >> 16) % 160;
+                        for (int y = 0; y < height; ++y) {
+                                frame[y * linesize + x] = base + y;
+                        }
+                }
+        }
+}
+
+/**
+ * Static progressive content has no temporal difference and the missing
+ * lines are predicted exactly, so the output must equal the input.
+ */
+void
+yadif_test::testStatic()
+{
+        for (codec_t codec : { UYVY, v210 }) {
+                struct video_desc desc{1920, 64, codec, 25, INTERLACED_MERGED, 1};
+                int linesize = vc_get_linesize(desc.width, codec);
+                size_t frame_size = (size_t) linesize * desc.height;
+
+                struct yadif *state = yadif_create(desc);
+                CPPUNIT_ASSERT(state != nullptr);
+
+                uint32_t seed = 1;
+                vector<unsigned char> in(frame_size);
+                vector<unsigned char> out(frame_size);
+                fill_progressive(in, linesize, seed, codec);
+                for (int i = 0; i < 3; ++i) {
+                        yadif_push(state, in.data());
+                }
+                for (bool second_field : { false, true }) {
+                        yadif_filter(state, out.data(), linesize, second_field);
+                        ostringstream msg;
+                        msg << get_codec_name(codec) << (second_field ? " second" : " first") << " field";
+                        CPPUNIT_ASSERT_MESSAGE(msg.str(), out == in);
+                }
+                yadif_destroy(state);
+        }
+}
+
+/**
+ * With changing content, lines of the kept field must be copied unchanged
+ * from the frame preceding the last pushed one.
+ */
+void
+yadif_test::testKeptField()
+{
+        for (codec_t codec : { UYVY, v210 }) {
+                struct video_desc desc{1920, 64, codec, 25, INTERLACED_MERGED, 1};
+                int linesize = vc_get_linesize(desc.width, codec);
+                size_t frame_size = (size_t) linesize * desc.height;
+
+                struct yadif *state = yadif_create(desc);
+                CPPUNIT_ASSERT(state != nullptr);
+
+                uint32_t seed = 2;
+                vector<unsigned char> frames[2] = { vector<unsigned char>(frame_size), vector<unsigned char>(frame_size) };
+                vector<unsigned char> out(frame_size);
+                for (int i = 0; i < 4; ++i) {
+                        vector<unsigned char> &cur = frames[i % 2];
+                        const vector<unsigned char> &prev = frames[(i + 1) % 2];
+                        fill_noise(cur, seed, codec);
+                        yadif_push(state, cur.data());
+                        if (i == 0) {
+                                continue;
+                        }
+                        for (bool second_field : { false, true }) {
+                                yadif_filter(state, out.data(), linesize, second_field);
+                                for (unsigned y = second_field ? 1 : 0; y < desc.height; y += 2) {
+                                        ostringstream msg;
+                                        msg << get_codec_name(codec) << " frame " << i << " line " << y;
+                                        CPPUNIT_ASSERT_MESSAGE(msg.str(), equal(out.begin() + y * linesize,
+                                                                out.begin() + (y + 1) * linesize,
+                                                                prev.begin() + y * linesize));
+                                }
+                        }
+                }
+                yadif_destroy(state);
+        }
+}
@@ -0,0 +1,27 @@
+#ifndef YADIF_TEST_H
+#define YADIF_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class yadif_test : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( yadif_test );
+  CPPUNIT_TEST( testSimdUYVY );
+  CPPUNIT_TEST( testSimdV210 );
+  CPPUNIT_TEST( testStatic );
+  CPPUNIT_TEST( testKeptField );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  yadif_test();
+  ~yadif_test();
+  void setUp();
+  void tearDown();
+
+  void testSimdUYVY();
+  void testSimdV210();
+  void testStatic();
+  void testKeptField();
+};
+
+#endif //  YADIF_TEST_H